@@ -22,7 +22,6 @@
 #define MAX_JPEG_W 160
 #define MAX_JPEG_H 120
 #define RGB24_IMAGE_SIZE (MAX_JPEG_W * MAX_JPEG_H * 3)
-#define JR32_MAX_FILE (JR32_HEADER_SIZE + MAX_JPEG_W * MAX_JPEG_H * 4)
 
 #define C_BLACK 0
 #define C_BLUE 1
@@ -51,7 +50,9 @@ static int image_h = 0;
 static int image_pixel_stride = 0;
 static char status_line[48];
 static char current_name[MAX_NAME];
-static unsigned char image_file_buf[JR32_MAX_FILE];
+// 图片文件经 tlx_mmap 只读映射，不再整份读进私有缓冲；只有解码结果占自己的内存
+static unsigned char image_rgb_buf[RGB24_IMAGE_SIZE];
+static void* image_map = 0;
 static unsigned char* image_pixels = 0;
 
 void main();
@@ -133,6 +134,30 @@ static unsigned short read_u16_le(const unsigned char* p) {
     return (unsigned short)((unsigned short)p[0] | ((unsigned short)p[1] << 8));
 }
 
+static void unmap_image_file(void) {
+    if (image_map) tlx_munmap(image_map);
+    image_map = 0;
+}
+
+// 映射整个文件，返回映射起点；映射持有文件，句柄随即关闭
+static const unsigned char* map_image_file(const char* path, int* out_size) {
+    TlxFileInfo info;
+    void* address = 0;
+    int handle;
+
+    unmap_image_file();
+    handle = tlx_open(path, TLX_OPEN_READ);
+    if (handle < 0) return 0;
+    if (tlx_fstat(handle, &info) < 0 || info.size == 0 || tlx_mmap(handle, 0, 0, &address) < 0) {
+        tlx_close(handle);
+        return 0;
+    }
+    tlx_close(handle);
+    image_map = address;
+    *out_size = (int)info.size;
+    return (const unsigned char*)address;
+}
+
 static int decode_jr32(const unsigned char* data, int size) {
     int expected;
 
@@ -156,8 +181,9 @@ static int decode_jr32(const unsigned char* data, int size) {
 static void load_selected_image(void) {
     JpegInfo info;
     char path[48];
-    int read;
-    int jpg_size;
+    const unsigned char* data;
+    int size = 0;
+    int jpg_size = 0;
 
     image_loaded = 0;
     image_pixels = 0;
@@ -170,12 +196,12 @@ static void load_selected_image(void) {
 
     s_copy(path, "image/", sizeof(path));
     s_append(path, image_files[selected_index], sizeof(path));
-    jpg_size = read_file(path, image_file_buf, sizeof(image_file_buf));
-    if (jpg_size <= 0) {
+    data = map_image_file(path, &jpg_size);
+    if (!data) {
         set_status("JPG read failed.");
         return;
     }
-    if (!jpeg_probe(image_file_buf, jpg_size, &info)) {
+    if (!jpeg_probe(data, jpg_size, &info)) {
         set_status("Bad JPG header.");
         return;
     }
@@ -188,11 +214,11 @@ static void load_selected_image(void) {
     {
         int rgb_bytes = info.width * info.height * 3;
         if (rgb_bytes > 0 && rgb_bytes <= RGB24_IMAGE_SIZE &&
-            jpg_size + rgb_bytes <= JR32_MAX_FILE &&
-            jpeg_decode_rgb(image_file_buf, jpg_size, image_file_buf + jpg_size, JR32_MAX_FILE - jpg_size, &info)) {
+            jpeg_decode_rgb(data, jpg_size, image_rgb_buf, RGB24_IMAGE_SIZE, &info)) {
+            unmap_image_file();
             image_w = info.width;
             image_h = info.height;
-            image_pixels = image_file_buf + jpg_size;
+            image_pixels = image_rgb_buf;
             image_loaded = 1;
             image_pixel_stride = 3;
             s_copy(current_name, image_files[selected_index], sizeof(current_name));
@@ -210,14 +236,15 @@ static void load_selected_image(void) {
         return;
     }
 
+    // 预解码的 JR32 像素直接在映射里显示，映射保留到换下一张图
     build_jr32_path(image_files[selected_index], path, sizeof(path));
-    read = read_file(path, image_file_buf, sizeof(image_file_buf));
-    if (read <= 0 || read > JR32_MAX_FILE) {
+    data = map_image_file(path, &size);
+    if (!data) {
         set_status("Read failed.");
         return;
     }
 
-    if (!decode_jr32(image_file_buf, read)) {
+    if (!decode_jr32(data, size)) {
         set_status("JPEG decode failed.");
         return;
     }
@@ -227,8 +254,9 @@ static void load_selected_image(void) {
 }
 
 static void refresh_image_list(void) {
-    char list_buf[512];
-    int i = 0;
+    TlxDirEntry entries[8];
+    int dir;
+    int got;
 
     image_file_count = 0;
     selected_index = -1;
@@ -236,28 +264,21 @@ static void refresh_image_list(void) {
     image_loaded = 0;
     image_pixels = 0;
 
-    if (!list_files_at(list_buf, sizeof(list_buf), "image")) {
+    dir = tlx_opendir("image");
+    if (dir < 0) {
         set_status("image/ missing.");
         return;
     }
 
-    while (list_buf[i] && image_file_count < MAX_IMAGE_FILES) {
-        char name[MAX_NAME];
-        int p = 0;
-
-        while (list_buf[i] && list_buf[i] != '\n') {
-            if (p < MAX_NAME - 1) name[p++] = list_buf[i];
-            i++;
+    while (image_file_count < MAX_IMAGE_FILES && (got = tlx_readdir(dir, entries, 8)) > 0) {
+        for (int i = 0; i < got && image_file_count < MAX_IMAGE_FILES; i++) {
+            if (entries[i].kind != TLX_HANDLE_KIND_FILE) continue;
+            if (!s_ends_with(entries[i].name, ".jpg")) continue;
+            s_copy(image_files[image_file_count], entries[i].name, MAX_NAME);
+            image_file_count++;
         }
-        if (list_buf[i] == '\n') i++;
-        name[p] = '\0';
-
-        if (name[0] == '\0') continue;
-        if (!s_ends_with(name, ".jpg")) continue;
-
-        s_copy(image_files[image_file_count], name, MAX_NAME);
-        image_file_count++;
     }
+    tlx_close(dir);
 
     if (image_file_count == 0) {
         set_status("No JPG files.");
@@ -626,6 +626,7 @@ static void print_sysinfo(void) {
     char ver[64];
     unsigned int ticks;
     UserVideoStats video_stats;
+    UserFsStats fs_stats;
 
     write_line("=== Tsuki OS System Info ===");
 
@@ -646,11 +647,79 @@ static void print_sysinfo(void) {
         write_text("Idle hlt: "); write_uint(video_stats.idle_halts); push_char('\n');
     }
 
+    if (get_fs_stats(&fs_stats)) {
+        write_text("Bcache hit:"); write_uint(fs_stats.cache_hits);
+        write_text(" miss:"); write_uint(fs_stats.cache_misses); push_char('\n');
+        write_text("Bcache wb: "); write_uint(fs_stats.cache_writebacks);
+        write_text(" dirty:"); write_uint(fs_stats.cache_dirty_blocks); push_char('\n');
+        write_text("Icache hit:"); write_uint(fs_stats.inode_cache_hits);
+        write_text(" miss:"); write_uint(fs_stats.inode_cache_misses);
+        write_text(" pin:"); write_uint(fs_stats.inodes_pinned); push_char('\n');
+        write_text("Dcache hit:"); write_uint(fs_stats.dentry_hits);
+        write_text(" miss:"); write_uint(fs_stats.dentry_misses);
+        write_text(" idx:"); write_uint(fs_stats.indexed_dirs); push_char('\n');
+        write_text("Readahead: "); write_uint(fs_stats.readahead_blocks);
+        write_text(" hit:"); write_uint(fs_stats.readahead_hits); push_char('\n');
+        write_text("Journal commit:"); write_uint(fs_stats.journal_commits);
+        write_text(" blk:"); write_uint(fs_stats.journal_blocks); push_char('\n');
+    }
+
     write_line("");
     write_line("Processes:");
     print_ps();
 }
 
+// 同一段扇区分别用 PIO 和 DMA 读，对比吞吐 (测速期间文件系统操作会等待)
+static void print_diskbench(void) {
+    UserDiskBench bench;
+
+    write_line("Reading disk, please wait...");
+    if (!disk_bench(&bench)) {
+        write_line("diskbench: read failed");
+        return;
+    }
+    write_text("Read ");
+    write_uint(bench.kib);
+    write_line(" KiB each way");
+    // AHCI 与 virtio-blk 只有 DMA，报吞吐和队列深度
+    if (bench.backend != 0) {
+        const char* name = bench.backend == 1 ? "AHCI: " : "virtio-blk: ";
+        if (bench.dma_kib_per_s == 0) {
+            write_text(name);
+            write_line("read failed");
+            return;
+        }
+        write_text(name);
+        write_uint(bench.dma_kib_per_s);
+        write_text(" KiB/s, queue depth ");
+        write_uint(bench.queue_depth);
+        push_char('\n');
+        return;
+    }
+    if (bench.pio_kib_per_s == 0) {
+        write_line("diskbench: read failed");
+        return;
+    }
+    write_text("PIO: ");
+    write_uint(bench.pio_kib_per_s);
+    write_line(" KiB/s");
+    if (!bench.dma_available) {
+        write_line("DMA: no bus master IDE");
+        return;
+    }
+    if (bench.dma_kib_per_s == 0) {
+        write_line("DMA: read failed");
+        return;
+    }
+    write_text("DMA: ");
+    write_uint(bench.dma_kib_per_s);
+    write_text(" KiB/s (x");
+    write_uint(bench.dma_kib_per_s / bench.pio_kib_per_s);
+    push_char('.');
+    write_uint(bench.dma_kib_per_s * 10 / bench.pio_kib_per_s % 10);
+    write_line(")");
+}
+
 static void render(void) {
     int accent = is_focused ? 9 : 8;
 
@@ -731,41 +800,29 @@ static void launch_and_report(const char* filename) {
 }
 
 static void print_ls(int allow_hidden) {
-    char list_buf[512];
-    list_buf[0] = '\0';
-    if (!list_files_at(list_buf, sizeof(list_buf), current_dir[0] ? current_dir : 0)) {
+    TlxDirEntry entries[8];
+    int dir;
+    int got;
+    int shown = 0;
+
+    dir = tlx_opendir(current_dir[0] ? current_dir : "/");
+    if (dir < 0) {
         write_line("ls failed.");
         return;
     }
-    if (list_buf[0] == '\0') {
-        write_line("(no files)");
-        return;
-    }
 
-    int shown = 0;
-    int i = 0;
-    while (list_buf[i]) {
-        char name[96];
-        int p = 0;
+    while ((got = tlx_readdir(dir, entries, 8)) > 0) {
+        for (int i = 0; i < got; i++) {
+            char shown_name[112];
 
-        while (list_buf[i] && list_buf[i] != '\n') {
-            if (p < (int)sizeof(name) - 1) {
-                name[p++] = list_buf[i];
-            }
-            i++;
+            format_visible_name(entries[i].name, allow_hidden, shown_name, sizeof(shown_name));
+            if (shown_name[0] == '\0') continue;
+            if (entries[i].kind == TLX_HANDLE_KIND_DIR) s_append(shown_name, "/", sizeof(shown_name));
+            write_line(shown_name);
+            shown++;
         }
-        if (list_buf[i] == '\n') i++;
-        name[p] = '\0';
-
-        if (name[0] == '\0') continue;
-
-        char shown_name[112];
-        format_visible_name(name, allow_hidden, shown_name, sizeof(shown_name));
-        if (shown_name[0] == '\0') continue;
-
-        write_line(shown_name);
-        shown++;
     }
+    tlx_close(dir);
 
     if (!shown) {
         write_line("(no files)");
@@ -778,6 +835,7 @@ static void run_command_core(char* c, int allow_hidden) {
         write_line("help  version  pwd  cls/clear  ls");
         write_line("cd <dir>  cat <file>  run [--new] <name>");
         write_line("echo <text>  uptime  sysinfo  ps");
+        write_line("diskbench");
         write_line("mkdir <dir>  touch <file>  rm <file>");
         write_line("net  ip <a.b.c.d>  gw <a.b.c.d>");
         write_line("dnsip <a.b.c.d>  ping <a.b.c.d>");
@@ -832,6 +890,11 @@ static void run_command_core(char* c, int allow_hidden) {
         return;
     }
 
+    if (s_cmp(c, "diskbench") == 0) {
+        print_diskbench();
+        return;
+    }
+
     if (s_ncmp(c, "mkdir ", 6) == 0) {
         char* name = ltrim(c + 6);
         char real_name[INPUT_MAX];
@@ -4,6 +4,8 @@
 [EXTERN timer_tick_and_schedule]
 [EXTERN keyboard_handler_isr]
 [EXTERN mouse_handler_isr]
+[EXTERN disk_irq_handler]
+[EXTERN disk_pci_irq_handler]
 [EXTERN paging_handle_fault]
 
 global _start
@@ -159,6 +161,7 @@ irq8_handler_stub:
 irq9_handler_stub:
     pusha
     cld
+    call disk_pci_irq_handler
     mov al, 0x20
     out 0xA0, al
     out 0x20, al
@@ -169,6 +172,7 @@ irq9_handler_stub:
 irq10_handler_stub:
     pusha
     cld
+    call disk_pci_irq_handler
     mov al, 0x20
     out 0xA0, al
     out 0x20, al
@@ -179,6 +183,7 @@ irq10_handler_stub:
 irq11_handler_stub:
     pusha
     cld
+    call disk_pci_irq_handler
     mov al, 0x20
     out 0xA0, al
     out 0x20, al
@@ -210,6 +215,7 @@ irq13_handler_stub:
 irq14_handler_stub:
     pusha
     cld
+    call disk_irq_handler
     mov al, 0x20
     out 0xA0, al
     out 0x20, al
@@ -227,23 +233,33 @@ irq15_handler_stub:
     iret
 
 ; --- 错误异常处理 ---
+; 文件映射的缺页处理完会返回，这里保存现场并在返回后重新执行出错的指令
 page_fault_stub:
-    cli
+    pusha
+    push ds
+    push es
+    push fs
+    push gs
     cld
-    mov esi, cr2
-    mov edi, [esp]
-    mov ebp, [esp + 4]
     mov ax, 0x10
     mov ds, ax
     mov es, ax
     mov fs, ax
     mov gs, ax
-    push ebp
-    push edi
-    push esi
+    mov eax, cr2
+    ; 现场 (pusha 32 字节 + 段寄存器 16 字节) 之上依次是错误码、eip
+    push dword [esp + 52]       ; eip
+    push dword [esp + 52]       ; 错误码 (上一条压栈后偏移同为 52)
+    push eax
     call paging_handle_fault
     add esp, 12
-    jmp $
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 4                  ; 弹出错误码
+    iret
 
 isr_err_stub:
     cli
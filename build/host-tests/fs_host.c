@@ -0,0 +1,2747 @@
+// fs.c
+#include "fs.h"
+#include "disk.h"
+#include "iosched.h"
+#include "bcache.h"
+#include "dcache.h"
+#include "journal.h"
+#include "pagecache.h"
+#include "sync.h"
+#include "utils.h"
+#include "heap.h"
+#include "klog.h"
+
+static Ext2SuperBlock ext2_sb;
+static int fs_ready = 0;
+static int fs_io_error = 0;     // 元数据读失败后置位，直到重新挂载都不再分配、释放或写入
+static unsigned int fs_read_errors = 0;   // 元数据读失败次数，读文件时据此发现映射没读出来
+static KMutex fs_mutex;
+static int fs_lock_depth = 0;   // 只由持锁者读写
+static unsigned int fs_last_sync_tick = 0;
+static unsigned int fs_lock_flags = 0;
+
+// 块大小由超级块 s_log_block_size 决定 (1 KiB 或 4 KiB)，挂载时设定；静态缓冲按最大块分配
+#define FS_MAX_BLOCK_SIZE     4096u
+#define FS_MAX_ADDR_PER_BLOCK (FS_MAX_BLOCK_SIZE / 4)
+static unsigned int fs_block_size = 1024;
+static unsigned int fs_sectors_per_block = 2;   // i_blocks 以 512 字节扇区计
+static int fs_inline_data = 0;                   // 超级块带内联数据特性时新写的小文件存进 inode
+static unsigned char fs_inode_block_buf[FS_MAX_BLOCK_SIZE];
+static unsigned char fs_dir_block_buf[FS_MAX_BLOCK_SIZE];
+static unsigned char fs_io_block_buf[FS_MAX_BLOCK_SIZE];
+
+// 间接块映射：i_block[12] 一级、[13] 二级、[14] 三级间接；每块地址数随块大小变化
+#define FS_IND_BASE       12u
+static unsigned int fs_addr_per_block = 256;
+static unsigned int fs_dind_base = FS_IND_BASE + 256;
+static unsigned int fs_tind_base = FS_IND_BASE + 256 + 256 * 256;
+
+// 最近使用的间接块常驻内存，顺序读写时不必每个数据块都重新取映射
+#define FS_INDIRECT_CACHE_ENTRIES 6
+
+typedef struct {
+    unsigned int block_num;   // 0 表示空槽
+    unsigned int last_used;
+    unsigned int entries[FS_MAX_ADDR_PER_BLOCK];
+} FsIndirectCacheEntry;
+
+static FsIndirectCacheEntry fs_indirect_cache[FS_INDIRECT_CACHE_ENTRIES];
+static unsigned int fs_indirect_clock = 0;
+
+// 预留窗口：写文件时在内存里为该 inode 圈出一段连续空闲块 (不改位图)，
+// 其它分配绕开窗口；写完且文件未被打开时，或最后一个句柄关闭时归还剩余部分
+#define FS_PREALLOC_WINDOWS    8
+#define FS_PREALLOC_MIN_BLOCKS 8
+#define FS_PREALLOC_MAX_BLOCKS 256
+
+typedef struct {
+    unsigned int inode_num;   // 0 表示空槽
+    unsigned int next;        // 下一个交出的块
+    unsigned int end;         // 窗口末尾 (不含)
+    unsigned int last_used;
+} FsPrealloc;
+
+static FsPrealloc fs_prealloc[FS_PREALLOC_WINDOWS];
+static unsigned int fs_prealloc_clock = 0;
+
+// 日志打开时，释放的块在这次释放提交进日志之前不再分配：ordered 模式提交前先写数据，
+// 若立刻分给别的文件，提交前崩溃后旧元数据仍指向它，内容却已被新文件覆盖 (同 ext3)。
+// 按连续段记录，记满时并进最近的一段 (多圈住的块同样只是暂不分配)
+#define FS_FREED_EXTENTS  32
+#define FS_FREED_UNSYNCED 0xFFFFFFFFu
+
+typedef struct {
+    unsigned int start;
+    unsigned int count;
+    unsigned int commits;   // 写入块缓存时的日志提交次数，之后再有提交即已落进日志；
+                            // 还只在内存位图里时为 FS_FREED_UNSYNCED
+} FsFreedExtent;
+
+static FsFreedExtent fs_freed[FS_FREED_EXTENTS];
+static unsigned int fs_freed_count = 0;
+
+// 一次分配请求的上下文：inode_num 为 0 时不建预留窗口 (目录等元数据)；
+// want 为本次还要分配的数据块数，last 为上一个分到的块，用作下一块的目标位置
+typedef struct {
+    unsigned int inode_num;
+    unsigned int want;
+    unsigned int allocated;
+    unsigned int last;
+} FsAllocRequest;
+
+// 块组：位图第 i 位对应块组内第 i 块 (块号 g * s_blocks_per_group + i)，
+// 块组 0 与原先的单块组镜像完全一致。组描述符表常驻内存，位图按块组缓存最近用到的几块，
+// 按 32 位字访问；元数据改动先记脏，最外层解锁时统一落到块缓存
+#define FS_MAX_GROUPS           128
+#define FS_SUPER_OFFSET         1024u
+#define FS_GROUP_DESC_PER_BLOCK (fs_block_size / sizeof(Ext2GroupDesc))
+#define FS_BITMAP_WORDS         (FS_MAX_BLOCK_SIZE / 4)
+#define FS_BITMAP_SLOTS         4
+#define FS_GROUP_NONE           0xFFFFFFFFu
+
+typedef struct {
+    unsigned int group;       // FS_GROUP_NONE 表示空槽
+    unsigned int last_used;
+    int dirty;
+    unsigned int words[FS_BITMAP_WORDS];
+} FsBitmapSlot;
+
+static Ext2GroupDesc fs_groups[FS_MAX_GROUPS];
+static unsigned int fs_group_count = 0;
+static unsigned int fs_gdt_block = 2;
+static unsigned int fs_inode_table_blocks = 0;
+static unsigned int fs_gdt_dirty = 0;       // bit k 对应描述符表第 k 块
+static FsBitmapSlot fs_block_bitmaps[FS_BITMAP_SLOTS];
+static FsBitmapSlot fs_inode_bitmaps[FS_BITMAP_SLOTS];
+static unsigned int fs_bitmap_clock = 0;
+static int fs_sb_dirty = 0;
+
+// inode 缓存：按 inode 号查找，写入只记脏；refcount>0 的条目被打开的句柄或运行中的映像 pin 住
+#define FS_ICACHE_ENTRIES 32
+
+typedef struct {
+    unsigned int inode_num;   // 0 表示空槽
+    unsigned int refcount;
+    unsigned int last_used;
+    unsigned char dirty;
+    Ext2Inode inode;
+} FsInodeCacheEntry;
+
+static FsInodeCacheEntry fs_icache[FS_ICACHE_ENTRIES];
+static unsigned int fs_icache_clock = 0;
+static unsigned int fs_icache_hits = 0;
+static unsigned int fs_icache_misses = 0;
+
+#define HIDDEN_SUFFIX "._hid_"
+
+static int find_file_in_dir(const char* filename, unsigned int dir_inode_num);
+static void flush_metadata(void);
+static void prealloc_release(unsigned int inode_num);
+static int journal_mount(void);
+
+static unsigned int irq_save_disable(void) {
+    unsigned int flags;
+    flags = 0;
+    return flags;
+}
+
+static void irq_restore(unsigned int flags) {
+    (void)flags;
+}
+
+static void irq_enable(void) {
+    
+}
+
+// 文件系统锁是可睡眠互斥锁，可递归进入。系统调用里与主循环 (周期写回) 持锁期间开中断：
+// 磁盘传输时时钟、调度、鼠标和其它进程照常运行，别的进程要进文件系统就在锁上睡眠
+static void fs_lock_enter(void) {
+    unsigned int flags = irq_save_disable();
+
+    kmutex_lock(&fs_mutex);
+    if (fs_lock_depth++ == 0) fs_lock_flags = flags;
+    if (sync_irq_allowed(flags)) irq_enable();
+}
+
+static void fs_lock_leave(void) {
+    unsigned int flags;
+
+    if (fs_lock_depth <= 0) return;
+    if (fs_lock_depth == 1) {
+        flush_metadata();
+        // 成组提交：待提交的元数据占到块缓存一半时提交，其余留给周期写回或 fs_sync()
+        if (bcache_meta_blocks() >= bcache_capacity() / 2) journal_commit();
+    }
+    flags = irq_save_disable();
+    if (--fs_lock_depth == 0) flags = fs_lock_flags;
+    kmutex_unlock(&fs_mutex);
+    irq_restore(flags);
+}
+
+static int str_ends_with(const char* s, const char* suffix) {
+    int ls = strlen(s);
+    int lf = strlen(suffix);
+    if (ls < lf) return 0;
+    return strcmp(s + (ls - lf), suffix) == 0;
+}
+
+static void copy_trim_hidden_suffix(char* dst, const char* src, int max_len) {
+    if (!dst || !src || max_len <= 0) return;
+
+    int i = 0;
+    while (i < max_len - 1 && src[i]) {
+        dst[i] = src[i];
+        i++;
+    }
+    dst[i] = '\0';
+
+    if (str_ends_with(dst, HIDDEN_SUFFIX)) {
+        int trimmed = strlen(dst) - strlen(HIDDEN_SUFFIX);
+        if (trimmed >= 0) dst[trimmed] = '\0';
+    }
+}
+
+static const char* path_leaf(const char* path) {
+    const char* leaf = path;
+    if (!path) return "";
+    for (int i = 0; path[i]; i++) {
+        if (path[i] == '/') leaf = path + i + 1;
+    }
+    return leaf;
+}
+
+static int split_lookup_path(const char* path, char* dir, int dir_max, char* name, int name_max) {
+    const char* slash;
+    const char* rest;
+    int dir_len;
+    int name_len;
+
+    if (!path || !dir || !name || dir_max <= 0 || name_max <= 0) return 0;
+    while (*path == '/') path++;
+    if (*path == '\0') return 0;
+
+    dir[0] = '\0';
+    name[0] = '\0';
+
+    slash = 0;
+    for (int i = 0; path[i]; i++) {
+        if (path[i] == '/') {
+            slash = path + i;
+            break;
+        }
+    }
+
+    if (!slash) {
+        name_len = strlen(path);
+        if (name_len >= name_max) name_len = name_max - 1;
+        memcpy(name, path, name_len);
+        name[name_len] = '\0';
+        return 1;
+    }
+
+    dir_len = (int)(slash - path);
+    if (dir_len <= 0 || slash[1] == '\0') return 0;
+    rest = slash + 1;
+    for (int i = 0; rest[i]; i++) {
+        if (rest[i] == '/') return 0;
+    }
+    if (dir_len >= dir_max) dir_len = dir_max - 1;
+    memcpy(dir, path, dir_len);
+    dir[dir_len] = '\0';
+
+    name_len = strlen(rest);
+    if (name_len >= name_max) name_len = name_max - 1;
+    memcpy(name, rest, name_len);
+    name[name_len] = '\0';
+    return 1;
+}
+
+static unsigned int resolve_dir_inode(const char* dir_path) {
+    char dir_name[FS_FILENAME_LEN];
+
+    if (!dir_path || dir_path[0] == '\0') return EXT2_ROOT_INODE;
+    while (*dir_path == '/') dir_path++;
+    if (*dir_path == '\0') return EXT2_ROOT_INODE;
+    if (strcmp(dir_path, ".") == 0) return EXT2_ROOT_INODE;
+
+    {
+        int i = 0;
+        while (dir_path[i] && dir_path[i] != '/' && i < FS_FILENAME_LEN - 1) {
+            dir_name[i] = dir_path[i];
+            i++;
+        }
+        dir_name[i] = '\0';
+        if (dir_path[i] != '\0') return 0;
+    }
+
+    return find_file_in_dir(dir_name, EXT2_ROOT_INODE);
+}
+
+static void* resolve_app_load_address(const char* filename) {
+    char base_name[FS_FILENAME_LEN];
+    const char* leaf;
+    if (!filename) return 0;
+    copy_trim_hidden_suffix(base_name, filename, sizeof(base_name));
+    leaf = path_leaf(base_name);
+
+    if (strcmp(leaf, "app.tsk") == 0) return (void*)MP_APP_LOAD_APP;
+    if (strcmp(leaf, "terminal.tsk") == 0) return (void*)MP_APP_LOAD_TERMINAL;
+    if (strcmp(leaf, "wm.tsk") == 0) return (void*)MP_APP_LOAD_WM;
+    if (strcmp(leaf, "start.tsk") == 0) return (void*)MP_APP_LOAD_START;
+    if (strcmp(leaf, "image.tsk") == 0) return (void*)MP_APP_LOAD_IMAGE;
+    if (strcmp(leaf, "settings.tsk") == 0) return (void*)MP_APP_LOAD_SETTINGS;
+
+    // 目前 flat binary 不是位置无关代码，未知 .tsk 无法安全并行加载
+    return 0;
+}
+
+static int tsk_header_has_magic(const TskHeader* header) {
+    if (!header) return 0;
+    return strncmp(header->magic, TSK_MAGIC, 4) == 0;
+}
+
+static unsigned int tsk_checksum32(const unsigned char* data, unsigned int size) {
+    unsigned int hash = 2166136261u;
+
+    if (!data && size != 0) return 0;
+
+    for (unsigned int i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static int tsk_load_addr_valid(unsigned int load_addr, unsigned int image_size) {
+    unsigned int slot_end;
+
+    if (image_size == 0 || image_size > MP_APP_SLOT_SIZE) return 0;
+    if (load_addr < MP_APP_SLOT_BASE || load_addr >= MP_APP_SLOT_LIMIT) return 0;
+    if ((load_addr - MP_APP_SLOT_BASE) % MP_APP_SLOT_SIZE != 0) return 0;
+
+    slot_end = load_addr + MP_APP_SLOT_SIZE;
+    if (slot_end < load_addr || slot_end > MP_APP_SLOT_LIMIT) return 0;
+
+    return 1;
+}
+
+// 元数据块读不出来时，内存里那份内容不可信，按它改写磁盘只会扩大损坏：
+// 之后的修改一律拒绝 (类似 ext2 的 errors=remount-ro)，读操作照常
+static void fs_read_failed(unsigned int block_num) {
+    (void)block_num;
+    fs_read_errors++;
+    if (!fs_io_error) klog_write("fs read error, now read-only");
+    fs_io_error = 1;
+}
+
+// 读入超级块与组描述符，magic 不对或读失败时返回 0。超级块总在字节 1024 处：
+// 1 KiB 块时是块 1，4 KiB 块时在块 0 内偏移 1024；块大小与块缓存不一致时按超级块重建块缓存
+static int load_super_and_group(void) {
+    // 按磁盘块读取到临时缓冲，避免直接读入结构体导致越界覆盖全局状态；挂载期间 io 缓冲空闲
+    unsigned char* raw = fs_io_block_buf;
+    unsigned int cache_block_size = bcache_block_size();
+    unsigned int log_block_size;
+
+    if (bcache_read(FS_SUPER_OFFSET / cache_block_size, raw) != 0) return 0;
+    memset(&ext2_sb, 0, sizeof(ext2_sb));
+    {
+        unsigned int copy_len = sizeof(ext2_sb);
+        if (copy_len > 1024) copy_len = 1024;
+        memcpy(&ext2_sb, raw + FS_SUPER_OFFSET % cache_block_size, copy_len);
+    }
+
+    // 恢复 Magic Check，因为 mkfs 修复了，现在应该能通过了
+    if (ext2_sb.s_magic != EXT2_MAGIC) {
+        // 如果这里失败，说明 offset 还是不对，或者数据没写进去
+        return 0;
+    }
+
+    // 只支持 1 KiB 与 4 KiB 块；4 KiB 时块 0 含超级块，s_first_data_block 为 0
+    log_block_size = ext2_sb.s_log_block_size;
+    if (log_block_size != 0 && log_block_size != 2) return 0;
+    if (ext2_sb.s_first_data_block != (log_block_size == 0 ? 1u : 0u)) return 0;
+    fs_block_size = 1024u << log_block_size;
+    fs_sectors_per_block = fs_block_size / 512;
+    fs_addr_per_block = fs_block_size / 4;
+    fs_dind_base = FS_IND_BASE + fs_addr_per_block;
+    fs_tind_base = fs_dind_base + fs_addr_per_block * fs_addr_per_block;
+    fs_gdt_block = ext2_sb.s_first_data_block + 1;
+    fs_inline_data = (ext2_sb.s_feature_incompat & EXT2_FEATURE_INCOMPAT_INLINE_DATA) != 0;
+    if (cache_block_size != fs_block_size) bcache_init(FS_BASE_SECTOR, fs_block_size);
+
+    // 读取组描述符表 (紧跟超级块所在块)，块组 0 之外的位图与 inode 表位置都从这里取
+    if (ext2_sb.s_blocks_per_group == 0 || ext2_sb.s_blocks_per_group > fs_block_size * 8 ||
+        ext2_sb.s_inodes_per_group == 0 || ext2_sb.s_inodes_per_group > fs_block_size * 8) {
+        return 0;
+    }
+    fs_group_count = (ext2_sb.s_blocks_count + ext2_sb.s_blocks_per_group - 1) / ext2_sb.s_blocks_per_group;
+    if (fs_group_count == 0 || fs_group_count > FS_MAX_GROUPS ||
+        ext2_sb.s_inodes_count > fs_group_count * ext2_sb.s_inodes_per_group) {
+        return 0;
+    }
+    fs_inode_table_blocks = (ext2_sb.s_inodes_per_group * 128u + fs_block_size - 1) / fs_block_size;
+    memset(fs_groups, 0, sizeof(fs_groups));
+    for (unsigned int k = 0; k * FS_GROUP_DESC_PER_BLOCK < fs_group_count; k++) {
+        unsigned int count = fs_group_count - k * FS_GROUP_DESC_PER_BLOCK;
+        if (count > FS_GROUP_DESC_PER_BLOCK) count = FS_GROUP_DESC_PER_BLOCK;
+        if (bcache_read(fs_gdt_block + k, raw) != 0) return 0;
+        memcpy(&fs_groups[k * FS_GROUP_DESC_PER_BLOCK], raw, count * sizeof(Ext2GroupDesc));
+    }
+    return 1;
+}
+
+// 初始化文件系统
+void fs_init() {
+    int replayed;
+
+    // 重新挂载时丢弃旧缓存，磁盘内容以当前镜像为准
+    journal_disable();
+    bcache_init(FS_BASE_SECTOR, fs_block_size);
+    memset(fs_icache, 0, sizeof(fs_icache));
+    memset(fs_indirect_cache, 0, sizeof(fs_indirect_cache));
+    memset(fs_prealloc, 0, sizeof(fs_prealloc));
+    fs_freed_count = 0;
+    dcache_reset();
+    pagecache_reset();
+    fs_io_error = 0;
+    fs_icache_hits = 0;
+    fs_icache_misses = 0;
+
+    if (!load_super_and_group()) {
+        fs_ready = 0;
+        return;
+    }
+
+    // 日志里有已提交未 checkpoint 的事务时先重放，再按重放后的磁盘内容重新读取；
+    // 重放没做完时只读挂载，事务留到下次挂载
+    replayed = journal_mount();
+    if (replayed == JOURNAL_REPLAY_FAILED) fs_read_failed(0);
+    if (replayed > 0 || replayed == JOURNAL_REPLAY_FAILED) {
+        bcache_init(FS_BASE_SECTOR, fs_block_size);
+        memset(fs_indirect_cache, 0, sizeof(fs_indirect_cache));
+        if (!load_super_and_group()) {
+            fs_ready = 0;
+            return;
+        }
+    }
+
+    // 位图在首次分配/释放时按块组读入，之后只改内存副本
+    for (int i = 0; i < FS_BITMAP_SLOTS; i++) {
+        fs_block_bitmaps[i].group = FS_GROUP_NONE;
+        fs_block_bitmaps[i].dirty = 0;
+        fs_inode_bitmaps[i].group = FS_GROUP_NONE;
+        fs_inode_bitmaps[i].dirty = 0;
+    }
+    fs_sb_dirty = 0;
+    fs_gdt_dirty = 0;
+    if (replayed >= 0) journal_enable();
+    fs_ready = 1;
+}
+
+int fs_is_ready(void) {
+    return fs_ready;
+}
+
+// 将块缓存中的脏块全部写回磁盘
+void fs_sync(void) {
+    fs_lock_enter();
+    if (fs_ready) {
+        flush_metadata();
+        bcache_sync();
+    }
+    fs_lock_leave();
+}
+
+// 由内核主循环调用：顺带推进在途的预读请求；有脏块且距上次写回超过间隔时批量刷盘
+void fs_periodic_sync(unsigned int now_ticks) {
+    // 主循环不等锁：有进程正在读写时留到下一轮
+    if (fs_ready && kmutex_trylock(&fs_mutex)) {
+        bcache_poll_io();
+        kmutex_unlock(&fs_mutex);
+    }
+    if (!fs_ready || !bcache_has_dirty()) {
+        fs_last_sync_tick = now_ticks;
+        return;
+    }
+    if (now_ticks - fs_last_sync_tick < FS_WRITEBACK_INTERVAL_TICKS) return;
+    if (!kmutex_trylock(&fs_mutex)) return;
+    fs_last_sync_tick = now_ticks;
+    fs_sync();
+    kmutex_unlock(&fs_mutex);
+}
+
+int fs_is_busy(void) {
+    return kmutex_is_locked(&fs_mutex);
+}
+
+// 持锁并等在途的请求全部结束，测速期间磁盘上只有测速命令
+void fs_disk_benchmark(DiskBenchResult* out) {
+    fs_lock_enter();
+    while (iosched_pending()) iosched_wait_any();
+    disk_benchmark(out);
+    fs_lock_leave();
+}
+
+void fs_get_stats(FsStats* out) {
+    BcacheStats cache;
+    DcacheStats dentries;
+    JournalStats journal;
+    IoschedStats io;
+
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    bcache_get_stats(&cache);
+    out->cache_hits = cache.hits;
+    out->cache_misses = cache.misses;
+    out->cache_writebacks = cache.writebacks;
+    out->cache_evictions = cache.evictions;
+    out->cache_dirty_blocks = cache.dirty_blocks;
+    out->readahead_blocks = cache.readahead_blocks;
+    out->readahead_hits = cache.readahead_hits;
+    out->async_requests = cache.async_requests;
+    out->max_in_flight = cache.max_in_flight;
+    iosched_get_stats(&io);
+    out->io_commands = io.read.commands + io.write.commands;
+    out->io_merges = io.read.merges + io.write.merges;
+    out->io_sectors = io.read.sectors + io.write.sectors;
+    journal_get_stats(&journal);
+    out->journal_commits = journal.commits;
+    out->journal_blocks = journal.blocks;
+    out->inode_cache_hits = fs_icache_hits;
+    out->inode_cache_misses = fs_icache_misses;
+    for (int i = 0; i < FS_ICACHE_ENTRIES; i++) {
+        if (fs_icache[i].refcount > 0) out->inodes_pinned++;
+    }
+    dcache_get_stats(&dentries);
+    out->dentry_hits = dentries.hits;
+    out->dentry_misses = dentries.misses;
+    out->indexed_dirs = dentries.indexed_dirs;
+}
+
+// 直接在 inode 表所在块上读写，不经过 inode 缓存
+static void inode_location(unsigned int inode_num, unsigned int* block, unsigned int* offset_in_block) {
+    unsigned int group = (inode_num - 1) / ext2_sb.s_inodes_per_group;
+    unsigned int offset = ((inode_num - 1) % ext2_sb.s_inodes_per_group) * 128;
+    *block = fs_groups[group].bg_inode_table + (offset / fs_block_size);
+    *offset_in_block = offset % fs_block_size;
+}
+
+static int load_inode_raw(unsigned int inode_num, Ext2Inode* inode) {
+    unsigned int block;
+    unsigned int offset_in_block;
+
+    inode_location(inode_num, &block, &offset_in_block);
+    if (bcache_read(block, fs_inode_block_buf) != 0) {
+        fs_read_failed(block);
+        memset(inode, 0, sizeof(Ext2Inode));
+        return 0;
+    }
+    memcpy(inode, fs_inode_block_buf + offset_in_block, sizeof(Ext2Inode));
+    return 1;
+}
+
+static void store_inode_raw(unsigned int inode_num, const Ext2Inode* inode) {
+    unsigned int block;
+    unsigned int offset_in_block;
+
+    if (fs_io_error) return;
+    inode_location(inode_num, &block, &offset_in_block);
+    if (bcache_read(block, fs_inode_block_buf) != 0) {
+        fs_read_failed(block);
+        return;
+    }
+    memcpy(fs_inode_block_buf + offset_in_block, inode, sizeof(Ext2Inode));
+    bcache_write_meta(block, fs_inode_block_buf);
+}
+
+static FsInodeCacheEntry* icache_lookup(unsigned int inode_num) {
+    for (int i = 0; i < FS_ICACHE_ENTRIES; i++) {
+        if (fs_icache[i].inode_num == inode_num) return &fs_icache[i];
+    }
+    return 0;
+}
+
+static int icache_is_pinned(unsigned int inode_num) {
+    FsInodeCacheEntry* e = icache_lookup(inode_num);
+    return e && e->refcount > 0;
+}
+
+// 取空槽或最久未用且未被 pin 的槽，脏 inode 先写回块缓存；全部被 pin 时返回 0
+static FsInodeCacheEntry* icache_claim(unsigned int inode_num) {
+    FsInodeCacheEntry* victim = 0;
+
+    for (int i = 0; i < FS_ICACHE_ENTRIES; i++) {
+        FsInodeCacheEntry* e = &fs_icache[i];
+        if (e->inode_num == 0) {
+            victim = e;
+            break;
+        }
+        if (e->refcount > 0) continue;
+        if (!victim || e->last_used < victim->last_used) victim = e;
+    }
+    if (!victim) return 0;
+
+    if (victim->inode_num != 0 && victim->dirty) {
+        store_inode_raw(victim->inode_num, &victim->inode);
+    }
+    victim->inode_num = inode_num;
+    victim->refcount = 0;
+    victim->dirty = 0;
+    return victim;
+}
+
+static FsInodeCacheEntry* icache_get(unsigned int inode_num) {
+    FsInodeCacheEntry* e = icache_lookup(inode_num);
+
+    if (e) {
+        fs_icache_hits++;
+    } else {
+        fs_icache_misses++;
+        e = icache_claim(inode_num);
+        if (!e) return 0;
+        if (!load_inode_raw(inode_num, &e->inode)) {
+            e->inode_num = 0;
+            return 0;
+        }
+    }
+    e->last_used = ++fs_icache_clock;
+    return e;
+}
+
+static void icache_flush(void) {
+    for (int i = 0; i < FS_ICACHE_ENTRIES; i++) {
+        FsInodeCacheEntry* e = &fs_icache[i];
+        if (e->inode_num == 0 || !e->dirty) continue;
+        store_inode_raw(e->inode_num, &e->inode);
+        e->dirty = 0;
+    }
+}
+
+// 内部：读取 inode，优先命中 inode 缓存
+static int read_inode(unsigned int inode_num, Ext2Inode* inode) {
+    FsInodeCacheEntry* e;
+
+    if (inode_num < 1 || !fs_ready || !inode) return 0;
+    e = icache_get(inode_num);
+    if (e) memcpy(inode, &e->inode, sizeof(Ext2Inode));
+    else if (!load_inode_raw(inode_num, inode)) return 0;
+    return 1;
+}
+
+// 只更新缓存并记脏，最外层解锁时统一写回 inode 表
+static int write_inode(unsigned int inode_num, const Ext2Inode* inode) {
+    FsInodeCacheEntry* e;
+
+    if (inode_num < 1 || !fs_ready || fs_io_error || !inode) return 0;
+    e = icache_lookup(inode_num);
+    if (!e) e = icache_claim(inode_num);
+    if (!e) {
+        store_inode_raw(inode_num, inode);
+        return 1;
+    }
+    memcpy(&e->inode, inode, sizeof(Ext2Inode));
+    e->dirty = 1;
+    e->last_used = ++fs_icache_clock;
+    return 1;
+}
+
+int fs_inode_pin(unsigned int inode_num) {
+    FsInodeCacheEntry* e;
+    int pinned_slots = 0;
+    int ok = 0;
+
+    fs_lock_enter();
+    if (fs_ready && inode_num >= 1 && inode_num <= ext2_sb.s_inodes_count) {
+        for (int i = 0; i < FS_ICACHE_ENTRIES; i++) {
+            if (fs_icache[i].refcount > 0) pinned_slots++;
+        }
+        // 至少留一半槽位给普通查找，超出时 pin 失败，调用方照常按需读取
+        if (icache_is_pinned(inode_num) || pinned_slots < FS_ICACHE_ENTRIES / 2) {
+            e = icache_get(inode_num);
+            if (e) {
+                e->refcount++;
+                ok = 1;
+            }
+        }
+    }
+    fs_lock_leave();
+    return ok;
+}
+
+void fs_inode_unpin(unsigned int inode_num) {
+    FsInodeCacheEntry* e;
+
+    if (inode_num == 0) return;
+    fs_lock_enter();
+    e = icache_lookup(inode_num);
+    if (e && e->refcount > 0) {
+        e->refcount--;
+        if (e->refcount == 0) prealloc_release(inode_num);
+    }
+    fs_lock_leave();
+}
+
+// 读取数据块 (辅助)，经块缓存命中时不访问磁盘；失败返回 0，buffer 被清零
+static int read_block(unsigned int block_num, void* buffer) {
+    if (!buffer) return 0; // 防止传入NULL
+    return bcache_read(block_num, buffer) == 0;
+}
+
+// 读取元数据块 (目录块、间接块)，失败时文件系统转为只读
+static int read_meta_block(unsigned int block_num, void* buffer) {
+    if (read_block(block_num, buffer)) return 1;
+    fs_read_failed(block_num);
+    return 0;
+}
+
+// 写入只落到块缓存，由 fs_sync() / 周期写回 / LRU 淘汰刷到磁盘
+static void write_block(unsigned int block_num, const void* buffer) {
+    if (!buffer || fs_io_error) return;
+    bcache_write(block_num, buffer);
+}
+
+// 元数据 (超级块、组描述符、位图、inode 表、间接块、目录块) 经日志提交后才写回原位置
+static void write_meta_block(unsigned int block_num, const void* buffer) {
+    if (!buffer || fs_io_error) return;
+    bcache_write_meta(block_num, buffer);
+}
+
+
+// ===== Allocation helpers (called within fs_lock) =====
+
+// 4 KiB 块时超级块与块 0 的其余部分 (引导区) 共用一块，先读出再覆盖超级块那 1 KiB
+static int write_superblock(void) {
+    unsigned char* buf = (unsigned char*)malloc(fs_block_size);
+    unsigned int block = FS_SUPER_OFFSET / fs_block_size;
+    unsigned int offset = FS_SUPER_OFFSET % fs_block_size;
+
+    if (!buf) return 0;
+    if (offset != 0 && bcache_read(block, buf) != 0) {
+        fs_read_failed(block);
+        free(buf);
+        return 0;
+    }
+    if (offset == 0) memset(buf, 0, fs_block_size);
+    memset(buf + offset, 0, 1024);
+    memcpy(buf + offset, &ext2_sb, sizeof(ext2_sb));
+    write_meta_block(block, buf);
+    free(buf);
+    return 1;
+}
+
+// 只写回记脏的描述符表块
+static int write_group_descs(void) {
+    unsigned char* buf = (unsigned char*)malloc(fs_block_size);
+    if (!buf) return 0;
+    for (unsigned int k = 0; k * FS_GROUP_DESC_PER_BLOCK < fs_group_count; k++) {
+        unsigned int count = fs_group_count - k * FS_GROUP_DESC_PER_BLOCK;
+
+        if (!(fs_gdt_dirty & (1u << k))) continue;
+        if (count > FS_GROUP_DESC_PER_BLOCK) count = FS_GROUP_DESC_PER_BLOCK;
+        memset(buf, 0, fs_block_size);
+        memcpy(buf, &fs_groups[k * FS_GROUP_DESC_PER_BLOCK], count * sizeof(Ext2GroupDesc));
+        write_meta_block(fs_gdt_block + k, buf);
+    }
+    free(buf);
+    fs_gdt_dirty = 0;
+    return 1;
+}
+
+static void group_desc_dirty(unsigned int group) {
+    fs_gdt_dirty |= 1u << (group / FS_GROUP_DESC_PER_BLOCK);
+}
+
+static void bitmap_slot_writeback(FsBitmapSlot* slot, int is_inode) {
+    const Ext2GroupDesc* gd;
+
+    if (slot->group == FS_GROUP_NONE || !slot->dirty) return;
+    gd = &fs_groups[slot->group];
+    write_meta_block(is_inode ? gd->bg_inode_bitmap : gd->bg_block_bitmap, slot->words);
+    slot->dirty = 0;
+}
+
+// 取某个块组的块位图或 inode 位图；不在内存时换出最久未用的槽位 (脏的先写入块缓存)。
+// 返回的指针在下一次取别的块组位图前有效
+static FsBitmapSlot* group_bitmap(unsigned int group, int is_inode) {
+    FsBitmapSlot* slots = is_inode ? fs_inode_bitmaps : fs_block_bitmaps;
+    FsBitmapSlot* victim = &slots[0];
+
+    for (int i = 0; i < FS_BITMAP_SLOTS; i++) {
+        if (slots[i].group == group) {
+            slots[i].last_used = ++fs_bitmap_clock;
+            return &slots[i];
+        }
+    }
+    for (int i = 0; i < FS_BITMAP_SLOTS; i++) {
+        if (slots[i].group == FS_GROUP_NONE) {
+            victim = &slots[i];
+            break;
+        }
+        if (slots[i].last_used < victim->last_used) victim = &slots[i];
+    }
+    bitmap_slot_writeback(victim, is_inode);
+    if (bcache_read(is_inode ? fs_groups[group].bg_inode_bitmap : fs_groups[group].bg_block_bitmap,
+                    victim->words) != 0) {
+        // 读不出来的位图当作全部占用且不缓存，不会从里面分配
+        fs_read_failed(is_inode ? fs_groups[group].bg_inode_bitmap : fs_groups[group].bg_block_bitmap);
+        memset(victim->words, 0xFF, fs_block_size);
+        victim->group = FS_GROUP_NONE;
+        victim->dirty = 0;
+        return victim;
+    }
+    victim->group = group;
+    victim->dirty = 0;
+    victim->last_used = ++fs_bitmap_clock;
+    return victim;
+}
+
+static unsigned int journal_commits(void) {
+    JournalStats stats;
+
+    journal_get_stats(&stats);
+    return stats.commits;
+}
+
+// 丢掉已随日志提交的段
+static void freed_expire(void) {
+    unsigned int commits;
+    unsigned int kept = 0;
+
+    if (fs_freed_count == 0) return;
+    commits = journal_commits();
+    for (unsigned int i = 0; i < fs_freed_count; i++) {
+        if (fs_freed[i].commits != FS_FREED_UNSYNCED && fs_freed[i].commits != commits) continue;
+        fs_freed[kept++] = fs_freed[i];
+    }
+    fs_freed_count = kept;
+}
+
+// block_num 到该段的距离，落在段内为 0
+static unsigned int freed_gap(const FsFreedExtent* e, unsigned int block_num) {
+    if (block_num < e->start) return e->start - block_num;
+    if (block_num >= e->start + e->count) return block_num - (e->start + e->count - 1);
+    return 0;
+}
+
+static int block_freed_uncommitted(unsigned int block_num) {
+    for (unsigned int i = 0; i < fs_freed_count; i++) {
+        if (freed_gap(&fs_freed[i], block_num) == 0) return 1;
+    }
+    return 0;
+}
+
+static void freed_record(unsigned int block_num) {
+    FsFreedExtent* e;
+
+    if (!journal_enabled()) return;
+    freed_expire();
+    e = fs_freed_count > 0 ? &fs_freed[fs_freed_count - 1] : 0;
+    if (!e || e->commits != FS_FREED_UNSYNCED ||
+        (block_num != e->start + e->count && block_num + 1 != e->start)) {
+        if (fs_freed_count < FS_FREED_EXTENTS) {
+            e = &fs_freed[fs_freed_count++];
+            e->start = block_num;
+            e->count = 1;
+            e->commits = FS_FREED_UNSYNCED;
+            return;
+        }
+        // 记满：扩展离得最近的一段把它盖住
+        e = &fs_freed[0];
+        for (unsigned int i = 1; i < fs_freed_count; i++) {
+            if (freed_gap(&fs_freed[i], block_num) < freed_gap(e, block_num)) e = &fs_freed[i];
+        }
+    }
+    if (block_num < e->start) {
+        e->count += e->start - block_num;
+        e->start = block_num;
+    } else if (block_num >= e->start + e->count) {
+        e->count = block_num - e->start + 1;
+    }
+    e->commits = FS_FREED_UNSYNCED;
+}
+
+// 把本次操作累计的 inode、位图与计数改动一次性写入块缓存
+static void flush_metadata(void) {
+    if (!fs_ready || fs_io_error) return;
+    icache_flush();
+    for (int i = 0; i < FS_BITMAP_SLOTS; i++) {
+        bitmap_slot_writeback(&fs_block_bitmaps[i], 0);
+        bitmap_slot_writeback(&fs_inode_bitmaps[i], 1);
+    }
+    if (fs_sb_dirty && write_superblock()) fs_sb_dirty = 0;
+    if (fs_gdt_dirty) write_group_descs();
+    // 释放已进了块缓存，等下一次提交
+    for (unsigned int i = 0; i < fs_freed_count; i++) {
+        if (fs_freed[i].commits == FS_FREED_UNSYNCED) fs_freed[i].commits = journal_commits();
+    }
+}
+
+static int bitmap_test(const unsigned int* words, unsigned int bit) {
+    return (words[bit / 32] >> (bit % 32)) & 1u;
+}
+
+static void bitmap_set(unsigned int* words, unsigned int bit) {
+    words[bit / 32] |= 1u << (bit % 32);
+}
+
+static void bitmap_clear(unsigned int* words, unsigned int bit) {
+    words[bit / 32] &= ~(1u << (bit % 32));
+}
+
+// 在 [start, limit) 内找第一个 0 位，整字全满时一次跳过 32 位；找不到返回 limit
+static unsigned int bitmap_find_zero(const unsigned int* words, unsigned int start, unsigned int limit) {
+    unsigned int i = start;
+
+    while (i < limit) {
+        unsigned int word_index = i / 32;
+        // 起始字中 start 之前的位视为已占用
+        unsigned int word = words[word_index] | ((1u << (i % 32)) - 1u);
+        if (word != 0xFFFFFFFFu) {
+            unsigned int bit = word_index * 32 + (unsigned int)__builtin_ctz(~word);
+            return bit < limit ? bit : limit;
+        }
+        i = (word_index + 1) * 32;
+    }
+    return limit;
+}
+
+static unsigned int inode_group(unsigned int inode_num) {
+    return (inode_num - 1) / ext2_sb.s_inodes_per_group;
+}
+
+// 新目录放到空闲 inode 不低于平均值的块组里空闲块最多的那个，让不同目录的文件分散到各块组
+static unsigned int pick_dir_group(void) {
+    unsigned int average = ext2_sb.s_free_inodes_count / fs_group_count;
+    unsigned int best = 0;
+    int found = 0;
+
+    for (unsigned int g = 0; g < fs_group_count; g++) {
+        const Ext2GroupDesc* gd = &fs_groups[g];
+        if (gd->bg_free_inodes_count == 0 || gd->bg_free_inodes_count < average) continue;
+        if (!found || gd->bg_free_blocks_count > fs_groups[best].bg_free_blocks_count) {
+            best = g;
+            found = 1;
+        }
+    }
+    return best;
+}
+
+// 普通文件的 inode 优先放在父目录所在块组，文件数据随后也从该块组分配
+static unsigned int alloc_inode(unsigned int parent_inode, int is_dir) {
+    unsigned int per_group;
+    unsigned int first_group;
+
+    if (!fs_ready || fs_io_error || ext2_sb.s_free_inodes_count == 0) return 0;
+
+    per_group = ext2_sb.s_inodes_per_group;
+    if (is_dir) first_group = pick_dir_group();
+    else if (parent_inode >= 1 && parent_inode <= ext2_sb.s_inodes_count) first_group = inode_group(parent_inode);
+    else first_group = 0;
+
+    for (unsigned int n = 0; n < fs_group_count; n++) {
+        unsigned int group = (first_group + n) % fs_group_count;
+        unsigned int base = group * per_group;
+        unsigned int start = 0;
+        unsigned int limit = per_group;
+        FsBitmapSlot* bitmap;
+        unsigned int i;
+
+        if (fs_groups[group].bg_free_inodes_count == 0) continue;
+        if (group == 0) {
+            start = ext2_sb.s_first_ino;
+            if (start < 11) start = 11;
+        }
+        if (base + limit > ext2_sb.s_inodes_count) limit = ext2_sb.s_inodes_count - base;
+
+        // 仍被 pin 的已删除 inode 暂不复用，避免旧句柄读到新文件
+        bitmap = group_bitmap(group, 1);
+        i = bitmap_find_zero(bitmap->words, start, limit);
+        while (i < limit && icache_is_pinned(base + i + 1)) {
+            i = bitmap_find_zero(bitmap->words, i + 1, limit);
+        }
+        if (i >= limit) continue;
+
+        bitmap_set(bitmap->words, i);
+        bitmap->dirty = 1;
+        ext2_sb.s_free_inodes_count--;
+        fs_groups[group].bg_free_inodes_count--;
+        fs_sb_dirty = 1;
+        group_desc_dirty(group);
+        return base + i + 1;
+    }
+    return 0;
+}
+
+static void free_inode(unsigned int inode_num) {
+    unsigned int group;
+    FsBitmapSlot* bitmap;
+    unsigned int bit;
+
+    if (!fs_ready || fs_io_error || inode_num < 1 || inode_num > ext2_sb.s_inodes_count) return;
+    group = inode_group(inode_num);
+    bit = (inode_num - 1) % ext2_sb.s_inodes_per_group;
+    bitmap = group_bitmap(group, 1);
+    if (!bitmap_test(bitmap->words, bit)) return;
+
+    bitmap_clear(bitmap->words, bit);
+    bitmap->dirty = 1;
+    ext2_sb.s_free_inodes_count++;
+    fs_groups[group].bg_free_inodes_count++;
+    fs_sb_dirty = 1;
+    group_desc_dirty(group);
+}
+
+// ===== 块分配 =====
+
+static unsigned int block_group(unsigned int block_num) {
+    return block_num / ext2_sb.s_blocks_per_group;
+}
+
+static unsigned int group_first_block(unsigned int group) {
+    return group * ext2_sb.s_blocks_per_group;
+}
+
+static unsigned int group_end_block(unsigned int group) {
+    unsigned int end = group_first_block(group) + ext2_sb.s_blocks_per_group;
+    return end < ext2_sb.s_blocks_count ? end : ext2_sb.s_blocks_count;
+}
+
+// 块组中 inode 表之后的第一个块
+static unsigned int group_data_start(unsigned int group) {
+    return fs_groups[group].bg_inode_table + fs_inode_table_blocks;
+}
+
+static int block_in_use(unsigned int block_num) {
+    unsigned int group = block_group(block_num);
+    return bitmap_test(group_bitmap(group, 0)->words, block_num - group_first_block(group));
+}
+
+static FsPrealloc* prealloc_find(unsigned int inode_num) {
+    for (int i = 0; i < FS_PREALLOC_WINDOWS; i++) {
+        if (fs_prealloc[i].inode_num == inode_num) return &fs_prealloc[i];
+    }
+    return 0;
+}
+
+static void prealloc_release(unsigned int inode_num) {
+    FsPrealloc* w;
+
+    if (inode_num == 0) return;
+    w = prealloc_find(inode_num);
+    if (w) w->inode_num = 0;
+}
+
+static int block_reserved_by_other(unsigned int block_num, unsigned int owner) {
+    for (int i = 0; i < FS_PREALLOC_WINDOWS; i++) {
+        const FsPrealloc* w = &fs_prealloc[i];
+        if (w->inode_num != 0 && w->inode_num != owner &&
+            block_num >= w->next && block_num < w->end) return 1;
+    }
+    return 0;
+}
+
+// 从 start 起连续可用 (位图空闲、不在别人窗口里、不是尚未提交的释放) 的块数，最多数到 max_len；不跨块组
+static unsigned int free_run_length(unsigned int start, unsigned int max_len, unsigned int owner) {
+    unsigned int group = block_group(start);
+    unsigned int base = group_first_block(group);
+    unsigned int end = group_end_block(group);
+    const FsBitmapSlot* bitmap = group_bitmap(group, 0);
+    unsigned int len = 0;
+
+    while (start + len < end && len < max_len &&
+           !bitmap_test(bitmap->words, start + len - base) &&
+           !block_reserved_by_other(start + len, owner) &&
+           !block_freed_uncommitted(start + len)) {
+        len++;
+    }
+    return len;
+}
+
+// 在块组的 [from, stop) 内找第一段长度 >= want 的空闲区；都不够长时更新 *best 为其中最长的一段
+static unsigned int scan_group(unsigned int group, unsigned int from, unsigned int stop,
+                               unsigned int want, unsigned int owner, unsigned int* out_len,
+                               unsigned int* best, unsigned int* best_len) {
+    unsigned int base = group_first_block(group);
+    const FsBitmapSlot* bitmap = group_bitmap(group, 0);
+    unsigned int i = from - base;
+
+    while (i < stop - base) {
+        unsigned int len;
+
+        i = bitmap_find_zero(bitmap->words, i, stop - base);
+        if (i >= stop - base) break;
+        len = free_run_length(base + i, want, owner);
+        if (len == 0) {
+            i++;
+            continue;
+        }
+        if (len >= want) {
+            *out_len = len;
+            return base + i;
+        }
+        if (len > *best_len) {
+            *best = base + i;
+            *best_len = len;
+        }
+        i += len;
+    }
+    return 0;
+}
+
+// goal 空闲时直接从它开始，让文件顺着上一块往后长；否则从 goal 向后找第一段长度 >= want
+// 的空闲区：先扫 goal 所在块组的剩余部分，再依次扫后面的块组 (描述符里没有空闲块的整组跳过)，
+// 最后绕回 goal 所在块组的前半段；都不够长时取其中最长的一段
+static unsigned int find_free_run(unsigned int goal, unsigned int want,
+                                  unsigned int owner, unsigned int* out_len) {
+    unsigned int group = 0;
+    unsigned int start;
+    unsigned int best = 0;
+    unsigned int best_len = 0;
+
+    if (goal < ext2_sb.s_blocks_count) group = block_group(goal);
+    start = group_data_start(group);
+    if (goal >= start && goal < group_end_block(group)) {
+        *out_len = free_run_length(goal, want, owner);
+        if (*out_len > 0) return goal;
+        start = goal;
+    }
+
+    for (unsigned int n = 0; n <= fs_group_count; n++) {
+        unsigned int g = (group + n) % fs_group_count;
+        unsigned int from = n == 0 ? start : group_data_start(g);
+        unsigned int stop = n == fs_group_count ? start : group_end_block(g);
+        unsigned int found;
+
+        if (fs_groups[g].bg_free_blocks_count == 0 || from >= stop) continue;
+        found = scan_group(g, from, stop, want, owner, out_len, &best, &best_len);
+        if (found) return found;
+    }
+    *out_len = best_len;
+    return best;
+}
+
+// 按 req 分配一个块：先顺着该 inode 的预留窗口往下取，窗口用完或写入位置跳开时
+// 围绕 goal 重新找一段连续空闲区并把余下部分圈成新窗口
+static unsigned int alloc_block(unsigned int goal, FsAllocRequest* req) {
+    unsigned int i;
+    unsigned int owner = req ? req->inode_num : 0;
+    unsigned int want = 1;
+    unsigned int run_len = 0;
+    FsPrealloc* w;
+
+    if (!fs_ready || fs_io_error) return 0;
+    freed_expire();
+
+    if (owner) {
+        w = prealloc_find(owner);
+        if (w && w->next < w->end && (goal == 0 || goal == w->next) &&
+            !block_in_use(w->next)) {
+            i = w->next++;
+            w->last_used = ++fs_prealloc_clock;
+            goto take;
+        }
+        if (w) w->inode_num = 0;
+
+        // 间接块夹在数据块之间，一并算进要找的连续长度
+        want = req->want + (req->want + fs_addr_per_block - 1) / fs_addr_per_block;
+        if (want < FS_PREALLOC_MIN_BLOCKS) want = FS_PREALLOC_MIN_BLOCKS;
+        if (want > FS_PREALLOC_MAX_BLOCKS) want = FS_PREALLOC_MAX_BLOCKS;
+    }
+
+    i = find_free_run(goal, want, owner, &run_len);
+    if (i == 0) {
+        // 预留只是提示，空间紧张时全部作废，不能因此报告磁盘已满
+        memset(fs_prealloc, 0, sizeof(fs_prealloc));
+        i = find_free_run(goal, want, owner, &run_len);
+    }
+    if (i == 0 && fs_freed_count > 0) {
+        // 只剩尚未提交的释放：先提交再用它们
+        flush_metadata();
+        journal_commit();
+        freed_expire();
+        i = find_free_run(goal, want, owner, &run_len);
+    }
+    if (i == 0) return 0;
+
+    if (owner && run_len > 1) {
+        w = &fs_prealloc[0];
+        for (int k = 0; k < FS_PREALLOC_WINDOWS; k++) {
+            if (fs_prealloc[k].inode_num == 0) {
+                w = &fs_prealloc[k];
+                break;
+            }
+            if (fs_prealloc[k].last_used < w->last_used) w = &fs_prealloc[k];
+        }
+        w->inode_num = owner;
+        w->next = i + 1;
+        w->end = i + run_len;
+        w->last_used = ++fs_prealloc_clock;
+    }
+
+take:
+    {
+        unsigned int group = block_group(i);
+        FsBitmapSlot* bitmap = group_bitmap(group, 0);
+
+        bitmap_set(bitmap->words, i - group_first_block(group));
+        bitmap->dirty = 1;
+        ext2_sb.s_free_blocks_count--;
+        fs_groups[group].bg_free_blocks_count--;
+        fs_sb_dirty = 1;
+        group_desc_dirty(group);
+    }
+
+    // 新块内容未定义，不在这里清零：调用方要么整块写入，要么对外暴露前自行清零
+    if (req) {
+        req->allocated++;
+        req->last = i;
+        if (req->want > 0) req->want--;
+    }
+    return i;
+}
+
+static void free_block(unsigned int block_num) {
+    unsigned int group;
+    FsBitmapSlot* bitmap;
+
+    if (!fs_ready || fs_io_error || block_num == 0 || block_num >= ext2_sb.s_blocks_count) return;
+    group = block_group(block_num);
+    bitmap = group_bitmap(group, 0);
+    if (!bitmap_test(bitmap->words, block_num - group_first_block(group))) return;
+
+    for (int i = 0; i < FS_INDIRECT_CACHE_ENTRIES; i++) {
+        if (fs_indirect_cache[i].block_num == block_num) fs_indirect_cache[i].block_num = 0;
+    }
+
+    bitmap_clear(bitmap->words, block_num - group_first_block(group));
+    bitmap->dirty = 1;
+    ext2_sb.s_free_blocks_count++;
+    fs_groups[group].bg_free_blocks_count++;
+    fs_sb_dirty = 1;
+    group_desc_dirty(group);
+    freed_record(block_num);
+}
+
+static unsigned int dir_entry_actual_size(unsigned int name_len) {
+    return (8 + name_len + 3) & ~3u;
+}
+
+static int dir_entry_bounds(const unsigned char* block, unsigned int pos,
+                            unsigned int* out_rec_len, unsigned int* out_name_len) {
+    unsigned int rec_len;
+    unsigned int name_len;
+
+    if (!block || !out_rec_len || !out_name_len) return 0;
+    if ((pos & 3u) != 0 || pos > fs_block_size - 8u) return 0;
+
+    rec_len = (unsigned int)block[pos + 4] |
+              ((unsigned int)block[pos + 5] << 8);
+    name_len = (unsigned int)block[pos + 6];
+
+    if (rec_len < 8 || (rec_len & 3u) != 0) return 0;
+    if (rec_len > fs_block_size - pos) return 0;
+    if (name_len > 255u || name_len > rec_len - 8u) return 0;
+
+    *out_rec_len = rec_len;
+    *out_name_len = name_len;
+    return 1;
+}
+
+// ===== 块映射 =====
+
+// 返回间接块内容的缓存副本，指针在下一次 indirect_load() 之前有效
+static unsigned int* indirect_load(unsigned int block_num) {
+    FsIndirectCacheEntry* victim = &fs_indirect_cache[0];
+
+    for (int i = 0; i < FS_INDIRECT_CACHE_ENTRIES; i++) {
+        FsIndirectCacheEntry* e = &fs_indirect_cache[i];
+        if (e->block_num == block_num) {
+            e->last_used = ++fs_indirect_clock;
+            return e->entries;
+        }
+        if (e->block_num == 0 || (victim->block_num != 0 && e->last_used < victim->last_used)) victim = e;
+    }
+    victim->last_used = ++fs_indirect_clock;
+    if (!read_meta_block(block_num, victim->entries)) {
+        // 清零的内容不缓存，映射到的都是空洞
+        victim->block_num = 0;
+        return victim->entries;
+    }
+    victim->block_num = block_num;
+    return victim->entries;
+}
+
+// 把缓存中修改过的间接块写入块缓存 (block_num 须刚经 indirect_load 取得)
+static void indirect_store(unsigned int block_num) {
+    for (int i = 0; i < FS_INDIRECT_CACHE_ENTRIES; i++) {
+        if (fs_indirect_cache[i].block_num == block_num) {
+            write_meta_block(block_num, fs_indirect_cache[i].entries);
+            return;
+        }
+    }
+}
+
+// 逻辑块号 -> 根槽位 (i_block 下标) 与各级间接块内的下标，返回间接层数，越界返回 -1
+static int bmap_path(unsigned int lblock, unsigned int* root_index, unsigned int offsets[3]) {
+    if (lblock < FS_IND_BASE) {
+        *root_index = lblock;
+        return 0;
+    }
+    if (lblock < fs_dind_base) {
+        *root_index = 12;
+        offsets[0] = lblock - FS_IND_BASE;
+        return 1;
+    }
+    if (lblock < fs_tind_base) {
+        lblock -= fs_dind_base;
+        *root_index = 13;
+        offsets[0] = lblock / fs_addr_per_block;
+        offsets[1] = lblock % fs_addr_per_block;
+        return 2;
+    }
+    lblock -= fs_tind_base;
+    if (lblock >= fs_addr_per_block * fs_addr_per_block * fs_addr_per_block) return -1;
+    *root_index = 14;
+    offsets[0] = lblock / (fs_addr_per_block * fs_addr_per_block);
+    offsets[1] = (lblock / fs_addr_per_block) % fs_addr_per_block;
+    offsets[2] = lblock % fs_addr_per_block;
+    return 3;
+}
+
+static unsigned int bmap(Ext2Inode* inode, unsigned int lblock, int create, FsAllocRequest* req);
+
+static int inode_is_inline(const Ext2Inode* inode) {
+    return (inode->i_flags & EXT2_INLINE_DATA_FL) != 0;
+}
+
+// 新块的目标位置：紧跟本次请求上一个分到的块，否则紧跟前一个逻辑块
+static unsigned int bmap_goal(const Ext2Inode* inode, unsigned int lblock, const FsAllocRequest* req) {
+    unsigned int prev;
+
+    if (req && req->last) return req->last + 1;
+    // 文件的第一个块从 inode 所在块组找起，数据与 inode、目录留在同一块组
+    if (lblock == 0) return req && req->inode_num ? group_data_start(inode_group(req->inode_num)) : 0;
+    prev = bmap((Ext2Inode*)inode, lblock - 1, 0, 0);
+    return prev ? prev + 1 : 0;
+}
+
+static unsigned int bmap_alloc(const Ext2Inode* inode, unsigned int lblock, int is_indirect,
+                               FsAllocRequest* req) {
+    unsigned int block_num = alloc_block(bmap_goal(inode, lblock, req), req);
+
+    if (!block_num) return 0;
+    if (is_indirect) {
+        unsigned int* entries = indirect_load(block_num);
+        memset(entries, 0, fs_block_size);
+        indirect_store(block_num);
+    }
+    return block_num;
+}
+
+// 逻辑块 -> 物理块。create 时补齐缺失的数据块与各级间接块，新分配块数累加到 req->allocated
+static unsigned int bmap(Ext2Inode* inode, unsigned int lblock, int create, FsAllocRequest* req) {
+    unsigned int offsets[3];
+    unsigned int root_index;
+    unsigned int block_num;
+    int depth = bmap_path(lblock, &root_index, offsets);
+
+    // 内联文件的 i_block[] 存的是数据，先由调用方转成块存储
+    if (depth < 0 || inode_is_inline(inode)) return 0;
+    block_num = inode->i_block[root_index];
+    if (block_num == 0) {
+        if (!create) return 0;
+        block_num = bmap_alloc(inode, lblock, depth > 0, req);
+        if (!block_num) return 0;
+        inode->i_block[root_index] = block_num;
+    }
+
+    for (int level = 0; level < depth; level++) {
+        unsigned int next = indirect_load(block_num)[offsets[level]];
+        if (next == 0) {
+            if (!create) return 0;
+            next = bmap_alloc(inode, lblock, level + 1 < depth, req);
+            if (!next) return 0;
+            indirect_load(block_num)[offsets[level]] = next;
+            indirect_store(block_num);
+        }
+        block_num = next;
+    }
+    return block_num;
+}
+
+static unsigned int inode_block_at(const Ext2Inode* inode, unsigned int lblock) {
+    return bmap((Ext2Inode*)inode, lblock, 0, 0);
+}
+
+// 找到日志 inode 并交给 journal_load()；日志区必须物理连续，否则不启用日志
+static int journal_mount(void) {
+    Ext2Inode inode;
+    unsigned int start;
+    unsigned int blocks;
+
+    if (!(ext2_sb.s_feature_compat & EXT2_FEATURE_COMPAT_HAS_JOURNAL)) return -1;
+    if (ext2_sb.s_journal_inum == 0 || ext2_sb.s_journal_inum > ext2_sb.s_inodes_count) return -1;
+
+    if (!load_inode_raw(ext2_sb.s_journal_inum, &inode)) return -1;
+    blocks = inode.i_size / fs_block_size;
+    start = inode_block_at(&inode, 0);
+    if (start == 0 || blocks < JOURNAL_MIN_BLOCKS) return -1;
+    for (unsigned int b = 1; b < blocks; b++) {
+        if (inode_block_at(&inode, b) != start + b) return -1;
+    }
+    return journal_load(start, blocks);
+}
+
+// 释放以 block_num 为根、depth 层间接的子树中相对序号 >= first 的块；
+// 子树整体释放时返回 1。每层先拷贝一份映射，递归期间间接块缓存可能被换出
+static int free_tree(unsigned int block_num, int depth, unsigned int first, unsigned int* freed) {
+    unsigned int span = 1;
+    unsigned int* entries;
+    int changed = 0;
+
+    if (depth == 0) {
+        free_block(block_num);
+        (*freed)++;
+        return 1;
+    }
+    for (int i = 1; i < depth; i++) span *= fs_addr_per_block;
+
+    entries = (unsigned int*)malloc(fs_block_size);
+    if (!entries) return 0;
+    memcpy(entries, indirect_load(block_num), fs_block_size);
+    for (unsigned int i = first / span; i < fs_addr_per_block; i++) {
+        unsigned int child_first = i == first / span ? first % span : 0;
+        if (entries[i] == 0) continue;
+        if (free_tree(entries[i], depth - 1, child_first, freed)) {
+            entries[i] = 0;
+            changed = 1;
+        }
+    }
+
+    if (first == 0) {
+        free(entries);
+        free_block(block_num);
+        (*freed)++;
+        return 1;
+    }
+    if (changed) {
+        memcpy(indirect_load(block_num), entries, fs_block_size);
+        indirect_store(block_num);
+    }
+    free(entries);
+    return 0;
+}
+
+// 释放逻辑块号 >= first_block 的全部数据块及不再需要的间接块，返回释放的块数
+static unsigned int inode_free_blocks_from(Ext2Inode* inode, unsigned int first_block) {
+    const unsigned int bases[3] = { FS_IND_BASE, fs_dind_base, fs_tind_base };
+    unsigned int freed = 0;
+
+    if (inode_is_inline(inode)) return 0;
+    for (unsigned int i = first_block; i < 12; i++) {
+        if (inode->i_block[i] != 0) {
+            free_block(inode->i_block[i]);
+            inode->i_block[i] = 0;
+            freed++;
+        }
+    }
+    for (int level = 0; level < 3; level++) {
+        unsigned int root = inode->i_block[12 + level];
+        unsigned int capacity = fs_addr_per_block;
+        unsigned int first;
+
+        for (int i = 0; i < level; i++) capacity *= fs_addr_per_block;
+        if (root == 0) continue;
+        if (first_block >= bases[level] && first_block - bases[level] >= capacity) continue;
+        first = first_block > bases[level] ? first_block - bases[level] : 0;
+        if (free_tree(root, level + 1, first, &freed)) inode->i_block[12 + level] = 0;
+    }
+    return freed;
+}
+
+// ===== 目录 =====
+// 目录块经 bmap() 映射，可跨直接块与各级间接块；location = (块序号 << 12) | 块内偏移
+
+#define DIR_LOCATION(block_index, pos) (((block_index) << 12) | (pos))
+#define DIR_LOCATION_BLOCK(location)   ((location) >> 12)
+#define DIR_LOCATION_POS(location)     ((location) & 0xFFFu)
+
+static unsigned int dir_block_count(const Ext2Inode* dir_inode) {
+    return dir_inode->i_size / fs_block_size;
+}
+
+// 目录第 block_index 个数据块的块号，空洞/越界返回 0
+static unsigned int dir_block_at(const Ext2Inode* dir_inode, unsigned int block_index) {
+    return inode_block_at(dir_inode, block_index);
+}
+
+static int dir_entry_name_is(const Ext2DirEntry* entry, unsigned int name_len, const char* name) {
+    return entry->inode != 0 && name_len == (unsigned int)strlen(name) &&
+           strncmp(entry->name, name, (int)name_len) == 0;
+}
+
+static unsigned int dir_entry_hash(const Ext2DirEntry* entry, unsigned int name_len) {
+    char name[256];
+    memcpy(name, entry->name, (int)name_len);
+    name[name_len] = '\0';
+    return dcache_name_hash(name);
+}
+
+// 线性扫描整个目录；build_index 时把每个有效项登记进哈希索引。
+// 返回 inode 号，未找到返回 0，目录块损坏返回 -1
+static int dir_scan(unsigned int dir_inode_num, const Ext2Inode* dir_inode, const char* name,
+                    int build_index, unsigned int* out_location) {
+    unsigned int blocks = dir_block_count(dir_inode);
+    int found = 0;
+
+    for (unsigned int b = 0; b < blocks; b++) {
+        unsigned int block_num = dir_block_at(dir_inode, b);
+        unsigned int pos = 0;
+
+        if (block_num == 0) return -1;
+        if (!read_meta_block(block_num, fs_dir_block_buf)) return -1;
+        while (pos < fs_block_size) {
+            Ext2DirEntry* entry;
+            unsigned int rec_len;
+            unsigned int name_len;
+
+            if (!dir_entry_bounds(fs_dir_block_buf, pos, &rec_len, &name_len)) {
+                klog_write("bad dir entry");
+                return -1;
+            }
+            entry = (Ext2DirEntry*)(fs_dir_block_buf + pos);
+            if (build_index && entry->inode != 0 && name_len > 0) {
+                dindex_insert(dir_inode_num, dir_entry_hash(entry, name_len), DIR_LOCATION(b, pos));
+            }
+            if (!found && name && dir_entry_name_is(entry, name_len, name)) {
+                found = (int)entry->inode;
+                if (out_location) *out_location = DIR_LOCATION(b, pos);
+                if (!build_index) return found;
+            }
+            pos += rec_len;
+        }
+    }
+    return found;
+}
+
+// 经哈希索引查找，候选位置读回目录块核对名字
+static int dir_lookup_indexed(unsigned int dir_inode_num, const Ext2Inode* dir_inode, const char* name,
+                              unsigned int hash, unsigned int* out_location) {
+    unsigned int cursor = 0;
+    unsigned int location;
+
+    while ((location = dindex_next(dir_inode_num, hash, &cursor)) != DINDEX_NONE) {
+        unsigned int block_num = dir_block_at(dir_inode, DIR_LOCATION_BLOCK(location));
+        unsigned int pos = DIR_LOCATION_POS(location);
+        unsigned int rec_len;
+        unsigned int name_len;
+
+        if (block_num == 0) continue;
+        if (!read_meta_block(block_num, fs_dir_block_buf)) continue;
+        if (!dir_entry_bounds(fs_dir_block_buf, pos, &rec_len, &name_len)) continue;
+        if (dir_entry_name_is((const Ext2DirEntry*)(fs_dir_block_buf + pos), name_len, name)) {
+            if (out_location) *out_location = location;
+            return (int)((const Ext2DirEntry*)(fs_dir_block_buf + pos))->inode;
+        }
+    }
+    return 0;
+}
+
+static int dir_lookup_entry(unsigned int dir_inode_num, const Ext2Inode* dir_inode, const char* name,
+                            unsigned int hash, unsigned int* out_location) {
+    if (!dindex_exists(dir_inode_num) && dir_block_count(dir_inode) >= FS_DIR_INDEX_MIN_BLOCKS &&
+        dindex_create(dir_inode_num, dir_block_count(dir_inode) * 16)) {
+        int result = dir_scan(dir_inode_num, dir_inode, name, 1, out_location);
+        if (result < 0) dindex_drop(dir_inode_num);
+        return result;
+    }
+    if (dindex_exists(dir_inode_num)) {
+        return dir_lookup_indexed(dir_inode_num, dir_inode, name, hash, out_location);
+    }
+    return dir_scan(dir_inode_num, dir_inode, name, 0, out_location);
+}
+
+static void dir_entry_added(unsigned int dir_inode_num, const char* name, unsigned int target_inode,
+                            unsigned int location) {
+    unsigned int hash = dcache_name_hash(name);
+    dcache_insert(dir_inode_num, name, hash, target_inode);
+    dindex_insert(dir_inode_num, hash, location);
+}
+
+static int add_dir_entry(unsigned int dir_inode_num, unsigned int target_inode,
+                         const char* name, unsigned char file_type) {
+    Ext2Inode dir_inode;
+    Ext2DirEntry* ne;
+    unsigned int blocks;
+    unsigned int name_len;
+    unsigned int entry_len;
+    unsigned int new_block;
+    FsAllocRequest req;
+
+    if (!read_inode(dir_inode_num, &dir_inode)) return 0;
+    if ((dir_inode.i_mode & 0xF000) != 0x4000 || dir_inode.i_block[0] == 0) return 0;
+
+    name_len = strlen(name);
+    if (name_len > 255) name_len = 255;
+    entry_len = dir_entry_actual_size(name_len);
+    blocks = dir_block_count(&dir_inode);
+
+    // 先在已有目录块里找能容纳新项的空隙 (已删除项或记录尾部的余量)
+    for (unsigned int b = dindex_space_hint(dir_inode_num); b < blocks; b++) {
+        unsigned int block_num = dir_block_at(&dir_inode, b);
+        unsigned int pos = 0;
+
+        if (block_num == 0) return 0;
+        if (!read_meta_block(block_num, fs_dir_block_buf)) return 0;
+        while (pos < fs_block_size) {
+            Ext2DirEntry* entry;
+            unsigned int actual;
+            unsigned int rec_len;
+            unsigned int stored_name_len;
+
+            if (!dir_entry_bounds(fs_dir_block_buf, pos, &rec_len, &stored_name_len)) return 0;
+            entry = (Ext2DirEntry*)(fs_dir_block_buf + pos);
+            actual = entry->inode != 0 ? dir_entry_actual_size(stored_name_len) : 0;
+
+            if (rec_len - actual >= entry_len) {
+                unsigned int new_pos = pos + actual;
+                if (actual != 0) entry->rec_len = (unsigned short)actual;
+                ne = (Ext2DirEntry*)(fs_dir_block_buf + new_pos);
+                ne->inode = target_inode;
+                ne->rec_len = (unsigned short)(rec_len - actual);
+                ne->name_len = (unsigned char)name_len;
+                ne->file_type = file_type;
+                memcpy(ne->name, name, (int)name_len);
+                write_meta_block(block_num, fs_dir_block_buf);
+                dir_entry_added(dir_inode_num, name, target_inode, DIR_LOCATION(b, new_pos));
+                return 1;
+            }
+            pos += rec_len;
+        }
+        dindex_set_space_hint(dir_inode_num, b + 1);
+    }
+
+    // 没有空位时给目录追加一个新块 (需要时一并分配间接块)
+    memset(&req, 0, sizeof(req));
+    new_block = bmap(&dir_inode, blocks, 1, &req);
+    if (!new_block) {
+        inode_free_blocks_from(&dir_inode, blocks);
+        return 0;
+    }
+    memset(fs_dir_block_buf, 0, fs_block_size);
+    ne = (Ext2DirEntry*)fs_dir_block_buf;
+    ne->inode = target_inode;
+    ne->rec_len = fs_block_size;
+    ne->name_len = (unsigned char)name_len;
+    ne->file_type = file_type;
+    memcpy(ne->name, name, (int)name_len);
+    write_meta_block(new_block, fs_dir_block_buf);
+
+    dir_inode.i_size += fs_block_size;
+    dir_inode.i_blocks += req.allocated * fs_sectors_per_block;
+    write_inode(dir_inode_num, &dir_inode);
+    dir_entry_added(dir_inode_num, name, target_inode, DIR_LOCATION(blocks, 0));
+    return 1;
+}
+
+static int remove_dir_entry(unsigned int dir_inode_num, const char* name) {
+    Ext2Inode dir_inode;
+    unsigned int hash;
+    unsigned int location = 0;
+    unsigned int block_num;
+    unsigned int target_pos;
+    unsigned int pos = 0;
+    unsigned int prev_pos = 0;
+
+    if (!read_inode(dir_inode_num, &dir_inode)) return 0;
+    if ((dir_inode.i_mode & 0xF000) != 0x4000 || dir_inode.i_block[0] == 0) return 0;
+
+    hash = dcache_name_hash(name);
+    if (dir_lookup_entry(dir_inode_num, &dir_inode, name, hash, &location) <= 0) return 0;
+    block_num = dir_block_at(&dir_inode, DIR_LOCATION_BLOCK(location));
+    target_pos = DIR_LOCATION_POS(location);
+    if (block_num == 0) return 0;
+    if (!read_meta_block(block_num, fs_dir_block_buf)) return 0;
+
+    // 从块头重新走一遍，找到前一项以便合并记录长度
+    while (pos < target_pos) {
+        unsigned int rec_len;
+        unsigned int name_len;
+        if (!dir_entry_bounds(fs_dir_block_buf, pos, &rec_len, &name_len)) return 0;
+        prev_pos = pos;
+        pos += rec_len;
+    }
+    if (pos != target_pos) return 0;
+
+    if (prev_pos == pos) {
+        ((Ext2DirEntry*)(fs_dir_block_buf + pos))->inode = 0;
+    } else {
+        Ext2DirEntry* prev_entry = (Ext2DirEntry*)(fs_dir_block_buf + prev_pos);
+        Ext2DirEntry* entry = (Ext2DirEntry*)(fs_dir_block_buf + pos);
+        prev_entry->rec_len = (unsigned short)(prev_entry->rec_len + entry->rec_len);
+    }
+    write_meta_block(block_num, fs_dir_block_buf);
+
+    dindex_remove(dir_inode_num, hash, location);
+    dcache_insert(dir_inode_num, name, hash, 0);
+    if (DIR_LOCATION_BLOCK(location) < dindex_space_hint(dir_inode_num)) {
+        dindex_set_space_hint(dir_inode_num, DIR_LOCATION_BLOCK(location));
+    }
+    return 1;
+}
+
+// 内部：在目录中查找文件名，先查目录项缓存 (含负向项)，再查哈希索引或线性扫描
+static int find_file_in_dir(const char* filename, unsigned int dir_inode_num) {
+    Ext2Inode dir_inode;
+    unsigned int hash;
+    unsigned int cached;
+    int result;
+
+    if (!filename || !read_inode(dir_inode_num, &dir_inode)) {
+        klog_write("read inode fail");
+        return 0;
+    }
+    if ((dir_inode.i_mode & 0xF000) != 0x4000 || dir_inode.i_block[0] == 0) {
+        klog_write("not a dir");
+        return 0;
+    }
+
+    hash = dcache_name_hash(filename);
+    if (dcache_lookup(dir_inode_num, filename, hash, &cached)) return (int)cached;
+
+    result = dir_lookup_entry(dir_inode_num, &dir_inode, filename, hash, 0);
+    if (result < 0) return 0;
+    dcache_insert(dir_inode_num, filename, hash, (unsigned int)result);
+    if (result == 0) klog_write_pair("dir miss ", filename);
+    return result;
+}
+
+// 打开系统文件 (获取 inode 信息)
+int sys_file_open(const char* filename, SystemFile* out_file) {
+    char dir_name[FS_FILENAME_LEN];
+    char base_name[FS_FILENAME_LEN];
+    unsigned int dir_inode_num;
+    unsigned int inode_num;
+
+    fs_lock_enter();
+    if (!fs_ready) {
+        fs_lock_leave();
+        return 0;
+    }
+
+    if (!split_lookup_path(filename, dir_name, sizeof(dir_name), base_name, sizeof(base_name))) {
+        klog_write_pair("path bad ", filename);
+        fs_lock_leave();
+        return 0;
+    }
+
+    dir_inode_num = EXT2_ROOT_INODE;
+    if (dir_name[0]) {
+        dir_inode_num = find_file_in_dir(dir_name, EXT2_ROOT_INODE);
+        if (!dir_inode_num) {
+            klog_write_pair("dir fail ", dir_name);
+            fs_lock_leave();
+            return 0;
+        }
+    }
+
+    inode_num = find_file_in_dir(base_name, dir_inode_num);
+    if (!inode_num) {
+        klog_write_pair("file fail ", base_name);
+        fs_lock_leave();
+        return 0;
+    }
+    
+    Ext2Inode inode;
+    if (!read_inode(inode_num, &inode)) {
+        klog_write("inode open fail");
+        fs_lock_leave();
+        return 0;
+    }
+    
+    int fn_len = strlen(filename);
+    if(fn_len > FS_FILENAME_LEN - 1) fn_len = FS_FILENAME_LEN - 1;
+
+    for(int i=0; i<fn_len; i++) out_file->filename[i] = filename[i];
+    out_file->filename[fn_len] = '\0';
+    
+    out_file->size = inode.i_size;
+    out_file->inode_num = inode_num;
+    out_file->type = (inode.i_mode & 0xF000) == 0x4000 ? 1 : 0;
+    fs_lock_leave();
+    return 1;
+}
+
+// 打开应用层文件
+int app_file_open(const char* filename, AppFile* out_file) {
+    SystemFile sys_file;
+    if (sys_file_open(filename, &sys_file)) {
+        out_file->sys_file = sys_file;
+        out_file->current_pos = 0;
+        memset(&out_file->readahead, 0, sizeof(out_file->readahead));
+        return 1;
+    }
+    return 0;
+}
+
+static int read_inode_range_locked(const Ext2Inode* inode, unsigned int start_pos, unsigned int size, void* buffer) {
+    unsigned int bytes_read = 0;
+    unsigned int limit;
+    int direct_failed = 0;
+    unsigned int errors = fs_read_errors;
+
+    if (!inode || !buffer) return 0;
+    if (start_pos >= inode->i_size) return 0;
+
+    limit = size;
+    if (limit > inode->i_size - start_pos) limit = inode->i_size - start_pos;
+
+    // 内联文件随 inode 一起读进来了，不再碰数据块
+    if (inode_is_inline(inode)) {
+        memcpy(buffer, (const unsigned char*)inode->i_block + start_pos, (int)limit);
+        return (int)limit;
+    }
+
+    while (bytes_read < limit) {
+        unsigned int pos = start_pos + bytes_read;
+        unsigned int block_offset = pos % fs_block_size;
+        unsigned int block_num = inode_block_at(inode, pos / fs_block_size);
+        unsigned int to_copy;
+
+        to_copy = limit - bytes_read;
+        if (to_copy > fs_block_size - block_offset) {
+            to_copy = fs_block_size - block_offset;
+        }
+
+        // 空洞直接补 0，不碰磁盘
+        if (block_num == 0) {
+            memset((unsigned char*)buffer + bytes_read, 0, (int)to_copy);
+            bytes_read += to_copy;
+            continue;
+        }
+
+        // 块对齐、至少两整块的区间：合并物理相邻的块，一条命令直接读进调用方缓冲；
+        // 起始块已在缓存 (例如刚预读过) 时先从缓存取
+        if (!direct_failed && block_offset == 0 && limit - bytes_read >= 2 * fs_block_size &&
+            !bcache_contains(block_num)) {
+            unsigned int max_run = (limit - bytes_read) / fs_block_size;
+            unsigned int run = 1;
+
+            while (run < max_run && inode_block_at(inode, pos / fs_block_size + run) == block_num + run) run++;
+            if (run > 1 && bcache_read_direct(block_num, run, (unsigned char*)buffer + bytes_read) == 0) {
+                bytes_read += run * fs_block_size;
+                continue;
+            }
+            // 合并读失败 (例如借不到中转缓冲) 时余下的块都逐块经块缓存读
+            if (run > 1) direct_failed = 1;
+        }
+
+        // 头尾不足一块的部分与孤立块仍经块缓存中转
+        if (!read_block(block_num, fs_io_block_buf)) return -1;
+        memcpy((unsigned char*)buffer + bytes_read, fs_io_block_buf + block_offset, (int)to_copy);
+        bytes_read += to_copy;
+    }
+
+    // 间接块读失败时映射被当成空洞，读出的 0 不能当作文件内容
+    if (fs_read_errors != errors) return -1;
+    return (int)bytes_read;
+}
+
+// 顺序读时把读者前方的一个窗口预先读入块缓存；读者进入已预读部分的后半段时
+// 再补下一段，窗口随连续顺序读翻倍。随机读把状态清零
+static void readahead_after_read(const Ext2Inode* inode, FsReadahead* ra,
+                                 unsigned int pos, unsigned int bytes_read) {
+    unsigned int next_block;
+    unsigned int file_blocks;
+    unsigned int start;
+    unsigned int stop;
+
+    if (!ra || bytes_read == 0 || inode_is_inline(inode)) return;
+    if (pos != ra->next_pos) {
+        memset(ra, 0, sizeof(*ra));
+        ra->next_pos = pos + bytes_read;
+        return;
+    }
+    ra->next_pos = pos + bytes_read;
+    if (ra->window == 0) ra->window = FS_READAHEAD_MIN_BLOCKS;
+    else if (ra->window < FS_READAHEAD_MAX_BLOCKS) ra->window *= 2;
+    // 一次就读了整窗以上的调用方已经走合并读，不必预读
+    if (bytes_read >= FS_READAHEAD_MAX_BLOCKS * fs_block_size) return;
+
+    next_block = ra->next_pos / fs_block_size;
+    file_blocks = (inode->i_size + fs_block_size - 1) / fs_block_size;
+    if (ra->ra_end > next_block + ra->window / 2) return;
+
+    start = ra->ra_end > next_block ? ra->ra_end : next_block;
+    stop = next_block + ra->window;
+    if (stop > file_blocks) stop = file_blocks;
+    ra->ra_end = stop;
+
+    // 按物理连续段交给块缓存，每段一条命令；空洞跳过
+    while (start < stop) {
+        unsigned int block_num = inode_block_at(inode, start);
+        unsigned int run = 1;
+
+        if (block_num == 0) {
+            start++;
+            continue;
+        }
+        while (start + run < stop && inode_block_at(inode, start + run) == block_num + run) run++;
+        bcache_prefetch(block_num, run);
+        start += run;
+    }
+}
+
+// 支持 ext2 风格的 12 个直接块 + 一/二/三级间接块
+int fs_read_file(const char* filename, void* buffer, unsigned int capacity) {
+    SystemFile file;
+    Ext2Inode inode;
+    int ret;
+    fs_lock_enter();
+    if (!sys_file_open(filename, &file)) {
+        fs_lock_leave();
+        return 0;
+    }
+
+    if (!read_inode(file.inode_num, &inode)) {
+        fs_lock_leave();
+        return 0;
+    }
+
+    ret = read_inode_range_locked(&inode, 0, capacity, buffer);
+    fs_lock_leave();
+    return ret;
+}
+
+// lblock 由 bmap(create) 补齐时要新分配的块数 (数据块加缺失的各级间接块)，已映射返回 0。
+// prev 是同一批里上一个要补的逻辑块 (没有时为 FS_LBLOCK_NONE)，与它共用的缺失间接块已计过
+#define FS_LBLOCK_NONE 0xFFFFFFFFu
+
+static unsigned int bmap_missing(const Ext2Inode* inode, unsigned int lblock, unsigned int prev) {
+    unsigned int offsets[3];
+    unsigned int prev_offsets[3];
+    unsigned int root_index;
+    unsigned int prev_root = 0;
+    unsigned int block_num;
+    unsigned int missing = 1;
+    int depth = bmap_path(lblock, &root_index, offsets);
+    int prev_depth = prev == FS_LBLOCK_NONE ? -1 : bmap_path(prev, &prev_root, prev_offsets);
+    int level = 0;
+
+    if (depth < 0) return 0;
+    block_num = inode->i_block[root_index];
+    while (block_num != 0 && level < depth) block_num = indirect_load(block_num)[offsets[level++]];
+    if (block_num != 0) return 0;
+
+    // 第 k 级间接块由根槽位和前 k 级下标确定
+    for (int k = level; k < depth; k++) {
+        int shared = prev_depth == depth && prev_root == root_index;
+        for (int i = 0; shared && i < k; i++) shared = prev_offsets[i] == offsets[i];
+        if (!shared) missing++;
+    }
+    return missing;
+}
+
+// 写入整块覆盖一个空洞且数据全为 0 时不必分配，空洞本来就读出 0
+static int pwrite_block_stays_hole(const Ext2Inode* inode, unsigned int b, unsigned int pos,
+                                   unsigned int end, const unsigned char* src) {
+    unsigned int block_start = b * fs_block_size;
+    const unsigned char* data;
+
+    if (block_start < pos || end - block_start < fs_block_size) return 0;
+    data = src + (block_start - pos);
+    for (unsigned int i = 0; i < fs_block_size; i++) {
+        if (data[i] != 0) return 0;
+    }
+    return inode_block_at(inode, b) == 0;
+}
+
+static int pwrite_locked(unsigned int inode_num, Ext2Inode* inode, unsigned int pos,
+                         const unsigned char* src, unsigned int size);
+
+// 内联文件长到 i_block[] 放不下时转成块存储：原内容按普通写入落到块 0。失败时恢复原样
+static int inline_to_blocks_locked(unsigned int inode_num, Ext2Inode* inode) {
+    unsigned char data[EXT2_INLINE_DATA_MAX];
+    unsigned int size = inode->i_size;
+
+    memcpy(data, inode->i_block, EXT2_INLINE_DATA_MAX);
+    memset(inode->i_block, 0, sizeof(inode->i_block));
+    inode->i_flags &= ~EXT2_INLINE_DATA_FL;
+    if (size == 0 || pwrite_locked(inode_num, inode, 0, data, size) == (int)size) return 1;
+    memcpy(inode->i_block, data, EXT2_INLINE_DATA_MAX);
+    inode->i_flags |= EXT2_INLINE_DATA_FL;
+    return 0;
+}
+
+// 在 pos 处写入 size 字节，只读改写涉及的块，只为写到的空洞分配新块；越过文件末尾时
+// 中间留成空洞。先数出要新分配的块数，空间不够时什么都不做；然后把所需的块全部挂上再写数据。
+// 空文件或内联文件写完仍放得进 inode 时直接写进 i_block[]
+static int pwrite_locked(unsigned int inode_num, Ext2Inode* inode, unsigned int pos,
+                         const unsigned char* src, unsigned int size) {
+    unsigned int end = pos + size;
+    unsigned int old_blocks;
+    unsigned int first_block;
+    unsigned int end_blocks;
+    unsigned int need = 0;
+    unsigned int prev = FS_LBLOCK_NONE;
+    int first_was_hole;
+    int failed = 0;
+    int last_was_hole;
+    FsAllocRequest req;
+
+    if (end < pos) return -1;
+    if (size == 0) return 0;
+
+    if (end <= EXT2_INLINE_DATA_MAX &&
+        (inode_is_inline(inode) || (fs_inline_data && inode->i_size == 0 && inode->i_blocks == 0))) {
+        if (!inode_is_inline(inode)) {
+            memset(inode->i_block, 0, sizeof(inode->i_block));
+            inode->i_flags |= EXT2_INLINE_DATA_FL;
+        }
+        // 末尾之后的字节恒为 0，越过末尾写入时中间自然补零
+        memcpy((unsigned char*)inode->i_block + pos, src, (int)size);
+        pagecache_write(inode_num, pos, src, size);
+        if (end > inode->i_size) inode->i_size = end;
+        if (!write_inode(inode_num, inode)) return -1;
+        return (int)size;
+    }
+    if (inode_is_inline(inode) && !inline_to_blocks_locked(inode_num, inode)) return -1;
+    old_blocks = (inode->i_size + fs_block_size - 1) / fs_block_size;
+
+    first_block = pos / fs_block_size;
+    end_blocks = (end + fs_block_size - 1) / fs_block_size;
+    memset(&req, 0, sizeof(req));
+    req.inode_num = inode_num;
+
+    for (unsigned int b = first_block; b < end_blocks; b++) {
+        unsigned int missing;
+
+        if (pwrite_block_stays_hole(inode, b, pos, end, src)) continue;
+        missing = bmap_missing(inode, b, prev);
+        if (missing == 0) continue;
+        need += missing;
+        req.want++;
+        prev = b;
+    }
+    if (need > ext2_sb.s_free_blocks_count) return -1;
+
+    // 只有头尾两块可能不是整块覆盖，记下它们原先是否是空洞，新块要从全 0 开始
+    first_was_hole = inode_block_at(inode, first_block) == 0;
+    last_was_hole = inode_block_at(inode, end_blocks - 1) == 0;
+    // 要读改写的头尾块先读一遍 (下面再读时命中块缓存)，读不出来时什么都不改
+    if (pos % fs_block_size != 0 && first_block < old_blocks && !first_was_hole &&
+        !read_block(inode_block_at(inode, first_block), fs_io_block_buf)) return -1;
+    if (end % fs_block_size != 0 && end_blocks - 1 < old_blocks && !last_was_hole &&
+        !read_block(inode_block_at(inode, end_blocks - 1), fs_io_block_buf)) return -1;
+    for (unsigned int b = first_block; b < end_blocks; b++) {
+        if (pwrite_block_stays_hole(inode, b, pos, end, src)) continue;
+        if (!bmap(inode, b, 1, &req)) {
+            // 空间已预先数过，只有文件末尾之后的新块需要回收
+            inode_free_blocks_from(inode, old_blocks > first_block ? old_blocks : first_block);
+            prealloc_release(inode_num);
+            return -1;
+        }
+    }
+
+    for (unsigned int b = first_block; b < end_blocks; b++) {
+        unsigned int block_start = b * fs_block_size;
+        unsigned int from = pos > block_start ? pos - block_start : 0;
+        unsigned int to = end - block_start < fs_block_size ? end - block_start : fs_block_size;
+        unsigned int block_num = inode_block_at(inode, b);
+        int was_hole = (b == first_block && first_was_hole) || (b == end_blocks - 1 && last_was_hole);
+
+        if (!block_num) continue;
+        // 整块覆盖不必先读；文件末尾之后的字节在块内始终为 0
+        if (from != 0 || to != fs_block_size) {
+            if (b >= old_blocks || was_hole) {
+                memset(fs_io_block_buf, 0, fs_block_size);
+            } else if (!read_block(block_num, fs_io_block_buf)) {
+                // 期间被换出后又读失败：保留该块原内容，整体报错
+                failed = 1;
+                continue;
+            }
+        }
+        memcpy(fs_io_block_buf + from, src + (block_start + from - pos), (int)(to - from));
+        write_block(block_num, fs_io_block_buf);
+    }
+    pagecache_write(inode_num, pos, src, size);
+
+    if (end > inode->i_size) inode->i_size = end;
+    inode->i_blocks += req.allocated * fs_sectors_per_block;
+    // 文件仍被打开时保留预留窗口，后续追加可以接着往后写
+    if (!icache_is_pinned(inode_num)) prealloc_release(inode_num);
+    if (!write_inode(inode_num, inode)) return -1;
+    return failed ? -1 : (int)size;
+}
+
+// 把文件长度改为 size：缩短时释放多余的块并清零新末块的尾部；变长时只改长度，
+// 新增部分是空洞 (原末块里末尾之后的字节本来就是 0)。内联文件放不下时先转成块存储
+static int truncate_locked(unsigned int inode_num, Ext2Inode* inode, unsigned int size) {
+    unsigned int keep_blocks = (size + fs_block_size - 1) / fs_block_size;
+    unsigned int freed;
+
+    if (size == inode->i_size) return 1;
+    if (inode_is_inline(inode)) {
+        if (size > EXT2_INLINE_DATA_MAX && !inline_to_blocks_locked(inode_num, inode)) return 0;
+        // 缩短时把新末尾之后的字节清零
+        if (size < inode->i_size) memset((unsigned char*)inode->i_block + size, 0, (int)(inode->i_size - size));
+    } else if (size < inode->i_size) {
+        freed = inode_free_blocks_from(inode, keep_blocks);
+        inode->i_blocks -= freed * fs_sectors_per_block;
+        if (size % fs_block_size != 0) {
+            unsigned int block_num = inode_block_at(inode, size / fs_block_size);
+            // 读不出来时末块尾部保持原样，新长度仍然生效
+            if (block_num && read_block(block_num, fs_io_block_buf)) {
+                memset(fs_io_block_buf + size % fs_block_size, 0, fs_block_size - size % fs_block_size);
+                write_block(block_num, fs_io_block_buf);
+            }
+        }
+    }
+    inode->i_size = size;
+    pagecache_truncate(inode_num, size);
+    return write_inode(inode_num, inode);
+}
+
+// 整个替换文件内容，等价于 pwrite(0) 加截断
+int fs_write_file(const char* filename, const void* buffer, unsigned int size) {
+    SystemFile file;
+    Ext2Inode inode;
+    int result = 0;
+
+    fs_lock_enter();
+    if (!filename || (size > 0 && !buffer)) goto out;
+    if (!sys_file_open(filename, &file) || file.type != 0) goto out;
+    if (!read_inode(file.inode_num, &inode)) goto out;
+
+    // 新内容放得进 inode 时先清空原有的块，让它变成内联文件
+    if (fs_inline_data && size > 0 && size <= EXT2_INLINE_DATA_MAX && !inode_is_inline(&inode) &&
+        !truncate_locked(file.inode_num, &inode, 0)) goto out;
+    if (pwrite_locked(file.inode_num, &inode, 0, (const unsigned char*)buffer, size) != (int)size) goto out;
+    if (!truncate_locked(file.inode_num, &inode, size)) goto out;
+    result = (int)size;
+
+out:
+    fs_lock_leave();
+    return result;
+}
+
+int fs_pwrite_inode(unsigned int inode_num, unsigned int pos, const void* buffer,
+                    unsigned int size, unsigned int* out_file_size) {
+    Ext2Inode inode;
+    int result = -1;
+
+    fs_lock_enter();
+    if (!fs_ready || (size > 0 && !buffer) || !read_inode(inode_num, &inode) ||
+        (inode.i_mode & 0xF000) != 0x8000) goto out;
+    if (pos == FS_POS_APPEND) pos = inode.i_size;
+    result = pwrite_locked(inode_num, &inode, pos, (const unsigned char*)buffer, size);
+    if (out_file_size) *out_file_size = inode.i_size;
+
+out:
+    fs_lock_leave();
+    return result;
+}
+
+int fs_truncate_inode(unsigned int inode_num, unsigned int size) {
+    Ext2Inode inode;
+    int ok = 0;
+
+    fs_lock_enter();
+    if (fs_ready && read_inode(inode_num, &inode) && (inode.i_mode & 0xF000) == 0x8000) {
+        ok = truncate_locked(inode_num, &inode, size);
+    }
+    fs_lock_leave();
+    return ok;
+}
+
+// App 读取接口 (支持流式读取)
+int app_file_read(AppFile* file, void* buffer, unsigned int size) {
+    Ext2Inode inode;
+    int bytes_read;
+
+    if (!fs_ready || !file) return 0;
+    
+    unsigned int bytes_to_read;
+    if (file->current_pos >= file->sys_file.size) return 0;
+
+    bytes_to_read = size;
+    if (bytes_to_read > file->sys_file.size - file->current_pos)
+        bytes_to_read = file->sys_file.size - file->current_pos;
+    
+    if (bytes_to_read == 0) return 0;
+
+    fs_lock_enter();
+    if (!read_inode(file->sys_file.inode_num, &inode)) {
+        fs_lock_leave();
+        return 0;
+    }
+
+    bytes_read = read_inode_range_locked(&inode, file->current_pos, bytes_to_read, buffer);
+    if (bytes_read > 0) readahead_after_read(&inode, &file->readahead, file->current_pos, (unsigned int)bytes_read);
+    fs_lock_leave();
+
+    if (bytes_read > 0) {
+        file->current_pos += (unsigned int)bytes_read;
+    }
+
+    return bytes_read;
+}
+
+// 按 inode 号读取，供已 pin 住 inode 的句柄使用，不再逐次解析路径
+int fs_read_inode_data(unsigned int inode_num, unsigned int pos, void* buffer,
+                       unsigned int size, unsigned int* out_file_size, FsReadahead* ra) {
+    Ext2Inode inode;
+    int bytes_read;
+
+    fs_lock_enter();
+    if (!fs_ready || !buffer || !read_inode(inode_num, &inode) ||
+        (inode.i_mode & 0xF000) != 0x8000) {
+        fs_lock_leave();
+        return -1;
+    }
+    if (out_file_size) *out_file_size = inode.i_size;
+    bytes_read = read_inode_range_locked(&inode, pos, size, buffer);
+    if (bytes_read > 0) readahead_after_read(&inode, ra, pos, (unsigned int)bytes_read);
+    fs_lock_leave();
+    return bytes_read;
+}
+
+// 把文件第 index 页读进页框：物理相邻的块合并成一条命令直接落进页框，孤立块经块缓存，
+// 空洞与文件末尾之后补零。不经 fs_io_block_buf 中转，映射区的缺页即使发生在别的
+// 文件系统操作中途 (例如 tlx_write 的源缓冲在映射里) 也不会踩坏它的中转缓冲。
+// 有块读不出来时返回 0
+static int read_page_locked(const Ext2Inode* inode, unsigned int index, unsigned char* page) {
+    unsigned int per_page = PAGECACHE_PAGE_SIZE / fs_block_size;
+    unsigned int first = index * per_page;
+    unsigned int page_start = index * PAGECACHE_PAGE_SIZE;
+    unsigned int errors = fs_read_errors;
+    unsigned int i = 0;
+
+    if (inode_is_inline(inode)) {
+        memset(page, 0, PAGECACHE_PAGE_SIZE);
+        if (index == 0) memcpy(page, inode->i_block, (int)inode->i_size);
+        return 1;
+    }
+    while (i < per_page) {
+        unsigned int block_num = inode_block_at(inode, first + i);
+        unsigned int run = 1;
+
+        if (block_num == 0) {
+            memset(page + i * fs_block_size, 0, (int)fs_block_size);
+            i++;
+            continue;
+        }
+        while (i + run < per_page && inode_block_at(inode, first + i + run) == block_num + run) run++;
+        // 合并读失败时退回逐块经块缓存读
+        if (run == 1 || bcache_read_direct(block_num, run, page + i * fs_block_size) != 0) {
+            for (unsigned int j = 0; j < run; j++) {
+                if (!read_block(block_num + j, page + (i + j) * fs_block_size)) return 0;
+            }
+        }
+        i += run;
+    }
+    if (inode->i_size - page_start < PAGECACHE_PAGE_SIZE) {
+        memset(page + (inode->i_size - page_start), 0, (int)(PAGECACHE_PAGE_SIZE - (inode->i_size - page_start)));
+    }
+    return fs_read_errors == errors;
+}
+
+void* fs_page_get(unsigned int inode_num, unsigned int index) {
+    Ext2Inode inode;
+    void* page;
+
+    fs_lock_enter();
+    page = pagecache_lookup(inode_num, index);
+    if (!page && fs_ready && read_inode(inode_num, &inode) && (inode.i_mode & 0xF000) == 0x8000 &&
+        index < inode.i_size / PAGECACHE_PAGE_SIZE + (inode.i_size % PAGECACHE_PAGE_SIZE != 0)) {
+        page = pagecache_claim(inode_num, index);
+        if (page && !read_page_locked(&inode, index, (unsigned char*)page)) {
+            pagecache_discard(page);
+            page = 0;
+        }
+    }
+    fs_lock_leave();
+    return page;
+}
+
+void fs_page_put(void* page) {
+    if (!page) return;
+    fs_lock_enter();
+    pagecache_release(page);
+    fs_lock_leave();
+}
+
+static int open_tsk_with_hidden_alias(const char* filename, AppFile* file,
+                                      char actual_name[FS_FILENAME_LEN]) {
+    if (!filename || !file || !actual_name) return 0;
+    copy_trim_hidden_suffix(actual_name, filename, FS_FILENAME_LEN);
+    if (!app_file_open(actual_name, file)) {
+        klog_write_pair("open miss ", actual_name);
+        if (!str_ends_with(filename, HIDDEN_SUFFIX)) {
+            int n = strlen(actual_name);
+            int sfx = strlen(HIDDEN_SUFFIX);
+            if (n + sfx < FS_FILENAME_LEN) {
+                for (int i = 0; i < sfx; i++) actual_name[n + i] = HIDDEN_SUFFIX[i];
+                actual_name[n + sfx] = '\0';
+            }
+        }
+        if (!app_file_open(actual_name, file)) {
+            klog_write_pair("open fail ", actual_name);
+            return 0;
+        }
+    }
+    klog_write_pair("open ok ", actual_name);
+    return 1;
+}
+
+int tsk_probe(const char* filename, TskImageInfo* out_info) {
+    AppFile file;
+    char actual_name[FS_FILENAME_LEN];
+    TskHeader header;
+    unsigned int raw_size;
+    void* legacy_load;
+    int header_bytes;
+
+    if (!filename || !out_info) return 0;
+    memset(out_info, 0, sizeof(*out_info));
+    if (!open_tsk_with_hidden_alias(filename, &file, actual_name)) return 0;
+    raw_size = file.sys_file.size;
+    if (raw_size == 0) { klog_write_pair("size zero ", actual_name); return 0; }
+
+    memset(&header, 0, sizeof(header));
+    header_bytes = app_file_read(&file, &header, sizeof(header));
+    if (header_bytes == (int)sizeof(header) && tsk_header_has_magic(&header)) {
+        if (header.version != TSK_VERSION || header.flags != 0 ||
+            !tsk_load_addr_valid(header.load_addr, header.image_size) ||
+            header.entry_offset >= header.image_size ||
+            raw_size < sizeof(TskHeader) ||
+            header.image_size > raw_size - sizeof(TskHeader)) {
+            klog_write_pair("hdr invalid ", actual_name);
+            return 0;
+        }
+        out_info->load_addr = header.load_addr;
+        out_info->entry_offset = header.entry_offset;
+        out_info->image_size = header.image_size;
+        out_info->inode_num = file.sys_file.inode_num;
+        out_info->has_header = 1;
+        return 1;
+    }
+
+    if (raw_size > MP_APP_SLOT_SIZE) { klog_write_pair("size too big ", actual_name); return 0; }
+    legacy_load = resolve_app_load_address(actual_name);
+    if (!legacy_load) { klog_write_pair("slot fail ", actual_name); return 0; }
+    out_info->load_addr = (unsigned int)legacy_load;
+    out_info->entry_offset = 0;
+    out_info->image_size = raw_size;
+    out_info->inode_num = file.sys_file.inode_num;
+    out_info->has_header = 0;
+    return 1;
+}
+
+int tsk_load_to(const char* filename, void* destination, const TskImageInfo* expected) {
+    AppFile file;
+    char actual_name[FS_FILENAME_LEN];
+    TskHeader header;
+    int read_result;
+
+    if (!filename || !destination || !expected || expected->image_size == 0 ||
+        expected->image_size > MP_APP_SLOT_SIZE) return 0;
+    if (!open_tsk_with_hidden_alias(filename, &file, actual_name)) return 0;
+    if (file.sys_file.inode_num != expected->inode_num) {
+        klog_write_pair("inode changed ", actual_name);
+        return 0;
+    }
+
+    memset(destination, 0, MP_APP_SLOT_SIZE);
+    if (expected->has_header) {
+        memset(&header, 0, sizeof(header));
+        if (app_file_read(&file, &header, sizeof(header)) != (int)sizeof(header) ||
+            !tsk_header_has_magic(&header) || header.version != TSK_VERSION ||
+            header.flags != 0 || header.load_addr != expected->load_addr ||
+            header.entry_offset != expected->entry_offset ||
+            header.image_size != expected->image_size) {
+            klog_write_pair("hdr changed ", actual_name);
+            return 0;
+        }
+        read_result = app_file_read(&file, destination, expected->image_size);
+        if ((unsigned int)read_result != expected->image_size ||
+            tsk_checksum32((const unsigned char*)destination, expected->image_size) !=
+                header.image_checksum) {
+            memset(destination, 0, MP_APP_SLOT_SIZE);
+            klog_write_pair("hdr data bad ", actual_name);
+            return 0;
+        }
+        klog_write_pair("hdr read ok ", actual_name);
+        return 1;
+    }
+
+    file.current_pos = 0;
+    read_result = app_file_read(&file, destination, expected->image_size);
+    if ((unsigned int)read_result != expected->image_size) {
+        memset(destination, 0, MP_APP_SLOT_SIZE);
+        klog_write_pair("read fail ", actual_name);
+        return 0;
+    }
+    klog_write_pair("read ok ", actual_name);
+    return 1;
+}
+
+int tsk_load(const char* filename, void** out_entry,
+             unsigned int* out_load_base, unsigned int* out_image_size) {
+    TskImageInfo info;
+    if (!filename || !out_entry) return 0;
+    if (out_load_base) *out_load_base = 0;
+    if (out_image_size) *out_image_size = 0;
+    if (!tsk_probe(filename, &info) ||
+        !tsk_load_to(filename, (void*)info.load_addr, &info)) return 0;
+    if (out_load_base) *out_load_base = info.load_addr;
+    if (out_image_size) *out_image_size = info.image_size;
+    *out_entry = (void*)(info.load_addr + info.entry_offset);
+    return 1;
+}
+
+
+// ===== Public file management API =====
+
+int fs_create_file(const char* path) {
+    char dir_name[FS_FILENAME_LEN];
+    char base_name[FS_FILENAME_LEN];
+    unsigned int dir_inode_num;
+    unsigned int new_inode_num;
+    Ext2Inode new_inode;
+
+    fs_lock_enter();
+    if (!fs_ready || !path) {
+        fs_lock_leave();
+        return 0;
+    }
+    if (!split_lookup_path(path, dir_name, sizeof(dir_name), base_name, sizeof(base_name))) {
+        fs_lock_leave();
+        return 0;
+    }
+    dir_inode_num = EXT2_ROOT_INODE;
+    if (dir_name[0]) {
+        dir_inode_num = find_file_in_dir(dir_name, EXT2_ROOT_INODE);
+        if (!dir_inode_num) { fs_lock_leave(); return 0; }
+    }
+    if (find_file_in_dir(base_name, dir_inode_num)) {
+        fs_lock_leave();
+        return -1;
+    }
+    new_inode_num = alloc_inode(dir_inode_num, 0);
+    if (!new_inode_num) { fs_lock_leave(); return 0; }
+
+    memset(&new_inode, 0, sizeof(new_inode));
+    new_inode.i_mode = 0x81A4;
+    new_inode.i_size = 0;
+    new_inode.i_links_count = 1;
+    new_inode.i_blocks = 0;
+    if (!write_inode(new_inode_num, &new_inode)) {
+        free_inode(new_inode_num);
+        fs_lock_leave();
+        return 0;
+    }
+    if (!add_dir_entry(dir_inode_num, new_inode_num, base_name, EXT2_FT_REG_FILE)) {
+        free_inode(new_inode_num);
+        fs_lock_leave();
+        return 0;
+    }
+    fs_lock_leave();
+    return 1;
+}
+
+int fs_delete_file(const char* path) {
+    char dir_name[FS_FILENAME_LEN];
+    char base_name[FS_FILENAME_LEN];
+    unsigned int dir_inode_num;
+    unsigned int inode_num;
+    Ext2Inode inode;
+
+    fs_lock_enter();
+    if (!fs_ready || !path) { fs_lock_leave(); return 0; }
+    if (!split_lookup_path(path, dir_name, sizeof(dir_name), base_name, sizeof(base_name))) {
+        fs_lock_leave(); return 0;
+    }
+    dir_inode_num = EXT2_ROOT_INODE;
+    if (dir_name[0]) {
+        dir_inode_num = find_file_in_dir(dir_name, EXT2_ROOT_INODE);
+        if (!dir_inode_num) { fs_lock_leave(); return 0; }
+    }
+    inode_num = find_file_in_dir(base_name, dir_inode_num);
+    if (!inode_num) { fs_lock_leave(); return 0; }
+    if (!read_inode(inode_num, &inode)) { fs_lock_leave(); return 0; }
+    if ((inode.i_mode & 0xF000) == 0x4000) { fs_lock_leave(); return -1; }
+
+    inode_free_blocks_from(&inode, 0);
+    prealloc_release(inode_num);
+    pagecache_forget(inode_num);
+
+    memset(&inode, 0, sizeof(inode));
+    inode.i_dtime = 1;
+    write_inode(inode_num, &inode);
+    free_inode(inode_num);
+    remove_dir_entry(dir_inode_num, base_name);
+
+    fs_lock_leave();
+    return 1;
+}
+
+int fs_mkdir(const char* path) {
+    char dir_name[FS_FILENAME_LEN];
+    char base_name[FS_FILENAME_LEN];
+    unsigned int dir_inode_num;
+    unsigned int new_inode_num;
+    unsigned int new_block_num;
+    Ext2Inode new_inode;
+    unsigned char* block_buf;
+
+    fs_lock_enter();
+    if (!fs_ready || !path) { fs_lock_leave(); return 0; }
+    if (!split_lookup_path(path, dir_name, sizeof(dir_name), base_name, sizeof(base_name))) {
+        fs_lock_leave(); return 0;
+    }
+    dir_inode_num = EXT2_ROOT_INODE;
+    if (dir_name[0]) {
+        dir_inode_num = find_file_in_dir(dir_name, EXT2_ROOT_INODE);
+        if (!dir_inode_num) { fs_lock_leave(); return 0; }
+    }
+    if (find_file_in_dir(base_name, dir_inode_num)) { fs_lock_leave(); return -1; }
+
+    new_inode_num = alloc_inode(dir_inode_num, 1);
+    if (!new_inode_num) { fs_lock_leave(); return 0; }
+    new_block_num = alloc_block(group_data_start(inode_group(new_inode_num)), 0);
+    if (!new_block_num) {
+        free_inode(new_inode_num);
+        fs_lock_leave();
+        return 0;
+    }
+
+    memset(&new_inode, 0, sizeof(new_inode));
+    new_inode.i_mode = 0x41ED;
+    new_inode.i_size = fs_block_size;
+    new_inode.i_links_count = 2;
+    new_inode.i_blocks = fs_sectors_per_block;
+    new_inode.i_block[0] = new_block_num;
+    if (!write_inode(new_inode_num, &new_inode)) {
+        free_block(new_block_num);
+        free_inode(new_inode_num);
+        fs_lock_leave();
+        return 0;
+    }
+
+    block_buf = (unsigned char*)malloc(fs_block_size);
+    if (!block_buf) {
+        free_block(new_block_num);
+        free_inode(new_inode_num);
+        fs_lock_leave();
+        return 0;
+    }
+    memset(block_buf, 0, fs_block_size);
+    {
+        Ext2DirEntry* dot = (Ext2DirEntry*)block_buf;
+        dot->inode = new_inode_num;
+        dot->rec_len = 12;
+        dot->name_len = 1;
+        dot->file_type = EXT2_FT_DIR;
+        dot->name[0] = '.';
+
+        Ext2DirEntry* dotdot = (Ext2DirEntry*)(block_buf + 12);
+        dotdot->inode = dir_inode_num;
+        dotdot->rec_len = fs_block_size - 12;
+        dotdot->name_len = 2;
+        dotdot->file_type = EXT2_FT_DIR;
+        dotdot->name[0] = '.';
+        dotdot->name[1] = '.';
+    }
+    write_meta_block(new_block_num, block_buf);
+    free(block_buf);
+
+    if (!add_dir_entry(dir_inode_num, new_inode_num, base_name, EXT2_FT_DIR)) {
+        free_block(new_block_num);
+        free_inode(new_inode_num);
+        fs_lock_leave();
+        return 0;
+    }
+    {
+        Ext2Inode parent_inode;
+        if (read_inode(dir_inode_num, &parent_inode)) {
+            parent_inode.i_links_count++;
+            write_inode(dir_inode_num, &parent_inode);
+        }
+    }
+    fs_groups[inode_group(new_inode_num)].bg_used_dirs_count++;
+    group_desc_dirty(inode_group(new_inode_num));
+
+    fs_lock_leave();
+    return 1;
+}
+
+
+// 修复后的 fs_list_files
+void fs_list_files() {
+    Ext2Inode root_inode;
+    unsigned int blocks;
+
+    fs_lock_enter();
+    if (!fs_ready || !read_inode(EXT2_ROOT_INODE, &root_inode) || root_inode.i_block[0] == 0) {
+        fs_lock_leave();
+        return;
+    }
+
+    blocks = dir_block_count(&root_inode);
+    for (unsigned int b = 0; b < blocks; b++) {
+        unsigned int block_num = dir_block_at(&root_inode, b);
+        unsigned int pos = 0;
+
+        if (block_num == 0) break;
+        if (!read_meta_block(block_num, fs_dir_block_buf)) break;
+        while (pos < fs_block_size) {
+            unsigned int rec_len;
+            unsigned int name_len;
+            if (!dir_entry_bounds(fs_dir_block_buf, pos, &rec_len, &name_len)) break;
+            pos += rec_len;
+        }
+    }
+    fs_lock_leave();
+}
+
+
+// 从 *cursor (目录内字节偏移) 起依次把有效目录项交给 visit；visit 返回 0 表示装不下，
+// 游标停在该项上，下次从这里继续。每块只读一次，游标之前的项只走 rec_len 不拷贝。
+// 返回 1 表示走到目录末尾，0 表示被 visit 提前叫停，-1 表示目录块损坏
+typedef int (*DirVisitFn)(void* ctx, const Ext2DirEntry* entry, unsigned int name_len);
+
+static int dir_walk_locked(const Ext2Inode* dir_inode, unsigned int* cursor, DirVisitFn visit, void* ctx) {
+    unsigned int blocks = dir_block_count(dir_inode);
+
+    for (unsigned int b = *cursor / fs_block_size; b < blocks; b++) {
+        unsigned int block_num = dir_block_at(dir_inode, b);
+        unsigned int base = b * fs_block_size;
+        unsigned int pos = 0;
+
+        if (block_num == 0) return -1;
+        if (!read_meta_block(block_num, fs_dir_block_buf)) return -1;
+        while (pos < fs_block_size) {
+            const Ext2DirEntry* entry;
+            unsigned int rec_len;
+            unsigned int name_len;
+
+            if (!dir_entry_bounds(fs_dir_block_buf, pos, &rec_len, &name_len)) return -1;
+            entry = (const Ext2DirEntry*)(fs_dir_block_buf + pos);
+            if (base + pos >= *cursor && entry->inode != 0) {
+                *cursor = base + pos;
+                if (!visit(ctx, entry, name_len)) return 0;
+            }
+            pos += rec_len;
+        }
+        *cursor = base + fs_block_size;
+    }
+    return 1;
+}
+
+static int dir_entry_is_dot(const Ext2DirEntry* entry, unsigned int name_len) {
+    return (name_len == 1 && entry->name[0] == '.') ||
+           (name_len == 2 && entry->name[0] == '.' && entry->name[1] == '.');
+}
+
+typedef struct {
+    char* buffer;
+    int max_len;
+    int buf_idx;
+} DirTextList;
+
+static int dir_visit_text(void* ctx, const Ext2DirEntry* entry, unsigned int name_len) {
+    DirTextList* list = (DirTextList*)ctx;
+
+    if (dir_entry_is_dot(entry, name_len)) return 1;
+    if (list->buf_idx + (int)name_len + 1 < list->max_len) {
+        memcpy(list->buffer + list->buf_idx, entry->name, (int)name_len);
+        list->buf_idx += (int)name_len;
+        list->buffer[list->buf_idx++] = '\n';
+    }
+    return 1;
+}
+
+// 【修复】获取真实的文件列表
+int fs_get_file_list(char* buffer, int max_len, const char* dir_path) {
+    Ext2Inode dir_inode;
+    unsigned int dir_inode_num;
+    unsigned int cursor = 0;
+    DirTextList list;
+
+    if (!buffer || max_len <= 0) return 0;
+    buffer[0] = '\0';
+    fs_lock_enter();
+    if (!fs_ready) {
+        fs_lock_leave();
+        return 0;
+    }
+
+    dir_inode_num = resolve_dir_inode(dir_path);
+    if (!dir_inode_num || !read_inode(dir_inode_num, &dir_inode) ||
+        (dir_inode.i_mode & 0xF000) != 0x4000 || dir_inode.i_block[0] == 0) {
+        fs_lock_leave();
+        return 0;
+    }
+
+    list.buffer = buffer;
+    list.max_len = max_len;
+    list.buf_idx = 0;
+    if (dir_walk_locked(&dir_inode, &cursor, dir_visit_text, &list) < 0) {
+        buffer[0] = '\0';
+        fs_lock_leave();
+        return 0;
+    }
+    buffer[list.buf_idx] = '\0';
+    fs_lock_leave();
+    return 1;
+}
+
+typedef struct {
+    FsDirEntry* out;
+    unsigned int max;
+    unsigned int count;
+} DirRecordList;
+
+static int dir_visit_record(void* ctx, const Ext2DirEntry* entry, unsigned int name_len) {
+    DirRecordList* list = (DirRecordList*)ctx;
+    FsDirEntry* record;
+    Ext2Inode inode;
+
+    if (dir_entry_is_dot(entry, name_len)) return 1;
+    if (list->count >= list->max) return 0;
+    record = &list->out[list->count];
+    if (name_len > FS_FILENAME_LEN - 1) name_len = FS_FILENAME_LEN - 1;
+    memset(record, 0, sizeof(*record));
+    memcpy(record->name, entry->name, (int)name_len);
+    record->inode = entry->inode;
+    // read_inode 走 inode 表缓冲，不会覆盖正在遍历的目录块
+    if (read_inode(entry->inode, &inode)) {
+        record->size = inode.i_size;
+        record->type = (inode.i_mode & 0xF000) == 0x4000 ? 1 : 0;
+    }
+    list->count++;
+    return 1;
+}
+
+int fs_read_dir(unsigned int dir_inode_num, unsigned int* cursor, FsDirEntry* out, unsigned int max) {
+    Ext2Inode dir_inode;
+    DirRecordList list;
+
+    if (!cursor || !out || max == 0) return -1;
+    fs_lock_enter();
+    if (!fs_ready || !read_inode(dir_inode_num, &dir_inode) || (dir_inode.i_mode & 0xF000) != 0x4000) {
+        fs_lock_leave();
+        return -1;
+    }
+    list.out = out;
+    list.max = max;
+    list.count = 0;
+    if (dir_walk_locked(&dir_inode, cursor, dir_visit_record, &list) < 0) {
+        fs_lock_leave();
+        return -1;
+    }
+    fs_lock_leave();
+    return (int)list.count;
+}
@@ -0,0 +1,418 @@
+// ahci.c - AHCI SATA 控制器：命令列表、FIS 接收区、NCQ 命令槽
+#include "ahci.h"
+#include "heap.h"
+#include "paging.h"
+#include "pci.h"
+
+// HBA 全局寄存器
+#define HBA_CAP   0x00
+#define HBA_GHC   0x04
+#define HBA_IS    0x08
+#define HBA_PI    0x0C
+#define HBA_PORTS 0x100
+#define HBA_PORT_SIZE 0x80
+#define HBA_MMIO_SIZE (HBA_PORTS + 32 * HBA_PORT_SIZE)
+
+#define CAP_NCS_SHIFT 8       // 命令槽数 - 1，5 位
+#define CAP_SNCQ  (1u << 30)
+#define GHC_IE    (1u << 1)
+#define GHC_AE    (1u << 31)
+
+// 端口寄存器 (相对端口基址)
+#define PX_CLB    0x00
+#define PX_CLBU   0x04
+#define PX_FB     0x08
+#define PX_FBU    0x0C
+#define PX_IS     0x10
+#define PX_IE     0x14
+#define PX_CMD    0x18
+#define PX_TFD    0x20
+#define PX_SIG    0x24
+#define PX_SSTS   0x28
+#define PX_SERR   0x30
+#define PX_SACT   0x34
+#define PX_CI     0x38
+
+#define PX_CMD_ST  (1u << 0)
+#define PX_CMD_FRE (1u << 4)
+#define PX_CMD_FR  (1u << 14)
+#define PX_CMD_CR  (1u << 15)
+
+#define PX_IS_DHRS (1u << 0)  // 收到 D2H 寄存器 FIS (非 NCQ 命令结束)
+#define PX_IS_SDBS (1u << 3)  // 收到 Set Device Bits FIS (NCQ 命令结束)
+#define PX_IS_IFS  (1u << 27)
+#define PX_IS_HBDS (1u << 28)
+#define PX_IS_HBFS (1u << 29)
+#define PX_IS_TFES (1u << 30)
+#define PX_IS_ERRORS (PX_IS_IFS | PX_IS_HBDS | PX_IS_HBFS | PX_IS_TFES)
+
+#define TFD_BSY   0x80
+#define TFD_DRQ   0x08
+#define TFD_ERR   0x01
+
+#define SATA_SIG_ATA  0x00000101u
+#define SSTS_DET_PRESENT 3
+
+#define FIS_TYPE_H2D  0x27
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_READ_FPDMA      0x60
+#define ATA_CMD_WRITE_FPDMA     0x61
+#define ATA_CMD_FLUSH_EXT       0xEA
+#define ATA_CMD_IDENTIFY        0xEC
+
+#define AHCI_TIMEOUT 1000000
+
+typedef struct {
+    unsigned int flags;       // 0-4 命令 FIS 长度 (dword)，6 写，16-31 描述符表项数
+    volatile unsigned int prdbc;
+    unsigned int ctba;
+    unsigned int ctbau;
+    unsigned int reserved[4];
+} AhciCommandHeader;
+
+typedef struct {
+    unsigned int dba;
+    unsigned int dbau;
+    unsigned int reserved;
+    unsigned int dbc;         // 0-21 字节数 - 1
+} AhciPrd;
+
+typedef struct {
+    unsigned char cfis[64];
+    unsigned char acmd[16];
+    unsigned char reserved[48];
+    AhciPrd prdt[AHCI_PRD_ENTRIES];
+} AhciCommandTable;
+
+static volatile unsigned char* ahci_abar = 0;
+static volatile unsigned char* ahci_port = 0;
+static unsigned int ahci_port_index = 0;
+static AhciCommandHeader* ahci_cmd_list = 0;
+static AhciCommandTable* ahci_tables = 0;
+static unsigned int ahci_slots = 0;
+static unsigned int ahci_depth = 0;
+static int ahci_ncq = 0;
+static unsigned int ahci_sectors = 0;
+static int ahci_irq = 0;
+static void* ahci_fis = 0;
+// IDENTIFY 的数据只在初始化时用一次；内核数据段恒等映射，可以直接给 DMA
+static unsigned short ahci_ident[SECTOR_SIZE / 2] __attribute__((aligned(4)));
+static DiskRequest* ahci_slot_req[32];
+static unsigned int ahci_issued = 0;    // 已发出、还没取走的槽
+static unsigned int ahci_flushing = 0;  // 写已完成、正在 FLUSH 的槽 (非 NCQ)
+static unsigned int ahci_failed = 0;    // 出错后待以 -1 交还的槽
+
+static unsigned int hba_read(unsigned int reg) {
+    return *(volatile unsigned int*)(ahci_abar + reg);
+}
+
+static void hba_write(unsigned int reg, unsigned int value) {
+    *(volatile unsigned int*)(ahci_abar + reg) = value;
+}
+
+static unsigned int port_read(unsigned int reg) {
+    return *(volatile unsigned int*)(ahci_port + reg);
+}
+
+static void port_write(unsigned int reg, unsigned int value) {
+    *(volatile unsigned int*)(ahci_port + reg) = value;
+}
+
+static int port_wait_clear(unsigned int reg, unsigned int bits) {
+    for (int i = 0; i < AHCI_TIMEOUT; i++) {
+        if (!(port_read(reg) & bits)) return 1;
+    }
+    return 0;
+}
+
+static int port_stop(void) {
+    port_write(PX_CMD, port_read(PX_CMD) & ~PX_CMD_ST);
+    if (!port_wait_clear(PX_CMD, PX_CMD_CR)) return 0;
+    port_write(PX_CMD, port_read(PX_CMD) & ~PX_CMD_FRE);
+    return port_wait_clear(PX_CMD, PX_CMD_FR);
+}
+
+static int port_start(void) {
+    port_write(PX_SERR, 0xFFFFFFFFu);
+    port_write(PX_IS, 0xFFFFFFFFu);
+    port_write(PX_CMD, port_read(PX_CMD) | PX_CMD_FRE);
+    if (!port_wait_clear(PX_TFD, TFD_BSY | TFD_DRQ)) return 0;
+    port_write(PX_CMD, port_read(PX_CMD) | PX_CMD_ST);
+    return 1;
+}
+
+// 填命令 FIS：48 位 LBA；count 在 NCQ 命令里放在 feature 字段，tag 放在 count 字段
+static void build_fis(unsigned int slot, unsigned char command, unsigned int lba,
+                      unsigned int count, unsigned char device) {
+    unsigned char* fis = ahci_tables[slot].cfis;
+
+    memset(fis, 0, sizeof(ahci_tables[slot].cfis));
+    fis[0] = FIS_TYPE_H2D;
+    fis[1] = 0x80;            // C = 1：这是命令
+    fis[2] = command;
+    fis[4] = (unsigned char)lba;
+    fis[5] = (unsigned char)(lba >> 8);
+    fis[6] = (unsigned char)(lba >> 16);
+    fis[7] = device;
+    fis[8] = (unsigned char)(lba >> 24);
+    if (command == ATA_CMD_READ_FPDMA || command == ATA_CMD_WRITE_FPDMA) {
+        fis[3] = (unsigned char)count;
+        fis[11] = (unsigned char)(count >> 8);
+        fis[12] = (unsigned char)(slot << 3);
+    } else {
+        fis[12] = (unsigned char)count;
+        fis[13] = (unsigned char)(count >> 8);
+    }
+}
+
+static void set_header(unsigned int slot, int write, unsigned int prds) {
+    ahci_cmd_list[slot].flags = 5 | (write ? (1u << 6) : 0) | (prds << 16);
+    ahci_cmd_list[slot].prdbc = 0;
+}
+
+// 物理上紧接的段并成一项；AHCI 的描述符没有 64 KiB 边界限制，单项至多 4 MiB
+static int build_prdt(unsigned int slot, const DiskRequest* cmd) {
+    AhciPrd* prdt = ahci_tables[slot].prdt;
+    int n = 0;
+
+    for (const DiskRequest* seg = cmd; seg; seg = seg->merged) {
+        unsigned int bytes = seg->count * SECTOR_SIZE;
+
+        if (!seg->phys || (seg->phys & 1)) return -1;
+        if (n > 0 && prdt[n - 1].dba + (prdt[n - 1].dbc + 1) == seg->phys) {
+            prdt[n - 1].dbc += bytes;
+            continue;
+        }
+        if (n == AHCI_PRD_ENTRIES) return -1;
+        prdt[n].dba = seg->phys;
+        prdt[n].dbau = 0;
+        prdt[n].reserved = 0;
+        prdt[n].dbc = bytes - 1;
+        n++;
+    }
+    return n;
+}
+
+// 初始化时同步执行一条命令 (关中断、轮询)
+static int run_polled(unsigned int slot) {
+    port_write(PX_CI, 1u << slot);
+    for (int i = 0; i < AHCI_TIMEOUT; i++) {
+        if (port_read(PX_IS) & PX_IS_TFES) return 0;
+        if (!(port_read(PX_CI) & (1u << slot))) return !(port_read(PX_TFD) & TFD_ERR);
+    }
+    return 0;
+}
+
+static int identify(unsigned short* ident) {
+    build_fis(0, ATA_CMD_IDENTIFY, 0, 0, 0);
+    ahci_tables[0].prdt[0].dba = (unsigned int)ident;
+    ahci_tables[0].prdt[0].dbau = 0;
+    ahci_tables[0].prdt[0].dbc = SECTOR_SIZE - 1;
+    set_header(0, 0, 1);
+    return run_polled(0);
+}
+
+static int find_port(unsigned int implemented) {
+    for (unsigned int i = 0; i < 32; i++) {
+        volatile unsigned char* port = ahci_abar + HBA_PORTS + i * HBA_PORT_SIZE;
+        if (!(implemented & (1u << i))) continue;
+        if ((*(volatile unsigned int*)(port + PX_SSTS) & 0xF) != SSTS_DET_PRESENT) continue;
+        if (*(volatile unsigned int*)(port + PX_SIG) != SATA_SIG_ATA) continue;
+        ahci_port = port;
+        ahci_port_index = i;
+        return 1;
+    }
+    return 0;
+}
+
+// 初始化失败时交还已分配的内存，端口不再引用它们
+static void release_memory(void) {
+    free_aligned(ahci_cmd_list);
+    free_aligned(ahci_tables);
+    free_aligned(ahci_fis);
+    ahci_cmd_list = 0;
+    ahci_tables = 0;
+    ahci_fis = 0;
+    ahci_abar = 0;
+}
+
+int ahci_init(void) {
+    PciDeviceInfo dev;
+    unsigned int abar;
+    unsigned int cap;
+    unsigned short cmd;
+
+    if (!pci_find_first_by_class(0x01, 0x06, &dev) || dev.prog_if != 0x01) return 0;
+    abar = dev.bar[5] & 0xFFFFFFF0u;
+    if (abar == 0 || (dev.bar[5] & 0x1)) return 0;
+
+    // 开启 Memory Space + Bus Master
+    cmd = pci_config_read_word(dev.bus, dev.slot, dev.func, 0x04);
+    cmd |= 0x0006;
+    pci_config_write_word(dev.bus, dev.slot, dev.func, 0x04, cmd);
+    if (paging_is_enabled() && !paging_map_identity_range(abar, HBA_MMIO_SIZE)) return 0;
+    ahci_abar = (volatile unsigned char*)abar;
+
+    hba_write(HBA_GHC, hba_read(HBA_GHC) | GHC_AE);
+    cap = hba_read(HBA_CAP);
+    ahci_slots = ((cap >> CAP_NCS_SHIFT) & 0x1F) + 1;
+    if (!find_port(hba_read(HBA_PI)) || !port_stop()) {
+        ahci_abar = 0;
+        return 0;
+    }
+
+    // 命令列表 1 KiB 对齐，FIS 接收区 256 字节对齐，命令表 128 字节对齐
+    ahci_cmd_list = (AhciCommandHeader*)malloc_aligned(32 * sizeof(AhciCommandHeader), 1024);
+    ahci_tables = (AhciCommandTable*)malloc_aligned(ahci_slots * sizeof(AhciCommandTable), 128);
+    ahci_fis = malloc_aligned(256, 256);
+    if (!ahci_cmd_list || !ahci_tables || !ahci_fis) {
+        release_memory();
+        return 0;
+    }
+    for (unsigned int i = 0; i < ahci_slots; i++) {
+        ahci_cmd_list[i].ctba = (unsigned int)&ahci_tables[i];
+        ahci_cmd_list[i].ctbau = 0;
+    }
+    port_write(PX_CLB, (unsigned int)ahci_cmd_list);
+    port_write(PX_CLBU, 0);
+    port_write(PX_FB, (unsigned int)ahci_fis);
+    port_write(PX_FBU, 0);
+    port_write(PX_IE, 0);
+    if (!port_start() || !identify(ahci_ident)) {
+        // 端口停不下来时控制器可能还在用命令列表与 FIS 区，只好不还
+        if (port_stop()) release_memory();
+        else ahci_abar = 0;
+        return 0;
+    }
+
+    // IDENTIFY 第 76 字第 8 位：支持 NCQ；第 75 字低 5 位：队列深度 - 1
+    ahci_ncq = (cap & CAP_SNCQ) && (ahci_ident[76] & (1u << 8));
+    ahci_depth = 1;
+    if (ahci_ncq) {
+        ahci_depth = (ahci_ident[75] & 0x1F) + 1u;
+        if (ahci_depth > ahci_slots) ahci_depth = ahci_slots;
+    }
+    ahci_sectors = disk_identify_capacity(ahci_ident);
+
+    // 完成与出错都来中断；线接在从片的 IRQ9..11 上 (kernel_entry.asm 里接了这三条) 才打开
+    port_write(PX_IS, 0xFFFFFFFFu);
+    hba_write(HBA_IS, 0xFFFFFFFFu);
+    port_write(PX_IE, PX_IS_DHRS | PX_IS_SDBS | PX_IS_ERRORS);
+    if (dev.irq_line >= 9 && dev.irq_line <= 11) {
+        hba_write(HBA_GHC, hba_read(HBA_GHC) | GHC_IE);
+        outb(0xA1, inb(0xA1) & (unsigned char)~(1 << (dev.irq_line - 8)));
+        ahci_irq = 1;
+    }
+    return 1;
+}
+
+int ahci_available(void) {
+    return ahci_abar != 0;
+}
+
+unsigned int ahci_queue_depth(void) {
+    return ahci_depth;
+}
+
+unsigned int ahci_capacity(void) {
+    return ahci_sectors;
+}
+
+unsigned int ahci_in_flight(void) {
+    unsigned int n = 0;
+    for (unsigned int bits = ahci_issued; bits; bits &= bits - 1) n++;
+    return n;
+}
+
+int ahci_irq_enabled(void) {
+    return ahci_irq;
+}
+
+int ahci_issue(DiskRequest* cmd) {
+    unsigned int slot;
+    unsigned int sectors = 0;
+    int prds;
+
+    if (ahci_in_flight() >= ahci_depth) return 0;
+    for (slot = 0; slot < ahci_depth; slot++) {
+        if (!(ahci_issued & (1u << slot))) break;
+    }
+    if (slot == ahci_depth) return 0;
+
+    prds = build_prdt(slot, cmd);
+    if (prds < 0) return -1;
+    for (const DiskRequest* seg = cmd; seg; seg = seg->merged) sectors += seg->count;
+    if (ahci_ncq) {
+        // device 第 6 位固定为 1，第 7 位 FUA：写完即落盘，不再单独 FLUSH
+        build_fis(slot, cmd->write ? ATA_CMD_WRITE_FPDMA : ATA_CMD_READ_FPDMA, cmd->lba, sectors,
+                  cmd->write ? 0xC0 : 0x40);
+    } else {
+        build_fis(slot, cmd->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT, cmd->lba, sectors, 0x40);
+    }
+    set_header(slot, cmd->write, (unsigned int)prds);
+
+    ahci_slot_req[slot] = cmd;
+    ahci_issued |= 1u << slot;
+    if (ahci_ncq) port_write(PX_SACT, 1u << slot);
+    port_write(PX_CI, 1u << slot);
+    return 1;
+}
+
+// 端口停下后清错误重新启动；在途的槽全部记为失败
+static void port_recover(void) {
+    port_stop();
+    port_write(PX_SERR, 0xFFFFFFFFu);
+    port_start();
+    ahci_failed |= ahci_issued;
+    ahci_flushing = 0;
+}
+
+static DiskRequest* take_slot(unsigned int slot) {
+    DiskRequest* req = ahci_slot_req[slot];
+
+    ahci_slot_req[slot] = 0;
+    ahci_issued &= ~(1u << slot);
+    ahci_failed &= ~(1u << slot);
+    return req;
+}
+
+DiskRequest* ahci_reap(int* status) {
+    unsigned int pending;
+    unsigned int busy;
+
+    if (!ahci_abar) return 0;
+    // 先清端口的中断状态，再清 HBA 上本端口那一位
+    pending = port_read(PX_IS);
+    if (pending) {
+        port_write(PX_IS, pending);
+        hba_write(HBA_IS, 1u << ahci_port_index);
+    }
+    if ((pending & PX_IS_ERRORS) && ahci_issued) port_recover();
+
+    for (unsigned int slot = 0; slot < ahci_depth; slot++) {
+        if (ahci_failed & (1u << slot)) {
+            *status = -1;
+            return take_slot(slot);
+        }
+    }
+
+    busy = port_read(PX_CI) | port_read(PX_SACT);
+    for (unsigned int slot = 0; slot < ahci_depth; slot++) {
+        unsigned int bit = 1u << slot;
+        if (!(ahci_issued & bit) || (busy & bit)) continue;
+
+        // 非 NCQ 的写：数据已到驱动器缓存，同一个槽接着发 FLUSH CACHE EXT
+        if (!ahci_ncq && ahci_slot_req[slot]->write && !(ahci_flushing & bit)) {
+            ahci_flushing |= bit;
+            build_fis(slot, ATA_CMD_FLUSH_EXT, 0, 0, 0);
+            set_header(slot, 0, 0);
+            port_write(PX_CI, bit);
+            continue;
+        }
+        ahci_flushing &= ~bit;
+        *status = 0;
+        return take_slot(slot);
+    }
+    return 0;
+}
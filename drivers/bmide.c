@@ -0,0 +1,114 @@
+// bmide.c - PCI IDE 总线主控 DMA：描述符表与总线主控寄存器
+#include "bmide.h"
+#include "pci.h"
+
+// 主通道的总线主控寄存器 (相对 BAR4 基址)；从通道在 +8，这里不用
+#define BM_COMMAND 0x0
+#define BM_STATUS  0x2
+#define BM_PRDT    0x4
+
+#define BM_CMD_START 0x01
+#define BM_CMD_READ  0x08     // 方向：设备 -> 内存
+#define BM_ST_ERROR  0x02
+#define BM_ST_IRQ    0x04
+#define BM_ST_KEEP   0x60     // 两个驱动器的 "DMA capable" 位，写状态时保留
+
+#define PRD_EOT      0x8000   // 表的最后一项
+#define PRD_MAX      0x10000u
+
+typedef struct {
+    unsigned int addr;
+    unsigned short bytes;     // 0 表示 64 KiB
+    unsigned short flags;
+} __attribute__((packed)) BmidePrd;
+
+// 描述符表本身要 4 字节对齐且不跨 64 KiB；内核数据段恒等映射，虚拟地址即物理地址
+static BmidePrd bmide_prdt[BMIDE_PRD_ENTRIES] __attribute__((aligned(sizeof(BmidePrd) * BMIDE_PRD_ENTRIES)));
+static unsigned short bmide_base = 0;
+static unsigned char bmide_direction = 0;
+
+static inline void outl(unsigned short port, unsigned int value) {
+    __asm__ __volatile__("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+void bmide_init(void) {
+    PciDeviceInfo dev;
+    unsigned short cmd;
+
+    bmide_base = 0;
+    if (!pci_find_first_by_class(0x01, 0x01, &dev)) return;
+    // 编程接口第 7 位：支持总线主控；第 0 位：主通道在 PCI 原生模式，
+    // 端口和中断不再是 0x1F0 / IRQ14，disk.c 不认，只用兼容模式
+    if (!(dev.prog_if & 0x80) || (dev.prog_if & 0x01)) return;
+    if (!(dev.bar[4] & 0x1) || (dev.bar[4] & 0xFFFCu) == 0) return;
+
+    // 打开 I/O 空间译码与总线主控
+    cmd = pci_config_read_word(dev.bus, dev.slot, dev.func, 0x04);
+    cmd |= 0x0005;
+    pci_config_write_word(dev.bus, dev.slot, dev.func, 0x04, cmd);
+
+    bmide_base = (unsigned short)(dev.bar[4] & 0xFFFCu);
+    outb(bmide_base + BM_COMMAND, 0);
+    outb(bmide_base + BM_STATUS, (inb(bmide_base + BM_STATUS) & BM_ST_KEEP) | BM_ST_ERROR | BM_ST_IRQ);
+}
+
+int bmide_available(void) {
+    return bmide_base != 0;
+}
+
+// 物理上紧接且不跨 64 KiB 边界的段并进同一项
+int bmide_prepare(const DiskRequest* cmd) {
+    int n = 0;
+
+    if (!bmide_base || !cmd) return 0;
+    for (const DiskRequest* seg = cmd; seg; seg = seg->merged) {
+        unsigned int phys = seg->phys;
+        unsigned int bytes = seg->count * SECTOR_SIZE;
+
+        if (!phys || (phys & 1)) return 0;
+        while (bytes > 0) {
+            unsigned int chunk = PRD_MAX - (phys & (PRD_MAX - 1));
+            if (chunk > bytes) chunk = bytes;
+
+            if (n > 0) {
+                BmidePrd* last = &bmide_prdt[n - 1];
+                unsigned int len = last->bytes ? last->bytes : PRD_MAX;
+                if (last->addr + len == phys && (last->addr & ~(PRD_MAX - 1)) == (phys & ~(PRD_MAX - 1))) {
+                    last->bytes = (unsigned short)(len + chunk);
+                    phys += chunk;
+                    bytes -= chunk;
+                    continue;
+                }
+            }
+            if (n == BMIDE_PRD_ENTRIES) return 0;
+            bmide_prdt[n].addr = phys;
+            bmide_prdt[n].bytes = (unsigned short)chunk;
+            bmide_prdt[n].flags = 0;
+            n++;
+            phys += chunk;
+            bytes -= chunk;
+        }
+    }
+    if (n == 0) return 0;
+    bmide_prdt[n - 1].flags = PRD_EOT;
+
+    bmide_direction = cmd->write ? 0 : BM_CMD_READ;
+    outb(bmide_base + BM_COMMAND, bmide_direction);
+    outl(bmide_base + BM_PRDT, (unsigned int)bmide_prdt);
+    outb(bmide_base + BM_STATUS, (inb(bmide_base + BM_STATUS) & BM_ST_KEEP) | BM_ST_ERROR | BM_ST_IRQ);
+    return 1;
+}
+
+void bmide_start(void) {
+    outb(bmide_base + BM_COMMAND, bmide_direction | BM_CMD_START);
+}
+
+// 驱动器拉中断时控制器置 IRQ 位；描述符表比传输长时 ACTIVE 位不会自己清，一并停掉
+int bmide_poll(void) {
+    unsigned char status = inb(bmide_base + BM_STATUS);
+
+    if (!(status & (BM_ST_IRQ | BM_ST_ERROR))) return 0;
+    outb(bmide_base + BM_COMMAND, bmide_direction);
+    outb(bmide_base + BM_STATUS, (status & BM_ST_KEEP) | BM_ST_ERROR | BM_ST_IRQ);
+    return (status & BM_ST_ERROR) ? -1 : 1;
+}
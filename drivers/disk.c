@@ -1,4 +1,12 @@
 #include "disk.h"
+#include "ahci.h"
+#include "bmide.h"
+#include "heap.h"
+#include "irq.h"
+#include "paging.h"
+#include "process.h"
+#include "sync.h"
+#include "virtio_blk.h"
 
 // ATA 端口定义 (Primary Bus)
 #define ATA_DATA        0x1F0
@@ -10,10 +18,53 @@
 #define ATA_DRIVE_HEAD  0x1F6
 #define ATA_STATUS      0x1F7
 #define ATA_COMMAND     0x1F7
+#define ATA_CONTROL     0x3F6
 
 #define ATA_CMD_READ    0x20
 #define ATA_CMD_WRITE   0x30
+#define ATA_CMD_READ_EXT  0x24
+#define ATA_CMD_WRITE_EXT 0x34
+#define ATA_CMD_READ_MULTIPLE      0xC4
+#define ATA_CMD_WRITE_MULTIPLE     0xC5
+#define ATA_CMD_READ_MULTIPLE_EXT  0x29
+#define ATA_CMD_WRITE_MULTIPLE_EXT 0x39
+#define ATA_CMD_SET_MULTIPLE       0xC6
+#define ATA_CMD_READ_DMA  0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_READ_DMA_EXT  0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
 #define ATA_CMD_FLUSH   0xE7
+#define ATA_CMD_FLUSH_EXT 0xEA
+#define ATA_CMD_IDENTIFY  0xEC
+
+#define ATA_SR_ERR      0x01
+#define ATA_SR_DRQ      0x08
+#define ATA_SR_DF       0x20
+#define ATA_SR_BSY      0x80
+
+#define ATA_CTRL_NIEN   0x02
+// 28 位命令能访问的扇区数
+#define ATA_LBA28_LIMIT 0x10000000u
+// READ/WRITE MULTIPLE 每次 DRQ 至多传这么多扇区 (也是关中断传输的最长一段)
+#define ATA_MULTIPLE_MAX 16
+// 初始化时轮询等驱动器的次数上限
+#define ATA_TIMEOUT      1000000
+
+// 队头请求的执行阶段
+#define DISK_PHASE_ISSUE  0   // 还没发命令
+#define DISK_PHASE_DATA   1   // 逐扇区等 DRQ 传数据
+#define DISK_PHASE_FLUSH  2   // 写完最后一个扇区，等空闲后发 FLUSH
+#define DISK_PHASE_SETTLE 3   // FLUSH 已发，等它完成
+#define DISK_PHASE_DMA    4   // DMA 命令已发，等总线主控报告结束
+
+// 测速：盘首 1 MiB，每条命令 64 KiB，读 4 遍，至多 8 条同时在途
+#define DISK_BENCH_SECTORS 2048
+#define DISK_BENCH_CHUNK   128
+#define DISK_BENCH_ROUNDS  4
+#define DISK_BENCH_DEPTH   8
+#define DISK_TICKS_PER_SEC 100
+
+extern unsigned int timer_get_ticks(void);
 
 // 汇编辅助：从端口读入 count 个 word (2字节)
 static inline void insw(unsigned short port, void* addr, unsigned int count) {
@@ -25,96 +76,642 @@ static inline void outsw(unsigned short port, const void* addr, unsigned int cou
     __asm__ volatile ("cld; rep outsw" : "+S"(addr), "+c"(count) : "d"(port) : "memory");
 }
 
-static inline unsigned int irq_save_disable(void) {
-    unsigned int flags;
-    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) :: "memory");
-    return flags;
-}
+// 能同时执行多条命令的后端 (AHCI、virtio-blk)：disk.c 只管把排队的请求交出去、收回结束的
+typedef struct {
+    int backend;                           // DISK_BACKEND_*
+    int (*issue)(DiskRequest* cmd);        // 1 已发出，0 没有空位，-1 无法执行
+    DiskRequest* (*reap)(int* status);     // 取一条已结束的命令，没有时返回 0
+    unsigned int (*depth)(void);
+} DiskQueueOps;
 
-static inline void irq_restore(unsigned int flags) {
-    __asm__ volatile ("push %0; popf" :: "r"(flags) : "memory", "cc");
-}
+static const DiskQueueOps disk_virtio_ops = {
+    DISK_BACKEND_VIRTIO, virtio_blk_issue, virtio_blk_reap, virtio_blk_queue_depth
+};
+static const DiskQueueOps disk_ahci_ops = {
+    DISK_BACKEND_AHCI, ahci_issue, ahci_reap, ahci_queue_depth
+};
 
-void disk_init() {
-    // ATA PIO 模式通常不需要复杂的初始化
+// 请求队列。ATA：队头就是正在执行的请求，一次只有一条命令在驱动器上；
+// 多队列后端：还没交给设备的请求，交出去就出队
+static DiskRequest* disk_queue_head = 0;
+static DiskRequest* disk_queue_tail = 0;
+static unsigned int disk_queue_len = 0;    // 排队的加上执行中的
+static const DiskQueueOps* disk_queued = 0;
+static unsigned int disk_phase = DISK_PHASE_ISSUE;
+static DiskRequest* disk_segment = 0;      // 数据阶段正在传输的一段
+static unsigned int disk_sectors_done = 0; // 该段内已传的扇区
+// 已结束、回调还没调用的命令 (中断里不调回调，留给 disk_poll())
+static DiskRequest* disk_done_head = 0;
+static DiskRequest* disk_done_tail = 0;
+// 打开磁盘中断 (IRQ14，或 AHCI / virtio-blk 的 PCI 中断线) 之后由中断推进，等待的进程睡在这里
+static int disk_irq_enabled = 0;
+static WaitQueue disk_waiters;
+static DiskStats disk_stats;
+// 盘的扇区总数 (0 未知) 与单条命令的扇区上限
+static unsigned int disk_sectors = 0;
+static unsigned int disk_max_count = DISK_MAX_SECTORS_LBA28;
+// ATA：驱动器支持 LBA48；READ/WRITE MULTIPLE 每次 DRQ 的扇区数 (1 表示不用)；
+// 当前命令每次 DRQ 传的扇区数
+static int disk_lba48 = 0;
+static unsigned int disk_multiple = 1;
+static unsigned int disk_block = 1;
+
+unsigned int disk_identify_capacity(const unsigned short* ident) {
+    // 第 83 字第 10 位：支持 48 位地址
+    if (ident[83] & (1u << 10)) {
+        if (ident[102] || ident[103]) return 0xFFFFFFFFu;
+        return ident[100] | ((unsigned int)ident[101] << 16);
+    }
+    return ident[60] | ((unsigned int)ident[61] << 16);
 }
 
-// 等待硬盘不再繁忙 (BSY) 且准备好数据传输 (DRQ)
-void disk_wait() {
-    while(1) {
+// 等 BSY 清零，返回最后读到的状态；超时返回 0xFF
+static unsigned char ata_wait_idle(void) {
+    for (int i = 0; i < ATA_TIMEOUT; i++) {
         unsigned char status = inb(ATA_STATUS);
-        // bit 7 (BSY) == 0, bit 3 (DRQ) == 1, or bit 0 (ERR) == 1
-        if ((status & 0x80) == 0 && (status & 0x08)) break;
-        if (status & 0x01) return; // Error
+        if (!(status & ATA_SR_BSY)) return status;
     }
+    return 0xFF;
 }
 
-static void disk_wait_not_busy() {
+// 轮询执行 IDENTIFY DEVICE (此时 nIEN = 1，不来中断)；没有驱动器或出错返回 0
+static int ata_identify(unsigned short* ident) {
+    unsigned char status;
+
+    outb(ATA_DRIVE_HEAD, 0xA0);
+    outb(ATA_SECTOR_CNT, 0);
+    outb(ATA_LBA_LO, 0);
+    outb(ATA_LBA_MID, 0);
+    outb(ATA_LBA_HI, 0);
+    outb(ATA_COMMAND, ATA_CMD_IDENTIFY);
+    if (inb(ATA_STATUS) == 0) return 0;
     while (1) {
-        unsigned char status = inb(ATA_STATUS);
-        if ((status & 0x80) == 0) break;
-        if (status & 0x01) break;
+        status = ata_wait_idle();
+        if (status == 0xFF || (status & ATA_SR_ERR)) return 0;
+        if (status & ATA_SR_DRQ) break;
     }
+    insw(ATA_DATA, ident, 256);
+    return 1;
 }
 
-void disk_read_sectors(int lba, int count, void* buffer) {
-    unsigned int flags;
+// 读出容量、LBA48 支持和 MULTIPLE 的块大小，并用 SET MULTIPLE 设好；失败时按 28 位、逐扇区走
+static void ata_configure(void) {
+    unsigned short* ident = (unsigned short*)malloc(SECTOR_SIZE);
+    unsigned int multiple;
 
-    // 【防崩溃检查】: 如果 buffer 是 NULL，绝对不能读，否则覆盖 IVT (0x00) 导致黑屏
-    if (buffer == 0) {
+    if (!ident) return;
+    outb(ATA_CONTROL, ATA_CTRL_NIEN);
+    if (!ata_identify(ident)) {
+        free(ident);
         return;
     }
+    disk_sectors = disk_identify_capacity(ident);
+    disk_lba48 = (ident[83] & (1u << 10)) != 0;
+    if (disk_lba48) disk_max_count = DISK_MAX_SECTORS_EXT;
 
-    flags = irq_save_disable();
-    disk_wait_not_busy();
+    // 第 47 字低 8 位：每次 DRQ 至多传的扇区数；取不超过 ATA_MULTIPLE_MAX 的 2 的幂
+    multiple = ident[47] & 0xFF;
+    if (multiple > ATA_MULTIPLE_MAX) multiple = ATA_MULTIPLE_MAX;
+    disk_multiple = 1;
+    while (disk_multiple * 2 <= multiple) disk_multiple *= 2;
+    if (disk_multiple > 1) {
+        outb(ATA_DRIVE_HEAD, 0xE0);
+        outb(ATA_SECTOR_CNT, (unsigned char)disk_multiple);
+        outb(ATA_COMMAND, ATA_CMD_SET_MULTIPLE);
+        if (ata_wait_idle() & ATA_SR_ERR) disk_multiple = 1;
+    }
+    free(ident);
+}
+
+void disk_init() {
+    // 依次试 virtio-blk、AHCI，找到就整个块设备走它，主 IDE 通道不再使用
+    if (virtio_blk_init()) {
+        disk_queued = &disk_virtio_ops;
+        disk_irq_enabled = virtio_blk_irq_enabled();
+        disk_sectors = virtio_blk_capacity();
+        disk_max_count = DISK_MAX_SECTORS_EXT;
+        return;
+    }
+    if (ahci_init()) {
+        disk_queued = &disk_ahci_ops;
+        disk_irq_enabled = ahci_irq_enabled();
+        disk_sectors = ahci_capacity();
+        disk_max_count = DISK_MAX_SECTORS_EXT;
+        return;
+    }
+    ata_configure();
+    // 设备控制寄存器 nIEN = 0：驱动器每块数据就绪、命令结束时拉 INTRQ。
+    // 再打开从片上的 IRQ14 (主片的 IRQ2 级联一直开着)
+    outb(ATA_CONTROL, 0x00);
+    outb(0xA1, inb(0xA1) & (unsigned char)~(1 << 6));
+    disk_irq_enabled = 1;
+    bmide_init();
+}
 
-    outb(ATA_DRIVE_HEAD, 0xE0 | ((lba >> 24) & 0x0F)); // 0xE0 = Master Drive, LBA Mode
-    outb(ATA_SECTOR_CNT, (unsigned char)count);
-    outb(ATA_LBA_LO, (unsigned char)(lba & 0xFF));
-    outb(ATA_LBA_MID, (unsigned char)((lba >> 8) & 0xFF));
-    outb(ATA_LBA_HI, (unsigned char)((lba >> 16) & 0xFF));
-    outb(ATA_COMMAND, ATA_CMD_READ); // 发送“读”命令
+// 逐页换算，相邻页物理上不接续就放弃 (DMA 只对连续的缓冲区做)
+void disk_map_buffer(DiskRequest* req) {
+    unsigned int start;
+    unsigned int end;
+    unsigned int phys;
 
-    unsigned short* ptr = (unsigned short*)buffer;
-    
-    for (int i = 0; i < count; i++) {
-        disk_wait(); // 等待硬盘准备好
-        // 读取 256 个字 (512 字节)
-        insw(ATA_DATA, ptr, 256);
-        ptr += 256;
+    if (!req) return;
+    req->phys = 0;
+    req->cr3 = paging_is_enabled() ? paging_current_cr3() : 0;
+    if (!req->buffer || req->count == 0) return;
+    start = (unsigned int)req->buffer;
+    end = start + req->count * SECTOR_SIZE;
+    phys = paging_translate(start);
+    if (!phys) return;
+    for (unsigned int page = (start & 0xFFFFF000u) + 0x1000u; page < end; page += 0x1000u) {
+        if (paging_translate(page) != phys + (page - start)) return;
     }
+    req->phys = phys;
+}
+
+// 链上所有段的扇区总数
+static unsigned int disk_command_sectors(const DiskRequest* req) {
+    unsigned int total = 0;
+    for (; req; req = req->merged) total += req->count;
+    return total;
+}
+
+// 超出 28 位命令的 LBA 范围或扇区数时才用 EXT 命令，多数命令省下 4 次端口写
+static int disk_need_ext(const DiskRequest* req) {
+    unsigned int sectors = disk_command_sectors(req);
+    if (!disk_lba48) return 0;
+    return sectors > DISK_MAX_SECTORS_LBA28 || req->lba + sectors > ATA_LBA28_LIMIT;
+}
+
+static void disk_issue(const DiskRequest* req, unsigned char command, int ext) {
+    unsigned int sectors = disk_command_sectors(req);
 
-    disk_wait_not_busy();
+    if (ext) {
+        // 48 位：每个寄存器先写高字节 (HOB) 再写低字节；LBA 只有 32 位，47..32 位为 0
+        outb(ATA_DRIVE_HEAD, 0x40);
+        outb(ATA_SECTOR_CNT, (unsigned char)(sectors >> 8));
+        outb(ATA_LBA_LO, (unsigned char)(req->lba >> 24));
+        outb(ATA_LBA_MID, 0);
+        outb(ATA_LBA_HI, 0);
+    } else {
+        outb(ATA_DRIVE_HEAD, 0xE0 | ((req->lba >> 24) & 0x0F)); // 0xE0 = Master Drive, LBA Mode
+    }
+    outb(ATA_SECTOR_CNT, (unsigned char)sectors);
+    outb(ATA_LBA_LO, (unsigned char)(req->lba & 0xFF));
+    outb(ATA_LBA_MID, (unsigned char)((req->lba >> 8) & 0xFF));
+    outb(ATA_LBA_HI, (unsigned char)((req->lba >> 16) & 0xFF));
+    outb(ATA_COMMAND, command);
+}
+
+// PIO 命令：能用 MULTIPLE 就一次 DRQ 传 disk_multiple 个扇区，少来几次中断
+static unsigned char disk_pio_command(const DiskRequest* req, int ext) {
+    if (disk_multiple > 1) {
+        disk_block = disk_multiple;
+        if (ext) return req->write ? ATA_CMD_WRITE_MULTIPLE_EXT : ATA_CMD_READ_MULTIPLE_EXT;
+        return req->write ? ATA_CMD_WRITE_MULTIPLE : ATA_CMD_READ_MULTIPLE;
+    }
+    disk_block = 1;
+    if (ext) return req->write ? ATA_CMD_WRITE_EXT : ATA_CMD_READ_EXT;
+    return req->write ? ATA_CMD_WRITE : ATA_CMD_READ;
+}
+
+// 链上任一段要求 PIO 则整条走 PIO
+static int disk_use_dma(const DiskRequest* req) {
+    if (!bmide_available()) return 0;
+    for (const DiskRequest* seg = req; seg; seg = seg->merged) {
+        if (seg->no_dma) return 0;
+    }
+    return bmide_prepare(req);
+}
+
+// 切到 seg 提交者的地址空间去读写 buffer，返回原来的页目录交给 disk_leave_space()；
+// 调用方关中断，否则中途被调度走再回来时页目录已换回本进程的
+static unsigned int disk_enter_space(const DiskRequest* seg) {
+    unsigned int old = paging_current_cr3();
+
+    if (seg->cr3 && seg->cr3 != old) paging_switch(seg->cr3);
+    return old;
+}
+
+static void disk_leave_space(unsigned int old) {
+    if (paging_current_cr3() != old) paging_switch(old);
+}
+
+// 链上每段置完成，挂到待回调链表上；调用方关中断
+static void disk_command_done(DiskRequest* req, int status) {
+    disk_queue_len--;
+    req->next = 0;
+    for (DiskRequest* seg = req; seg; seg = seg->merged) {
+        seg->status = status;
+        seg->done = 1;
+    }
+    if (disk_done_tail) disk_done_tail->next = req;
+    else disk_done_head = req;
+    disk_done_tail = req;
+}
+
+// ATA：队头出队并结束
+static void disk_finish(int status) {
+    DiskRequest* req = disk_queue_head;
+
+    disk_queue_head = req->next;
+    if (!disk_queue_head) disk_queue_tail = 0;
+    disk_phase = DISK_PHASE_ISSUE;
+    disk_segment = 0;
+    disk_sectors_done = 0;
+    disk_command_done(req, status);
+}
+
+// 推进队头请求一步 (至多传一次 DRQ 的数据块)，调用方关中断。
+// 返回 1 表示有进展，0 表示驱动器忙、这一轮无事可做。
+// 进程上下文与 IRQ14 都调用它：进程里读状态寄存器会清掉 INTRQ，但 PIC 已经锁存了
+// 这次中断，处理函数进来发现无事可做直接返回
+static int disk_step_ata(void) {
+    DiskRequest* req = disk_queue_head;
+    unsigned char status;
+    unsigned int block;
+    int ext;
+
+    if (!req) return 0;
+    status = inb(ATA_STATUS);
+    if (status & ATA_SR_BSY) return 0;
+
+    switch (disk_phase) {
+    case DISK_PHASE_ISSUE:
+        ext = disk_need_ext(req);
+        if (disk_use_dma(req)) {
+            if (ext) disk_issue(req, req->write ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT, 1);
+            else disk_issue(req, req->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, 0);
+            bmide_start();
+            disk_phase = DISK_PHASE_DMA;
+            disk_stats.dma_commands++;
+            disk_stats.dma_sectors += disk_command_sectors(req);
+            return 1;
+        }
+        disk_issue(req, disk_pio_command(req, ext), ext);
+        disk_stats.pio_commands++;
+        disk_stats.pio_sectors += disk_command_sectors(req);
+        disk_phase = DISK_PHASE_DATA;
+        disk_segment = req;
+        disk_sectors_done = 0;
+        // 写命令的第一块数据不来中断：驱动器几微秒内就给出 DRQ，在这里等掉；
+        // 一直等不到就当命令失败，不能关着中断死等
+        if (req->write) {
+            int i;
+            for (i = 0; i < ATA_TIMEOUT; i++) {
+                status = inb(ATA_STATUS);
+                if (status & ATA_SR_ERR) break;
+                if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) break;
+            }
+            if (i == ATA_TIMEOUT) disk_finish(-1);
+        }
+        return 1;
+    case DISK_PHASE_DATA:
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            disk_finish(-1);
+            return 1;
+        }
+        if (!(status & ATA_SR_DRQ)) return 0;
+        // 一次 DRQ 传 disk_block 个扇区 (命令的最后一块可能不足)，可以跨过段的边界。
+        // 多半是在中断里、别的进程正在运行，buffer 按提交者的页目录访问
+        for (block = 0; block < disk_block && disk_segment; block++) {
+            unsigned int space = disk_enter_space(disk_segment);
+
+            if (req->write) {
+                outsw(ATA_DATA, (const unsigned char*)disk_segment->buffer + disk_sectors_done * SECTOR_SIZE, 256);
+            } else {
+                insw(ATA_DATA, (unsigned char*)disk_segment->buffer + disk_sectors_done * SECTOR_SIZE, 256);
+            }
+            disk_leave_space(space);
+            if (++disk_sectors_done < disk_segment->count) continue;
+            disk_segment = disk_segment->merged;
+            disk_sectors_done = 0;
+        }
+        if (disk_segment) return 1;
+        if (req->write) disk_phase = DISK_PHASE_FLUSH;
+        else disk_finish(0);
+        return 1;
+    case DISK_PHASE_DMA: {
+        int result = bmide_poll();
+        if (result == 0) return 0;
+        if (result < 0 || (status & ATA_SR_ERR)) {
+            disk_stats.dma_errors++;
+            disk_finish(-1);
+        } else if (req->write) {
+            disk_phase = DISK_PHASE_FLUSH;
+        } else {
+            disk_finish(0);
+        }
+        return 1;
+    }
+    case DISK_PHASE_FLUSH:
+        // 写完最后一块 (或 DMA 写结束) 后驱动器报的是写命令本身的结果，出错就不必再 FLUSH
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            disk_finish(-1);
+            return 1;
+        }
+        outb(ATA_COMMAND, disk_lba48 ? ATA_CMD_FLUSH_EXT : ATA_CMD_FLUSH);
+        disk_phase = DISK_PHASE_SETTLE;
+        return 1;
+    default:
+        disk_finish((status & (ATA_SR_ERR | ATA_SR_DF)) ? -1 : 0);
+        return 1;
+    }
+}
+
+// 多队列后端：收走已结束的命令，再把排队的请求交给设备直到没有空位，调用方关中断
+static int disk_step_queued(void) {
+    DiskRequest* req;
+    int status;
+    int progress = 0;
+
+    while ((req = disk_queued->reap(&status)) != 0) {
+        disk_command_done(req, status);
+        progress = 1;
+    }
+    while ((req = disk_queue_head) != 0) {
+        int issued = disk_queued->issue(req);
+        if (issued == 0) break;
+        disk_queue_head = req->next;
+        if (!disk_queue_head) disk_queue_tail = 0;
+        if (issued < 0) {
+            disk_command_done(req, -1);
+        } else {
+            disk_stats.dma_commands++;
+            disk_stats.dma_sectors += disk_command_sectors(req);
+        }
+        progress = 1;
+    }
+    return progress;
+}
+
+static int disk_step(void) {
+    return disk_queued ? disk_step_queued() : disk_step_ata();
+}
+
+// 关中断、在 seg 提交者的地址空间里拷贝 (中转缓冲在堆上，哪个地址空间都能访问)
+static void disk_copy_user(const DiskRequest* seg, void* dst, const void* src) {
+    unsigned int flags = irq_save_disable();
+    unsigned int space = disk_enter_space(seg);
+
+    memcpy(dst, src, (int)(seg->count * SECTOR_SIZE));
+    disk_leave_space(space);
     irq_restore(flags);
 }
 
-void disk_write_sectors(int lba, int count, const void* buffer) {
-    const unsigned short* ptr = (const unsigned short*)buffer;
+// 多队列后端只做 DMA：物理上不连续 (或没对齐到偶数地址) 的段借一块堆上的中转缓冲，
+// 写命令先拷进去。堆在恒等映射区内，地址即物理地址。
+// 借不到时还掉已借的，返回 0
+static int disk_bounce_setup(DiskRequest* req) {
+    for (DiskRequest* seg = req; seg; seg = seg->merged) {
+        if (seg->phys && !(seg->phys & 1)) continue;
+        seg->bounce = malloc(seg->count * SECTOR_SIZE);
+        if (!seg->bounce) {
+            for (DiskRequest* s = req; s != seg; s = s->merged) {
+                if (s->bounce) free(s->bounce);
+                s->bounce = 0;
+            }
+            return 0;
+        }
+        if (seg->write) disk_copy_user(seg, seg->bounce, seg->buffer);
+        seg->phys = (unsigned int)seg->bounce;
+    }
+    return 1;
+}
+
+// 读成功的段从中转缓冲拷回调用方，再还给堆；在 disk_poll() 里做，调用者未必是提交者
+static void disk_bounce_release(DiskRequest* req) {
+    for (DiskRequest* seg = req; seg; seg = seg->merged) {
+        if (!seg->bounce) continue;
+        if (!seg->write && seg->status == 0) disk_copy_user(seg, seg->buffer, seg->bounce);
+        free(seg->bounce);
+        seg->bounce = 0;
+    }
+}
+
+// 链上各段调用回调；回调可能复用请求结构，先取下一段
+static void disk_complete(DiskRequest* req) {
+    disk_bounce_release(req);
+    while (req) {
+        DiskRequest* next = req->merged;
+        if (req->on_done) req->on_done(req);
+        req = next;
+    }
+}
+
+// 由 irq14_handler_stub 调用 (关中断)：推进到驱动器再次忙为止，有命令结束就唤醒等待者
+void disk_irq_handler(void) {
+    DiskRequest* done_before = disk_done_tail;
+
+    // 没有命令时也要读一次状态寄存器应答 INTRQ，否则电平一直拉高、PIC 收不到下一个沿
+    if (disk_queued || !disk_queue_head) {
+        inb(ATA_STATUS);
+        return;
+    }
+
+    while (disk_step()) {}
+    if (disk_done_tail != done_before) {
+        while (process_wake_one(&disk_waiters)) {}
+    }
+}
+
+// 由 irq9/10/11_handler_stub 调用 (关中断)：这几条线可能与别的 PCI 设备共用，
+// 后端的 reap 应答自己设备的中断，没有结束的命令时什么也不做
+void disk_pci_irq_handler(void) {
+    DiskRequest* done_before = disk_done_tail;
+
+    if (!disk_queued) return;
+    while (disk_step()) {}
+    if (disk_done_tail != done_before) {
+        while (process_wake_one(&disk_waiters)) {}
+    }
+}
+
+void disk_submit(DiskRequest* req) {
     unsigned int flags;
+    unsigned int sectors;
+    int valid = 1;
 
-    if (!buffer || count <= 0) {
+    if (!req) return;
+    req->next = 0;
+    // 【防崩溃检查】: buffer 为 NULL 时绝对不能读，否则覆盖 IVT (0x00) 导致黑屏；
+    // 扇区数不超过单条命令上限，范围不绕回、不越过盘尾
+    for (DiskRequest* seg = req; seg; seg = seg->merged) {
+        seg->done = 0;
+        seg->status = 0;
+        seg->bounce = 0;
+        if (!seg->buffer || seg->count == 0) valid = 0;
+    }
+    sectors = disk_command_sectors(req);
+    if (sectors > disk_max_count || req->lba + sectors < req->lba) valid = 0;
+    if (disk_sectors && req->lba + sectors > disk_sectors) valid = 0;
+    if (valid && disk_queued && !disk_bounce_setup(req)) valid = 0;
+    if (!valid) {
+        for (DiskRequest* seg = req; seg; seg = seg->merged) {
+            seg->status = -1;
+            seg->done = 1;
+        }
+        disk_complete(req);
         return;
     }
 
     flags = irq_save_disable();
-    disk_wait_not_busy();
+    if (disk_queue_tail) disk_queue_tail->next = req;
+    else disk_queue_head = req;
+    disk_queue_tail = req;
+    disk_queue_len++;
+    irq_restore(flags);
+}
+
+// 每一步单独关中断，关中断窗口不超过一次 DRQ 的传输 (至多 ATA_MULTIPLE_MAX 个扇区)；驱动器忙时立即返回。
+// 之后在开中断的状态下调用已结束命令的回调
+int disk_poll(void) {
+    int completed = 0;
 
-    outb(ATA_DRIVE_HEAD, 0xE0 | ((lba >> 24) & 0x0F));
-    outb(ATA_SECTOR_CNT, (unsigned char)count);
-    outb(ATA_LBA_LO, (unsigned char)(lba & 0xFF));
-    outb(ATA_LBA_MID, (unsigned char)((lba >> 8) & 0xFF));
-    outb(ATA_LBA_HI, (unsigned char)((lba >> 16) & 0xFF));
-    outb(ATA_COMMAND, ATA_CMD_WRITE);
+    while (1) {
+        unsigned int flags = irq_save_disable();
+        int progress = disk_step();
+        DiskRequest* finished = disk_done_head;
 
-    for (int i = 0; i < count; i++) {
-        disk_wait();
-        outsw(ATA_DATA, ptr, 256);
-        ptr += 256;
-        disk_wait_not_busy();
+        disk_done_head = 0;
+        disk_done_tail = 0;
+        irq_restore(flags);
+        while (finished) {
+            DiskRequest* next = finished->next;
+            finished->next = 0;
+            completed++;
+            disk_complete(finished);
+            finished = next;
+        }
+        if (!progress) break;
     }
+    return completed;
+}
 
-    disk_wait_not_busy();
-    outb(ATA_COMMAND, ATA_CMD_FLUSH);
-    disk_wait_not_busy();
+void disk_wait_any(void) {
+    unsigned int flags = irq_save_disable();
+
+    // 还没发出的命令先发出去，否则不会有中断来叫醒
+    if (disk_irq_enabled && disk_queue_head && (disk_queued || disk_phase == DISK_PHASE_ISSUE)) disk_step();
+    if (disk_irq_enabled && disk_queue_len > 0 && !disk_done_head) {
+        if (sync_preemptible()) process_wait(&disk_waiters);
+        else if (irq_were_enabled(flags)) __asm__ volatile ("sti; hlt; cli" ::: "memory");
+    }
     irq_restore(flags);
 }
+
+int disk_wait_request(DiskRequest* req) {
+    if (!req) return -1;
+    while (!req->done) {
+        disk_poll();
+        if (!req->done) disk_wait_any();
+    }
+    // 中断里结束的命令还挂在待回调链表上，交付掉再返回 (请求结构可能在栈上)
+    disk_poll();
+    return req->status;
+}
+
+unsigned int disk_pending(void) {
+    return disk_queue_len;
+}
+
+unsigned int disk_queue_depth(void) {
+    return disk_queued ? disk_queued->depth() : 1;
+}
+
+unsigned int disk_max_sectors(void) {
+    return disk_max_count;
+}
+
+unsigned int disk_capacity(void) {
+    return disk_sectors;
+}
+
+// 按单条命令上限切开，逐条提交并等待，任一条失败就停
+static int disk_rw_sync(unsigned int lba, unsigned int count, unsigned char* buffer, int write) {
+    DiskRequest req;
+
+    if (!buffer || count == 0) return -1;
+    while (count > 0) {
+        unsigned int chunk = count < disk_max_count ? count : disk_max_count;
+
+        memset(&req, 0, sizeof(req));
+        req.lba = lba;
+        req.count = chunk;
+        req.buffer = buffer;
+        req.write = (unsigned char)write;
+        disk_map_buffer(&req);
+        disk_submit(&req);
+        if (disk_wait_request(&req) != 0) return -1;
+        lba += chunk;
+        count -= chunk;
+        buffer += chunk * SECTOR_SIZE;
+    }
+    return 0;
+}
+
+int disk_read_sectors(unsigned int lba, unsigned int count, void* buffer) {
+    return disk_rw_sync(lba, count, (unsigned char*)buffer, 0);
+}
+
+int disk_write_sectors(unsigned int lba, unsigned int count, const void* buffer) {
+    return disk_rw_sync(lba, count, (unsigned char*)buffer, 1);
+}
+
+void disk_get_stats(DiskStats* out) {
+    if (!out) return;
+    *out = disk_stats;
+}
+
+// 同时至多 DISK_BENCH_DEPTH 条在途 (ATA 在驱动里排队逐条执行，AHCI 交给 NCQ)，
+// 按提交顺序等待，等完的请求结构再拿去提交下一条。返回所用的 tick 数，出错返回 0
+static unsigned int disk_bench_pass(unsigned char* buffer, DiskRequest* reqs, int no_dma) {
+    unsigned int total = DISK_BENCH_SECTORS / DISK_BENCH_CHUNK * DISK_BENCH_ROUNDS;
+    unsigned int submitted = 0;
+    unsigned int start = timer_get_ticks();
+    unsigned int ticks;
+    int failed = 0;
+
+    for (unsigned int finished = 0; finished < total; finished++) {
+        while (submitted < total && submitted - finished < DISK_BENCH_DEPTH) {
+            DiskRequest* req = &reqs[submitted % DISK_BENCH_DEPTH];
+            memset(req, 0, sizeof(*req));
+            req->lba = (submitted * DISK_BENCH_CHUNK) % DISK_BENCH_SECTORS;
+            req->count = DISK_BENCH_CHUNK;
+            req->buffer = buffer;
+            req->no_dma = (unsigned char)no_dma;
+            disk_map_buffer(req);
+            disk_submit(req);
+            submitted++;
+        }
+        if (disk_wait_request(&reqs[finished % DISK_BENCH_DEPTH]) != 0) failed = 1;
+    }
+    if (failed) return 0;
+    ticks = timer_get_ticks() - start;
+    return ticks ? ticks : 1;
+}
+
+static unsigned int disk_bench_rate(unsigned int kib, unsigned int ticks) {
+    return ticks ? kib * DISK_TICKS_PER_SEC / ticks : 0;
+}
+
+void disk_benchmark(DiskBenchResult* out) {
+    unsigned char* buffer;
+    DiskRequest* reqs;
+
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    out->kib = DISK_BENCH_SECTORS / 2 * DISK_BENCH_ROUNDS;
+    out->backend = disk_queued ? disk_queued->backend : DISK_BACKEND_ATA;
+    out->queue_depth = disk_queue_depth();
+    out->dma_available = disk_queued || bmide_available();
+    // 各条命令读进同一块缓冲区，内容不要
+    buffer = (unsigned char*)malloc(DISK_BENCH_CHUNK * SECTOR_SIZE);
+    reqs = (DiskRequest*)malloc(DISK_BENCH_DEPTH * sizeof(DiskRequest));
+    if (buffer && reqs) {
+        // 多队列后端只有 DMA
+        if (!disk_queued) out->pio_kib_per_s = disk_bench_rate(out->kib, disk_bench_pass(buffer, reqs, 1));
+        if (out->dma_available) out->dma_kib_per_s = disk_bench_rate(out->kib, disk_bench_pass(buffer, reqs, 0));
+    }
+    if (reqs) free(reqs);
+    if (buffer) free(buffer);
+}
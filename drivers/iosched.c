@@ -0,0 +1,200 @@
+// iosched.c - 磁盘 I/O 调度：相邻请求合并、LBA 电梯排序、派发期限
+#include "iosched.h"
+#include "utils.h"
+
+// 待派发的命令按起始 LBA 升序串在 next 上，每条命令合并进来的请求挂在链头的 merged 上
+static DiskRequest* iosched_queue = 0;
+static unsigned int iosched_head_lba = 0;     // 电梯位置：上一条命令的结束 LBA
+static unsigned int iosched_dispatched = 0;   // 已派发的命令数，期限按它计
+static IoschedStats iosched_stats;
+
+static IoschedQueueStats* queue_stats(const DiskRequest* req) {
+    return req->write ? &iosched_stats.write : &iosched_stats.read;
+}
+
+static unsigned int command_sectors(const DiskRequest* cmd) {
+    unsigned int total = 0;
+    for (; cmd; cmd = cmd->merged) total += cmd->count;
+    return total;
+}
+
+static unsigned int command_requests(const DiskRequest* cmd) {
+    unsigned int n = 0;
+    for (; cmd; cmd = cmd->merged) n++;
+    return n;
+}
+
+// cmd 与紧随其后的命令首尾相接、方向相同且合起来不超上限时并成一条
+static int try_join(DiskRequest* cmd) {
+    DiskRequest* next;
+    DiskRequest* tail;
+
+    if (!cmd || !(next = cmd->next)) return 0;
+    if (cmd->write != next->write || cmd->lba + command_sectors(cmd) != next->lba) return 0;
+    if (command_sectors(cmd) + command_sectors(next) > disk_max_sectors()) return 0;
+    if (command_requests(cmd) + command_requests(next) > IOSCHED_MAX_SEGMENTS) return 0;
+
+    for (tail = cmd; tail->merged; tail = tail->merged) {}
+    tail->merged = next;
+    cmd->next = next->next;
+    next->next = 0;
+    if (next->expire < cmd->expire) cmd->expire = next->expire;
+    return 1;
+}
+
+// 单个请求就超出命令上限或越过盘尾的不进队列，免得和合法请求并成一条后连累它们
+static int request_valid(const DiskRequest* req) {
+    unsigned int capacity = disk_capacity();
+
+    if (!req->buffer || req->count == 0 || req->count > disk_max_sectors()) return 0;
+    if (req->lba + req->count < req->lba) return 0;
+    return !capacity || req->lba + req->count <= capacity;
+}
+
+void iosched_submit(DiskRequest* req) {
+    IoschedQueueStats* stats;
+    DiskRequest* prev = 0;
+    DiskRequest* pos = iosched_queue;
+
+    if (!req) return;
+    req->merged = 0;
+    // 非法请求交给驱动直接以失败完成
+    if (!request_valid(req)) {
+        disk_submit(req);
+        return;
+    }
+    req->done = 0;
+    req->status = 0;
+    disk_map_buffer(req);
+    req->expire = iosched_dispatched + (req->write ? IOSCHED_WRITE_EXPIRE : IOSCHED_READ_EXPIRE);
+    stats = queue_stats(req);
+    stats->requests++;
+    stats->sectors += req->count;
+    if (++stats->depth > stats->max_depth) stats->max_depth = stats->depth;
+
+    // 按 LBA 插入后分别试着并到前一条 (后向合并) 和把后一条并进来 (前向合并)
+    while (pos && pos->lba <= req->lba) {
+        prev = pos;
+        pos = pos->next;
+    }
+    req->next = pos;
+    if (prev) prev->next = req;
+    else iosched_queue = req;
+    if (try_join(req)) stats->merges++;
+    if (try_join(prev)) stats->merges++;
+}
+
+// 有超期命令时取期限最早的那条，否则从电梯位置往上找第一条，到顶回绕
+static DiskRequest* pick_command(DiskRequest** out_prev) {
+    DiskRequest* best = 0;
+    DiskRequest* best_prev = 0;
+    DiskRequest* prev = 0;
+
+    for (DiskRequest* cmd = iosched_queue; cmd; prev = cmd, cmd = cmd->next) {
+        if ((int)(iosched_dispatched - cmd->expire) < 0) continue;
+        if (!best || (int)(cmd->expire - best->expire) < 0) {
+            best = cmd;
+            best_prev = prev;
+        }
+    }
+    if (best) {
+        queue_stats(best)->expired++;
+        *out_prev = best_prev;
+        return best;
+    }
+
+    prev = 0;
+    for (DiskRequest* cmd = iosched_queue; cmd; prev = cmd, cmd = cmd->next) {
+        if (cmd->lba >= iosched_head_lba) {
+            *out_prev = prev;
+            return cmd;
+        }
+    }
+    *out_prev = 0;
+    return iosched_queue;
+}
+
+static void dispatch(void) {
+    DiskRequest* prev;
+    DiskRequest* cmd = pick_command(&prev);
+    IoschedQueueStats* stats;
+
+    if (!cmd) return;
+    if (prev) prev->next = cmd->next;
+    else iosched_queue = cmd->next;
+    cmd->next = 0;
+
+    stats = queue_stats(cmd);
+    stats->commands++;
+    stats->depth -= command_requests(cmd);
+    iosched_head_lba = cmd->lba + command_sectors(cmd);
+    iosched_dispatched++;
+    disk_submit(cmd);
+}
+
+// 驱动里只放它能同时执行的条数 (ATA 一条，AHCI 的 NCQ 队列深度)：其余的留在这里继续合并、排序
+int iosched_poll(void) {
+    int completed = 0;
+
+    while (1) {
+        completed += disk_poll();
+        if (disk_pending() >= disk_queue_depth() || !iosched_queue) break;
+        dispatch();
+    }
+    return completed;
+}
+
+void iosched_wait_any(void) {
+    if (iosched_poll() > 0) return;
+    disk_wait_any();
+}
+
+int iosched_wait(DiskRequest* req) {
+    if (!req) return -1;
+    while (!req->done) iosched_wait_any();
+    // 中断里结束的命令还挂在驱动的待回调链表上，交付掉再返回 (请求结构可能在栈上)
+    iosched_poll();
+    return req->status;
+}
+
+unsigned int iosched_pending(void) {
+    return iosched_stats.read.depth + iosched_stats.write.depth + disk_pending();
+}
+
+// 拆开的大请求一次排进去的段数，多队列后端上几条命令可以同时在途
+#define IOSCHED_RW_BATCH 4
+
+int iosched_rw(unsigned int lba, unsigned int count, void* buffer, int write) {
+    DiskRequest reqs[IOSCHED_RW_BATCH];
+    unsigned char* p = (unsigned char*)buffer;
+    unsigned int max = disk_max_sectors();
+    int result = 0;
+
+    if (!buffer || count == 0) return -1;
+    while (count > 0) {
+        unsigned int n = 0;
+
+        for (; n < IOSCHED_RW_BATCH && count > 0; n++) {
+            unsigned int chunk = count < max ? count : max;
+
+            memset(&reqs[n], 0, sizeof(reqs[n]));
+            reqs[n].lba = lba;
+            reqs[n].count = chunk;
+            reqs[n].buffer = p;
+            reqs[n].write = (unsigned char)write;
+            iosched_submit(&reqs[n]);
+            lba += chunk;
+            count -= chunk;
+            p += chunk * SECTOR_SIZE;
+        }
+        for (unsigned int i = 0; i < n; i++) {
+            if (iosched_wait(&reqs[i]) != 0) result = -1;
+        }
+    }
+    return result;
+}
+
+void iosched_get_stats(IoschedStats* out) {
+    if (!out) return;
+    *out = iosched_stats;
+}
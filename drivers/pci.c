@@ -109,3 +109,20 @@ int pci_find_first_by_class(unsigned char class_code, unsigned char subclass, Pc
     }
     return 0;
 }
+
+int pci_find_device(unsigned short vendor_id, unsigned short device_id, PciDeviceInfo* out) {
+    PciDeviceInfo info;
+    for (unsigned int bus = 0; bus < 1; bus++) {
+        for (unsigned int slot = 0; slot < 32; slot++) {
+            for (unsigned int func = 0; func < 8; func++) {
+                if (!pci_probe_device((unsigned char)bus, (unsigned char)slot, (unsigned char)func, &info)) {
+                    continue;
+                }
+                if (info.vendor_id != vendor_id || info.device_id != device_id) continue;
+                if (out) *out = info;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,345 @@
+// virtio_blk.c - virtio-blk (legacy PCI)：split virtqueue、间接描述符
+#include "virtio_blk.h"
+#include "heap.h"
+#include "pci.h"
+
+#define VIRTIO_VENDOR       0x1AF4
+#define VIRTIO_BLK_DEVICE   0x1001
+
+// legacy 寄存器 (相对 BAR0)
+#define VIO_DEVICE_FEATURES 0x00
+#define VIO_GUEST_FEATURES  0x04
+#define VIO_QUEUE_PFN       0x08
+#define VIO_QUEUE_SIZE      0x0C
+#define VIO_QUEUE_SELECT    0x0E
+#define VIO_QUEUE_NOTIFY    0x10
+#define VIO_STATUS          0x12
+#define VIO_ISR             0x13
+#define VIO_CONFIG          0x14   // 没开 MSI-X 时设备配置从这里开始，开头 8 字节是扇区总数
+
+#define STATUS_ACKNOWLEDGE  0x01
+#define STATUS_DRIVER       0x02
+#define STATUS_DRIVER_OK    0x04
+#define STATUS_FAILED       0x80
+
+#define VIRTIO_BLK_F_RO          (1u << 5)
+#define VIRTIO_BLK_F_FLUSH       (1u << 9)
+#define VIRTIO_RING_F_INDIRECT   (1u << 28)
+
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_T_FLUSH  4
+
+#define VRING_DESC_F_NEXT     1
+#define VRING_DESC_F_WRITE    2   // 设备往这里写
+#define VRING_DESC_F_INDIRECT 4
+#define VRING_AVAIL_F_NO_INTERRUPT 1
+#define VRING_ALIGN 4096u
+
+// 请求头 + 各数据段 + 状态字节
+#define SLOT_DESCS (VIRTIO_BLK_SEGMENTS + 2)
+
+typedef struct {
+    unsigned int addr;
+    unsigned int addr_hi;
+    unsigned int len;
+    unsigned short flags;
+    unsigned short next;
+} VirtqDesc;
+
+typedef struct {
+    unsigned short flags;
+    volatile unsigned short idx;
+    unsigned short ring[];
+} VirtqAvail;
+
+typedef struct {
+    unsigned int id;
+    unsigned int len;
+} VirtqUsedElem;
+
+typedef struct {
+    volatile unsigned short flags;
+    volatile unsigned short idx;
+    volatile VirtqUsedElem ring[];
+} VirtqUsed;
+
+typedef struct {
+    unsigned int type;
+    unsigned int reserved;
+    unsigned int sector;
+    unsigned int sector_hi;
+} VirtioBlkHeader;
+
+// 间接描述符表要 16 字节对齐
+typedef struct {
+    VirtioBlkHeader header;
+    VirtqDesc table[SLOT_DESCS];
+    volatile unsigned char status;
+} __attribute__((aligned(16))) VirtioBlkSlot;
+
+static unsigned short vblk_io = 0;
+static unsigned int vblk_queue_size = 0;
+static VirtqDesc* vblk_desc = 0;
+static VirtqAvail* vblk_avail = 0;
+static VirtqUsed* vblk_used = 0;
+static unsigned short vblk_avail_idx = 0;
+static unsigned short vblk_last_used = 0;
+static VirtioBlkSlot* vblk_slots = 0;
+static DiskRequest* vblk_slot_req[VIRTIO_BLK_SLOTS];
+static unsigned int vblk_depth = 0;
+static unsigned int vblk_busy = 0;       // 占用中的槽
+static unsigned int vblk_flushing = 0;   // 写已完成、正在 FLUSH 的槽
+static int vblk_indirect = 0;
+static int vblk_need_flush = 0;
+static int vblk_irq = 0;
+static unsigned int vblk_sectors = 0;
+
+static inline void outw(unsigned short port, unsigned short value) {
+    __asm__ __volatile__("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline unsigned short inw(unsigned short port) {
+    unsigned short ret;
+    __asm__ __volatile__("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(unsigned short port, unsigned int value) {
+    __asm__ __volatile__("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline unsigned int inl(unsigned short port) {
+    unsigned int ret;
+    __asm__ __volatile__("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// x86 的写不会越过先前的写，挡住编译器重排即可
+static inline void ring_barrier(void) {
+    __asm__ __volatile__("" ::: "memory");
+}
+
+static unsigned int align_up(unsigned int value, unsigned int align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+// legacy 布局：描述符表、avail 环紧接，used 环从下一个 4 KiB 边界开始
+static int setup_queue(void) {
+    unsigned int used_offset;
+    unsigned int bytes;
+    unsigned int ring;
+
+    outw(vblk_io + VIO_QUEUE_SELECT, 0);
+    vblk_queue_size = inw(vblk_io + VIO_QUEUE_SIZE);
+    if (vblk_queue_size == 0) return 0;
+    used_offset = align_up(16 * vblk_queue_size + 6 + 2 * vblk_queue_size, VRING_ALIGN);
+    bytes = used_offset + align_up(6 + 8 * vblk_queue_size, VRING_ALIGN);
+
+    ring = (unsigned int)malloc_aligned(bytes, VRING_ALIGN);
+    if (!ring) return 0;
+    vblk_desc = (VirtqDesc*)ring;
+    vblk_avail = (VirtqAvail*)(ring + 16 * vblk_queue_size);
+    vblk_used = (VirtqUsed*)(ring + used_offset);
+    outl(vblk_io + VIO_QUEUE_PFN, ring / VRING_ALIGN);
+    return 1;
+}
+
+int virtio_blk_init(void) {
+    PciDeviceInfo dev;
+    unsigned int features;
+    unsigned short cmd;
+
+    if (!pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &dev) || !(dev.bar[0] & 0x1)) return 0;
+    // 开启 I/O Space + Bus Master
+    cmd = pci_config_read_word(dev.bus, dev.slot, dev.func, 0x04);
+    cmd |= 0x0005;
+    pci_config_write_word(dev.bus, dev.slot, dev.func, 0x04, cmd);
+    vblk_io = (unsigned short)(dev.bar[0] & 0xFFFCu);
+
+    // 复位后依次置 ACKNOWLEDGE、DRIVER，协商特性，建好队列再置 DRIVER_OK
+    outb(vblk_io + VIO_STATUS, 0);
+    outb(vblk_io + VIO_STATUS, STATUS_ACKNOWLEDGE);
+    outb(vblk_io + VIO_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+    features = inl(vblk_io + VIO_DEVICE_FEATURES);
+    if (features & VIRTIO_BLK_F_RO) {
+        outb(vblk_io + VIO_STATUS, STATUS_FAILED);
+        vblk_io = 0;
+        return 0;
+    }
+    features &= VIRTIO_BLK_F_FLUSH | VIRTIO_RING_F_INDIRECT;
+    outl(vblk_io + VIO_GUEST_FEATURES, features);
+    vblk_sectors = inl(vblk_io + VIO_CONFIG + 4) ? 0xFFFFFFFFu : inl(vblk_io + VIO_CONFIG);
+    vblk_indirect = (features & VIRTIO_RING_F_INDIRECT) != 0;
+    vblk_need_flush = (features & VIRTIO_BLK_F_FLUSH) != 0;
+
+    if (!setup_queue()) {
+        outb(vblk_io + VIO_STATUS, STATUS_FAILED);
+        vblk_io = 0;
+        return 0;
+    }
+    // 间接描述符时一个请求占环上一项；否则占连续 SLOT_DESCS 项
+    vblk_depth = vblk_indirect ? vblk_queue_size : vblk_queue_size / SLOT_DESCS;
+    if (vblk_depth > VIRTIO_BLK_SLOTS) vblk_depth = VIRTIO_BLK_SLOTS;
+    vblk_slots = vblk_depth ? (VirtioBlkSlot*)malloc_aligned(vblk_depth * sizeof(VirtioBlkSlot), 16) : 0;
+    if (!vblk_slots) {
+        // 复位设备让它放开环，再把环还给堆
+        outb(vblk_io + VIO_STATUS, 0);
+        outl(vblk_io + VIO_QUEUE_PFN, 0);
+        outb(vblk_io + VIO_STATUS, STATUS_FAILED);
+        free_aligned(vblk_desc);
+        vblk_desc = 0;
+        vblk_avail = 0;
+        vblk_used = 0;
+        vblk_io = 0;
+        return 0;
+    }
+
+    // 中断线在 IRQ9..11 上 (kernel_entry.asm 接了这三条) 才用中断，否则让设备别发
+    if (dev.irq_line >= 9 && dev.irq_line <= 11) {
+        outb(0xA1, inb(0xA1) & (unsigned char)~(1 << (dev.irq_line - 8)));
+        vblk_irq = 1;
+    } else {
+        vblk_avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    }
+    outb(vblk_io + VIO_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+    return 1;
+}
+
+int virtio_blk_available(void) {
+    return vblk_io != 0;
+}
+
+unsigned int virtio_blk_queue_depth(void) {
+    return vblk_depth;
+}
+
+unsigned int virtio_blk_capacity(void) {
+    return vblk_sectors;
+}
+
+int virtio_blk_irq_enabled(void) {
+    return vblk_irq;
+}
+
+// 槽的描述符链：间接时在槽自己的表里，否则在环上第 slot * SLOT_DESCS 项起
+static VirtqDesc* slot_descs(unsigned int slot, unsigned short* base) {
+    if (vblk_indirect) {
+        *base = 0;
+        return vblk_slots[slot].table;
+    }
+    *base = (unsigned short)(slot * SLOT_DESCS);
+    return &vblk_desc[*base];
+}
+
+static void set_desc(VirtqDesc* d, unsigned int addr, unsigned int len, unsigned short flags) {
+    d->addr = addr;
+    d->addr_hi = 0;
+    d->len = len;
+    d->flags = flags;
+}
+
+// 填好第 slot 槽的 n 项描述符后把链头放进 avail 环并通知设备
+static void post_slot(unsigned int slot, unsigned int n) {
+    unsigned short base;
+    VirtqDesc* d = slot_descs(slot, &base);
+    unsigned short head = base;
+
+    for (unsigned int i = 0; i + 1 < n; i++) {
+        d[i].flags |= VRING_DESC_F_NEXT;
+        d[i].next = (unsigned short)(base + i + 1);
+    }
+    d[n - 1].next = 0;
+    if (vblk_indirect) {
+        head = (unsigned short)slot;
+        set_desc(&vblk_desc[head], (unsigned int)d, n * sizeof(VirtqDesc), VRING_DESC_F_INDIRECT);
+    }
+    vblk_slots[slot].status = 0xFF;
+    vblk_avail->ring[vblk_avail_idx % vblk_queue_size] = head;
+    ring_barrier();
+    vblk_avail->idx = ++vblk_avail_idx;
+    ring_barrier();
+    outw(vblk_io + VIO_QUEUE_NOTIFY, 0);
+}
+
+static void post_request(unsigned int slot, unsigned int type, unsigned int sector, unsigned int n_data) {
+    unsigned short base;
+    VirtqDesc* d = slot_descs(slot, &base);
+    VirtioBlkSlot* s = &vblk_slots[slot];
+
+    s->header.type = type;
+    s->header.reserved = 0;
+    s->header.sector = sector;
+    s->header.sector_hi = 0;
+    set_desc(&d[0], (unsigned int)&s->header, sizeof(s->header), 0);
+    set_desc(&d[n_data + 1], (unsigned int)&s->status, 1, VRING_DESC_F_WRITE);
+    post_slot(slot, n_data + 2);
+}
+
+int virtio_blk_issue(DiskRequest* cmd) {
+    unsigned short base;
+    VirtqDesc* d;
+    unsigned int slot;
+    unsigned int n = 0;
+
+    for (slot = 0; slot < vblk_depth; slot++) {
+        if (!(vblk_busy & (1u << slot))) break;
+    }
+    if (slot == vblk_depth) return 0;
+
+    // 数据段从第 1 项起，物理上紧接的段并成一项
+    d = slot_descs(slot, &base);
+    for (const DiskRequest* seg = cmd; seg; seg = seg->merged) {
+        unsigned int bytes = seg->count * SECTOR_SIZE;
+
+        if (!seg->phys) return -1;
+        if (n > 0 && d[n].addr + d[n].len == seg->phys) {
+            d[n].len += bytes;
+            continue;
+        }
+        if (n == VIRTIO_BLK_SEGMENTS) return -1;
+        n++;
+        set_desc(&d[n], seg->phys, bytes, cmd->write ? 0 : VRING_DESC_F_WRITE);
+    }
+
+    vblk_slot_req[slot] = cmd;
+    vblk_busy |= 1u << slot;
+    post_request(slot, cmd->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN, cmd->lba, n);
+    return 1;
+}
+
+DiskRequest* virtio_blk_reap(int* status) {
+    if (!vblk_io) return 0;
+    // 读 ISR 即应答中断 (电平触发，不读线一直拉着)
+    inb(vblk_io + VIO_ISR);
+
+    while (vblk_last_used != vblk_used->idx) {
+        unsigned int id;
+        unsigned int slot;
+        unsigned int bit;
+        DiskRequest* req;
+        int ok;
+
+        ring_barrier();
+        id = vblk_used->ring[vblk_last_used % vblk_queue_size].id;
+        vblk_last_used++;
+        slot = vblk_indirect ? id : id / SLOT_DESCS;
+        if (slot >= vblk_depth || !(vblk_busy & (1u << slot))) continue;
+        bit = 1u << slot;
+        req = vblk_slot_req[slot];
+        ok = vblk_slots[slot].status == 0;
+
+        // 写进了设备缓存：同一个槽接着发 FLUSH
+        if (ok && vblk_need_flush && req->write && !(vblk_flushing & bit)) {
+            vblk_flushing |= bit;
+            post_request(slot, VIRTIO_BLK_T_FLUSH, 0, 0);
+            continue;
+        }
+        vblk_flushing &= ~bit;
+        vblk_busy &= ~bit;
+        vblk_slot_req[slot] = 0;
+        *status = ok ? 0 : -1;
+        return req;
+    }
+    return 0;
+}
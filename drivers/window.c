@@ -270,7 +270,7 @@ void win_handle_mouse(ps2_mouse_event_t* event, int mx, int my) {
                     int by = w->y + (TITLE_BAR_HEIGHT - 11) / 2;
                     if (mx >= bx && mx < bx + 11 && my >= by && my < by + 11) {
                         Process* owner = process_find_by_window(w);
-                        if (owner && owner->pid != 0) { klog_write_pair("window close ", owner->name); owner->state = PROCESS_DEAD; owner->win = 0; }
+                        if (owner && owner->pid != 0) { klog_write_pair("window close ", owner->name); process_kill(owner); owner->win = 0; }
                         destroy_locked(w); irq_restore(flags); return;
                     }
                 }
@@ -0,0 +1,553 @@
+// bcache.c - 文件系统块缓存
+#include "bcache.h"
+#include "iosched.h"
+#include "heap.h"
+#include "utils.h"
+
+#define BCACHE_NONE (-1)
+
+typedef struct {
+    unsigned int block_num;
+    unsigned char valid;
+    unsigned char dirty;
+    unsigned char readahead;   // 预读装入且尚未被读到
+    unsigned char meta;        // 未提交到日志的元数据，不能写回原位置
+    unsigned char io;          // 有异步请求在途：读未完成时内容无效，写未完成时内容不能改
+    short hash_next;
+    short lru_prev;   // 更近使用的一侧
+    short lru_next;   // 更久未用的一侧
+} BcacheEntry;
+
+// 异步请求槽位：预读一段连续块读进暂存区，完成时拷进各自的槽位；写回一次一块，
+// 直接从槽位数据写出
+typedef struct {
+    DiskRequest req;
+    unsigned char* staging;   // 预读暂存区，写回请求为 0
+    unsigned int block_num;
+    unsigned int blocks;
+    unsigned char busy;
+} BcacheIo;
+
+// 数据区按字节总量固定，块越大槽位越少
+static BcacheEntry bcache_entries[BCACHE_ENTRIES];
+static unsigned char bcache_pool[BCACHE_POOL_BYTES];
+static unsigned int bcache_block_bytes = BCACHE_MIN_BLOCK_SIZE;
+static unsigned int bcache_sectors_per_block = BCACHE_MIN_BLOCK_SIZE / SECTOR_SIZE;
+// 单条命令最多读这么多块 (disk_max_sectors()，bcache_init() 时按驱动算)
+static unsigned int bcache_direct_max_blocks = DISK_MAX_SECTORS_LBA28 / (BCACHE_MIN_BLOCK_SIZE / SECTOR_SIZE);
+static short bcache_slots = BCACHE_ENTRIES;
+static short bcache_hash[BCACHE_HASH_BUCKETS];
+static short bcache_lru_head = BCACHE_NONE;  // 最近使用
+static short bcache_lru_tail = BCACHE_NONE;  // 最久未用
+static unsigned int bcache_base_sector = 0;
+static unsigned int bcache_dirty_count = 0;
+static unsigned int bcache_meta_count = 0;
+static int (*bcache_commit_hook)(void) = 0;
+static BcacheStats bcache_stats;
+static BcacheIo bcache_io[BCACHE_IO_SLOTS];
+static unsigned int bcache_io_busy = 0;
+static unsigned int bcache_io_blocks = 0;   // io 标记的条目数
+
+static unsigned char* entry_data(short idx) {
+    return bcache_pool + (unsigned int)idx * bcache_block_bytes;
+}
+
+static unsigned int bcache_bucket(unsigned int block_num) {
+    return ((block_num * 2654435761u) >> 16) % BCACHE_HASH_BUCKETS;
+}
+
+static void lru_unlink(short idx) {
+    BcacheEntry* e = &bcache_entries[idx];
+    if (e->lru_prev != BCACHE_NONE) bcache_entries[e->lru_prev].lru_next = e->lru_next;
+    else bcache_lru_head = e->lru_next;
+    if (e->lru_next != BCACHE_NONE) bcache_entries[e->lru_next].lru_prev = e->lru_prev;
+    else bcache_lru_tail = e->lru_prev;
+    e->lru_prev = BCACHE_NONE;
+    e->lru_next = BCACHE_NONE;
+}
+
+static void lru_push_front(short idx) {
+    BcacheEntry* e = &bcache_entries[idx];
+    e->lru_prev = BCACHE_NONE;
+    e->lru_next = bcache_lru_head;
+    if (bcache_lru_head != BCACHE_NONE) bcache_entries[bcache_lru_head].lru_prev = idx;
+    bcache_lru_head = idx;
+    if (bcache_lru_tail == BCACHE_NONE) bcache_lru_tail = idx;
+}
+
+static void lru_touch(short idx) {
+    if (bcache_lru_head == idx) return;
+    lru_unlink(idx);
+    lru_push_front(idx);
+}
+
+static void hash_remove(short idx) {
+    unsigned int bucket = bcache_bucket(bcache_entries[idx].block_num);
+    short* link = &bcache_hash[bucket];
+    while (*link != BCACHE_NONE) {
+        if (*link == idx) {
+            *link = bcache_entries[idx].hash_next;
+            bcache_entries[idx].hash_next = BCACHE_NONE;
+            return;
+        }
+        link = &bcache_entries[*link].hash_next;
+    }
+}
+
+static void hash_insert(short idx) {
+    unsigned int bucket = bcache_bucket(bcache_entries[idx].block_num);
+    bcache_entries[idx].hash_next = bcache_hash[bucket];
+    bcache_hash[bucket] = idx;
+}
+
+static short bcache_lookup(unsigned int block_num) {
+    short idx = bcache_hash[bcache_bucket(block_num)];
+    while (idx != BCACHE_NONE) {
+        if (bcache_entries[idx].valid && bcache_entries[idx].block_num == block_num) return idx;
+        idx = bcache_entries[idx].hash_next;
+    }
+    return BCACHE_NONE;
+}
+
+// 同 bcache_lookup，但先等该块在途的异步请求完成 (读失败时条目会被丢弃，需要重查)
+static short bcache_find(unsigned int block_num) {
+    short idx = bcache_lookup(block_num);
+    while (idx != BCACHE_NONE && bcache_entries[idx].io) {
+        iosched_wait_any();
+        idx = bcache_lookup(block_num);
+    }
+    return idx;
+}
+
+static void clear_meta(short idx) {
+    if (!bcache_entries[idx].meta) return;
+    bcache_entries[idx].meta = 0;
+    bcache_meta_count--;
+}
+
+// 异步请求完成回调，在 iosched_poll() / iosched_wait_any() 里执行；调用它们的地方缓存结构都是完整的
+static void bcache_io_done(DiskRequest* req) {
+    BcacheIo* io = (BcacheIo*)req->ctx;
+
+    for (unsigned int k = 0; k < io->blocks; k++) {
+        short idx = bcache_lookup(io->block_num + k);
+        BcacheEntry* e;
+
+        if (idx == BCACHE_NONE || !bcache_entries[idx].io) continue;
+        e = &bcache_entries[idx];
+        e->io = 0;
+        bcache_io_blocks--;
+        if (!io->staging) {
+            // 写回：成功的元数据块已落到原位置；checkpoint 失败的块保持脏的待提交元数据，
+            // 日志里的事务因此不会被作废，其它块与同步写一样不重试
+            if (req->status == 0) {
+                clear_meta(idx);
+            } else {
+                bcache_stats.write_errors++;
+                if (e->meta && !e->dirty) {
+                    e->dirty = 1;
+                    bcache_dirty_count++;
+                }
+            }
+            continue;
+        }
+        if (req->status == 0) {
+            memcpy(entry_data(idx), io->staging + k * bcache_block_bytes, bcache_block_bytes);
+        } else {
+            // 预读失败就当没读过，之后按需读时再走同步路径
+            hash_remove(idx);
+            e->valid = 0;
+            e->readahead = 0;
+        }
+    }
+    if (io->staging) free(io->staging);
+    io->staging = 0;
+    io->busy = 0;
+    bcache_io_busy--;
+}
+
+// 取一个空闲请求槽位并立即标记占用；全忙时推进队列等最早的请求完成
+static BcacheIo* io_slot(void) {
+    while (1) {
+        for (int i = 0; i < BCACHE_IO_SLOTS; i++) {
+            if (bcache_io[i].busy) continue;
+            bcache_io[i].busy = 1;
+            bcache_io_busy++;
+            if (bcache_io_busy > bcache_stats.max_in_flight) bcache_stats.max_in_flight = bcache_io_busy;
+            return &bcache_io[i];
+        }
+        iosched_wait_any();
+    }
+}
+
+static void io_submit(BcacheIo* io, unsigned int block_num, unsigned int blocks,
+                      void* buffer, int write, unsigned char* staging) {
+    memset(&io->req, 0, sizeof(io->req));
+    io->staging = staging;
+    io->block_num = block_num;
+    io->blocks = blocks;
+    io->req.lba = bcache_base_sector + block_num * bcache_sectors_per_block;
+    io->req.count = blocks * bcache_sectors_per_block;
+    io->req.buffer = buffer;
+    io->req.write = (unsigned char)write;
+    io->req.on_done = bcache_io_done;
+    io->req.ctx = io;
+    bcache_stats.async_requests++;
+    iosched_submit(&io->req);
+}
+
+static void bcache_io_drain(void) {
+    while (bcache_io_busy > 0) iosched_wait_any();
+}
+
+// 提交一个脏块的异步写回；请求完成前槽位被 io 标记钉住
+static void writeback_submit(short idx) {
+    BcacheEntry* e = &bcache_entries[idx];
+
+    if (!e->valid || !e->dirty || e->io) return;
+    e->dirty = 0;
+    e->io = 1;
+    bcache_dirty_count--;
+    bcache_io_blocks++;
+    bcache_stats.writebacks++;
+    io_submit(io_slot(), e->block_num, 1, entry_data(idx), 1, 0);
+}
+
+// 淘汰前的同步写回：槽位马上要换给别的块，写失败也只能记下
+static void bcache_writeback(short idx) {
+    BcacheEntry* e = &bcache_entries[idx];
+    if (!e->valid || !e->dirty) return;
+    if (iosched_rw(bcache_base_sector + e->block_num * bcache_sectors_per_block,
+                   bcache_sectors_per_block, entry_data(idx), 1) != 0) {
+        bcache_stats.write_errors++;
+    }
+    e->dirty = 0;
+    bcache_dirty_count--;
+    bcache_stats.writebacks++;
+}
+
+// 从 LRU 尾部往前找第一个可以淘汰的条目 (未提交的元数据与请求在途的块除外)
+static short pick_victim(void) {
+    short idx = bcache_lru_tail;
+    while (idx != BCACHE_NONE && (bcache_entries[idx].meta || bcache_entries[idx].io)) {
+        idx = bcache_entries[idx].lru_prev;
+    }
+    return idx;
+}
+
+// 取最久未用的条目并重新绑定到 block_num，脏块先写回
+static short bcache_claim(unsigned int block_num) {
+    short idx = pick_victim();
+    BcacheEntry* e;
+
+    if (idx == BCACHE_NONE) {
+        // 所有槽位都钉住了：先等在途请求，再提交日志；提交失败时只能直接写回
+        bcache_io_drain();
+        idx = pick_victim();
+    }
+    if (idx == BCACHE_NONE) {
+        if (bcache_commit_hook) bcache_commit_hook();
+        idx = pick_victim();
+        if (idx == BCACHE_NONE) {
+            idx = bcache_lru_tail;
+            while (bcache_entries[idx].io) idx = bcache_entries[idx].lru_prev;
+        }
+    }
+    e = &bcache_entries[idx];
+    clear_meta(idx);
+
+    if (e->valid) {
+        bcache_writeback(idx);
+        hash_remove(idx);
+        bcache_stats.evictions++;
+    }
+    e->block_num = block_num;
+    e->valid = 1;
+    e->dirty = 0;
+    e->readahead = 0;
+    hash_insert(idx);
+    lru_touch(idx);
+    return idx;
+}
+
+void bcache_init(unsigned int base_sector, unsigned int block_size) {
+    // 重新挂载前让在途请求落地，回调还要访问旧的槽位
+    bcache_io_drain();
+    if (block_size < BCACHE_MIN_BLOCK_SIZE || block_size > BCACHE_MAX_BLOCK_SIZE) block_size = BCACHE_MIN_BLOCK_SIZE;
+    bcache_base_sector = base_sector;
+    bcache_block_bytes = block_size;
+    bcache_sectors_per_block = block_size / SECTOR_SIZE;
+    bcache_direct_max_blocks = disk_max_sectors() / bcache_sectors_per_block;
+    bcache_slots = (short)(BCACHE_POOL_BYTES / block_size);
+    if (bcache_slots > BCACHE_ENTRIES) bcache_slots = BCACHE_ENTRIES;
+    bcache_lru_head = BCACHE_NONE;
+    bcache_lru_tail = BCACHE_NONE;
+    bcache_dirty_count = 0;
+    bcache_meta_count = 0;
+    bcache_io_blocks = 0;
+    memset(&bcache_stats, 0, sizeof(bcache_stats));
+    for (int i = 0; i < BCACHE_HASH_BUCKETS; i++) bcache_hash[i] = BCACHE_NONE;
+    for (short i = 0; i < BCACHE_ENTRIES; i++) {
+        bcache_entries[i].block_num = 0;
+        bcache_entries[i].valid = 0;
+        bcache_entries[i].dirty = 0;
+        bcache_entries[i].readahead = 0;
+        bcache_entries[i].meta = 0;
+        bcache_entries[i].io = 0;
+        bcache_entries[i].hash_next = BCACHE_NONE;
+        bcache_entries[i].lru_prev = BCACHE_NONE;
+        bcache_entries[i].lru_next = BCACHE_NONE;
+        if (i < bcache_slots) lru_push_front(i);
+    }
+}
+
+unsigned int bcache_block_size(void) {
+    return bcache_block_bytes;
+}
+
+unsigned int bcache_capacity(void) {
+    return (unsigned int)bcache_slots;
+}
+
+int bcache_read(unsigned int block_num, void* buffer) {
+    short idx;
+
+    if (!buffer) return -1;
+    idx = bcache_find(block_num);
+    if (idx != BCACHE_NONE) {
+        bcache_stats.hits++;
+        if (bcache_entries[idx].readahead) {
+            bcache_entries[idx].readahead = 0;
+            bcache_stats.readahead_hits++;
+        }
+        lru_touch(idx);
+    } else {
+        bcache_stats.misses++;
+        idx = bcache_claim(block_num);
+        if (iosched_rw(bcache_base_sector + block_num * bcache_sectors_per_block,
+                       bcache_sectors_per_block, entry_data(idx), 0) != 0) {
+            // 与预读失败一样不留在缓存里，下次读到时重新发命令
+            hash_remove(idx);
+            bcache_entries[idx].valid = 0;
+            bcache_entries[idx].readahead = 0;
+            memset(buffer, 0, bcache_block_bytes);
+            return -1;
+        }
+    }
+    memcpy(buffer, entry_data(idx), bcache_block_bytes);
+    return 0;
+}
+
+void bcache_write(unsigned int block_num, const void* buffer) {
+    short idx;
+
+    if (!buffer) return;
+    idx = bcache_find(block_num);
+    if (idx != BCACHE_NONE) lru_touch(idx);
+    else idx = bcache_claim(block_num);
+
+    memcpy(entry_data(idx), buffer, bcache_block_bytes);
+    if (!bcache_entries[idx].dirty) {
+        bcache_entries[idx].dirty = 1;
+        bcache_dirty_count++;
+    }
+}
+
+void bcache_write_meta(unsigned int block_num, const void* buffer) {
+    short idx;
+
+    if (!buffer) return;
+    bcache_write(block_num, buffer);
+    idx = bcache_lookup(block_num);
+    if (bcache_commit_hook && idx != BCACHE_NONE && !bcache_entries[idx].meta) {
+        bcache_entries[idx].meta = 1;
+        bcache_meta_count++;
+    }
+}
+
+int bcache_read_direct(unsigned int block_num, unsigned int count, void* buffer) {
+    unsigned char* dst = (unsigned char*)buffer;
+
+    if (!buffer) return -1;
+    for (unsigned int done = 0; done < count; ) {
+        unsigned int chunk = count - done;
+        if (chunk > bcache_direct_max_blocks) chunk = bcache_direct_max_blocks;
+        if (iosched_rw(bcache_base_sector + (block_num + done) * bcache_sectors_per_block,
+                       chunk * bcache_sectors_per_block, dst + done * bcache_block_bytes, 0) != 0) {
+            return -1;
+        }
+        done += chunk;
+    }
+
+    // 尚未写回的块磁盘上是旧内容，用缓存副本覆盖
+    if (bcache_dirty_count == 0) return 0;
+    for (unsigned int i = 0; i < count; i++) {
+        short idx = bcache_lookup(block_num + i);
+        if (idx != BCACHE_NONE && bcache_entries[idx].dirty) {
+            memcpy(dst + i * bcache_block_bytes, entry_data(idx), bcache_block_bytes);
+        }
+    }
+    return 0;
+}
+
+void bcache_prefetch(unsigned int block_num, unsigned int count) {
+    unsigned int i = 0;
+
+    if (count == 0) return;
+    if (count > bcache_direct_max_blocks) count = bcache_direct_max_blocks;
+
+    while (i < count) {
+        unsigned char* staging;
+        unsigned int run = 0;
+
+        if (bcache_lookup(block_num + i) != BCACHE_NONE) {
+            i++;
+            continue;
+        }
+        while (i + run < count && bcache_lookup(block_num + i + run) == BCACHE_NONE) run++;
+        // 在途的预读不能把缓存自己挤满
+        if (bcache_io_blocks + run > (unsigned int)bcache_slots / 2) {
+            if (bcache_io_blocks >= (unsigned int)bcache_slots / 2) return;
+            run = (unsigned int)bcache_slots / 2 - bcache_io_blocks;
+        }
+        staging = (unsigned char*)malloc(run * bcache_block_bytes);
+        if (!staging) return;
+        // 先占槽位再提交：回调按块号找回这些条目
+        for (unsigned int k = 0; k < run; k++) {
+            short idx = bcache_claim(block_num + i + k);
+            bcache_entries[idx].readahead = 1;
+            bcache_entries[idx].io = 1;
+            bcache_io_blocks++;
+            bcache_stats.readahead_blocks++;
+        }
+        io_submit(io_slot(), block_num + i, run, staging, 0, staging);
+        i += run;
+    }
+}
+
+unsigned int bcache_poll_io(void) {
+    if (bcache_io_busy > 0) iosched_poll();
+    return bcache_io_busy;
+}
+
+int bcache_contains(unsigned int block_num) {
+    return bcache_lookup(block_num) != BCACHE_NONE;
+}
+
+int bcache_sync(void) {
+    int written = 0;
+    unsigned int budget;
+
+    // 元数据必须先进日志才能写回原位置
+    if (bcache_meta_count > 0 && bcache_commit_hook) bcache_commit_hook();
+
+    // 按块号升序写回，减少磁头来回移动；写失败重新记脏的元数据块本轮不再重写
+    budget = bcache_dirty_count;
+    while (bcache_dirty_count > 0 && budget-- > 0) {
+        short best = BCACHE_NONE;
+        for (short i = 0; i < bcache_slots; i++) {
+            if (!bcache_entries[i].valid || !bcache_entries[i].dirty) continue;
+            if (best == BCACHE_NONE ||
+                bcache_entries[i].block_num < bcache_entries[best].block_num) best = i;
+        }
+        if (best == BCACHE_NONE) {
+            bcache_dirty_count = 0;
+            break;
+        }
+        writeback_submit(best);
+        written++;
+    }
+    bcache_io_drain();
+    return written;
+}
+
+int bcache_has_dirty(void) {
+    return bcache_dirty_count != 0;
+}
+
+void bcache_set_commit_hook(int (*hook)(void)) {
+    bcache_commit_hook = hook;
+    if (!hook) {
+        for (short i = 0; i < bcache_slots; i++) clear_meta(i);
+    }
+}
+
+unsigned int bcache_meta_blocks(void) {
+    return bcache_meta_count;
+}
+
+unsigned int bcache_list_meta(unsigned int* blocks, unsigned int max) {
+    unsigned int count = 0;
+
+    if (!blocks) return 0;
+    for (short i = 0; i < bcache_slots && count < max; i++) {
+        unsigned int pos;
+        if (!bcache_entries[i].valid || !bcache_entries[i].meta) continue;
+        // 插入排序，条目数很少
+        pos = count++;
+        while (pos > 0 && blocks[pos - 1] > bcache_entries[i].block_num) {
+            blocks[pos] = blocks[pos - 1];
+            pos--;
+        }
+        blocks[pos] = bcache_entries[i].block_num;
+    }
+    return count;
+}
+
+const void* bcache_peek(unsigned int block_num) {
+    short idx = bcache_find(block_num);
+    return idx == BCACHE_NONE ? 0 : entry_data(idx);
+}
+
+int bcache_sync_data(void) {
+    int written = 0;
+
+    for (short i = 0; i < bcache_slots; i++) {
+        if (!bcache_entries[i].valid || !bcache_entries[i].dirty || bcache_entries[i].meta) continue;
+        writeback_submit(i);
+        written++;
+    }
+    bcache_io_drain();
+    return written;
+}
+
+int bcache_checkpoint_meta(void) {
+    int written = 0;
+    unsigned int errors = bcache_stats.write_errors;
+
+    // meta 标记在写成功时才由完成回调清掉
+    for (short i = 0; i < bcache_slots; i++) {
+        if (!bcache_entries[i].meta) continue;
+        if (bcache_entries[i].dirty) {
+            writeback_submit(i);
+            written++;
+        } else if (!bcache_entries[i].io) {
+            clear_meta(i);
+        }
+    }
+    bcache_io_drain();
+    return bcache_stats.write_errors == errors ? written : -1;
+}
+
+int bcache_write_direct(unsigned int block_num, unsigned int count, const void* buffer) {
+    const unsigned char* src = (const unsigned char*)buffer;
+
+    if (!buffer) return -1;
+    for (unsigned int done = 0; done < count; ) {
+        unsigned int chunk = count - done;
+        if (chunk > bcache_direct_max_blocks) chunk = bcache_direct_max_blocks;
+        if (iosched_rw(bcache_base_sector + (block_num + done) * bcache_sectors_per_block,
+                       chunk * bcache_sectors_per_block, (void*)(src + done * bcache_block_bytes), 1) != 0) {
+            bcache_stats.write_errors++;
+            return -1;
+        }
+        done += chunk;
+    }
+    return 0;
+}
+
+void bcache_get_stats(BcacheStats* out) {
+    if (!out) return;
+    *out = bcache_stats;
+    out->dirty_blocks = bcache_dirty_count;
+}
@@ -0,0 +1,259 @@
+// dcache.c - 目录项缓存与目录哈希索引
+#include "dcache.h"
+#include "heap.h"
+#include "utils.h"
+
+#define DINDEX_SLOT_EMPTY 0u
+#define DINDEX_SLOT_DEAD  1u
+#define DINDEX_MIN_SLOTS  64u
+
+typedef struct {
+    unsigned int dir_inode;   // 0 表示空项
+    unsigned int inode;       // 0 表示负向项：目录中不存在该名字
+    unsigned int hash;
+    unsigned int last_used;
+    char name[DCACHE_NAME_MAX];
+} DcacheEntry;
+
+typedef struct {
+    unsigned int hash;
+    unsigned int tag;         // location + 2，0/1 保留给空槽与墓碑
+} DindexSlot;
+
+typedef struct {
+    unsigned int dir_inode;   // 0 表示未使用
+    unsigned int last_used;
+    unsigned int used;        // 有效项 + 墓碑
+    unsigned int capacity;    // 2 的幂
+    unsigned int space_hint;
+    DindexSlot* slots;
+} DirIndex;
+
+static DcacheEntry dcache_entries[DCACHE_SETS][DCACHE_WAYS];
+static DirIndex dindex_dirs[DINDEX_DIRS];
+static unsigned int dcache_clock = 0;
+static unsigned int dcache_hits = 0;
+static unsigned int dcache_misses = 0;
+
+unsigned int dcache_name_hash(const char* name) {
+    unsigned int hash = 2166136261u;
+
+    if (!name) return 0;
+    while (*name) {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static DcacheEntry* dcache_set(unsigned int dir_inode, unsigned int hash) {
+    return dcache_entries[(hash ^ (dir_inode * 2654435761u)) % DCACHE_SETS];
+}
+
+static DcacheEntry* dcache_find(unsigned int dir_inode, const char* name, unsigned int hash) {
+    DcacheEntry* set = dcache_set(dir_inode, hash);
+
+    for (int i = 0; i < DCACHE_WAYS; i++) {
+        if (set[i].dir_inode == dir_inode && set[i].hash == hash &&
+            strcmp(set[i].name, name) == 0) {
+            return &set[i];
+        }
+    }
+    return 0;
+}
+
+void dcache_reset(void) {
+    memset(dcache_entries, 0, sizeof(dcache_entries));
+    dcache_hits = 0;
+    dcache_misses = 0;
+    for (int i = 0; i < DINDEX_DIRS; i++) {
+        if (dindex_dirs[i].slots) free(dindex_dirs[i].slots);
+    }
+    memset(dindex_dirs, 0, sizeof(dindex_dirs));
+}
+
+int dcache_lookup(unsigned int dir_inode, const char* name, unsigned int hash, unsigned int* out_inode) {
+    DcacheEntry* e;
+
+    if (!name || !out_inode) return 0;
+    e = dcache_find(dir_inode, name, hash);
+    if (!e) {
+        dcache_misses++;
+        return 0;
+    }
+    dcache_hits++;
+    e->last_used = ++dcache_clock;
+    *out_inode = e->inode;
+    return 1;
+}
+
+void dcache_insert(unsigned int dir_inode, const char* name, unsigned int hash, unsigned int inode) {
+    DcacheEntry* set;
+    DcacheEntry* e;
+    int len;
+
+    if (!name || dir_inode == 0) return;
+    len = strlen(name);
+    if (len >= DCACHE_NAME_MAX) return;
+
+    e = dcache_find(dir_inode, name, hash);
+    if (!e) {
+        set = dcache_set(dir_inode, hash);
+        e = &set[0];
+        for (int i = 0; i < DCACHE_WAYS; i++) {
+            if (set[i].dir_inode == 0) {
+                e = &set[i];
+                break;
+            }
+            if (set[i].last_used < e->last_used) e = &set[i];
+        }
+        e->dir_inode = dir_inode;
+        e->hash = hash;
+        memcpy(e->name, name, len + 1);
+    }
+    e->inode = inode;
+    e->last_used = ++dcache_clock;
+}
+
+void dcache_get_stats(DcacheStats* out) {
+    if (!out) return;
+    out->hits = dcache_hits;
+    out->misses = dcache_misses;
+    out->indexed_dirs = 0;
+    for (int i = 0; i < DINDEX_DIRS; i++) {
+        if (dindex_dirs[i].dir_inode != 0) out->indexed_dirs++;
+    }
+}
+
+// ===== 目录哈希索引 =====
+
+static DirIndex* dindex_find(unsigned int dir_inode) {
+    if (dir_inode == 0) return 0;
+    for (int i = 0; i < DINDEX_DIRS; i++) {
+        if (dindex_dirs[i].dir_inode == dir_inode) return &dindex_dirs[i];
+    }
+    return 0;
+}
+
+static void dindex_release(DirIndex* index) {
+    if (!index) return;
+    if (index->slots) free(index->slots);
+    memset(index, 0, sizeof(*index));
+}
+
+static void dindex_place(DindexSlot* slots, unsigned int capacity, unsigned int hash, unsigned int tag) {
+    unsigned int i = hash & (capacity - 1);
+
+    while (slots[i].tag > DINDEX_SLOT_DEAD) i = (i + 1) & (capacity - 1);
+    slots[i].hash = hash;
+    slots[i].tag = tag;
+}
+
+// 扩容时顺带清掉墓碑
+static int dindex_grow(DirIndex* index, unsigned int capacity) {
+    DindexSlot* slots = (DindexSlot*)malloc(capacity * sizeof(DindexSlot));
+    unsigned int live = 0;
+
+    if (!slots) return 0;
+    memset(slots, 0, capacity * sizeof(DindexSlot));
+    for (unsigned int i = 0; i < index->capacity; i++) {
+        if (index->slots[i].tag <= DINDEX_SLOT_DEAD) continue;
+        dindex_place(slots, capacity, index->slots[i].hash, index->slots[i].tag);
+        live++;
+    }
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    index->used = live;
+    return 1;
+}
+
+int dindex_create(unsigned int dir_inode, unsigned int expected_entries) {
+    DirIndex* index = dindex_find(dir_inode);
+    unsigned int capacity = DINDEX_MIN_SLOTS;
+
+    if (dir_inode == 0) return 0;
+    if (!index) {
+        index = &dindex_dirs[0];
+        for (int i = 0; i < DINDEX_DIRS; i++) {
+            if (dindex_dirs[i].dir_inode == 0) {
+                index = &dindex_dirs[i];
+                break;
+            }
+            if (dindex_dirs[i].last_used < index->last_used) index = &dindex_dirs[i];
+        }
+    }
+    dindex_release(index);
+
+    while (capacity < expected_entries * 2) capacity <<= 1;
+    index->slots = (DindexSlot*)malloc(capacity * sizeof(DindexSlot));
+    if (!index->slots) return 0;
+    memset(index->slots, 0, capacity * sizeof(DindexSlot));
+    index->dir_inode = dir_inode;
+    index->capacity = capacity;
+    index->last_used = ++dcache_clock;
+    return 1;
+}
+
+int dindex_exists(unsigned int dir_inode) {
+    return dindex_find(dir_inode) != 0;
+}
+
+void dindex_drop(unsigned int dir_inode) {
+    dindex_release(dindex_find(dir_inode));
+}
+
+void dindex_insert(unsigned int dir_inode, unsigned int hash, unsigned int location) {
+    DirIndex* index = dindex_find(dir_inode);
+
+    if (!index) return;
+    // 装载因子超过 3/4 时翻倍；内存不足就放弃索引，退回线性扫描
+    if ((index->used + 1) * 4 > index->capacity * 3 && !dindex_grow(index, index->capacity * 2)) {
+        dindex_release(index);
+        return;
+    }
+    dindex_place(index->slots, index->capacity, hash, location + 2);
+    index->used++;
+}
+
+void dindex_remove(unsigned int dir_inode, unsigned int hash, unsigned int location) {
+    DirIndex* index = dindex_find(dir_inode);
+    unsigned int i;
+
+    if (!index) return;
+    i = hash & (index->capacity - 1);
+    for (unsigned int probes = 0; probes < index->capacity; probes++) {
+        DindexSlot* slot = &index->slots[i];
+        if (slot->tag == DINDEX_SLOT_EMPTY) return;
+        if (slot->hash == hash && slot->tag == location + 2) {
+            slot->tag = DINDEX_SLOT_DEAD;
+            return;
+        }
+        i = (i + 1) & (index->capacity - 1);
+    }
+}
+
+unsigned int dindex_next(unsigned int dir_inode, unsigned int hash, unsigned int* cursor) {
+    DirIndex* index = dindex_find(dir_inode);
+
+    if (!index || !cursor) return DINDEX_NONE;
+    if (*cursor == 0) index->last_used = ++dcache_clock;
+    while (*cursor < index->capacity) {
+        DindexSlot* slot = &index->slots[(hash + *cursor) & (index->capacity - 1)];
+        (*cursor)++;
+        if (slot->tag == DINDEX_SLOT_EMPTY) break;
+        if (slot->tag != DINDEX_SLOT_DEAD && slot->hash == hash) return slot->tag - 2;
+    }
+    *cursor = index->capacity;
+    return DINDEX_NONE;
+}
+
+unsigned int dindex_space_hint(unsigned int dir_inode) {
+    DirIndex* index = dindex_find(dir_inode);
+    return index ? index->space_hint : 0;
+}
+
+void dindex_set_space_hint(unsigned int dir_inode, unsigned int block_index) {
+    DirIndex* index = dindex_find(dir_inode);
+    if (index) index->space_hint = block_index;
+}
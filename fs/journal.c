@@ -0,0 +1,207 @@
+// journal.c - 元数据日志：成组提交与挂载时重放
+#include "journal.h"
+#include "bcache.h"
+#include "heap.h"
+#include "utils.h"
+
+// 提交时经该大小的暂存区分段顺序写出日志
+#define JOURNAL_STAGE_BYTES (16 * 1024)
+
+static unsigned int journal_start = 0;
+static unsigned int journal_blocks = 0;
+static unsigned int journal_sequence = 0;
+static int journal_active = 0;
+static JournalStats journal_stats;
+static unsigned char journal_block_buf[BCACHE_MAX_BLOCK_SIZE];
+
+static unsigned int journal_checksum(unsigned int sum, const void* data) {
+    const unsigned int* words = (const unsigned int*)data;
+
+    for (unsigned int i = 0; i < bcache_block_size() / 4; i++) {
+        sum = ((sum << 1) | (sum >> 31)) ^ words[i];
+    }
+    return sum;
+}
+
+// 序号只在日志超级块写成功后才在内存里前进，两边始终一致
+static int advance_sequence(void) {
+    JournalSuperBlock* jsb = (JournalSuperBlock*)journal_block_buf;
+
+    memset(journal_block_buf, 0, sizeof(journal_block_buf));
+    jsb->magic = JOURNAL_MAGIC;
+    jsb->block_size = bcache_block_size();
+    jsb->blocks = journal_blocks;
+    jsb->sequence = journal_sequence + 1;
+    if (bcache_write_direct(journal_start, 1, journal_block_buf) != 0) return -1;
+    journal_sequence++;
+    return 0;
+}
+
+// 日志块 1 起若有序号等于当前序号、提交块完整且校验通过的事务，就写回原位置
+static int journal_replay(void) {
+    unsigned int block_size = bcache_block_size();
+    unsigned char* buf = (unsigned char*)malloc(2 * block_size);
+    JournalDescriptor* desc = (JournalDescriptor*)buf;
+    const JournalCommit* commit;
+    unsigned char* block;
+    unsigned int sum;
+    unsigned int count;
+
+    if (!buf) return 0;
+    block = buf + block_size;
+    if (bcache_read_direct(journal_start + 1, 1, desc) != 0) {
+        free(buf);
+        return 0;
+    }
+    count = desc->count;
+    if (desc->magic != JOURNAL_DESC_MAGIC || desc->sequence != journal_sequence ||
+        count == 0 || count + 3 > journal_blocks ||
+        count > (block_size - sizeof(JournalDescriptor)) / 4) {
+        free(buf);
+        return 0;
+    }
+
+    sum = journal_checksum(0, desc);
+    for (unsigned int i = 0; i <= count; i++) {
+        if (bcache_read_direct(journal_start + 2 + i, 1, block) != 0) {
+            free(buf);
+            return 0;
+        }
+        if (i < count) sum = journal_checksum(sum, block);
+    }
+    commit = (const JournalCommit*)block;
+    if (commit->magic != JOURNAL_COMMIT_MAGIC || commit->sequence != journal_sequence ||
+        commit->count != count || commit->checksum != sum) {
+        // 提交块没写完：事务未生效，原位置还是旧的一致状态
+        free(buf);
+        return 0;
+    }
+
+    // 读不出或写不进的块都不能算重放完；序号不前进，下次挂载重放 (重放是幂等的)
+    for (unsigned int i = 0; i < count; i++) {
+        if (desc->blocks[i] == 0) continue;
+        if (bcache_read_direct(journal_start + 2 + i, 1, block) != 0) {
+            free(buf);
+            return JOURNAL_REPLAY_FAILED;
+        }
+        if (bcache_write_direct(desc->blocks[i], 1, block) != 0) {
+            free(buf);
+            return JOURNAL_REPLAY_FAILED;
+        }
+    }
+    free(buf);
+    if (advance_sequence() != 0) return JOURNAL_REPLAY_FAILED;
+    journal_stats.replayed += count;
+    return (int)count;
+}
+
+int journal_load(unsigned int start, unsigned int blocks) {
+    const JournalSuperBlock* jsb = (const JournalSuperBlock*)journal_block_buf;
+
+    journal_disable();
+    journal_blocks = 0;
+    memset(&journal_stats, 0, sizeof(journal_stats));
+    if (start == 0 || blocks < JOURNAL_MIN_BLOCKS) return -1;
+
+    if (bcache_read_direct(start, 1, journal_block_buf) != 0) return -1;
+    if (jsb->magic != JOURNAL_MAGIC || jsb->block_size != bcache_block_size() ||
+        jsb->blocks < JOURNAL_MIN_BLOCKS || jsb->blocks > blocks) {
+        return -1;
+    }
+    journal_start = start;
+    journal_blocks = jsb->blocks;
+    journal_sequence = jsb->sequence;
+    return journal_replay();
+}
+
+void journal_enable(void) {
+    if (journal_blocks == 0) return;
+    journal_active = 1;
+    bcache_set_commit_hook(journal_commit);
+}
+
+void journal_disable(void) {
+    journal_active = 0;
+    bcache_set_commit_hook(0);
+}
+
+int journal_enabled(void) {
+    return journal_active;
+}
+
+int journal_commit(void) {
+    unsigned int targets[BCACHE_ENTRIES];
+    JournalDescriptor* desc;
+    JournalCommit* commit = (JournalCommit*)journal_block_buf;
+    unsigned int block_size = bcache_block_size();
+    unsigned int stage_blocks = JOURNAL_STAGE_BYTES / block_size;
+    unsigned char* stage;
+    unsigned int count;
+    unsigned int sum;
+    unsigned int pos = 1;
+    unsigned int staged = 1;
+    int failed = 0;
+
+    if (!journal_active) return -1;
+    count = bcache_list_meta(targets, BCACHE_ENTRIES);
+    if (count == 0) return 0;
+
+    // ordered：数据块先落盘，提交后的元数据不会指向未写出的数据
+    bcache_sync_data();
+
+    stage = (unsigned char*)malloc(JOURNAL_STAGE_BYTES);
+    if (!stage) {
+        // 内存不足时退回无日志的直接写回
+        bcache_checkpoint_meta();
+        return -1;
+    }
+    desc = (JournalDescriptor*)stage;
+    memset(stage, 0, block_size);
+    desc->magic = JOURNAL_DESC_MAGIC;
+    desc->sequence = journal_sequence;
+    desc->count = count;
+    memcpy(desc->blocks, targets, count * sizeof(unsigned int));
+    sum = journal_checksum(0, desc);
+
+    for (unsigned int i = 0; i < count; i++) {
+        const void* data = bcache_peek(targets[i]);
+        unsigned char* slot = stage + staged * block_size;
+
+        if (data) memcpy(slot, data, block_size);
+        else memset(slot, 0, block_size);
+        sum = journal_checksum(sum, slot);
+        if (++staged == stage_blocks) {
+            if (bcache_write_direct(journal_start + pos, staged, stage) != 0) failed = 1;
+            pos += staged;
+            staged = 0;
+        }
+    }
+    if (staged > 0) {
+        if (bcache_write_direct(journal_start + pos, staged, stage) != 0) failed = 1;
+        pos += staged;
+    }
+    free(stage);
+    // 事务没有完整进日志就不能 checkpoint：元数据仍钉在缓存里，下次提交整个重写
+    if (failed) return -1;
+
+    // 提交块单独写出：它落盘之前崩溃，重放时整个事务都会被忽略
+    memset(journal_block_buf, 0, sizeof(journal_block_buf));
+    commit->magic = JOURNAL_COMMIT_MAGIC;
+    commit->sequence = journal_sequence;
+    commit->count = count;
+    commit->checksum = sum;
+    if (bcache_write_direct(journal_start + pos, 1, journal_block_buf) != 0) return -1;
+
+    // 每个块都写回原位置后序号才加一，旧事务不再被重放。有块没写成功时事务留在日志里
+    // (崩溃后挂载时重放)，这些块仍是待提交的元数据，下次提交连同新改动一起重写
+    if (bcache_checkpoint_meta() < 0 || advance_sequence() != 0) return -1;
+
+    journal_stats.commits++;
+    journal_stats.blocks += count;
+    return (int)count;
+}
+
+void journal_get_stats(JournalStats* out) {
+    if (!out) return;
+    *out = journal_stats;
+}
@@ -0,0 +1,135 @@
+// pagecache.c - 文件页缓存 (供 tlx_mmap 共享映射)
+#include "pagecache.h"
+#include "utils.h"
+
+typedef struct {
+    unsigned int inode;       // 0 表示空槽，或已与被删除的 inode 脱钩 (refs > 0)
+    unsigned int index;
+    unsigned int refs;
+    unsigned int last_used;
+} PagecacheEntry;
+
+static PagecacheEntry pagecache_entries[PAGECACHE_MAX_PAGES];
+static unsigned char* pagecache_frames = 0;
+static unsigned int pagecache_pages = 0;
+static unsigned int pagecache_clock = 0;
+
+static unsigned char* page_of(unsigned int slot) {
+    return pagecache_frames + slot * PAGECACHE_PAGE_SIZE;
+}
+
+static int slot_of(const void* page) {
+    unsigned int offset;
+
+    if (!page || !pagecache_frames || (const unsigned char*)page < pagecache_frames) return -1;
+    offset = (unsigned int)((const unsigned char*)page - pagecache_frames);
+    if (offset % PAGECACHE_PAGE_SIZE != 0 || offset / PAGECACHE_PAGE_SIZE >= pagecache_pages) return -1;
+    return (int)(offset / PAGECACHE_PAGE_SIZE);
+}
+
+void pagecache_init(void* frames, unsigned int page_count) {
+    pagecache_frames = (unsigned char*)frames;
+    pagecache_pages = page_count < PAGECACHE_MAX_PAGES ? page_count : PAGECACHE_MAX_PAGES;
+    pagecache_reset();
+}
+
+void pagecache_reset(void) {
+    memset(pagecache_entries, 0, sizeof(pagecache_entries));
+    pagecache_clock = 0;
+}
+
+void* pagecache_lookup(unsigned int inode, unsigned int index) {
+    if (inode == 0) return 0;
+    for (unsigned int i = 0; i < pagecache_pages; i++) {
+        PagecacheEntry* e = &pagecache_entries[i];
+        if (e->inode == inode && e->index == index) {
+            e->refs++;
+            e->last_used = ++pagecache_clock;
+            return page_of(i);
+        }
+    }
+    return 0;
+}
+
+void* pagecache_claim(unsigned int inode, unsigned int index) {
+    int victim = -1;
+
+    if (inode == 0) return 0;
+    for (unsigned int i = 0; i < pagecache_pages; i++) {
+        PagecacheEntry* e = &pagecache_entries[i];
+        if (e->refs > 0) continue;
+        if (e->inode == 0) {
+            victim = (int)i;
+            break;
+        }
+        if (victim < 0 || e->last_used < pagecache_entries[victim].last_used) victim = (int)i;
+    }
+    if (victim < 0) return 0;
+    pagecache_entries[victim].inode = inode;
+    pagecache_entries[victim].index = index;
+    pagecache_entries[victim].refs = 1;
+    pagecache_entries[victim].last_used = ++pagecache_clock;
+    return page_of((unsigned int)victim);
+}
+
+void pagecache_release(void* page) {
+    int slot = slot_of(page);
+    PagecacheEntry* e;
+
+    if (slot < 0) return;
+    e = &pagecache_entries[slot];
+    if (e->refs > 0) e->refs--;
+    if (e->refs == 0 && e->inode == 0) memset(e, 0, sizeof(*e));
+}
+
+void pagecache_write(unsigned int inode, unsigned int pos, const void* data, unsigned int size) {
+    unsigned int end = pos + size;
+
+    if (inode == 0 || !data || size == 0) return;
+    for (unsigned int i = 0; i < pagecache_pages; i++) {
+        PagecacheEntry* e = &pagecache_entries[i];
+        unsigned int page_start = e->index * PAGECACHE_PAGE_SIZE;
+        unsigned int from;
+        unsigned int to;
+
+        if (e->inode != inode || end <= page_start || pos >= page_start + PAGECACHE_PAGE_SIZE) continue;
+        from = pos > page_start ? pos : page_start;
+        to = end < page_start + PAGECACHE_PAGE_SIZE ? end : page_start + PAGECACHE_PAGE_SIZE;
+        memcpy(page_of(i) + (from - page_start), (const unsigned char*)data + (from - pos), (int)(to - from));
+    }
+}
+
+void pagecache_discard(void* page) {
+    int slot = slot_of(page);
+
+    if (slot < 0) return;
+    pagecache_entries[slot].inode = 0;
+    pagecache_release(page);
+}
+
+// 新末尾之后的字节清零 (与磁盘块内文件末尾之后恒为 0 一致)；整页越过末尾且没人映射的页直接丢弃
+void pagecache_truncate(unsigned int inode, unsigned int size) {
+    if (inode == 0) return;
+    for (unsigned int i = 0; i < pagecache_pages; i++) {
+        PagecacheEntry* e = &pagecache_entries[i];
+        unsigned int page_start = e->index * PAGECACHE_PAGE_SIZE;
+
+        if (e->inode != inode || size >= page_start + PAGECACHE_PAGE_SIZE) continue;
+        if (size <= page_start && e->refs == 0) {
+            memset(e, 0, sizeof(*e));
+            continue;
+        }
+        if (size <= page_start) memset(page_of(i), 0, PAGECACHE_PAGE_SIZE);
+        else memset(page_of(i) + (size - page_start), 0, (int)(page_start + PAGECACHE_PAGE_SIZE - size));
+    }
+}
+
+void pagecache_forget(unsigned int inode) {
+    if (inode == 0) return;
+    for (unsigned int i = 0; i < pagecache_pages; i++) {
+        PagecacheEntry* e = &pagecache_entries[i];
+        if (e->inode != inode) continue;
+        if (e->refs == 0) memset(e, 0, sizeof(*e));
+        else e->inode = 0;
+    }
+}
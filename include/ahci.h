@@ -0,0 +1,36 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include "disk.h"
+
+// AHCI SATA 控制器 (QEMU: -device ahci)：经 drivers/pci.c 按类别 01h/06h 查找，
+// 寄存器在 BAR5 (ABAR) 的 MMIO 空间。只驱动第一个接了 SATA 硬盘的端口。
+// 每个端口一张 32 项的命令列表和一块 FIS 接收区，每个命令槽一张命令表
+// (命令 FIS + 物理区描述符表)，都从内核堆里按对齐要求切出 (堆在恒等映射区内)。
+// 驱动器与控制器都支持 NCQ 时用 READ/WRITE FPDMA QUEUED，同时在途的命令数取两边
+// 队列深度的较小者 (至多 32)，写命令带 FUA；否则一次只发一条 READ/WRITE DMA EXT，
+// 写完再发 FLUSH CACHE EXT。
+// 本模块只管控制器与命令槽，排队、回调与等待仍在 drivers/disk.c。
+// 所有函数由 disk.c 在关中断状态下调用。
+
+// 每个命令槽的描述符表项数，也是 iosched.c 合并一条命令的段数上限
+#define AHCI_PRD_ENTRIES 32
+
+// 找到控制器和硬盘、端口启动成功时返回 1
+int ahci_init(void);
+int ahci_available(void);
+// 可同时在途的命令数
+unsigned int ahci_queue_depth(void);
+// IDENTIFY 报告的扇区总数，超过 32 位的截成 0xFFFFFFFF
+unsigned int ahci_capacity(void);
+unsigned int ahci_in_flight(void);
+// 端口中断接到了 PIC 上 (否则靠轮询 ahci_reap() 发现完成)
+int ahci_irq_enabled(void);
+// 把命令 (含 merged 链) 放进空闲槽并发出：1 已发出；0 没有空闲槽；
+// -1 命令无法用 DMA 描述 (段数超限；不连续的缓冲区 disk.c 已换成中转缓冲)
+int ahci_issue(DiskRequest* cmd);
+// 应答端口中断并取出一条已结束的命令，*status 为 0 或 -1；没有时返回 0。
+// 出错时端口重启，出错前在途的命令全部以 -1 结束
+DiskRequest* ahci_reap(int* status);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+// 文件系统块缓存：位于 fs.c 与 drivers/disk.c 之间，按块号哈希索引，
+// LRU 淘汰，脏块延迟写回 (write-back)。
+// 设置了提交回调 (日志) 后，经 bcache_write_meta() 写入的元数据块在提交前
+// 不会写回原位置，也不会被淘汰；需要腾位置或刷盘时先调用回调提交日志。
+
+// 块大小在 bcache_init() 时给定 (1 KiB 或 4 KiB)；数据区总量固定，
+// 1 KiB 块时 64 个槽位，4 KiB 块时 16 个
+#define BCACHE_MIN_BLOCK_SIZE 1024
+#define BCACHE_MAX_BLOCK_SIZE 4096
+#define BCACHE_POOL_BYTES     (64 * 1024)
+#define BCACHE_ENTRIES        64
+#define BCACHE_HASH_BUCKETS   32
+// 同时在途的异步磁盘请求数 (预读与写回经 iosched_submit() 排队，相邻的写回合并成一条命令)
+#define BCACHE_IO_SLOTS       16
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int writebacks;
+    unsigned int evictions;
+    unsigned int dirty_blocks;
+    unsigned int readahead_blocks;   // 预读装入的块
+    unsigned int readahead_hits;     // 其中随后被读到的块
+    unsigned int async_requests;     // 经异步队列提交的请求
+    unsigned int max_in_flight;      // 同时在途请求数的峰值
+    unsigned int write_errors;       // 写回或直接写失败的命令
+} BcacheStats;
+
+// 丢弃所有缓存内容（不写回），base_sector 为块 0 所在的绝对扇区
+void bcache_init(unsigned int base_sector, unsigned int block_size);
+unsigned int bcache_block_size(void);
+// 当前块大小下可用的槽位数
+unsigned int bcache_capacity(void);
+// 返回 0 成功；-1 读命令失败，buffer 清零且该块不留在缓存里
+int bcache_read(unsigned int block_num, void* buffer);
+void bcache_write(unsigned int block_num, const void* buffer);
+// 元数据写入：装了提交回调时在日志提交前钉在缓存里，否则同 bcache_write
+void bcache_write_meta(unsigned int block_num, const void* buffer);
+// 物理相邻的 count 个块直接从磁盘读进 buffer (不占缓存槽位)，缓存中的脏块以缓存内容为准；
+// 返回 0 成功，-1 有命令失败 (buffer 内容不可用)
+int bcache_read_direct(unsigned int block_num, unsigned int count, void* buffer);
+// 预读：物理相邻的 count 个块中未缓存的部分按连续段提交异步读，不等完成；
+// 在途的块先占住槽位，之后读到它时才等请求结束
+void bcache_prefetch(unsigned int block_num, unsigned int count);
+// 推进在途的异步请求 (不等待)，返回仍在途的请求数
+unsigned int bcache_poll_io(void);
+int bcache_contains(unsigned int block_num);
+// 将所有脏块按块号升序提交异步写回，全部完成后返回写回的块数；写失败的块不重试
+int bcache_sync(void);
+int bcache_has_dirty(void);
+
+// ===== 日志支持 =====
+void bcache_set_commit_hook(int (*hook)(void));
+unsigned int bcache_meta_blocks(void);
+// 按块号升序列出待提交的元数据块，返回个数
+unsigned int bcache_list_meta(unsigned int* blocks, unsigned int max);
+// 缓存中该块内容的只读指针，不在缓存时返回 0；下一次缓存操作前有效
+const void* bcache_peek(unsigned int block_num);
+// ordered 模式：提交日志前先写回所有非元数据脏块
+int bcache_sync_data(void);
+// 日志提交后把元数据块写回原位置 (checkpoint)，写成功的块解除提交前的限制。
+// 返回写回的块数；有块写失败时返回 -1，这些块仍是脏的待提交元数据
+int bcache_checkpoint_meta(void);
+// 绕过缓存直接写磁盘上物理相邻的 count 个块，返回 0 成功，-1 有命令失败
+int bcache_write_direct(unsigned int block_num, unsigned int count, const void* buffer);
+void bcache_get_stats(BcacheStats* out);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef BMIDE_H
+#define BMIDE_H
+
+#include "disk.h"
+
+// PCI IDE 控制器的总线主控 DMA (Bus Master IDE)：drivers/disk.c 在主通道上用
+// READ DMA / WRITE DMA 代替 PIO 逐扇区搬运，完成仍由 IRQ14 通知。
+// 控制器经 drivers/pci.c 按类别 01h/01h 查找，编程接口第 7 位表示支持总线主控，
+// 寄存器在 BAR4 的 I/O 空间。找不到时 bmide_available() 为 0，驱动全走 PIO。
+// 本模块只管描述符表与总线主控寄存器，ATA 命令的发出与阶段推进仍在 disk.c。
+
+// 物理区描述符 (PRD) 表的项数；一项至多 64 KiB 且不能跨 64 KiB 边界，
+// 起点不对齐的 4 MiB 命令 (DISK_MAX_SECTORS_EXT) 要 65 项
+#define BMIDE_PRD_ENTRIES 128
+
+void bmide_init(void);
+int bmide_available(void);
+// 按命令 (含 merged 链) 各段的物理地址 (DiskRequest.phys) 填描述符表并设好方向。
+// 有段没有物理地址或表装不下时返回 0，调用方改用 PIO
+int bmide_prepare(const DiskRequest* cmd);
+// ATA 命令发出后启动总线主控
+void bmide_start(void);
+// 0 传输未结束；1 结束；-1 控制器报错。结束 (含出错) 时停下总线主控并清状态位
+int bmide_poll(void);
+
+#endif
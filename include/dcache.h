@@ -0,0 +1,42 @@
+#ifndef DCACHE_H
+#define DCACHE_H
+
+// 目录项缓存 (dentry cache) 与目录哈希索引，供 fs.c 的路径查找使用。
+// 两者都只保存在内存中，磁盘目录格式仍是线性的 ext2 目录块。
+
+#define DCACHE_SETS       32
+#define DCACHE_WAYS       4
+#define DCACHE_NAME_MAX   64
+
+// 同时建立哈希索引的目录数，超出时淘汰最久未用的索引
+#define DINDEX_DIRS       4
+#define DINDEX_NONE       0xFFFFFFFFu
+
+typedef struct {
+    unsigned int hits;
+    unsigned int misses;
+    unsigned int indexed_dirs;
+} DcacheStats;
+
+unsigned int dcache_name_hash(const char* name);
+
+void dcache_reset(void);
+// 命中返回 1，*out_inode 为 0 表示缓存的“不存在”结果
+int dcache_lookup(unsigned int dir_inode, const char* name, unsigned int hash, unsigned int* out_inode);
+// inode 为 0 时记录负向项
+void dcache_insert(unsigned int dir_inode, const char* name, unsigned int hash, unsigned int inode);
+void dcache_get_stats(DcacheStats* out);
+
+// 目录哈希索引：location 由调用方编码 (块序号与块内偏移)，名字校验由调用方读目录块完成
+int dindex_create(unsigned int dir_inode, unsigned int expected_entries);
+int dindex_exists(unsigned int dir_inode);
+void dindex_drop(unsigned int dir_inode);
+void dindex_insert(unsigned int dir_inode, unsigned int hash, unsigned int location);
+void dindex_remove(unsigned int dir_inode, unsigned int hash, unsigned int location);
+// 依次返回哈希相同的候选位置，*cursor 初始为 0，结束时返回 DINDEX_NONE
+unsigned int dindex_next(unsigned int dir_inode, unsigned int hash, unsigned int* cursor);
+// 追加目录项时从该目录块开始找空位
+unsigned int dindex_space_hint(unsigned int dir_inode);
+void dindex_set_space_hint(unsigned int dir_inode, unsigned int block_index);
+
+#endif
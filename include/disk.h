@@ -6,11 +6,102 @@
 // 读写硬盘的基本单位是扇区 (512字节)
 #define SECTOR_SIZE 512
 
+// 单条命令的扇区上限：28 位 ATA 的扇区数寄存器只有 8 位；LBA48 / AHCI / virtio-blk
+// 的计数有 16 位，这里限在 4 MiB，一条命令刚好装进一项 AHCI 描述符
+#define DISK_MAX_SECTORS_LBA28 255
+#define DISK_MAX_SECTORS_EXT   8192
+
+// 异步请求：disk_submit() 入队后立即返回。主 IDE 通道上按提交顺序逐条执行；
+// 块设备在 AHCI 或 virtio-blk 上时至多 disk_queue_depth() 条同时交给设备，完成顺序不定。
+// 完成时置 done、填 status，之后调用 on_done。请求结构与缓冲区由调用方持有，
+// 完成前不能释放或改动。disk_init() 之后数据传输由磁盘中断推进，此前 (以及关中断的
+// 上下文里) 靠 disk_poll() 轮询推进；on_done 从不在中断里调用，而是在
+// disk_poll() / disk_wait_request() 的调用方上下文里执行。
+// merged 链上的请求 LBA 依次紧接，与链头合成一条命令执行 (由 iosched.c 合并)。
+// 一条命令的扇区总数不超过 disk_max_sectors()，且不能越过盘尾 (disk_capacity())，
+// 否则以 -1 结束；更大的传输由同步接口 disk_read/write_sectors()、iosched_rw() 拆开。
+typedef struct DiskRequest DiskRequest;
+typedef void (*DiskDoneFn)(DiskRequest* req);
+
+struct DiskRequest {
+    unsigned int lba;
+    unsigned int count;          // 扇区数，1..disk_max_sectors()
+    void* buffer;
+    unsigned char write;
+    volatile unsigned char done;
+    int status;                  // 0 成功，-1 设备报错或参数非法
+    DiskDoneFn on_done;          // 可为 0
+    void* ctx;                   // 留给调用方
+    DiskRequest* next;           // 驱动与调度层内部排队用
+    DiskRequest* merged;         // 合并进同一条命令的下一段
+    unsigned int expire;         // 调度层的派发期限
+    unsigned int phys;           // buffer 的物理地址，不连续时为 0 (见 disk_map_buffer())
+    unsigned char no_dma;        // 强制走 PIO
+    void* bounce;                // 驱动内部：多队列后端替不连续的 buffer 借的中转缓冲
+    unsigned int cr3;            // 提交者的页目录，0 表示 buffer 在哪个地址空间都能访问 (见 disk_map_buffer())
+};
+
+// 驱动按传输方式分的统计
+typedef struct {
+    unsigned int dma_commands;
+    unsigned int dma_sectors;
+    unsigned int pio_commands;
+    unsigned int pio_sectors;
+    unsigned int dma_errors;
+} DiskStats;
+
+// disk_init() 选中的后端
+#define DISK_BACKEND_ATA    0
+#define DISK_BACKEND_AHCI   1
+#define DISK_BACKEND_VIRTIO 2
+
+// 测速结果：同一段扇区分别用 PIO 与 DMA 读一遍，单位 KiB/s；没有 DMA 时 dma 为 0，
+// AHCI 与 virtio-blk 只有 DMA，pio 为 0
+typedef struct {
+    unsigned int kib;
+    unsigned int pio_kib_per_s;
+    unsigned int dma_kib_per_s;
+    int dma_available;
+    int backend;                 // DISK_BACKEND_*
+    unsigned int queue_depth;    // 驱动可同时执行的命令数
+} DiskBenchResult;
+
 void disk_init();
-// 从 LBA 地址读取 count 个扇区到 buffer
-void disk_read_sectors(int lba, int count, void* buffer);
-// 向 LBA 地址写入 count 个扇区
-void disk_write_sectors(int lba, int count, const void* buffer);
+// 在提交者的地址空间里算好 req->phys：缓冲区物理上连续时填起始物理地址，否则填 0；
+// 同时记下提交者的页目录 req->cr3，驱动在别的进程上下文 (磁盘中断、别人的 disk_poll())
+// 里读写 buffer 时先切过去。命令可能在别的进程上下文里发出，所以要在提交时算；iosched_submit() 与下面的
+// 同步读写已经调用，直接用 disk_submit() 的调用方自己调用 (不调用时 ATA 走 PIO，
+// AHCI / virtio-blk 只能做 DMA，经堆上的中转缓冲)
+void disk_map_buffer(DiskRequest* req);
+void disk_submit(DiskRequest* req);
+// 推进队列并调用已结束命令的回调，返回本次回调的命令数
+int disk_poll(void);
+// 有命令在执行且没有待回调的命令时等下一次磁盘中断：普通进程在等待队列上睡眠、
+// 让出 CPU，PID 0 开着中断时 hlt；关中断且不能睡眠时立即返回，由调用方继续轮询
+void disk_wait_any(void);
+void disk_irq_handler(void);
+// PCI 中断线 (IRQ9..11) 的处理函数，AHCI 与 virtio-blk 用
+void disk_pci_irq_handler(void);
+// 推进队列直到 req 完成，返回 req->status
+int disk_wait_request(DiskRequest* req);
+// 排队中 (含正在执行) 的请求数
+unsigned int disk_pending(void);
+// 驱动可同时执行的命令数：ATA 为 1，AHCI 为 NCQ 队列深度，virtio-blk 为请求槽数
+unsigned int disk_queue_depth(void);
+// 单条命令的扇区上限 (DISK_MAX_SECTORS_LBA28 或 DISK_MAX_SECTORS_EXT)
+unsigned int disk_max_sectors(void);
+// 盘的总扇区数，超过 32 位的截成 0xFFFFFFFF (LBA 是 32 位，可达 2 TiB)；取不到时为 0，不做越界检查
+unsigned int disk_capacity(void);
+// 从 ATA IDENTIFY 数据取扇区总数：支持 LBA48 时用第 100..103 字，否则用第 60..61 字
+unsigned int disk_identify_capacity(const unsigned short* ident);
+// 从 LBA 地址读取 count 个扇区到 buffer，超过单条命令上限时拆成几条依次执行；
+// 返回 0 成功，-1 参数非法、越界或设备报错
+int disk_read_sectors(unsigned int lba, unsigned int count, void* buffer);
+// 向 LBA 地址写入 count 个扇区，约定同上
+int disk_write_sectors(unsigned int lba, unsigned int count, const void* buffer);
+void disk_get_stats(DiskStats* out);
+// 反复读盘首 1 MiB (不经调度层)，分别计时 PIO 与 DMA；调用方负责让磁盘空闲
+void disk_benchmark(DiskBenchResult* out);
 //outb 和 inb 的封装
 static inline unsigned char inb(unsigned short port) {
     unsigned char ret;
@@ -121,6 +121,12 @@ typedef struct {
 #define EXT2_FT_SOCK 6
 #define EXT2_FT_SYMLINK 7
 
+// 内联数据 (同 ext4)：不超过 i_block[] 大小的小文件直接存在 inode 里，i_flags 带
+// EXT2_INLINE_DATA_FL，不占数据块；超级块带此不兼容特性时内核才会新建内联文件
+#define EXT2_INLINE_DATA_FL 0x10000000u
+#define EXT2_FEATURE_INCOMPAT_INLINE_DATA 0x8000u
+#define EXT2_INLINE_DATA_MAX 60
+
 // ==================== 我们的简化文件系统 ====================
 
 #define FS_MAX_FILES 64
@@ -165,11 +171,61 @@ typedef struct {
     unsigned char type;
 } SystemFile;
 
+// fs_read_dir() 返回的定长目录记录，不含 "." 和 ".."
+typedef struct {
+    unsigned int inode;
+    unsigned int size;
+    unsigned char type;  // 0=文件, 1=目录
+    char name[FS_FILENAME_LEN];
+} FsDirEntry;
+
+// 顺序读预读状态，每个打开的句柄一份，清零即为初始状态
+typedef struct {
+    unsigned int next_pos;    // 上一次读取结束的位置，下一次从这里读视为顺序读
+    unsigned int window;      // 当前预读窗口 (块)，0 表示未判定为顺序读
+    unsigned int ra_end;      // 已预读到的逻辑块 (不含)
+} FsReadahead;
+
+// 预读窗口从 MIN 块起步，连续顺序读时翻倍，最多 MAX 块 (块缓存的一半)
+#define FS_READAHEAD_MIN_BLOCKS 4
+#define FS_READAHEAD_MAX_BLOCKS 32
+
 typedef struct {
     SystemFile sys_file;
     unsigned int current_pos;
+    FsReadahead readahead;
 } AppFile;
 
+// 目录块数达到该值后，首次查找时在内存中建立哈希索引
+#define FS_DIR_INDEX_MIN_BLOCKS 2
+
+// 脏块周期写回间隔 (timer tick，100Hz)
+#define FS_WRITEBACK_INTERVAL_TICKS 200
+
+// 文件系统运行统计
+typedef struct {
+    unsigned int cache_hits;
+    unsigned int cache_misses;
+    unsigned int cache_writebacks;
+    unsigned int cache_evictions;
+    unsigned int cache_dirty_blocks;
+    unsigned int inode_cache_hits;
+    unsigned int inode_cache_misses;
+    unsigned int inodes_pinned;
+    unsigned int dentry_hits;
+    unsigned int dentry_misses;
+    unsigned int indexed_dirs;
+    unsigned int readahead_blocks;
+    unsigned int readahead_hits;
+    unsigned int journal_commits;
+    unsigned int journal_blocks;
+    unsigned int async_requests;
+    unsigned int max_in_flight;
+    unsigned int io_commands;
+    unsigned int io_merges;
+    unsigned int io_sectors;
+} FsStats;
+
 // 简化的超级块 (放在内存中)
 typedef struct {
     unsigned int file_count;
@@ -182,17 +238,44 @@ void fs_init();
 int fs_is_ready(void);
 void fs_list_files();
 int fs_get_file_list(char* buffer, int max_len, const char* dir_path);
+// 从 *cursor (初始为 0) 起读出至多 max 条目录记录并推进游标；返回条数，0 表示已到末尾，
+// -1 表示不是目录或目录块损坏。游标是目录内的字节偏移，两次调用之间目录被修改也能续读
+int fs_read_dir(unsigned int dir_inode, unsigned int* cursor, FsDirEntry* out, unsigned int max);
 int fs_read_file(const char* filename, void* buffer, unsigned int capacity);
 int fs_create_file(const char* path);
 int fs_delete_file(const char* path);
 int fs_mkdir(const char* path);
 int fs_write_file(const char* filename, const void* buffer, unsigned int size);
+void fs_sync(void);
+void fs_periodic_sync(unsigned int now_ticks);
+// 有进程正持有文件系统锁 (调度器据此推迟要进文件系统的回收工作)
+int fs_is_busy(void);
+void fs_get_stats(FsStats* out);
+// 磁盘 PIO / DMA 读吞吐对比 (见 disk_benchmark())
+void fs_disk_benchmark(DiskBenchResult* out);
 
 // 封装接口
 int sys_file_open(const char* filename, SystemFile* out_file);
 int app_file_open(const char* filename, AppFile* out_file);
 int app_file_read(AppFile* file, void* buffer, unsigned int size);
 
+// inode 缓存：pin 住的 inode 常驻内存，删除后在 unpin 前不会被重新分配
+int fs_inode_pin(unsigned int inode_num);
+void fs_inode_unpin(unsigned int inode_num);
+// 按 inode 号在 pos 处写入，只改写涉及的块；pos 为 FS_POS_APPEND 时写到当前末尾。
+// 返回写入字节数，失败返回 -1 且文件不变；*out_file_size 为写入后的长度
+#define FS_POS_APPEND 0xFFFFFFFFu
+int fs_pwrite_inode(unsigned int inode_num, unsigned int pos, const void* buffer,
+                    unsigned int size, unsigned int* out_file_size);
+int fs_truncate_inode(unsigned int inode_num, unsigned int size);
+// 返回读取字节数，inode 无效或不是普通文件时返回 -1；ra 非空时按句柄做顺序预读
+int fs_read_inode_data(unsigned int inode_num, unsigned int pos, void* buffer,
+                       unsigned int size, unsigned int* out_file_size, FsReadahead* ra);
+// 文件页缓存 (见 pagecache.h)：返回文件第 index 个 4 KiB 页的页框并加一次引用，
+// 页整个在文件末尾之后或没有可用页框时返回 0；用完以 fs_page_put() 归还
+void* fs_page_get(unsigned int inode_num, unsigned int index);
+void fs_page_put(void* page);
+
 // TSK 加载
 int tsk_load(const char* filename, void** out_entry,
              unsigned int* out_load_base, unsigned int* out_image_size);
@@ -17,5 +17,8 @@ typedef struct HeapBlock {
 void heap_init();
 void* malloc(unsigned int size);
 void free(void* ptr);
+// 按 align (2 的幂) 对齐并清零的一块，供 DMA 描述符表等使用；只能用 free_aligned() 释放
+void* malloc_aligned(unsigned int size, unsigned int align);
+void free_aligned(void* ptr);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef IOSCHED_H
+#define IOSCHED_H
+
+#include "disk.h"
+
+// 磁盘 I/O 调度层：位于块缓存与 drivers/disk.c 之间。提交的请求先在这里排队，
+// 与 LBA 紧接、方向相同的已排队请求合并成一条命令 (前向/后向合并)，
+// 按 LBA 电梯顺序 (C-LOOK) 交给驱动；驱动满了 (见 disk_queue_depth()) 就不派发，好让后来的请求还能并进来。
+// 读请求有派发期限：排队期间又派发了 IOSCHED_READ_EXPIRE 条命令仍没轮到就插到最前，
+// 写请求的期限宽松得多，只防饿死。
+// 本模块自身不加锁，全部经 bcache.c 在文件系统锁内调用。
+
+// 单条命令的扇区上限取驱动的 disk_max_sectors()。
+// 单条命令合并的请求数上限，每段要占 DMA 描述符表的一项 (见 AHCI_PRD_ENTRIES)
+#define IOSCHED_MAX_SEGMENTS 32
+// 期限按派发的命令条数计
+#define IOSCHED_READ_EXPIRE  8
+#define IOSCHED_WRITE_EXPIRE 64
+
+// 每个方向一组统计；平均命令大小 = sectors / commands
+typedef struct {
+    unsigned int requests;   // 提交的请求
+    unsigned int merges;     // 并进已排队命令的请求
+    unsigned int commands;   // 实际派发给驱动的命令
+    unsigned int sectors;
+    unsigned int depth;      // 当前排队的请求数
+    unsigned int max_depth;
+    unsigned int expired;    // 超期提前派发的命令
+} IoschedQueueStats;
+
+typedef struct {
+    IoschedQueueStats read;
+    IoschedQueueStats write;
+} IoschedStats;
+
+// 入队，不等待；请求要求同 disk_submit()
+void iosched_submit(DiskRequest* req);
+// 推进驱动，驱动有空位时派发命令；返回本次完成的命令数
+int iosched_poll(void);
+// 推进一轮；没有任何命令完成时睡到下一次磁盘中断 (见 disk_wait_any())
+void iosched_wait_any(void);
+int iosched_wait(DiskRequest* req);
+// 调度层与驱动中尚未完成的请求数
+unsigned int iosched_pending(void);
+// 同步读写：超过单条命令上限时拆成几个请求一起排队，全部完成后返回；
+// 返回 0 成功，任一段失败 (含越界) 返回 -1
+int iosched_rw(unsigned int lba, unsigned int count, void* buffer, int write);
+void iosched_get_stats(IoschedStats* out);
+
+#endif
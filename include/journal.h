@@ -0,0 +1,60 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "bcache.h"
+
+// 元数据日志 (ordered 模式)：日志区是一个 inode (s_journal_inum) 的物理连续数据块。
+// 日志块 0 为日志超级块；每次提交从日志块 1 开始顺序写出
+// 描述块 (目标块号) + 元数据块副本 + 提交块 (校验和)，随后立即 checkpoint 回原位置，
+// 并把日志超级块的序号加一，因此日志中最多只有一个未完成的事务。
+
+#define JOURNAL_MAGIC        0x4C4E524Au   // "JRNL"
+#define JOURNAL_DESC_MAGIC   0x4353444Au   // "JDSC"
+#define JOURNAL_COMMIT_MAGIC 0x544D434Au   // "JCMT"
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL 0x0004u
+
+// 日志区至少要放下一个装满块缓存的事务：超级块 + 描述块 + 提交块
+#define JOURNAL_MIN_BLOCKS   (BCACHE_ENTRIES + 3)
+
+typedef struct {
+    unsigned int magic;
+    unsigned int block_size;
+    unsigned int blocks;      // 日志区总块数 (含日志超级块)
+    unsigned int sequence;    // 下一个事务的序号
+} JournalSuperBlock;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int sequence;
+    unsigned int count;
+    unsigned int blocks[];    // count 个目标块号，后面依次是同样数目的块副本
+} JournalDescriptor;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int sequence;
+    unsigned int count;
+    unsigned int checksum;    // 描述块与全部块副本的校验和
+} JournalCommit;
+
+typedef struct {
+    unsigned int commits;
+    unsigned int blocks;      // 已提交的元数据块
+    unsigned int replayed;    // 挂载时重放的块
+} JournalStats;
+
+// 挂载时调用：start/blocks 为日志区的物理位置。日志有效且有已提交未 checkpoint 的
+// 事务时写回原位置并返回重放块数 (调用方随后应丢弃块缓存)，无事务返回 0，
+// 日志区无效返回 -1 (不启用日志)。重放时读写失败返回 JOURNAL_REPLAY_FAILED：事务
+// 留在日志里等下次挂载再重放，在那之前不能启用日志或改写文件系统
+#define JOURNAL_REPLAY_FAILED (-2)
+int journal_load(unsigned int start, unsigned int blocks);
+// 启用日志：之后的元数据写入在提交前钉在块缓存中
+void journal_enable(void);
+void journal_disable(void);
+int journal_enabled(void);
+// 把块缓存中所有待提交的元数据作为一个事务提交，返回提交的块数，失败返回 -1
+int journal_commit(void);
+void journal_get_stats(JournalStats* out);
+
+#endif
@@ -26,6 +26,8 @@ int list_files_at(char* buffer, int max_len, const char* dir);
 int launch_tsk(const char* filename);
 int launch_tsk_ex(const char* filename, int flags);
 int get_video_stats(UserVideoStats* out);
+int get_fs_stats(UserFsStats* out);
+int disk_bench(UserDiskBench* out);
 int get_mouse_click(int* x, int* y);
 
 // Start Menu Tile API
@@ -8,6 +8,8 @@
  * - 0x00280000 起为内核日志区
  * - 0x00300000 ~ 0x007FFFFF 为应用槽位区
  * - 0x00900000 起为窗口像素缓冲
+ * - 0x01000000 起为文件页缓存的页框 (恒等映射)
+ * - 0x40000000 起 4 MiB 为各进程私有的文件映射窗口 (tlx_mmap)
  */
 
 #define MP_KERNEL_CODE_BASE        0x00010000u
@@ -42,4 +44,13 @@
 #define MP_PROCESS_STACK_LIMIT     (MP_PROCESS_STACK_BASE + MP_PROCESS_STACK_SIZE * MP_PROCESS_STACK_COUNT)
 #define MP_APP_PHYS_ALIAS_BASE     0xC0000000u
 
+#define MP_PAGE_CACHE_BASE         0x01000000u
+#define MP_PAGE_CACHE_SIZE         0x00100000u
+#define MP_PAGE_CACHE_LIMIT        (MP_PAGE_CACHE_BASE + MP_PAGE_CACHE_SIZE)
+
+// 文件映射窗口正好一张页表 (页目录第 256 项)，内核自己的映射不会用到这一段
+#define MP_MMAP_BASE               0x40000000u
+#define MP_MMAP_SIZE               0x00400000u
+#define MP_MMAP_LIMIT              (MP_MMAP_BASE + MP_MMAP_SIZE)
+
 #endif
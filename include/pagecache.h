@@ -0,0 +1,31 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+// 文件页缓存：按 (inode, 页号) 缓存 4 KiB 的文件内容，tlx_mmap 的缺页直接把页框映射给进程，
+// 多个进程映射同一文件时共用同一份页。页框由 pagecache_init() 给定 (内核里是
+// MP_PAGE_CACHE_BASE 起的恒等映射区)。被引用的页不会被淘汰；写文件、截断时 fs.c 同步
+// 更新已缓存的页，映射者看到的内容与文件一致。
+// 本模块自身不加锁，全部经 fs.c 在文件系统锁内调用。
+
+#define PAGECACHE_PAGE_SIZE 4096u
+#define PAGECACHE_MAX_PAGES 256
+
+void pagecache_init(void* frames, unsigned int page_count);
+// 丢弃所有缓存页 (重新挂载时)
+void pagecache_reset(void);
+// 命中时引用数加一并返回页框，未命中返回 0
+void* pagecache_lookup(unsigned int inode, unsigned int index);
+// 为 (inode, index) 取一个页框，淘汰最久未用且未被引用的页，返回时引用数为 1；
+// 内容由调用方填充。没有可用页框时返回 0
+void* pagecache_claim(unsigned int inode, unsigned int index);
+void pagecache_release(void* page);
+// 刚取到的页没能填好 (读盘失败)：放弃引用且不留在缓存里
+void pagecache_discard(void* page);
+
+// 文件内容变化时同步已缓存的页
+void pagecache_write(unsigned int inode, unsigned int pos, const void* data, unsigned int size);
+void pagecache_truncate(unsigned int inode, unsigned int size);
+// inode 被删除：未被引用的页直接丢弃，仍被映射的页与 inode 脱钩，最后一次释放时回收
+void pagecache_forget(unsigned int inode);
+
+#endif
@@ -16,6 +16,12 @@ int paging_create_process_space(unsigned int virtual_base, unsigned int image_si
                                 PagingSpace* out);
 void paging_destroy_process_space(unsigned int cr3, int app_physical_slot);
 void* paging_app_alias(int app_physical_slot);
+// 文件映射窗口 (MP_MMAP_BASE 起) 内的单页只读映射，窗口的页表在首次映射时分配
+int paging_map_page(unsigned int cr3, unsigned int virtual_address, unsigned int physical);
+// 返回原先映射的页框，未映射时返回 0
+unsigned int paging_unmap_page(unsigned int cr3, unsigned int virtual_address);
+// 当前地址空间内的虚拟地址对应的物理地址，未映射时返回 0 (给 DMA 填描述符用)
+unsigned int paging_translate(unsigned int address);
 void paging_handle_fault(unsigned int fault_address, unsigned int error_code,
                          unsigned int instruction_pointer);
 
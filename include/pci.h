@@ -24,5 +24,6 @@ void pci_config_write_byte(unsigned char bus, unsigned char slot, unsigned char
 
 int pci_probe_device(unsigned char bus, unsigned char slot, unsigned char func, PciDeviceInfo* out);
 int pci_find_first_by_class(unsigned char class_code, unsigned char subclass, PciDeviceInfo* out);
+int pci_find_device(unsigned short vendor_id, unsigned short device_id, PciDeviceInfo* out);
 
 #endif
@@ -2,6 +2,7 @@
 #define PROCESS_H
 
 #include "window.h"
+#include "sync.h"
 
 // 进程状态
 typedef enum {
@@ -27,6 +28,7 @@ typedef struct Process {
     unsigned int page_directory;
     int app_physical_slot;
     unsigned int image_inode;
+    int image_inode_pinned; // 运行期间是否 pin 住了映像 inode
     unsigned int instance_id;
     ProcessState state;
     int sandbox_level;
@@ -36,6 +38,9 @@ typedef struct Process {
     int mouse_click_x;      // 点击位置 x（相对于客户区）
     int mouse_click_y;      // 点击位置 y（相对于客户区）
     int has_mouse_event;    // 是否有未读鼠标事件
+    unsigned int locks_held;    // 持有或正在等待的内核锁 (含递归)
+    int exit_pending;           // 持锁期间被要求退出，放掉最后一把锁时退出
+    struct Process* wait_next;  // 等待队列链表
     struct Process* next;   // 链表
 } Process;
 
@@ -49,6 +54,12 @@ int process_create(void (*entry_point)(), const char* name, Window* win,
                    unsigned int image_inode, unsigned int instance_id);
 void process_exit();
 void process_sleep(unsigned int ticks);
+// 让进程退出；持有内核锁时推迟到放锁之后
+void process_kill(Process* proc);
+// 在等待队列上睡眠，直到被 process_wake_one() 唤醒；调用方须已关中断
+void process_wait(WaitQueue* queue);
+Process* process_wake_one(WaitQueue* queue);
+int process_in_scheduler(void);
 void process_on_timer_tick(void);
 Process* process_find_by_window(Window* win);
 Process* process_find_by_name(const char* name);
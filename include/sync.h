@@ -0,0 +1,34 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+// 可睡眠互斥锁：拿不到锁的进程挂到等待队列上让出 CPU，放锁时按先来后到直接交给队首。
+// 同一进程可以递归加锁。只有进程上下文可以等待；调度器 (时钟中断) 里只能在
+// 确认无人持锁后借用，见 process.c 的回收逻辑。
+
+struct Process;
+
+typedef struct WaitQueue {
+    struct Process* head;
+    struct Process* tail;
+} WaitQueue;
+
+typedef struct {
+    struct Process* owner;    // depth 为 0 时无意义
+    unsigned int depth;
+    unsigned int contended;   // 累计发生等待的次数
+    WaitQueue waiters;
+} KMutex;
+
+void kmutex_lock(KMutex* mutex);
+// 拿不到锁时立即返回 0，不等待
+int kmutex_trylock(KMutex* mutex);
+void kmutex_unlock(KMutex* mutex);
+int kmutex_is_locked(const KMutex* mutex);
+
+// 当前是否在普通进程的系统调用里 (PID 非 0，且不在调度器内)：这时持锁期间可以开中断
+int sync_preemptible(void);
+// 持锁期间能否开中断：除上面的情况外，PID 0 在调度器外且进来时本就开着中断也可以。
+// flags 为加锁前 irq_save_disable() 的返回值
+int sync_irq_allowed(unsigned int flags);
+
+#endif
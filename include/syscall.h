@@ -43,6 +43,8 @@
 #define SYS_LAUNCH_TSK_EX 38
 #define SYS_BLIT_RGB      39
 #define SYS_GET_VIDEO_STATS 40
+#define SYS_GET_FS_STATS    41
+#define SYS_DISK_BENCH      42
 
 #define TSK_LAUNCH_ACTIVATE     0
 #define TSK_LAUNCH_NEW_INSTANCE 1
@@ -67,6 +69,33 @@ typedef struct {
     unsigned int idle_halts;
 } UserVideoStats;
 
+typedef struct {
+    unsigned int cache_hits;
+    unsigned int cache_misses;
+    unsigned int cache_writebacks;
+    unsigned int cache_evictions;
+    unsigned int cache_dirty_blocks;
+    unsigned int inode_cache_hits;
+    unsigned int inode_cache_misses;
+    unsigned int inodes_pinned;
+    unsigned int dentry_hits;
+    unsigned int dentry_misses;
+    unsigned int indexed_dirs;
+    unsigned int readahead_blocks;
+    unsigned int readahead_hits;
+    unsigned int journal_commits;
+    unsigned int journal_blocks;
+} UserFsStats;
+
+typedef struct {
+    unsigned int kib;
+    unsigned int pio_kib_per_s;
+    unsigned int dma_kib_per_s;
+    int dma_available;
+    int backend;            // 0 ATA，1 AHCI，2 virtio-blk
+    unsigned int queue_depth;
+} UserDiskBench;
+
 // 窗口事件位
 #define WIN_EVENT_FOCUS_CHANGED 0x1
 #define WIN_EVENT_KEY_READY     0x2
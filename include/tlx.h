@@ -11,6 +11,8 @@
 
 #define TLX_MAX_PATH 64
 #define TLX_MAX_FDS 8
+#define TLX_MAX_MAPS 4
+#define TLX_PAGE_SIZE 4096u
 
 #define TLX_STD_INPUT  0
 #define TLX_STD_OUTPUT 1
@@ -31,6 +33,8 @@
 #define TLX_ENOENT      2
 #define TLX_EIO         5
 #define TLX_EBAD_HANDLE 9
+#define TLX_ENOMEM      12
+#define TLX_EFAULT      14
 #define TLX_EBUSY       16
 #define TLX_EEXIST      17
 #define TLX_ENOT_DIR    20
@@ -60,6 +64,9 @@
 #define TLX_OP_IDENTITY 16
 #define TLX_OP_UNLINK   17
 #define TLX_OP_MKDIR    18
+#define TLX_OP_MMAP     19
+#define TLX_OP_MUNMAP   20
+#define TLX_OP_READDIR  21
 
 #define TLX_HANDLE_KIND_INPUT  1
 #define TLX_HANDLE_KIND_OUTPUT 2
@@ -70,7 +77,8 @@
 typedef struct {
     unsigned char used;
     unsigned char kind;
-    unsigned short reserved;
+    unsigned char pinned;     // 打开时成功 pin 住 inode
+    unsigned char reserved;
     unsigned int flags;
     unsigned int position;
     unsigned int size;
@@ -92,6 +100,14 @@ typedef struct {
     unsigned int feature_bits;
 } TlxIdentity;
 
+// tlx_readdir() 的定长目录记录；kind 为 TLX_HANDLE_KIND_FILE 或 TLX_HANDLE_KIND_DIR
+typedef struct {
+    unsigned int inode;
+    unsigned int size;
+    unsigned int kind;
+    char name[TLX_MAX_PATH];
+} TlxDirEntry;
+
 int tlx_open(const char* path, unsigned int flags);
 int tlx_close(int handle);
 int tlx_read(int handle, void* buffer, unsigned int size);
@@ -110,5 +126,16 @@ int tlx_spawn(const char* path);
 int tlx_identity(TlxIdentity* identity);
 int tlx_unlink(const char* path);
 int tlx_mkdir(const char* path);
+// 把文件从 offset 起 length 字节只读映射进调用者地址空间，页在首次访问时才装入，
+// 同一文件的页在各进程间共享。offset 须按 TLX_PAGE_SIZE 对齐，length 为 0 表示到文件末尾；
+// 映射自己持有文件，之后可以关闭句柄。成功返回 0 并把起始地址写入 *address
+int tlx_mmap(int handle, unsigned int offset, unsigned int length, void** address);
+// 解除 tlx_mmap() 返回的整段映射
+int tlx_munmap(void* address);
+// 以 TLX_OPEN_DIR 打开目录，得到的句柄交给 tlx_readdir()
+int tlx_opendir(const char* path);
+// 从目录句柄的当前位置起读出至多 max 条记录 (不含 "." 和 "..")，返回条数，0 表示已读完；
+// 位置随之推进，tlx_seek(handle, 0, TLX_SEEK_START) 可从头再读
+int tlx_readdir(int handle, TlxDirEntry* entries, unsigned int max);
 
 #endif
@@ -8,5 +8,10 @@ struct Process;
 void tlx_process_init(struct Process* process);
 void tlx_process_release(struct Process* process);
 int tlx_dispatch(Registers* regs);
+// 文件映射窗口内的缺页 (页不存在)：装入对应的文件页后返回 1，不是合法的映射访问返回 0
+int tlx_mmap_fault(struct Process* process, unsigned int address, int write);
+// 内核代进程读写 buffer 前调用：要写入的缓冲不能落在只读的映射里 (返回 0)；
+// 要读取的先把映射里的页装好，免得在文件系统锁内缺页
+int tlx_user_buffer(const void* buffer, unsigned int size, int write);
 
 #endif
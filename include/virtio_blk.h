@@ -0,0 +1,28 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "disk.h"
+
+// virtio-blk 块设备 (QEMU: -drive if=virtio)：按 legacy 接口驱动，经 drivers/pci.c 按
+// 厂商/设备号 1AF4:1001 查找 (transitional 设备都带这一套)，寄存器在 BAR0 的 I/O 空间。
+// 只用第 0 号 split virtqueue；每个在途请求占一个槽：请求头、状态字节和一张间接描述符表，
+// 设备支持 VIRTIO_RING_F_INDIRECT_DESC 时环上只占一项描述符，否则按槽号在环上切固定的一段。
+// 设备有写缓存 (VIRTIO_BLK_F_FLUSH) 时写完在同一个槽里接着发 FLUSH，结束才算完成。
+// 本模块只管设备与环，排队、回调与等待在 drivers/disk.c，全部在关中断状态下调用。
+
+// 同时在途的请求数上限
+#define VIRTIO_BLK_SLOTS 32
+// 一个请求的数据段数上限，与 iosched.c 的合并段数上限一致
+#define VIRTIO_BLK_SEGMENTS 32
+
+int virtio_blk_init(void);
+int virtio_blk_available(void);
+unsigned int virtio_blk_queue_depth(void);
+// 设备配置里的扇区总数，超过 32 位的截成 0xFFFFFFFF
+unsigned int virtio_blk_capacity(void);
+int virtio_blk_irq_enabled(void);
+// 与 ahci_issue() / ahci_reap() 相同的约定
+int virtio_blk_issue(DiskRequest* cmd);
+DiskRequest* virtio_blk_reap(int* status);
+
+#endif
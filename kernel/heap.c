@@ -88,3 +88,20 @@ void free(void* ptr) {
     }
     irq_restore(flags);
 }
+
+// 多要 align 加一个指针的空间，对齐后的地址前面一格记下 malloc 返回的原始指针
+void* malloc_aligned(unsigned int size, unsigned int align) {
+    unsigned char* raw = (unsigned char*)malloc(size + align + sizeof(void*));
+    unsigned int addr;
+
+    if (!raw) return 0;
+    addr = ((unsigned int)raw + sizeof(void*) + align - 1) & ~(align - 1);
+    ((void**)addr)[-1] = raw;
+    memset((void*)addr, 0, size);
+    return (void*)addr;
+}
+
+void free_aligned(void* ptr) {
+    if (!ptr) return;
+    free(((void**)ptr)[-1]);
+}
@@ -9,15 +9,18 @@ __asm__(".code32");
 #include "utils.h"
 #include "heap.h"
 #include "fs.h"
+#include "disk.h"
 #include "idt.h"
 #include "process.h"
 #include "klog.h"
 #include "net.h"
 #include "console.h"
 #include "paging.h"
+#include "pagecache.h"
 
 // 声明外部函数
 extern void init_timer(int freq);
+extern unsigned int timer_get_ticks(void);
 extern unsigned char __bss_start;
 extern unsigned char __bss_end;
 
@@ -67,7 +70,10 @@ void main() {
     klog_write("ps2 init");
     ps2_mouse_init();
     klog_write("mouse init");
-    // 4. 初始化文件系统
+    disk_init();
+    klog_write("disk init");
+    // 4. 初始化文件系统 (页缓存的页框在恒等映射区内，fs_init 只清空缓存内容)
+    pagecache_init((void*)MP_PAGE_CACHE_BASE, MP_PAGE_CACHE_SIZE / PAGECACHE_PAGE_SIZE);
     fs_init();
     if (!fs_is_ready()) {
         klog_write("fs init failed");
@@ -153,6 +159,9 @@ void main() {
             }
         }
 
+        // 3. 周期性把块缓存中的脏块写回磁盘。
+        fs_periodic_sync(timer_get_ticks());
+
         // Timer/PS2 IRQ 唤醒；静止桌面不再忙轮询。
         video_note_idle_halt();
         __asm__ volatile("sti; hlt");
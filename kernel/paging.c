@@ -5,6 +5,7 @@
 #include "kernel_core.h"
 #include "process.h"
 #include "klog.h"
+#include "tlx_kernel.h"
 
 #define PAGE_SIZE 4096u
 #define PAGE_PRESENT 0x001u
@@ -14,6 +15,11 @@
 #define PAGING_STRUCT_PAGES ((MP_PAGING_STRUCT_LIMIT - MP_PAGING_STRUCT_BASE) / PAGE_SIZE)
 #define IDENTITY_INITIAL_LIMIT 0x02000000u
 #define APP_SLOT_COUNT ((int)MP_APP_SLOT_COUNT)
+#define MMAP_DIRECTORY_INDEX (MP_MMAP_BASE >> 22)
+#define CR0_WRITE_PROTECT 0x00010000u
+#define CR0_PAGING 0x80000000u
+#define FAULT_PRESENT 0x1u
+#define FAULT_WRITE 0x2u
 
 static SlotArena structure_pages;
 static SlotArena app_physical_slots;
@@ -121,7 +127,8 @@ void paging_init(void) {
     current_cr3_value = kernel_cr3_value;
     __asm__ volatile("mov %0, %%cr3" :: "r"(kernel_cr3_value) : "memory");
     __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
-    cr0 |= 0x80000000u;
+    // 所有任务都跑在 ring 0：置 WP 后内核态写只读页同样触发缺页，文件映射的页才真正只读
+    cr0 |= CR0_PAGING | CR0_WRITE_PROTECT;
     __asm__ volatile("mov %0, %%cr0" :: "r"(cr0) : "memory");
     enabled = 1;
     irq_restore(flags);
@@ -196,9 +203,13 @@ int paging_create_process_space(unsigned int virtual_base, unsigned int image_si
 
 void paging_destroy_process_space(unsigned int cr3, int app_physical_slot) {
     unsigned int flags;
+    unsigned int* directory;
     if (!cr3 || cr3 == kernel_cr3_value) return;
     flags = irq_save_disable();
     unregister_directory(cr3);
+    directory = physical_page_ptr(cr3);
+    if (directory[MMAP_DIRECTORY_INDEX] & PAGE_PRESENT)
+        free_structure_pages(directory[MMAP_DIRECTORY_INDEX] & PAGE_MASK, 1);
     if (app_physical_slot >= 0 && app_physical_slot < APP_SLOT_COUNT)
         slot_arena_free(&app_physical_slots, app_physical_slot, 1);
     free_structure_pages(cr3, 3);
@@ -210,6 +221,68 @@ void* paging_app_alias(int app_physical_slot) {
     return (void*)(MP_APP_PHYS_ALIAS_BASE + (unsigned int)app_physical_slot * MP_APP_SLOT_SIZE);
 }
 
+static unsigned int* mmap_table(unsigned int cr3, int create) {
+    unsigned int* directory = physical_page_ptr(cr3);
+    unsigned int table;
+    if (directory[MMAP_DIRECTORY_INDEX] & PAGE_PRESENT)
+        return physical_page_ptr(directory[MMAP_DIRECTORY_INDEX]);
+    if (!create) return 0;
+    table = allocate_structure_pages(1);
+    if (!table) return 0;
+    directory[MMAP_DIRECTORY_INDEX] = table | PAGE_FLAGS;
+    return physical_page_ptr(table);
+}
+
+static int mmap_address_valid(unsigned int cr3, unsigned int address) {
+    return cr3 && cr3 != kernel_cr3_value && address >= MP_MMAP_BASE && address < MP_MMAP_LIMIT;
+}
+
+int paging_map_page(unsigned int cr3, unsigned int virtual_address, unsigned int physical) {
+    unsigned int flags;
+    unsigned int* table;
+    if (!mmap_address_valid(cr3, virtual_address)) return 0;
+    flags = irq_save_disable();
+    table = mmap_table(cr3, 1);
+    if (table) {
+        table[(virtual_address >> 12) & 0x3FFu] = (physical & PAGE_MASK) | PAGE_PRESENT;
+        if ((cr3 & PAGE_MASK) == current_cr3_value)
+            __asm__ volatile("invlpg (%0)" :: "r"(virtual_address) : "memory");
+    }
+    irq_restore(flags);
+    return table != 0;
+}
+
+unsigned int paging_unmap_page(unsigned int cr3, unsigned int virtual_address) {
+    unsigned int flags;
+    unsigned int* table;
+    unsigned int entry = 0;
+    if (!mmap_address_valid(cr3, virtual_address)) return 0;
+    flags = irq_save_disable();
+    table = mmap_table(cr3, 0);
+    if (table) {
+        entry = table[(virtual_address >> 12) & 0x3FFu];
+        table[(virtual_address >> 12) & 0x3FFu] = 0;
+        if ((entry & PAGE_PRESENT) && (cr3 & PAGE_MASK) == current_cr3_value)
+            __asm__ volatile("invlpg (%0)" :: "r"(virtual_address) : "memory");
+    }
+    irq_restore(flags);
+    return (entry & PAGE_PRESENT) ? (entry & PAGE_MASK) : 0;
+}
+
+// 按当前页目录把虚拟地址换成物理地址，未映射返回 0；分页开启前即恒等
+unsigned int paging_translate(unsigned int address) {
+    unsigned int* directory;
+    unsigned int* table;
+    unsigned int entry;
+    if (!enabled) return address;
+    directory = physical_page_ptr(current_cr3_value);
+    if (!(directory[address >> 22] & PAGE_PRESENT)) return 0;
+    table = physical_page_ptr(directory[address >> 22]);
+    entry = table[(address >> 12) & 0x3FFu];
+    if (!(entry & PAGE_PRESENT)) return 0;
+    return (entry & PAGE_MASK) | (address & ~PAGE_MASK);
+}
+
 static void hex32(unsigned int value, char out[11]) {
     static const char digits[] = "0123456789ABCDEF";
     out[0] = '0'; out[1] = 'x';
@@ -220,7 +293,12 @@ static void hex32(unsigned int value, char out[11]) {
 void paging_handle_fault(unsigned int fault_address, unsigned int error_code,
                          unsigned int instruction_pointer) {
     char text[11];
-    (void)error_code;
+    // 文件映射窗口里的页不存在：按需从页缓存装入后返回，重新执行出错的指令
+    if (current_process && current_process->pid != 0 && !process_in_scheduler() &&
+        !(error_code & FAULT_PRESENT) && fault_address >= MP_MMAP_BASE && fault_address < MP_MMAP_LIMIT &&
+        tlx_mmap_fault(current_process, fault_address, (error_code & FAULT_WRITE) != 0)) {
+        return;
+    }
     hex32(fault_address, text); klog_write_pair("page fault addr ", text);
     hex32(instruction_pointer, text); klog_write_pair("page fault eip ", text);
     if (current_process && current_process->pid != 0) {
@@ -8,11 +8,13 @@
 #include "kernel_core.h"
 #include "irq.h"
 #include "paging.h"
+#include "fs.h"
 
 Process* current_process = 0;
 static Process* process_list = 0;
 static int next_pid = 0;
 static unsigned int scheduler_tick_count = 0;
+static int scheduler_active = 0;
 
 // 定义初始栈的大小
 #define STACK_SIZE 12288
@@ -104,6 +106,7 @@ static void free_process_slot(Process* proc) {
                 proc->page_directory != paging_current_cr3()) {
                 paging_destroy_process_space(proc->page_directory, proc->app_physical_slot);
             }
+            if (proc->image_inode_pinned) fs_inode_unpin(proc->image_inode);
             memset(proc, 0, sizeof(*proc));
             process_used[i] = 0;
             return;
@@ -111,10 +114,13 @@ static void free_process_slot(Process* proc) {
     }
 }
 
+// 回收要关闭句柄、解除映像 inode 的 pin，都会进文件系统；
+// 有进程正持有文件系统锁时留到之后的 tick，不能在时钟中断里等锁
 static void reap_dead_processes(void) {
     Process* prev = 0;
     Process* p = process_list;
 
+    if (fs_is_busy()) return;
     while (p) {
         if (p != current_process && p->state == PROCESS_DEAD) {
             Process* dead = p;
@@ -132,6 +138,21 @@ static void reap_dead_processes(void) {
     }
 }
 
+// process_exit() 已把进程摘出链表；文件系统忙时先挂回链表，留给之后的 reap_dead_processes()
+static void release_exited(Process* proc) {
+    Process* p = process_list;
+
+    if (!fs_is_busy()) {
+        free_process_slot(proc);
+        return;
+    }
+    while (p && p != proc) p = p->next;
+    if (!p) {
+        proc->next = process_list;
+        process_list = proc;
+    }
+}
+
 static unsigned int stack_base_for(Process* proc) {
     if (!proc) return 0;
     for (int i = 0; i < MAX_PROCESSES; i++) {
@@ -175,6 +196,7 @@ void process_init() {
     kernel_proc->page_directory = paging_kernel_cr3();
     kernel_proc->app_physical_slot = -1;
     kernel_proc->image_inode = 0;
+    kernel_proc->image_inode_pinned = 0;
     kernel_proc->instance_id = 0;
     kernel_proc->sandbox_level = 0;
     kernel_proc->focus_state_cache = -1;
@@ -229,6 +251,8 @@ int process_create(void (*entry_point)(), const char* name, Window* win,
     new_proc->page_directory = page_directory ? page_directory : paging_kernel_cr3();
     new_proc->app_physical_slot = app_physical_slot;
     new_proc->image_inode = image_inode;
+    // 运行期间 pin 住映像 inode，同一 TSK 再次启动时无需重新读取 inode 表
+    new_proc->image_inode_pinned = image_inode ? fs_inode_pin(image_inode) : 0;
     new_proc->instance_id = instance_id;
     
     // 初始化栈内容，模拟中断现场
@@ -313,6 +337,50 @@ void process_sleep(unsigned int ticks) {
     current_process->time_slice_remaining = 0;
 }
 
+void process_kill(Process* proc) {
+    if (!proc || proc->pid == 0 || proc->state == PROCESS_DEAD) return;
+    if (proc->locks_held > 0) {
+        proc->exit_pending = 1;
+        return;
+    }
+    proc->state = PROCESS_DEAD;
+}
+
+void process_wait(WaitQueue* queue) {
+    Process* self = current_process;
+
+    if (!queue || !self) return;
+    self->wait_next = 0;
+    if (queue->tail) queue->tail->wait_next = self;
+    else queue->head = self;
+    queue->tail = self;
+    self->wake_tick = 0;
+    self->state = PROCESS_BLOCKED;
+    self->time_slice_remaining = 0;
+    while (self->state == PROCESS_BLOCKED) {
+        __asm__ volatile("sti; hlt; cli");
+    }
+}
+
+Process* process_wake_one(WaitQueue* queue) {
+    Process* proc;
+
+    if (!queue || !queue->head) return 0;
+    proc = queue->head;
+    queue->head = proc->wait_next;
+    if (!queue->head) queue->tail = 0;
+    proc->wait_next = 0;
+    if (proc->state == PROCESS_BLOCKED) {
+        proc->state = PROCESS_READY;
+        reset_time_slice(proc);
+    }
+    return proc;
+}
+
+int process_in_scheduler(void) {
+    return scheduler_active;
+}
+
 void process_on_timer_tick(void) {
     scheduler_tick_count++;
 
@@ -444,7 +512,7 @@ int process_get_info_list(ProcessInfo* buffer, int max_count) {
 }
 
 // 调度器：Priority + Round-Robin
-unsigned int process_schedule(unsigned int current_esp) {
+static unsigned int schedule_next(unsigned int current_esp) {
     Process* prev_process;
     Process* next;
     int keep_current;
@@ -482,7 +550,7 @@ unsigned int process_schedule(unsigned int current_esp) {
     }
     if (!next) {
         if (prev_process->state == PROCESS_DEAD) {
-            free_process_slot(prev_process);
+            release_exited(prev_process);
         }
         return current_esp;
     }
@@ -503,8 +571,18 @@ unsigned int process_schedule(unsigned int current_esp) {
 
     reap_dead_processes();
     if (prev_process != current_process && prev_process->state == PROCESS_DEAD) {
-        free_process_slot(prev_process);
+        release_exited(prev_process);
     }
 
     return current_process->esp;
 }
+
+// 调度期间 (时钟中断里) 标记一下：借用的锁不记到被打断的进程名下，也不开中断
+unsigned int process_schedule(unsigned int current_esp) {
+    unsigned int esp;
+
+    scheduler_active = 1;
+    esp = schedule_next(current_esp);
+    scheduler_active = 0;
+    return esp;
+}
@@ -0,0 +1,90 @@
+// sync.c - 基于调度器等待队列的可睡眠互斥锁
+#include "sync.h"
+#include "process.h"
+#include "irq.h"
+#include "klog.h"
+
+// 调度器里借用锁时不记在被打断的进程名下
+static Process* mutex_self(void) {
+    return process_in_scheduler() ? 0 : current_process;
+}
+
+void kmutex_lock(KMutex* mutex) {
+    unsigned int flags;
+    Process* self;
+
+    if (!mutex) return;
+    flags = irq_save_disable();
+    self = mutex_self();
+    if (self) self->locks_held++;
+    if (mutex->depth == 0) {
+        mutex->owner = self;
+        mutex->depth = 1;
+    } else if (mutex->owner == self) {
+        mutex->depth++;
+    } else {
+        if (!self) kpanic("mutex contended in scheduler");
+        mutex->contended++;
+        // 放锁的一方把所有权直接交过来后才会被唤醒
+        process_wait(&mutex->waiters);
+    }
+    irq_restore(flags);
+}
+
+int kmutex_trylock(KMutex* mutex) {
+    unsigned int flags;
+    Process* self;
+    int locked = 0;
+
+    if (!mutex) return 0;
+    flags = irq_save_disable();
+    self = mutex_self();
+    if (mutex->depth == 0 || mutex->owner == self) {
+        if (mutex->depth == 0) mutex->owner = self;
+        mutex->depth++;
+        if (self) self->locks_held++;
+        locked = 1;
+    }
+    irq_restore(flags);
+    return locked;
+}
+
+void kmutex_unlock(KMutex* mutex) {
+    unsigned int flags;
+    Process* self;
+    Process* next;
+
+    if (!mutex || mutex->depth == 0) return;
+    flags = irq_save_disable();
+    self = mutex_self();
+    if (--mutex->depth == 0) {
+        next = process_wake_one(&mutex->waiters);
+        if (next) {
+            mutex->owner = next;
+            mutex->depth = 1;
+        } else {
+            mutex->owner = 0;
+        }
+    }
+    if (self && self->locks_held > 0 && --self->locks_held == 0 && self->exit_pending) {
+        // 持锁期间被要求退出 (例如窗口被关闭)：锁已放掉，现在可以安全退出
+        self->exit_pending = 0;
+        process_exit();
+    }
+    irq_restore(flags);
+}
+
+int kmutex_is_locked(const KMutex* mutex) {
+    return mutex && mutex->depth > 0;
+}
+
+int sync_preemptible(void) {
+    return current_process && current_process->pid != 0 && !process_in_scheduler();
+}
+
+// PID 0 (内核主循环) 只用 trylock 进来，不会在锁上睡眠；开着中断时等盘能 hlt 而不是忙等，
+// 别的进程照常被调度，要锁的在锁上睡眠。启动阶段 (中断尚未打开) 仍保持关中断
+int sync_irq_allowed(unsigned int flags) {
+    if (sync_preemptible()) return 1;
+    return current_process && !process_in_scheduler() && irq_were_enabled(flags);
+}
@@ -495,6 +495,10 @@ void syscall_handler(Registers* regs) {
             break;
 
         case SYS_READ_FILE:
+            if (!tlx_user_buffer((void*)regs->ecx, (unsigned int)regs->edx, 1)) {
+                regs->eax = 0;
+                break;
+            }
             regs->eax = fs_read_file((char*)regs->ebx, (void*)regs->ecx,
                                      (unsigned int)regs->edx);
             break;
@@ -527,6 +531,45 @@ void syscall_handler(Registers* regs) {
             } else regs->eax = 0;
             break;
 
+        case SYS_GET_FS_STATS:
+            if (regs->ebx) {
+                FsStats stats;
+                UserFsStats* out = (UserFsStats*)regs->ebx;
+                fs_get_stats(&stats);
+                out->cache_hits = stats.cache_hits;
+                out->cache_misses = stats.cache_misses;
+                out->cache_writebacks = stats.cache_writebacks;
+                out->cache_evictions = stats.cache_evictions;
+                out->cache_dirty_blocks = stats.cache_dirty_blocks;
+                out->inode_cache_hits = stats.inode_cache_hits;
+                out->inode_cache_misses = stats.inode_cache_misses;
+                out->inodes_pinned = stats.inodes_pinned;
+                out->dentry_hits = stats.dentry_hits;
+                out->dentry_misses = stats.dentry_misses;
+                out->indexed_dirs = stats.indexed_dirs;
+                out->readahead_blocks = stats.readahead_blocks;
+                out->readahead_hits = stats.readahead_hits;
+                out->journal_commits = stats.journal_commits;
+                out->journal_blocks = stats.journal_blocks;
+                regs->eax = 1;
+            } else regs->eax = 0;
+            break;
+
+        case SYS_DISK_BENCH:
+            if (regs->ebx) {
+                DiskBenchResult result;
+                UserDiskBench* out = (UserDiskBench*)regs->ebx;
+                fs_disk_benchmark(&result);
+                out->kib = result.kib;
+                out->pio_kib_per_s = result.pio_kib_per_s;
+                out->dma_kib_per_s = result.dma_kib_per_s;
+                out->dma_available = result.dma_available;
+                out->backend = result.backend;
+                out->queue_depth = result.queue_depth;
+                regs->eax = 1;
+            } else regs->eax = 0;
+            break;
+
         case SYS_SLEEP:
             process_sleep((unsigned int)regs->ebx);
             regs->eax = 1;
@@ -594,7 +637,7 @@ void syscall_handler(Registers* regs) {
         }
 
         case SYS_FS_LIST:
-            if (regs->ebx && regs->ecx > 0) {
+            if (regs->ebx && regs->ecx > 0 && tlx_user_buffer((void*)regs->ebx, regs->ecx, 1)) {
                 regs->eax = fs_get_file_list((char*)regs->ebx, regs->ecx, (const char*)regs->edx);
             } else {
                 regs->eax = 0;
@@ -664,6 +707,10 @@ void syscall_handler(Registers* regs) {
             break;
 
         case SYS_WRITE_FILE:
+            if (!tlx_user_buffer((const void*)regs->ecx, regs->edx, 0)) {
+                regs->eax = 0;
+                break;
+            }
             regs->eax = fs_write_file((const char*)regs->ebx, (const void*)regs->ecx, regs->edx);
             if (regs->eax > 0 && regs->ebx &&
                 strcmp((const char*)regs->ebx, "system/config.rtsk") == 0) {
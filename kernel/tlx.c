@@ -2,6 +2,7 @@
 #include "tlx.h"
 #include "process.h"
 #include "fs.h"
+#include "paging.h"
 #include "heap.h"
 #include "utils.h"
 #include "ps2.h"
@@ -11,13 +12,24 @@
 extern unsigned int timer_get_ticks(void);
 
 #define TLX_CONTEXT_COUNT 16
-#define TLX_MAX_FILE_BYTES 0x44000u
+
+// 文件映射：窗口 [base, base + pages 页) 对应文件从 first_page 起的页，映射期间 pin 住 inode
+typedef struct {
+    unsigned int base;        // 0 表示空槽
+    unsigned int pages;
+    unsigned int first_page;
+    unsigned int inode;
+} TlxMapping;
 
 typedef struct {
     int used;
     Process* owner;
     TlxHandle handles[TLX_MAX_FDS];
+    FsReadahead readahead[TLX_MAX_FDS];
     char cwd[TLX_MAX_PATH];
+    TlxMapping maps[TLX_MAX_MAPS];
+    // 建立/解除映射和缺页装入期间持有：进程这时被关窗口会推迟到页表项与页引用对上之后再退出
+    KMutex mm_lock;
 } TlxContext;
 
 static TlxContext contexts[TLX_CONTEXT_COUNT];
@@ -63,6 +75,27 @@ static void tlx_init_standard_handles(TlxContext* context) {
     context->handles[TLX_STD_ERROR].kind = TLX_HANDLE_KIND_ERROR;
 }
 
+// 关闭句柄，释放其对 inode 的 pin
+static void tlx_release_handle(TlxHandle* handle) {
+    if (!handle || !handle->used) return;
+    if ((handle->kind == TLX_HANDLE_KIND_FILE || handle->kind == TLX_HANDLE_KIND_DIR) && handle->pinned) {
+        fs_inode_unpin(handle->inode);
+    }
+    handle->used = 0;
+    handle->pinned = 0;
+}
+
+// 解除映射：逐页撤掉页表项并归还页缓存里的页，最后解除 inode 的 pin
+static void tlx_release_mapping(TlxMapping* map, unsigned int cr3) {
+    if (!map || !map->base) return;
+    for (unsigned int p = 0; p < map->pages; p++) {
+        unsigned int page = paging_unmap_page(cr3, map->base + p * TLX_PAGE_SIZE);
+        if (page) fs_page_put((void*)page);
+    }
+    fs_inode_unpin(map->inode);
+    memset(map, 0, sizeof(*map));
+}
+
 void tlx_process_init(struct Process* process) {
     TlxContext* context = 0;
     TlxContext* free_context = 0;
@@ -77,6 +110,8 @@ void tlx_process_init(struct Process* process) {
     }
     if (!context) context = free_context;
     if (!context) return;
+    for (int h = 0; h < TLX_MAX_FDS; h++) tlx_release_handle(&context->handles[h]);
+    for (int m = 0; m < TLX_MAX_MAPS; m++) tlx_release_mapping(&context->maps[m], process->page_directory);
 
     memset(context, 0, sizeof(*context));
     context->used = 1;
@@ -90,6 +125,10 @@ void tlx_process_release(struct Process* process) {
     if (!process) return;
     for (int i = 0; i < TLX_CONTEXT_COUNT; i++) {
         if (contexts[i].used && contexts[i].owner == process) {
+            for (int h = 0; h < TLX_MAX_FDS; h++) tlx_release_handle(&contexts[i].handles[h]);
+            for (int m = 0; m < TLX_MAX_MAPS; m++) {
+                tlx_release_mapping(&contexts[i].maps[m], process->page_directory);
+            }
             memset(&contexts[i], 0, sizeof(contexts[i]));
             return;
         }
@@ -194,12 +233,14 @@ static int tlx_open_handle(TlxContext* context, const char* input_path, unsigned
     if (handle < 0) return -TLX_EMFILE;
 
     memset(&context->handles[handle], 0, sizeof(context->handles[handle]));
+    memset(&context->readahead[handle], 0, sizeof(context->readahead[handle]));
     context->handles[handle].used = 1;
     context->handles[handle].flags = flags;
 
     if (flags & TLX_OPEN_DIR) {
         if (strcmp(path, "/") == 0) {
             context->handles[handle].kind = TLX_HANDLE_KIND_DIR;
+            context->handles[handle].inode = EXT2_ROOT_INODE;
             tlx_copy_string(context->handles[handle].path, "/", TLX_MAX_PATH);
             return handle;
         }
@@ -214,6 +255,7 @@ static int tlx_open_handle(TlxContext* context, const char* input_path, unsigned
         context->handles[handle].kind = TLX_HANDLE_KIND_DIR;
         context->handles[handle].size = file.size;
         context->handles[handle].inode = file.inode_num;
+        context->handles[handle].pinned = (unsigned char)fs_inode_pin(file.inode_num);
         tlx_copy_string(context->handles[handle].path, path, TLX_MAX_PATH);
         return handle;
     }
@@ -227,20 +269,21 @@ static int tlx_open_handle(TlxContext* context, const char* input_path, unsigned
         return -TLX_EIS_DIR;
     }
     if ((flags & TLX_OPEN_TRUNC) && (flags & TLX_OPEN_WRITE)) {
-        fs_write_file(actual_path, 0, 0);
+        fs_truncate_inode(file.inode_num, 0);
         file.size = 0;
     }
 
     context->handles[handle].kind = TLX_HANDLE_KIND_FILE;
     context->handles[handle].size = file.size;
     context->handles[handle].inode = file.inode_num;
+    context->handles[handle].pinned = (unsigned char)fs_inode_pin(file.inode_num);
     context->handles[handle].position = (flags & TLX_OPEN_APPEND) ? file.size : 0;
     tlx_copy_string(context->handles[handle].path, actual_path, TLX_MAX_PATH);
     return handle;
 }
 
-static int tlx_read_handle(TlxHandle* handle, void* buffer, unsigned int size) {
-    AppFile file;
+static int tlx_read_handle(TlxHandle* handle, FsReadahead* readahead, void* buffer, unsigned int size) {
+    unsigned int file_size;
     int result;
 
     if (!handle) return -TLX_EINVAL;
@@ -248,50 +291,32 @@ static int tlx_read_handle(TlxHandle* handle, void* buffer, unsigned int size) {
     if (!buffer) return -TLX_EINVAL;
     if (handle->kind != TLX_HANDLE_KIND_FILE) return -TLX_EBAD_HANDLE;
     if (!(handle->flags & TLX_OPEN_READ)) return -TLX_EPERM;
-    if (!app_file_open(handle->path, &file)) return -TLX_EIO;
-    file.current_pos = handle->position;
-    result = app_file_read(&file, buffer, size);
-    if (result > 0) {
-        handle->position = file.current_pos;
-        handle->size = file.sys_file.size;
-    }
+    // 句柄打开时已 pin 住 inode，直接按 inode 号读取
+    result = fs_read_inode_data(handle->inode, handle->position, buffer, size, &file_size, readahead);
+    if (result < 0) return -TLX_EIO;
+    handle->size = file_size;
+    handle->position += (unsigned int)result;
     return result;
 }
 
 static int tlx_write_file(TlxHandle* handle, const void* buffer, unsigned int size) {
-    unsigned int new_size;
-    unsigned char* snapshot;
+    unsigned int pos;
+    unsigned int file_size = 0;
     int result;
 
     if (!handle || !buffer) return -TLX_EINVAL;
     if (handle->kind != TLX_HANDLE_KIND_FILE) return -TLX_EBAD_HANDLE;
     if (!(handle->flags & TLX_OPEN_WRITE)) return -TLX_EPERM;
-    if (handle->position > handle->size) return -TLX_EINVAL;
     if (size == 0) return 0;
-    if (size > TLX_MAX_FILE_BYTES - handle->position) return -TLX_EOVERFLOW;
-
-    new_size = handle->size;
-    if (handle->position + size > new_size) new_size = handle->position + size;
-    if (new_size > TLX_MAX_FILE_BYTES) return -TLX_ENOSPC;
-
-    snapshot = (unsigned char*)malloc(new_size ? new_size : 1);
-    if (!snapshot) return -TLX_ENOSPC;
-    memset(snapshot, 0, new_size);
-    if (handle->size > 0) {
-        result = fs_read_file(handle->path, snapshot, handle->size);
-        if (result != (int)handle->size) {
-            free(snapshot);
-            return -TLX_EIO;
-        }
-    }
+    if (size > 0xFFFFFFFFu - handle->position) return -TLX_EOVERFLOW;
 
-    memcpy(snapshot + handle->position, buffer, size);
-    result = fs_write_file(handle->path, snapshot, new_size);
-    free(snapshot);
-    if (result != (int)new_size) return -TLX_ENOSPC;
+    // 追加模式每次都写到文件当前末尾，由文件系统在同一把锁内取长度
+    pos = (handle->flags & TLX_OPEN_APPEND) ? FS_POS_APPEND : handle->position;
+    result = fs_pwrite_inode(handle->inode, pos, buffer, size, &file_size);
+    if (result != (int)size) return -TLX_ENOSPC;
 
-    handle->size = new_size;
-    handle->position += size;
+    handle->size = file_size;
+    handle->position = (handle->flags & TLX_OPEN_APPEND) ? file_size : handle->position + size;
     return (int)size;
 }
 
@@ -328,14 +353,17 @@ static int tlx_seek_handle(TlxHandle* handle, int offset, int whence) {
     int base;
     int target;
 
-    if (!handle || handle->kind != TLX_HANDLE_KIND_FILE) return -TLX_EBAD_HANDLE;
+    // 目录句柄的位置是 tlx_readdir 的游标
+    if (!handle || (handle->kind != TLX_HANDLE_KIND_FILE && handle->kind != TLX_HANDLE_KIND_DIR)) {
+        return -TLX_EBAD_HANDLE;
+    }
     if (whence == TLX_SEEK_START) base = 0;
     else if (whence == TLX_SEEK_HERE) base = (int)handle->position;
     else if (whence == TLX_SEEK_END) base = (int)handle->size;
     else return -TLX_EINVAL;
 
     target = base + offset;
-    if (target < 0 || (unsigned int)target > TLX_MAX_FILE_BYTES) return -TLX_EINVAL;
+    if (target < 0) return -TLX_EINVAL;
     handle->position = (unsigned int)target;
     return target;
 }
@@ -363,6 +391,143 @@ static int tlx_list_path(TlxContext* context, const char* input, char* buffer, u
     return result;
 }
 
+// 记录按小批在内核栈上转换后拷给调用者，游标存在句柄的 position 里
+static int tlx_readdir_handle(TlxHandle* handle, TlxDirEntry* entries, unsigned int max) {
+    FsDirEntry batch[8];
+    unsigned int count = 0;
+
+    if (!handle || handle->kind != TLX_HANDLE_KIND_DIR) return -TLX_EBAD_HANDLE;
+    if (!entries || max == 0) return -TLX_EINVAL;
+    while (count < max) {
+        unsigned int want = max - count < 8 ? max - count : 8;
+        int got = fs_read_dir(handle->inode, &handle->position, batch, want);
+
+        if (got < 0) return count > 0 ? (int)count : -TLX_EIO;
+        for (int i = 0; i < got; i++) {
+            TlxDirEntry* out = &entries[count++];
+            out->inode = batch[i].inode;
+            out->size = batch[i].size;
+            out->kind = batch[i].type == 1 ? TLX_HANDLE_KIND_DIR : TLX_HANDLE_KIND_FILE;
+            tlx_copy_string(out->name, batch[i].name, TLX_MAX_PATH);
+        }
+        if ((unsigned int)got < want) break;
+    }
+    return (int)count;
+}
+
+static TlxMapping* tlx_find_mapping(TlxContext* context, unsigned int address) {
+    for (int i = 0; i < TLX_MAX_MAPS; i++) {
+        TlxMapping* map = &context->maps[i];
+        if (map->base && address >= map->base && address - map->base < map->pages * TLX_PAGE_SIZE) return map;
+    }
+    return 0;
+}
+
+// 在映射窗口里找一段不与已有映射重叠的 pages 页，找不到返回 0
+static unsigned int tlx_map_window(TlxContext* context, unsigned int pages) {
+    unsigned int base = MP_MMAP_BASE;
+    int moved = 1;
+
+    while (moved) {
+        moved = 0;
+        for (int i = 0; i < TLX_MAX_MAPS; i++) {
+            TlxMapping* map = &context->maps[i];
+            unsigned int end = map->base + map->pages * TLX_PAGE_SIZE;
+            if (map->base && base < end && map->base < base + pages * TLX_PAGE_SIZE) {
+                base = end;
+                moved = 1;
+            }
+        }
+    }
+    if (pages > (MP_MMAP_LIMIT - base) / TLX_PAGE_SIZE) return 0;
+    return base;
+}
+
+static int tlx_mmap_handle(TlxContext* context, TlxHandle* handle, unsigned int offset,
+                           unsigned int length, void** out_address) {
+    TlxMapping* map = 0;
+    unsigned int pages;
+    unsigned int base;
+    int result = 0;
+
+    if (!handle || handle->kind != TLX_HANDLE_KIND_FILE) return -TLX_EBAD_HANDLE;
+    if (!(handle->flags & TLX_OPEN_READ)) return -TLX_EPERM;
+    if (!out_address || offset % TLX_PAGE_SIZE != 0 || offset >= handle->size) return -TLX_EINVAL;
+    if (!current_process || !current_process->page_directory) return -TLX_ENOSYS;
+    if (length == 0) length = handle->size - offset;
+    pages = length / TLX_PAGE_SIZE + (length % TLX_PAGE_SIZE != 0);
+    if (pages > MP_MMAP_SIZE / TLX_PAGE_SIZE) return -TLX_ENOMEM;
+
+    kmutex_lock(&context->mm_lock);
+    for (int i = 0; i < TLX_MAX_MAPS && !map; i++) {
+        if (!context->maps[i].base) map = &context->maps[i];
+    }
+    base = map ? tlx_map_window(context, pages) : 0;
+    if (!base) {
+        result = -TLX_ENOMEM;
+    } else if (!fs_inode_pin(handle->inode)) {
+        result = -TLX_EBUSY;
+    } else {
+        map->base = base;
+        map->pages = pages;
+        map->first_page = offset / TLX_PAGE_SIZE;
+        map->inode = handle->inode;
+        *out_address = (void*)base;
+    }
+    kmutex_unlock(&context->mm_lock);
+    return result;
+}
+
+static int tlx_munmap_address(TlxContext* context, unsigned int address) {
+    TlxMapping* map;
+    int result = -TLX_EINVAL;
+
+    kmutex_lock(&context->mm_lock);
+    map = tlx_find_mapping(context, address);
+    if (map && map->base == address) {
+        tlx_release_mapping(map, current_process->page_directory);
+        result = 0;
+    }
+    kmutex_unlock(&context->mm_lock);
+    return result;
+}
+
+int tlx_mmap_fault(struct Process* process, unsigned int address, int write) {
+    TlxContext* context = tlx_find_context(process, 0);
+    TlxMapping* map;
+    void* page = 0;
+    int mapped = 0;
+
+    // 映射只读：写入与越界访问都按非法访问处理
+    if (!context || write) return 0;
+    kmutex_lock(&context->mm_lock);
+    map = tlx_find_mapping(context, address);
+    if (map) page = fs_page_get(map->inode, map->first_page + (address - map->base) / TLX_PAGE_SIZE);
+    if (page) {
+        mapped = paging_map_page(process->page_directory, address & ~(TLX_PAGE_SIZE - 1u), (unsigned int)page);
+        if (!mapped) fs_page_put(page);
+    }
+    kmutex_unlock(&context->mm_lock);
+    return mapped;
+}
+
+int tlx_user_buffer(const void* buffer, unsigned int size, int write) {
+    unsigned int start = (unsigned int)buffer;
+    unsigned int end = start + size;
+
+    if (size == 0) return 1;
+    if (end < start) end = 0xFFFFFFFFu;
+    if (end <= MP_MMAP_BASE || start >= MP_MMAP_LIMIT) return 1;
+    if (write) return 0;
+    if (start < MP_MMAP_BASE) start = MP_MMAP_BASE;
+    if (end > MP_MMAP_LIMIT) end = MP_MMAP_LIMIT;
+    // 每页读一个字节，缺页在这里 (文件系统锁外) 处理掉
+    for (unsigned int page = start & ~(TLX_PAGE_SIZE - 1u); page < end; page += TLX_PAGE_SIZE) {
+        (void)*(volatile const unsigned char*)page;
+    }
+    return 1;
+}
+
 static int tlx_is_restricted(unsigned int op, unsigned int arg1) {
     if (!current_process) return 0;
     if (current_process->sandbox_level == SANDBOX_NONE) return 0;
@@ -374,7 +539,8 @@ static int tlx_is_restricted(unsigned int op, unsigned int arg1) {
     return !(op == TLX_OP_CLOSE || op == TLX_OP_READ || op == TLX_OP_FSTAT ||
              op == TLX_OP_GETPID || op == TLX_OP_GETPPID || op == TLX_OP_SLEEP ||
              op == TLX_OP_YIELD || op == TLX_OP_CLOCK || op == TLX_OP_IDENTITY ||
-             op == TLX_OP_UNLINK || op == TLX_OP_MKDIR);
+             op == TLX_OP_UNLINK || op == TLX_OP_MKDIR || op == TLX_OP_MMAP ||
+             op == TLX_OP_MUNMAP || op == TLX_OP_READDIR);
 }
 
 static int tlx_wait_for_wakeup(void) {
@@ -405,16 +571,18 @@ int tlx_dispatch(Registers* regs) {
             handle = tlx_get_handle(context, (int)regs->ecx);
             if ((int)regs->ecx >= 0 && (int)regs->ecx < 3) return 0;
             if (!handle) return -TLX_EBAD_HANDLE;
-            handle->used = 0;
+            tlx_release_handle(handle);
             return 0;
         case TLX_OP_READ:
             handle = tlx_get_handle(context, (int)regs->ecx);
             if (!handle) return -TLX_EBAD_HANDLE;
+            if (!tlx_user_buffer((void*)regs->edx, regs->esi, 1)) return -TLX_EFAULT;
             if (handle->kind == TLX_HANDLE_KIND_INPUT) return tlx_read_console((void*)regs->edx, regs->esi);
-            return tlx_read_handle(handle, (void*)regs->edx, regs->esi);
+            return tlx_read_handle(handle, &context->readahead[(int)regs->ecx], (void*)regs->edx, regs->esi);
         case TLX_OP_WRITE:
             handle = tlx_get_handle(context, (int)regs->ecx);
             if (!handle) return -TLX_EBAD_HANDLE;
+            if (!tlx_user_buffer((const void*)regs->edx, regs->esi, 0)) return -TLX_EFAULT;
             if (handle->kind == TLX_HANDLE_KIND_OUTPUT || handle->kind == TLX_HANDLE_KIND_ERROR) {
                 return tlx_write_console((const void*)regs->edx, regs->esi);
             }
@@ -426,6 +594,7 @@ int tlx_dispatch(Registers* regs) {
             handle = tlx_get_handle(context, (int)regs->ecx);
             return tlx_stat_handle(handle, (TlxFileInfo*)regs->edx);
         case TLX_OP_LIST:
+            if (!tlx_user_buffer((void*)regs->edx, regs->esi, 1)) return -TLX_EFAULT;
             return tlx_list_path(context, (const char*)regs->ecx, (char*)regs->edx, regs->esi);
         case TLX_OP_GETPID:
             return current_process ? current_process->pid : -1;
@@ -466,7 +635,7 @@ int tlx_dispatch(Registers* regs) {
             tlx_copy_string(identity.name, "Tsuki OS", sizeof(identity.name));
             tlx_copy_string(identity.release, "tlx-1", sizeof(identity.release));
             identity.abi_version = TLX_ABI_VERSION;
-            identity.feature_bits = 0x000001FFu;
+            identity.feature_bits = 0x000007FFu;
             memcpy((void*)regs->ecx, &identity, sizeof(identity));
             return 0;
         case TLX_OP_UNLINK:
@@ -483,6 +652,15 @@ int tlx_dispatch(Registers* regs) {
             if (result == 0) return -TLX_ENOSPC;
             if (result < 0) return -TLX_EEXIST;
             return 0;
+        case TLX_OP_MMAP:
+            return tlx_mmap_handle(context, tlx_get_handle(context, (int)regs->ecx), regs->edx, regs->esi,
+                                   (void**)regs->edi);
+        case TLX_OP_MUNMAP:
+            return tlx_munmap_address(context, regs->ecx);
+        case TLX_OP_READDIR:
+            if (regs->esi > 0xFFFFFFFFu / sizeof(TlxDirEntry)) return -TLX_EINVAL;
+            if (!tlx_user_buffer((void*)regs->edx, regs->esi * sizeof(TlxDirEntry), 1)) return -TLX_EFAULT;
+            return tlx_readdir_handle(tlx_get_handle(context, (int)regs->ecx), (TlxDirEntry*)regs->edx, regs->esi);
         default:
             return -TLX_ENOSYS;
     }
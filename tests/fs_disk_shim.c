@@ -4,36 +4,228 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "sync.h"
+
 #define FS_OFFSET (1024 * 1024)
-#define BLOCK_SIZE 1024
+#define SUPER_OFFSET (FS_OFFSET + 1024)
+#define MAX_BLOCK_SIZE 4096
+// Like an IDE drive without LBA48: 8-bit sector count.
+#define MAX_COMMAND_SECTORS 255
 
 static int disk_fd = -1;
+static unsigned int disk_sectors = 0;
+static unsigned int disk_read_commands = 0;
+static unsigned int disk_write_commands = 0;
+// While set, every read command fails the way a drive reporting ERR does.
+static int disk_fail_reads = 0;
+// While set, write commands outside [disk_keep_lba, disk_keep_end) fail.
+static int disk_fail_writes = 0;
+static unsigned int disk_keep_lba = 0;
+static unsigned int disk_keep_end = 0;
+
+static int disk_write_fails(unsigned int lba, unsigned int count) {
+    return disk_fail_writes && (lba < disk_keep_lba || lba + count > disk_keep_end);
+}
 
 int test_disk_open(const char* path) {
+    struct stat st;
+
     disk_fd = open(path, O_RDWR);
-    return disk_fd >= 0;
+    if (disk_fd < 0) return 0;
+    if (fstat(disk_fd, &st) != 0) return 0;
+    disk_sectors = (unsigned int)(st.st_size / 512);
+    return 1;
 }
 
 void test_disk_close(void) {
     if (disk_fd >= 0) close(disk_fd);
     disk_fd = -1;
+    disk_fail_reads = 0;
+    disk_fail_writes = 0;
+}
+
+void test_disk_fail_reads(int on) {
+    disk_fail_reads = on;
 }
 
 void disk_init(void) {}
 
-void disk_read_sectors(int lba, int count, void* buffer) {
-    size_t bytes = (size_t)count * 512u;
-    off_t offset = (off_t)lba * 512;
-    if (pread(disk_fd, buffer, bytes, offset) != (ssize_t)bytes) abort();
+unsigned int disk_max_sectors(void) {
+    return MAX_COMMAND_SECTORS;
+}
+
+unsigned int disk_capacity(void) {
+    return disk_sectors;
+}
+
+static int disk_range_ok(unsigned int lba, unsigned int count) {
+    return count > 0 && count <= MAX_COMMAND_SECTORS && lba + count >= lba && lba + count <= disk_sectors;
+}
+
+// Split like the kernel's synchronous wrappers: one command per MAX_COMMAND_SECTORS.
+int disk_read_sectors(unsigned int lba, unsigned int count, void* buffer) {
+    unsigned char* p = buffer;
+
+    if (!buffer || count == 0 || disk_fail_reads) return -1;
+    while (count > 0) {
+        unsigned int chunk = count < MAX_COMMAND_SECTORS ? count : MAX_COMMAND_SECTORS;
+        if (!disk_range_ok(lba, chunk)) return -1;
+        if (pread(disk_fd, p, (size_t)chunk * 512u, (off_t)lba * 512) != (ssize_t)chunk * 512) abort();
+        disk_read_commands++;
+        lba += chunk;
+        count -= chunk;
+        p += chunk * 512u;
+    }
+    return 0;
+}
+
+unsigned int test_disk_read_commands(void) {
+    return disk_read_commands;
+}
+
+int disk_write_sectors(unsigned int lba, unsigned int count, const void* buffer) {
+    const unsigned char* p = buffer;
+
+    if (!buffer || count == 0) return -1;
+    while (count > 0) {
+        unsigned int chunk = count < MAX_COMMAND_SECTORS ? count : MAX_COMMAND_SECTORS;
+        if (!disk_range_ok(lba, chunk) || disk_write_fails(lba, chunk)) return -1;
+        if (pwrite(disk_fd, p, (size_t)chunk * 512u, (off_t)lba * 512) != (ssize_t)chunk * 512) abort();
+        disk_write_commands++;
+        lba += chunk;
+        count -= chunk;
+        p += chunk * 512u;
+    }
+    return 0;
+}
+
+unsigned int test_disk_write_commands(void) {
+    return disk_write_commands;
 }
 
-void disk_write_sectors(int lba, int count, const void* buffer) {
-    size_t bytes = (size_t)count * 512u;
-    off_t offset = (off_t)lba * 512;
-    if (pwrite(disk_fd, buffer, bytes, offset) != (ssize_t)bytes) abort();
+// Mirrors include/disk.h, which cannot be included next to the libc headers.
+typedef struct DiskRequest DiskRequest;
+struct DiskRequest {
+    unsigned int lba;
+    unsigned int count;
+    void* buffer;
+    unsigned char write;
+    volatile unsigned char done;
+    int status;
+    void (*on_done)(DiskRequest* req);
+    void* ctx;
+    DiskRequest* next;
+    DiskRequest* merged;
+    unsigned int expire;
+    unsigned int phys;
+    unsigned char no_dma;
+    void* bounce;
+    unsigned int cr3;
+};
+
+// The fake drive copies through pread/pwrite, so there is nothing to map for DMA
+// and only one address space.
+void disk_map_buffer(DiskRequest* req) {
+    req->phys = 0;
+    req->cr3 = 0;
+}
+
+// The fake drive finishes one queued request per disk_poll() call, so
+// requests submitted back to back really are in flight together.
+static DiskRequest* disk_queue_head = NULL;
+static DiskRequest* disk_queue_tail = NULL;
+static unsigned int disk_queue_len = 0;
+
+void disk_submit(DiskRequest* req) {
+    unsigned int total = 0;
+
+    req->next = NULL;
+    for (DiskRequest* seg = req; seg; seg = seg->merged) {
+        seg->done = 0;
+        seg->status = 0;
+        if (!seg->buffer || seg->count == 0) abort();
+        total += seg->count;
+    }
+    // Oversized or out-of-range commands fail straight away, as in drivers/disk.c.
+    if (!disk_range_ok(req->lba, total)) {
+        while (req) {
+            DiskRequest* next = req->merged;
+            req->status = -1;
+            req->done = 1;
+            if (req->on_done) req->on_done(req);
+            req = next;
+        }
+        return;
+    }
+    if (disk_queue_tail) disk_queue_tail->next = req;
+    else disk_queue_head = req;
+    disk_queue_tail = req;
+    disk_queue_len++;
+}
+
+int disk_poll(void) {
+    DiskRequest* req = disk_queue_head;
+    unsigned int lba;
+
+    if (!req) return 0;
+    disk_queue_head = req->next;
+    if (!disk_queue_head) disk_queue_tail = NULL;
+    disk_queue_len--;
+    req->next = NULL;
+    // A merged chain is one command: the segments must follow each other on disk.
+    lba = req->lba;
+    for (DiskRequest* seg = req; seg; seg = seg->merged) {
+        off_t offset = (off_t)lba * 512;
+        size_t bytes = (size_t)seg->count * 512u;
+        if (seg->lba != lba || seg->write != req->write) abort();
+        lba += seg->count;
+        if (seg->write && disk_write_fails(seg->lba, seg->count)) {
+            seg->status = -1;
+        } else if (seg->write) {
+            if (pwrite(disk_fd, seg->buffer, bytes, offset) != (ssize_t)bytes) abort();
+        } else if (disk_fail_reads) {
+            seg->status = -1;
+        } else {
+            if (pread(disk_fd, seg->buffer, bytes, offset) != (ssize_t)bytes) abort();
+        }
+    }
+    if (req->write) disk_write_commands++;
+    else disk_read_commands++;
+    while (req) {
+        DiskRequest* next = req->merged;
+        req->done = 1;
+        if (req->on_done) req->on_done(req);
+        req = next;
+    }
+    return 1;
+}
+
+int disk_wait_request(DiskRequest* req) {
+    while (!req->done) {
+        if (!disk_poll()) abort();
+    }
+    return req->status;
+}
+
+unsigned int disk_pending(void) {
+    return disk_queue_len;
+}
+
+// Like the IDE path: one command on the drive at a time.
+unsigned int disk_queue_depth(void) {
+    return 1;
+}
+
+// There is no interrupt to wait for: the next disk_poll() makes progress.
+void disk_wait_any(void) {}
+
+// Only the diskbench syscall reaches this; the host tests never call it.
+void disk_benchmark(void* out) {
+    (void)out;
 }
 
 static uint32_t read_u32(off_t offset) {
@@ -43,28 +235,193 @@ static uint32_t read_u32(off_t offset) {
            ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
 }
 
+// 1024 << s_log_block_size
+static uint32_t block_size(void) {
+    return 1024u << read_u32(SUPER_OFFSET + 24);
+}
+
+unsigned int test_block_size(void) {
+    return block_size();
+}
+
 unsigned int test_free_blocks(void) {
-    return read_u32(FS_OFFSET + BLOCK_SIZE + 12);
+    return read_u32(SUPER_OFFSET + 12);
+}
+
+static uint32_t blocks_per_group(void) {
+    return read_u32(SUPER_OFFSET + 32);
+}
+
+unsigned int test_group_count(void) {
+    return (read_u32(SUPER_OFFSET + 4) + blocks_per_group() - 1) / blocks_per_group();
+}
+
+// Group descriptors are 32 bytes each, packed from the block after the
+// superblock's (s_first_data_block + 1) on.
+static off_t group_desc(unsigned int group) {
+    return FS_OFFSET + (off_t)(read_u32(SUPER_OFFSET + 20) + 1) * block_size() + (off_t)group * 32;
+}
+
+// Free blocks as recorded by the on-disk bitmaps, for cross-checking counters.
+unsigned int test_bitmap_free_blocks(void) {
+    unsigned char bitmap[MAX_BLOCK_SIZE];
+    uint32_t blocks = read_u32(SUPER_OFFSET + 4);
+    unsigned int free_count = 0;
+
+    for (unsigned int g = 0; g < test_group_count(); g++) {
+        uint32_t bitmap_block = read_u32(group_desc(g));
+        uint32_t valid = blocks - g * blocks_per_group();
+        if (pread(disk_fd, bitmap, block_size(), FS_OFFSET + (off_t)bitmap_block * block_size()) != (ssize_t)block_size()) abort();
+        if (valid > blocks_per_group()) valid = blocks_per_group();
+        for (uint32_t i = 0; i < valid; i++) {
+            if (!(bitmap[i / 8] & (1u << (i % 8)))) free_count++;
+        }
+    }
+    return free_count;
+}
+
+unsigned int test_group_free_blocks(void) {
+    unsigned int free_count = 0;
+    for (unsigned int g = 0; g < test_group_count(); g++) {
+        free_count += read_u32(group_desc(g) + 12) & 0xffffu;
+    }
+    return free_count;
 }
 
 void test_fill_block_bitmap(void) {
-    unsigned char full[BLOCK_SIZE];
-    uint32_t bitmap_block = read_u32(FS_OFFSET + 2 * BLOCK_SIZE);
+    unsigned char full[MAX_BLOCK_SIZE];
     memset(full, 0xff, sizeof(full));
-    if (pwrite(disk_fd, full, sizeof(full), FS_OFFSET + (off_t)bitmap_block * BLOCK_SIZE) != (ssize_t)sizeof(full)) abort();
+    for (unsigned int g = 0; g < test_group_count(); g++) {
+        uint32_t bitmap_block = read_u32(group_desc(g));
+        if (pwrite(disk_fd, full, block_size(), FS_OFFSET + (off_t)bitmap_block * block_size()) != (ssize_t)block_size()) abort();
+    }
 }
 
 void test_corrupt_root_rec_len(unsigned short rec_len) {
     unsigned char value[2];
-    uint32_t inode_table = read_u32(FS_OFFSET + 2 * BLOCK_SIZE + 8);
-    off_t root_inode = FS_OFFSET + (off_t)inode_table * BLOCK_SIZE + 128;
+    uint32_t inode_table = read_u32(group_desc(0) + 8);
+    off_t root_inode = FS_OFFSET + (off_t)inode_table * block_size() + 128;
     uint32_t root_data_block = read_u32(root_inode + 40);
-    off_t field = FS_OFFSET + (off_t)root_data_block * BLOCK_SIZE + 4;
+    off_t field = FS_OFFSET + (off_t)root_data_block * block_size() + 4;
     value[0] = (unsigned char)(rec_len & 0xff);
     value[1] = (unsigned char)(rec_len >> 8);
     if (pwrite(disk_fd, value, sizeof(value), field) != (ssize_t)sizeof(value)) abort();
 }
 
+// Physically contiguous runs in a file's block list (direct blocks, then the
+// single-indirect block followed by the blocks it maps).
+static off_t inode_offset(unsigned int inode_num);
+
+unsigned int test_file_extents(unsigned int inode_num) {
+    off_t inode = inode_offset(inode_num);
+    uint32_t blocks[12 + 1 + MAX_BLOCK_SIZE / 4];
+    unsigned int count = 0;
+    unsigned int extents = 0;
+
+    for (int i = 0; i < 13; i++) {
+        uint32_t block = read_u32(inode + 40 + i * 4);
+        if (block == 0) break;
+        blocks[count++] = block;
+    }
+    if (count == 13) {
+        off_t indirect = FS_OFFSET + (off_t)blocks[12] * block_size();
+        for (unsigned int i = 0; i < block_size() / 4; i++) {
+            uint32_t block = read_u32(indirect + i * 4);
+            if (block == 0) break;
+            blocks[count++] = block;
+        }
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        if (i == 0 || blocks[i] != blocks[i - 1] + 1) extents++;
+    }
+    return extents;
+}
+
+static off_t inode_offset(unsigned int inode_num) {
+    uint32_t per_group = read_u32(SUPER_OFFSET + 40);
+    uint32_t inode_table = read_u32(group_desc((inode_num - 1) / per_group) + 8);
+    uint32_t inode_size = read_u32(SUPER_OFFSET + 88) & 0xffffu;
+    return FS_OFFSET + (off_t)inode_table * block_size() + (off_t)((inode_num - 1) % per_group) * inode_size;
+}
+
+// Block group holding the inode, and the group of its first data block.
+unsigned int test_inode_group(unsigned int inode_num) {
+    return (inode_num - 1) / read_u32(SUPER_OFFSET + 40);
+}
+
+unsigned int test_file_first_group(unsigned int inode_num) {
+    return read_u32(inode_offset(inode_num) + 40) / blocks_per_group();
+}
+
+unsigned int test_file_first_block(unsigned int inode_num) {
+    return read_u32(inode_offset(inode_num) + 40);
+}
+
+unsigned int test_inode_flags(unsigned int inode_num) {
+    return read_u32(inode_offset(inode_num) + 32);
+}
+
+// The journal superblock is the first block of the journal inode.
+static off_t journal_offset(void) {
+    uint32_t journal_inode = read_u32(SUPER_OFFSET + 224);
+    return FS_OFFSET + (off_t)read_u32(inode_offset(journal_inode) + 40) * block_size();
+}
+
+unsigned int test_journal_sequence(void) {
+    return read_u32(journal_offset() + 12);
+}
+
+// Only the journal stays writable, as if the disk broke between a commit
+// reaching the journal and the checkpoint.
+void test_disk_fail_checkpoint(int on) {
+    uint32_t journal_inode = read_u32(SUPER_OFFSET + 224);
+
+    disk_keep_lba = (unsigned int)(journal_offset() / 512);
+    disk_keep_end = disk_keep_lba + read_u32(inode_offset(journal_inode) + 4) / 512;
+    disk_fail_writes = on;
+}
+
+static uint32_t journal_checksum(uint32_t sum, const uint32_t* words) {
+    for (unsigned int i = 0; i < block_size() / 4; i++) sum = ((sum << 1) | (sum >> 31)) ^ words[i];
+    return sum;
+}
+
+// Leave a committed-but-not-checkpointed transaction in the journal that
+// rewrites the first data block of inode_num with fill bytes, as if the
+// machine had crashed right after the commit block reached the disk.
+// A torn transaction gets a commit block with the wrong checksum.
+void test_journal_inject(unsigned int inode_num, unsigned char fill, int torn) {
+    uint32_t desc[MAX_BLOCK_SIZE / 4];
+    uint32_t copy[MAX_BLOCK_SIZE / 4];
+    uint32_t commit[MAX_BLOCK_SIZE / 4];
+    ssize_t bs = block_size();
+    off_t journal = journal_offset();
+    uint32_t sequence = test_journal_sequence();
+
+    memset(desc, 0, sizeof(desc));
+    desc[0] = 0x4353444Au;
+    desc[1] = sequence;
+    desc[2] = 1;
+    desc[3] = read_u32(inode_offset(inode_num) + 40);
+    memset(copy, fill, sizeof(copy));
+    memset(commit, 0, sizeof(commit));
+    commit[0] = 0x544D434Au;
+    commit[1] = sequence;
+    commit[2] = 1;
+    commit[3] = journal_checksum(journal_checksum(0, desc), copy) ^ (torn ? 1u : 0u);
+    if (pwrite(disk_fd, desc, bs, journal + bs) != bs ||
+        pwrite(disk_fd, copy, bs, journal + 2 * bs) != bs ||
+        pwrite(disk_fd, commit, bs, journal + 3 * bs) != bs) abort();
+}
+
+// Host tests are single-threaded: the mutex only has to count recursion.
+void kmutex_lock(KMutex* mutex) { mutex->depth++; }
+int kmutex_trylock(KMutex* mutex) { mutex->depth++; return 1; }
+void kmutex_unlock(KMutex* mutex) { if (mutex->depth > 0) mutex->depth--; }
+int kmutex_is_locked(const KMutex* mutex) { return mutex->depth > 0; }
+int sync_preemptible(void) { return 0; }
+int sync_irq_allowed(unsigned int flags) { (void)flags; return 0; }
+
 void klog_init(void) {}
 void klog_write(const char* msg) { (void)msg; }
 void klog_write_pair(const char* prefix, const char* value) { (void)prefix; (void)value; }
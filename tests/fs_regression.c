@@ -2,6 +2,35 @@
 #include <stdlib.h>
 #include <string.h>
 
+typedef struct {
+    unsigned int cache_hits;
+    unsigned int cache_misses;
+    unsigned int cache_writebacks;
+    unsigned int cache_evictions;
+    unsigned int cache_dirty_blocks;
+    unsigned int inode_cache_hits;
+    unsigned int inode_cache_misses;
+    unsigned int inodes_pinned;
+    unsigned int dentry_hits;
+    unsigned int dentry_misses;
+    unsigned int indexed_dirs;
+    unsigned int readahead_blocks;
+    unsigned int readahead_hits;
+    unsigned int journal_commits;
+    unsigned int journal_blocks;
+    unsigned int async_requests;
+    unsigned int max_in_flight;
+    unsigned int io_commands;
+    unsigned int io_merges;
+    unsigned int io_sectors;
+} FsStats;
+
+typedef struct {
+    unsigned int next_pos;
+    unsigned int window;
+    unsigned int ra_end;
+} FsReadahead;
+
 typedef struct {
     char filename[64];
     unsigned int size;
@@ -9,17 +38,60 @@ typedef struct {
     unsigned char type;
 } SystemFile;
 
+typedef struct {
+    unsigned int inode;
+    unsigned int size;
+    unsigned char type;
+    char name[64];
+} FsDirEntry;
+
 void fs_init(void);
 int fs_is_ready(void);
 int fs_read_file(const char* filename, void* buffer, unsigned int capacity);
 int fs_write_file(const char* filename, const void* buffer, unsigned int size);
+int fs_create_file(const char* path);
+int fs_get_file_list(char* buffer, int max_len, const char* dir_path);
+int fs_read_dir(unsigned int dir_inode, unsigned int* cursor, FsDirEntry* out, unsigned int max);
+int fs_delete_file(const char* path);
+int fs_mkdir(const char* path);
 int sys_file_open(const char* filename, SystemFile* out_file);
+void fs_sync(void);
+int fs_inode_pin(unsigned int inode_num);
+void fs_inode_unpin(unsigned int inode_num);
+int fs_read_inode_data(unsigned int inode_num, unsigned int pos, void* buffer,
+                       unsigned int size, unsigned int* out_file_size, FsReadahead* ra);
+void fs_get_stats(FsStats* out);
+void fs_periodic_sync(unsigned int now_ticks);
+int fs_pwrite_inode(unsigned int inode_num, unsigned int pos, const void* buffer,
+                    unsigned int size, unsigned int* out_file_size);
+int fs_truncate_inode(unsigned int inode_num, unsigned int size);
+#define FS_POS_APPEND 0xFFFFFFFFu
+void pagecache_init(void* frames, unsigned int page_count);
+void* fs_page_get(unsigned int inode_num, unsigned int index);
+void fs_page_put(void* page);
 
 int test_disk_open(const char* path);
 void test_disk_close(void);
 unsigned int test_free_blocks(void);
+unsigned int test_bitmap_free_blocks(void);
+unsigned int test_group_free_blocks(void);
+unsigned int test_file_extents(unsigned int inode_num);
+unsigned int test_disk_read_commands(void);
+void test_disk_fail_reads(int on);
+unsigned int test_disk_write_commands(void);
 void test_fill_block_bitmap(void);
 void test_corrupt_root_rec_len(unsigned short rec_len);
+unsigned int test_journal_sequence(void);
+unsigned int test_group_count(void);
+unsigned int test_inode_group(unsigned int inode_num);
+unsigned int test_file_first_group(unsigned int inode_num);
+unsigned int test_file_first_block(unsigned int inode_num);
+void test_journal_inject(unsigned int inode_num, unsigned char fill, int torn);
+void test_disk_fail_checkpoint(int on);
+unsigned int test_block_size(void);
+unsigned int test_inode_flags(unsigned int inode_num);
+int iosched_rw(unsigned int lba, unsigned int count, void* buffer, int write);
+unsigned int disk_capacity(void);
 
 static int open_fs(const char* image) {
     if (!test_disk_open(image)) return 0;
@@ -27,6 +99,12 @@ static int open_fs(const char* image) {
     return fs_is_ready();
 }
 
+// The block cache defers writes, so raw disk inspection must flush first.
+static unsigned int synced_free_blocks(void) {
+    fs_sync();
+    return test_free_blocks();
+}
+
 static int test_bounded_read(const char* image) {
     struct {
         unsigned char data[4];
@@ -63,15 +141,16 @@ static int test_shrink(const char* image) {
     memset(payload, 'L', sizeof(payload));
     free_before = test_free_blocks();
     if (fs_write_file("system/config.rtsk", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
-    free_after_grow = test_free_blocks();
+    free_after_grow = synced_free_blocks();
+    // Three bytes fit in the inode, so even the file's original block is released.
     result = fs_write_file("system/config.rtsk", "abc", 3);
-    free_after_shrink = test_free_blocks();
+    free_after_shrink = synced_free_blocks();
     if (!sys_file_open("system/config.rtsk", &file)) return 1;
     memset(out, 0, sizeof(out));
     if (fs_read_file("system/config.rtsk", out, sizeof(out)) != 3) return 1;
     test_disk_close();
     if (result != 3 || file.size != 3 || memcmp(out, "abc", 3) != 0 ||
-        free_after_grow + 2 != free_before || free_after_shrink != free_before) {
+        free_after_grow + 2 != free_before || free_after_shrink != free_before + 1) {
         fprintf(stderr, "FAIL shrink result=%d size=%u free=%u/%u/%u\n",
                 result, file.size, free_before, free_after_grow, free_after_shrink);
         return 1;
@@ -88,7 +167,7 @@ static int test_truncate_zero(const char* image) {
     if (!open_fs(image)) return 1;
     before = test_free_blocks();
     if (fs_write_file("system/config.rtsk", NULL, 0) != 0) return 1;
-    after = test_free_blocks();
+    after = synced_free_blocks();
     if (!sys_file_open("system/config.rtsk", &file)) return 1;
     test_disk_close();
     if (file.size != 0 || after != before + 1) {
@@ -107,7 +186,10 @@ static int test_allocation_failure(const char* image) {
 
     if (!open_fs(image)) return 1;
     if (fs_write_file("system/config.rtsk", "old", 3) != 3) return 1;
+    // Corrupt the image offline, then remount so cached metadata is dropped.
+    fs_sync();
     test_fill_block_bitmap();
+    fs_init();
     memset(payload, 'N', sizeof(payload));
     result = fs_write_file("system/config.rtsk", payload, sizeof(payload));
     if (!sys_file_open("system/config.rtsk", &file)) return 1;
@@ -138,6 +220,1197 @@ static int test_bad_directory(const char* image) {
     return 0;
 }
 
+static int test_writeback(const char* image) {
+    unsigned char payload[3000];
+    unsigned char out[3000];
+    FsStats before;
+    FsStats after;
+    int result;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 7u);
+    if (fs_write_file("system/config.rtsk", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    fs_get_stats(&before);
+    result = fs_read_file("system/config.rtsk", out, sizeof(out));
+    fs_get_stats(&after);
+    if (result != (int)sizeof(out) || after.cache_misses != before.cache_misses ||
+        before.cache_dirty_blocks == 0) {
+        fprintf(stderr, "FAIL writeback cached read result=%d misses=%u/%u dirty=%u\n",
+                result, before.cache_misses, after.cache_misses, before.cache_dirty_blocks);
+        return 1;
+    }
+
+    fs_sync();
+    fs_get_stats(&after);
+    if (after.cache_dirty_blocks != 0 || after.cache_writebacks == 0) return 1;
+    fs_init();
+    memset(out, 0, sizeof(out));
+    result = fs_read_file("system/config.rtsk", out, sizeof(out));
+    test_disk_close();
+    if (result != (int)sizeof(out) || memcmp(out, payload, sizeof(out)) != 0) {
+        fprintf(stderr, "FAIL writeback persisted result=%d\n", result);
+        return 1;
+    }
+    puts("PASS writeback_cache");
+    return 0;
+}
+
+static int counters_match_bitmap(void) {
+    unsigned int sb_free = test_free_blocks();
+    return sb_free == test_bitmap_free_blocks() && sb_free == test_group_free_blocks();
+}
+
+static int test_resident_bitmaps(const char* image) {
+    unsigned char big[40 * 1024];
+    unsigned char small[5000];
+    unsigned char out[40 * 1024];
+    unsigned int before;
+    unsigned int after;
+
+    if (!open_fs(image)) return 1;
+    before = test_free_blocks();
+    for (unsigned int i = 0; i < sizeof(big); i++) big[i] = (unsigned char)(i * 13u);
+    memset(small, 'S', sizeof(small));
+    if (fs_write_file("system/config.rtsk", big, sizeof(big)) != (int)sizeof(big)) return 1;
+    if (!fs_create_file("system/scratch.bin")) return 1;
+    if (fs_write_file("system/scratch.bin", small, sizeof(small)) != (int)sizeof(small)) return 1;
+    if (!fs_delete_file("system/scratch.bin")) return 1;
+    fs_sync();
+    after = test_free_blocks();
+    if (!counters_match_bitmap() || after >= before) {
+        fprintf(stderr, "FAIL resident_bitmaps counters sb=%u bitmap=%u gd=%u before=%u\n",
+                after, test_bitmap_free_blocks(), test_group_free_blocks(), before);
+        return 1;
+    }
+
+    // A remount reloads the bitmaps; new allocations must not reuse live blocks.
+    fs_init();
+    if (!fs_create_file("system/scratch.bin")) return 1;
+    if (fs_write_file("system/scratch.bin", small, sizeof(small)) != (int)sizeof(small)) return 1;
+    fs_sync();
+    memset(out, 0, sizeof(out));
+    if (fs_read_file("system/config.rtsk", out, sizeof(out)) != (int)sizeof(big)) return 1;
+    if (memcmp(out, big, sizeof(big)) != 0 || !counters_match_bitmap() ||
+        test_free_blocks() + 5 != after) {
+        fprintf(stderr, "FAIL resident_bitmaps remount free=%u/%u\n", after, test_free_blocks());
+        test_disk_close();
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS resident_bitmaps");
+    return 0;
+}
+
+static int test_inode_cache(const char* image) {
+    unsigned char payload[2500];
+    unsigned char out[2500];
+    SystemFile file;
+    SystemFile fresh;
+    FsStats before;
+    FsStats after;
+    unsigned int size = 0;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 3u);
+    if (!fs_create_file("system/pinned.bin")) return 1;
+    if (fs_write_file("system/pinned.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    if (!sys_file_open("system/pinned.bin", &file) || !fs_inode_pin(file.inode_num)) return 1;
+
+    // Reads through a pinned inode must not touch the inode table again.
+    fs_get_stats(&before);
+    memset(out, 0, sizeof(out));
+    if (fs_read_inode_data(file.inode_num, 100, out, 1000, &size, 0) != 1000) return 1;
+    fs_get_stats(&after);
+    if (after.inode_cache_misses != before.inode_cache_misses || after.inodes_pinned != 1 ||
+        size != sizeof(payload) || memcmp(out, payload + 100, 1000) != 0) {
+        fprintf(stderr, "FAIL inode_cache pinned read misses=%u/%u pinned=%u size=%u\n",
+                before.inode_cache_misses, after.inode_cache_misses, after.inodes_pinned, size);
+        return 1;
+    }
+
+    // A deleted but still pinned inode is not handed out to a new file.
+    if (!fs_delete_file("system/pinned.bin")) return 1;
+    if (fs_read_inode_data(file.inode_num, 0, out, sizeof(out), &size, 0) >= 0) return 1;
+    if (!fs_create_file("system/fresh.bin") || !sys_file_open("system/fresh.bin", &fresh)) return 1;
+    if (fresh.inode_num == file.inode_num) {
+        fprintf(stderr, "FAIL inode_cache reused pinned inode %u\n", file.inode_num);
+        return 1;
+    }
+    fs_inode_unpin(file.inode_num);
+
+    // Dirty cached inodes reach disk on sync.
+    if (fs_write_file("system/fresh.bin", payload, 700) != 700) return 1;
+    fs_sync();
+    fs_init();
+    if (!sys_file_open("system/fresh.bin", &fresh) || fresh.size != 700) return 1;
+    fs_get_stats(&after);
+    test_disk_close();
+    if (after.inodes_pinned != 0) return 1;
+    puts("PASS inode_cache");
+    return 0;
+}
+
+static int test_large_directory(const char* image) {
+    enum { FILES = 800 };
+    static char listing[32768];
+    char path[64];
+    SystemFile file;
+    SystemFile dir_before;
+    SystemFile dir_after;
+    FsStats stats;
+
+    if (!open_fs(image)) return 1;
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "image/f%04d.bin", i);
+        if (fs_create_file(path) != 1) {
+            fprintf(stderr, "FAIL large_directory create %s\n", path);
+            return 1;
+        }
+    }
+    if (!sys_file_open("image", &dir_before) || dir_before.size <= 12 * 1024) return 1;
+
+    // Deleted names become negative entries; their slots are reused without growing the directory.
+    for (int i = 0; i < FILES; i += 7) {
+        snprintf(path, sizeof(path), "image/f%04d.bin", i);
+        if (fs_delete_file(path) != 1) return 1;
+        if (sys_file_open(path, &file)) return 1;
+    }
+    for (int i = 0; i < FILES; i += 7) {
+        snprintf(path, sizeof(path), "image/g%04d.bin", i);
+        if (fs_create_file(path) != 1) return 1;
+    }
+    if (!sys_file_open("image", &dir_after) || dir_after.size != dir_before.size) {
+        fprintf(stderr, "FAIL large_directory grew %u -> %u\n", dir_before.size, dir_after.size);
+        return 1;
+    }
+    fs_get_stats(&stats);
+    if (stats.indexed_dirs == 0 || stats.dentry_hits == 0) return 1;
+
+    // After a remount the index is rebuilt from the on-disk blocks.
+    fs_sync();
+    fs_init();
+    for (int i = 0; i < FILES; i++) {
+        int expect = (i % 7) != 0;
+        snprintf(path, sizeof(path), "image/f%04d.bin", i);
+        if (sys_file_open(path, &file) != expect) {
+            fprintf(stderr, "FAIL large_directory lookup %s\n", path);
+            return 1;
+        }
+    }
+    if (!sys_file_open("image/tsk_girl.jpg", &file) || !sys_file_open("image/g0798.bin", &file)) return 1;
+    if (!fs_get_file_list(listing, sizeof(listing), "image") ||
+        !strstr(listing, "f0799.bin\n") || !strstr(listing, "g0000.bin\n") ||
+        strstr(listing, "f0007.bin")) {
+        fprintf(stderr, "FAIL large_directory listing\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS large_directory");
+    return 0;
+}
+
+static int test_large_file(const char* image) {
+    // 3 MiB reaches well into the double-indirect range (> 268 KiB).
+    const unsigned int size = 3u * 1024u * 1024u + 123u;
+    unsigned char* payload = malloc(size);
+    unsigned char* out = malloc(size);
+    unsigned char tail[64];
+    unsigned int before;
+    unsigned int after_grow;
+    unsigned int after_shrink;
+    int result;
+
+    if (!payload || !out || !open_fs(image)) return 1;
+    for (unsigned int i = 0; i < size; i++) payload[i] = (unsigned char)((i >> 10) ^ (i * 31u));
+    before = synced_free_blocks();
+    if (!fs_create_file("image/capture.bin")) return 1;
+    result = fs_write_file("image/capture.bin", payload, size);
+    after_grow = synced_free_blocks();
+    memset(out, 0, size);
+    if (result != (int)size || fs_read_file("image/capture.bin", out, size) != (int)size ||
+        memcmp(out, payload, size) != 0) {
+        fprintf(stderr, "FAIL large_file write/read result=%d\n", result);
+        return 1;
+    }
+    // 3073 data blocks + 1 indirect + 1 double-indirect + 11 second-level indirect blocks.
+    if (before - after_grow != 3073u + 1u + 1u + 11u) {
+        fprintf(stderr, "FAIL large_file blocks used=%u\n", before - after_grow);
+        return 1;
+    }
+
+    // Remount so reads go through freshly loaded indirect blocks.
+    fs_init();
+    if (fs_read_file("image/capture.bin", out, size) != (int)size || memcmp(out, payload, size) != 0) return 1;
+
+    // Shrinking back into the direct range frees every indirect level.
+    if (fs_write_file("image/capture.bin", payload, 5000) != 5000) return 1;
+    after_shrink = synced_free_blocks();
+    if (fs_read_file("image/capture.bin", tail, sizeof(tail)) != (int)sizeof(tail) ||
+        memcmp(tail, payload, sizeof(tail)) != 0 || before - after_shrink != 5u ||
+        !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL large_file shrink used=%u\n", before - after_shrink);
+        return 1;
+    }
+    if (fs_delete_file("image/capture.bin") != 1 || synced_free_blocks() != before) return 1;
+    test_disk_close();
+    free(payload);
+    free(out);
+    puts("PASS large_file");
+    return 0;
+}
+
+static unsigned int file_extents(const char* path) {
+    SystemFile file;
+    if (!sys_file_open(path, &file)) return 0;
+    fs_sync();
+    return test_file_extents(file.inode_num);
+}
+
+static int test_contiguous_allocation(const char* image) {
+    unsigned char block[1024];
+    unsigned char payload[40 * 1024];
+    unsigned char out[40 * 1024];
+    char path[32];
+    SystemFile grow;
+    unsigned int before;
+
+    if (!open_fs(image)) return 1;
+    memset(block, 'f', sizeof(block));
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 7u);
+
+    // Punch single-block holes; a first-fit allocator would scatter the next file across them.
+    for (int i = 0; i < 16; i++) {
+        snprintf(path, sizeof(path), "system/frag%02d.bin", i);
+        if (!fs_create_file(path) || fs_write_file(path, block, sizeof(block)) != (int)sizeof(block)) return 1;
+    }
+    for (int i = 0; i < 16; i += 2) {
+        snprintf(path, sizeof(path), "system/frag%02d.bin", i);
+        if (fs_delete_file(path) != 1) return 1;
+    }
+    before = synced_free_blocks();
+    if (!fs_create_file("system/stream.bin")) return 1;
+    if (fs_write_file("system/stream.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    // 40 data blocks + 1 indirect block; unused preallocation must not stay allocated.
+    if (file_extents("system/stream.bin") != 1 || before - synced_free_blocks() != 41u ||
+        !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL contiguous stream extents=%u used=%u\n",
+                file_extents("system/stream.bin"), before - test_free_blocks());
+        return 1;
+    }
+
+    // An open file keeps its window, so interleaved writes to another file don't split it.
+    if (!fs_create_file("system/grow.bin") || !fs_create_file("system/other.bin")) return 1;
+    if (!sys_file_open("system/grow.bin", &grow) || !fs_inode_pin(grow.inode_num)) return 1;
+    for (unsigned int size = 2048; size <= 6 * 1024; size += 2048) {
+        if (fs_write_file("system/grow.bin", payload, size) != (int)size) return 1;
+        if (fs_write_file("system/other.bin", payload, size) != (int)size) return 1;
+    }
+    fs_inode_unpin(grow.inode_num);
+    if (file_extents("system/grow.bin") != 1 || file_extents("system/other.bin") != 1) {
+        fprintf(stderr, "FAIL contiguous interleaved grow=%u other=%u\n",
+                file_extents("system/grow.bin"), file_extents("system/other.bin"));
+        return 1;
+    }
+
+    // Windows live only in memory; after a remount the bitmap alone must describe the disk.
+    fs_init();
+    memset(out, 0, sizeof(out));
+    if (fs_read_file("system/stream.bin", out, sizeof(out)) != (int)sizeof(out) ||
+        memcmp(out, payload, sizeof(out)) != 0 || !counters_match_bitmap()) return 1;
+    test_disk_close();
+    puts("PASS contiguous_allocation");
+    return 0;
+}
+
+static int test_coalesced_read(const char* image) {
+    unsigned char payload[40 * 1024];
+    unsigned char out[40 * 1024];
+    SystemFile file;
+    unsigned int file_size = 0;
+    unsigned int commands;
+    int result;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 11u + (i >> 10));
+    if (!fs_create_file("system/stream.bin")) return 1;
+    if (fs_write_file("system/stream.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    fs_sync();
+
+    // Cold cache: 40 contiguous blocks split only by the indirect block.
+    fs_init();
+    if (!sys_file_open("system/stream.bin", &file)) return 1;
+    commands = test_disk_read_commands();
+    memset(out, 0, sizeof(out));
+    result = fs_read_inode_data(file.inode_num, 0, out, sizeof(out), &file_size, 0);
+    commands = test_disk_read_commands() - commands;
+    if (result != (int)sizeof(out) || memcmp(out, payload, sizeof(out)) != 0 || commands > 4) {
+        fprintf(stderr, "FAIL coalesced_read aligned result=%d commands=%u\n", result, commands);
+        return 1;
+    }
+
+    // Unaligned head and tail are bounced; the middle still goes straight to the buffer.
+    memset(out, 0, sizeof(out));
+    result = fs_read_inode_data(file.inode_num, 100, out, sizeof(out) - 300, &file_size, 0);
+    if (result != (int)sizeof(out) - 300 || memcmp(out, payload + 100, sizeof(out) - 300) != 0) {
+        fprintf(stderr, "FAIL coalesced_read unaligned result=%d\n", result);
+        return 1;
+    }
+
+    // Blocks still dirty in the cache must win over the stale on-disk copy.
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)~payload[i];
+    if (fs_write_file("system/stream.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    memset(out, 0, sizeof(out));
+    result = fs_read_inode_data(file.inode_num, 0, out, sizeof(out), &file_size, 0);
+    if (result != (int)sizeof(out) || memcmp(out, payload, sizeof(out)) != 0) {
+        fprintf(stderr, "FAIL coalesced_read dirty result=%d\n", result);
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS coalesced_read");
+    return 0;
+}
+
+static int test_readahead(const char* image) {
+    static unsigned char payload[64 * 1024];
+    unsigned char chunk[512];
+    FsReadahead ra;
+    FsStats stats;
+    SystemFile file;
+    unsigned int file_size = 0;
+    unsigned int commands;
+    unsigned int prefetched;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 5u + (i >> 9));
+    if (!fs_create_file("system/log.txt")) return 1;
+    if (fs_write_file("system/log.txt", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    fs_sync();
+
+    // Small sequential reads should be served from blocks fetched ahead in batches.
+    fs_init();
+    if (!sys_file_open("system/log.txt", &file)) return 1;
+    memset(&ra, 0, sizeof(ra));
+    commands = test_disk_read_commands();
+    for (unsigned int pos = 0; pos < sizeof(payload); pos += sizeof(chunk)) {
+        if (fs_read_inode_data(file.inode_num, pos, chunk, sizeof(chunk), &file_size, &ra) != (int)sizeof(chunk) ||
+            memcmp(chunk, payload + pos, sizeof(chunk)) != 0) {
+            fprintf(stderr, "FAIL readahead data pos=%u\n", pos);
+            return 1;
+        }
+    }
+    commands = test_disk_read_commands() - commands;
+    fs_get_stats(&stats);
+    if (commands > 12 || stats.readahead_hits < 56 || stats.readahead_hits > stats.readahead_blocks) {
+        fprintf(stderr, "FAIL readahead sequential commands=%u blocks=%u hits=%u\n",
+                commands, stats.readahead_blocks, stats.readahead_hits);
+        return 1;
+    }
+
+    // Random access must not trigger readahead.
+    fs_init();
+    memset(&ra, 0, sizeof(ra));
+    for (unsigned int i = 0; i < 16; i++) {
+        unsigned int pos = ((i * 37u) % 60u + 2u) * 1024u;
+        if (fs_read_inode_data(file.inode_num, pos, chunk, sizeof(chunk), &file_size, &ra) != (int)sizeof(chunk)) return 1;
+    }
+    fs_get_stats(&stats);
+    prefetched = stats.readahead_blocks;
+    test_disk_close();
+    if (prefetched != 0) {
+        fprintf(stderr, "FAIL readahead random prefetched=%u\n", prefetched);
+        return 1;
+    }
+    puts("PASS readahead");
+    return 0;
+}
+
+static int test_async_io(const char* image) {
+    static unsigned char payload[64 * 1024];
+    static unsigned char out[64 * 1024];
+    unsigned char chunk[512];
+    FsReadahead ra;
+    FsStats stats;
+    SystemFile file;
+    unsigned int file_size = 0;
+    unsigned int commands;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 13u + (i >> 10));
+    if (!fs_create_file("system/async.bin")) return 1;
+    if (fs_write_file("system/async.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+
+    // Writeback queues the dirty blocks and only then waits for all of them.
+    fs_sync();
+    fs_get_stats(&stats);
+    if (stats.max_in_flight < 2 || stats.async_requests == 0) {
+        fprintf(stderr, "FAIL async_io writeback requests=%u max_in_flight=%u\n",
+                stats.async_requests, stats.max_in_flight);
+        return 1;
+    }
+
+    // Readahead returns with its requests still queued; the main loop's
+    // periodic hook moves them along without any reader waiting.
+    fs_init();
+    if (!sys_file_open("system/async.bin", &file)) return 1;
+    memset(&ra, 0, sizeof(ra));
+    for (unsigned int pos = 0; pos < 2 * sizeof(chunk); pos += sizeof(chunk)) {
+        if (fs_read_inode_data(file.inode_num, pos, chunk, sizeof(chunk), &file_size, &ra) != (int)sizeof(chunk)) return 1;
+    }
+    fs_get_stats(&stats);
+    commands = test_disk_read_commands();
+    fs_periodic_sync(0);
+    if (stats.readahead_blocks == 0 || test_disk_read_commands() == commands) {
+        fprintf(stderr, "FAIL async_io readahead blocks=%u not left in flight\n", stats.readahead_blocks);
+        return 1;
+    }
+
+    // Readers of blocks still in flight wait for them and see the right data.
+    if (fs_read_inode_data(file.inode_num, 0, out, sizeof(out), &file_size, NULL) != (int)sizeof(out) ||
+        memcmp(out, payload, sizeof(out)) != 0) {
+        fprintf(stderr, "FAIL async_io data\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS async_io");
+    return 0;
+}
+
+static int test_io_merging(const char* image) {
+    static unsigned char payload[64 * 1024];
+    static unsigned char out[64 * 1024];
+    FsStats before;
+    FsStats after;
+    unsigned int commands;
+    unsigned int blocks;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 29u + (i >> 8));
+    if (!fs_create_file("system/merge.bin")) return 1;
+    fs_sync();
+
+    // The file's blocks are contiguous, so their writebacks should leave the
+    // scheduler as a handful of multi-block commands instead of one per block.
+    if (fs_write_file("system/merge.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    fs_get_stats(&before);
+    commands = test_disk_write_commands();
+    fs_sync();
+    commands = test_disk_write_commands() - commands;
+    fs_get_stats(&after);
+    blocks = sizeof(payload) / test_block_size();
+    if (commands * 4 > blocks || after.io_merges - before.io_merges < blocks / 2 ||
+        after.io_sectors - before.io_sectors < sizeof(payload) / 512) {
+        fprintf(stderr, "FAIL io_merging commands=%u merges=%u for %u blocks\n",
+                commands, after.io_merges - before.io_merges, blocks);
+        return 1;
+    }
+
+    fs_init();
+    if (fs_read_file("system/merge.bin", out, sizeof(out)) != (int)sizeof(out) ||
+        memcmp(out, payload, sizeof(out)) != 0) {
+        fprintf(stderr, "FAIL io_merging data\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS io_merging");
+    return 0;
+}
+
+static int test_large_io(const char* image) {
+    static unsigned char expected[600 * 512];
+    static unsigned char out[600 * 512];
+    unsigned int commands;
+    FILE* raw;
+
+    if (!open_fs(image)) return 1;
+    raw = fopen(image, "rb");
+    if (!raw || fread(expected, 1, sizeof(expected), raw) != sizeof(expected)) return 1;
+    fclose(raw);
+
+    // 600 sectors is more than one command can carry; the block layer splits
+    // it into as few maximum-size commands as it can.
+    commands = test_disk_read_commands();
+    if (iosched_rw(0, 600, out, 0) != 0 || memcmp(out, expected, sizeof(out)) != 0) {
+        fprintf(stderr, "FAIL large_io read\n");
+        return 1;
+    }
+    commands = test_disk_read_commands() - commands;
+    if (commands != 3) {
+        fprintf(stderr, "FAIL large_io read took %u commands\n", commands);
+        return 1;
+    }
+    commands = test_disk_write_commands();
+    if (iosched_rw(0, 600, out, 1) != 0 || test_disk_write_commands() - commands != 3) {
+        fprintf(stderr, "FAIL large_io write\n");
+        return 1;
+    }
+
+    // Requests that run past the end of the disk fail instead of reaching the drive.
+    commands = test_disk_read_commands();
+    if (iosched_rw(disk_capacity() - 1, 2, out, 0) != -1 || iosched_rw(0xFFFFFFFFu, 2, out, 0) != -1 ||
+        test_disk_read_commands() != commands) {
+        fprintf(stderr, "FAIL large_io bounds\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS large_io");
+    return 0;
+}
+
+static int test_positional_write(const char* image) {
+    static unsigned char expected[80 * 1024];
+    static unsigned char out[80 * 1024];
+    char record[40];
+    SystemFile file;
+    FsStats before;
+    FsStats after;
+    unsigned int size = 0;
+    unsigned int file_size = 0;
+    int result;
+
+    if (!open_fs(image)) return 1;
+    if (!fs_create_file("system/app.log") || !sys_file_open("system/app.log", &file)) return 1;
+
+    // Appends only touch the tail block, so the cache never has to refetch the file.
+    fs_get_stats(&before);
+    for (int i = 0; i < 2000; i++) {
+        int len = snprintf(record, sizeof(record), "record %04d of the log\n", i);
+        if (fs_pwrite_inode(file.inode_num, FS_POS_APPEND, record, (unsigned int)len, &file_size) != len) return 1;
+        memcpy(expected + size, record, (size_t)len);
+        size += (unsigned int)len;
+    }
+    fs_get_stats(&after);
+    if (file_size != size || after.cache_misses - before.cache_misses > 8) {
+        fprintf(stderr, "FAIL positional_write append size=%u/%u misses=%u\n",
+                file_size, size, after.cache_misses - before.cache_misses);
+        return 1;
+    }
+
+    // Overwrite across a block boundary, then write past EOF leaving a zero gap.
+    memset(expected + 1000, 'X', 100);
+    if (fs_pwrite_inode(file.inode_num, 1000, expected + 1000, 100, &file_size) != 100) return 1;
+    memset(expected + size, 0, 3000);
+    memcpy(expected + size + 3000, "tail", 4);
+    if (fs_pwrite_inode(file.inode_num, size + 3000, "tail", 4, &file_size) != 4) return 1;
+    size += 3004;
+    fs_sync();
+    fs_init();
+    result = fs_read_file("system/app.log", out, sizeof(out));
+    if (result != (int)size || memcmp(out, expected, size) != 0 || !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL positional_write readback result=%d size=%u\n", result, size);
+        return 1;
+    }
+
+    // Truncating into the middle of a block zeroes the dropped tail for later growth.
+    if (!fs_truncate_inode(file.inode_num, 1500) || !fs_truncate_inode(file.inode_num, 2500)) return 1;
+    memset(expected + 1500, 0, 1000);
+    if (fs_read_file("system/app.log", out, sizeof(out)) != 2500 || memcmp(out, expected, 2500) != 0) {
+        fprintf(stderr, "FAIL positional_write truncate\n");
+        return 1;
+    }
+
+    // A growth that cannot allocate leaves the file untouched.
+    fs_sync();
+    test_fill_block_bitmap();
+    fs_init();
+    result = fs_pwrite_inode(file.inode_num, 2400, expected, 4000, &file_size);
+    if (result != -1 || fs_read_file("system/app.log", out, sizeof(out)) != 2500 ||
+        memcmp(out, expected, 2500) != 0) {
+        fprintf(stderr, "FAIL positional_write enospc result=%d\n", result);
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS positional_write");
+    return 0;
+}
+
+static int all_zero(const unsigned char* data, unsigned int size) {
+    for (unsigned int i = 0; i < size; i++) {
+        if (data[i] != 0) return 0;
+    }
+    return 1;
+}
+
+static int test_no_stale_data(const char* image) {
+    static unsigned char garbage[32 * 1024];
+    static unsigned char out[32 * 1024];
+    SystemFile file;
+    unsigned int file_size = 0;
+
+    if (!open_fs(image)) return 1;
+    // Leave recognisable garbage in freed blocks; new files will reuse them.
+    memset(garbage, 'G', sizeof(garbage));
+    if (!fs_create_file("system/old.bin") ||
+        fs_write_file("system/old.bin", garbage, sizeof(garbage)) != (int)sizeof(garbage)) return 1;
+    fs_sync();
+    if (fs_delete_file("system/old.bin") != 1) return 1;
+
+    // Blocks exposed by extension or by a write beyond EOF must read back as zeros.
+    if (!fs_create_file("system/new.bin") || !sys_file_open("system/new.bin", &file)) return 1;
+    if (!fs_truncate_inode(file.inode_num, 5000)) return 1;
+    if (fs_pwrite_inode(file.inode_num, 12000, "end", 3, &file_size) != 3 || file_size != 12003) return 1;
+    fs_sync();
+    fs_init();
+    memset(out, 0xff, sizeof(out));
+    if (fs_read_file("system/new.bin", out, sizeof(out)) != 12003 || !all_zero(out, 12000) ||
+        memcmp(out + 12000, "end", 3) != 0) {
+        fprintf(stderr, "FAIL no_stale_data exposed garbage\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS no_stale_data");
+    return 0;
+}
+
+static int test_journal(const char* image) {
+    unsigned char payload[1024];
+    unsigned char out[1024];
+    SystemFile file;
+    FsStats stats;
+    unsigned int sequence;
+    char path[32];
+
+    if (!open_fs(image)) return 1;
+    // A burst of metadata operations is batched into one group commit.
+    for (int i = 0; i < 12; i++) {
+        snprintf(path, sizeof(path), "system/j%02d.txt", i);
+        if (!fs_create_file(path)) return 1;
+    }
+    if (!fs_mkdir("jdir")) return 1;
+    for (int i = 0; i < 12; i += 2) {
+        snprintf(path, sizeof(path), "system/j%02d.txt", i);
+        if (fs_delete_file(path) != 1) return 1;
+    }
+    fs_get_stats(&stats);
+    if (stats.journal_commits != 0) return 1;
+    sequence = test_journal_sequence();
+    fs_sync();
+    fs_get_stats(&stats);
+    if (stats.journal_commits != 1 || stats.journal_blocks == 0 || stats.journal_blocks > 16 ||
+        test_journal_sequence() != sequence + 1 || !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL journal group commit commits=%u blocks=%u\n",
+                stats.journal_commits, stats.journal_blocks);
+        return 1;
+    }
+
+    // Uncommitted metadata is lost on a crash, leaving the previous state.
+    if (!fs_create_file("system/lost.txt")) return 1;
+    fs_init();
+    if (sys_file_open("system/lost.txt", &file) || !sys_file_open("system/j01.txt", &file) ||
+        sys_file_open("system/j00.txt", &file) || !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL journal crash before commit\n");
+        return 1;
+    }
+
+    memset(payload, 'P', sizeof(payload));
+    if (fs_write_file("system/j01.txt", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    fs_sync();
+    if (!sys_file_open("system/j01.txt", &file)) return 1;
+
+    // A torn transaction is ignored, a complete one is replayed exactly once.
+    sequence = test_journal_sequence();
+    test_journal_inject(file.inode_num, 'R', 1);
+    fs_init();
+    if (fs_read_file("system/j01.txt", out, sizeof(out)) != (int)sizeof(out) ||
+        memcmp(out, payload, sizeof(out)) != 0 || test_journal_sequence() != sequence) {
+        fprintf(stderr, "FAIL journal replayed a torn transaction\n");
+        return 1;
+    }
+    test_journal_inject(file.inode_num, 'R', 0);
+    fs_init();
+    memset(payload, 'R', sizeof(payload));
+    if (fs_read_file("system/j01.txt", out, sizeof(out)) != (int)sizeof(out) ||
+        memcmp(out, payload, sizeof(out)) != 0 || test_journal_sequence() != sequence + 1) {
+        fprintf(stderr, "FAIL journal replay\n");
+        return 1;
+    }
+
+    // Blocks freed by an uncommitted delete are not handed to new data before the commit.
+    {
+        static unsigned char data[8 * 1024];
+        unsigned int freed;
+
+        memset(data, 'F', sizeof(data));
+        if (!fs_create_file("system/freed.bin") ||
+            fs_write_file("system/freed.bin", data, sizeof(data)) != (int)sizeof(data)) return 1;
+        fs_sync();
+        if (!sys_file_open("system/freed.bin", &file)) return 1;
+        freed = test_file_first_block(file.inode_num);
+        if (fs_delete_file("system/freed.bin") != 1 || !fs_create_file("system/reuse.bin") ||
+            fs_write_file("system/reuse.bin", data, sizeof(data)) != (int)sizeof(data)) return 1;
+        fs_sync();
+        if (!sys_file_open("system/reuse.bin", &file) || test_file_first_block(file.inode_num) == freed ||
+            !counters_match_bitmap()) {
+            fprintf(stderr, "FAIL journal reused a block freed in the open transaction\n");
+            return 1;
+        }
+    }
+
+    // A failed checkpoint keeps the transaction in the journal: the sequence stays put
+    // and the next mount replays it.
+    sequence = test_journal_sequence();
+    if (!fs_create_file("system/kept.txt")) return 1;
+    test_disk_fail_checkpoint(1);
+    fs_sync();
+    test_disk_fail_checkpoint(0);
+    if (test_journal_sequence() != sequence) {
+        fprintf(stderr, "FAIL journal advanced past a failed checkpoint\n");
+        return 1;
+    }
+    fs_init();
+    if (!sys_file_open("system/kept.txt", &file) || test_journal_sequence() != sequence + 1 ||
+        !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL journal replay after failed checkpoint\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS journal");
+    return 0;
+}
+
+static int test_block_groups(const char* image) {
+    static unsigned char big[1200 * 1024];
+    static unsigned char out[1200 * 1024];
+    SystemFile file;
+    SystemFile spill;
+
+    if (!open_fs(image)) return 1;
+    if (test_group_count() < 2) {
+        fprintf(stderr, "FAIL block_groups image has %u group(s)\n", test_group_count());
+        return 1;
+    }
+
+    // A new directory goes to a less crowded group and its files follow it.
+    if (!fs_mkdir("gdir") || !fs_create_file("gdir/near.txt")) return 1;
+    // Larger than an inline file so that it needs a data block.
+    memset(big, 'n', 100);
+    if (fs_write_file("gdir/near.txt", big, 100) != 100) return 1;
+    fs_sync();
+    if (!sys_file_open("gdir/near.txt", &file)) return 1;
+    if (test_inode_group(file.inode_num) == 0 ||
+        test_file_first_group(file.inode_num) != test_inode_group(file.inode_num)) {
+        fprintf(stderr, "FAIL block_groups locality inode_group=%u data_group=%u\n",
+                test_inode_group(file.inode_num), test_file_first_group(file.inode_num));
+        return 1;
+    }
+
+    // A file larger than a whole group of this image spills into the others.
+    for (unsigned int i = 0; i < sizeof(big); i++) big[i] = (unsigned char)(i * 31u + (i >> 10));
+    if (!fs_create_file("gdir/spill.bin") ||
+        fs_write_file("gdir/spill.bin", big, sizeof(big)) != (int)sizeof(big)) return 1;
+    fs_sync();
+    if (!counters_match_bitmap()) {
+        fprintf(stderr, "FAIL block_groups counters sb=%u bitmap=%u gd=%u\n",
+                test_free_blocks(), test_bitmap_free_blocks(), test_group_free_blocks());
+        return 1;
+    }
+    fs_init();
+    if (!sys_file_open("gdir/spill.bin", &spill) ||
+        test_file_first_group(spill.inode_num) != test_inode_group(spill.inode_num) ||
+        fs_read_file("gdir/spill.bin", out, sizeof(out)) != (int)sizeof(big) ||
+        memcmp(out, big, sizeof(big)) != 0) {
+        fprintf(stderr, "FAIL block_groups spill\n");
+        return 1;
+    }
+    if (fs_delete_file("gdir/spill.bin") != 1) return 1;
+    fs_sync();
+    if (!counters_match_bitmap()) return 1;
+    test_disk_close();
+    puts("PASS block_groups");
+    return 0;
+}
+
+static int test_big_blocks(const char* image) {
+    // 3 MiB needs 769 blocks of 4 KiB: all reachable from the single-indirect block.
+    const unsigned int size = 3u * 1024u * 1024u + 123u;
+    unsigned char* payload = malloc(size);
+    unsigned char* out = malloc(size);
+    char path[64];
+    SystemFile file;
+    SystemFile dir;
+    FsStats stats;
+    unsigned int before;
+    unsigned int sequence;
+
+    if (!payload || !out || !open_fs(image)) return 1;
+    if (test_block_size() != 4096) {
+        fprintf(stderr, "FAIL big_blocks image block size %u\n", test_block_size());
+        return 1;
+    }
+    for (unsigned int i = 0; i < size; i++) payload[i] = (unsigned char)((i >> 12) ^ (i * 29u));
+    before = synced_free_blocks();
+    sequence = test_journal_sequence();
+    if (!fs_create_file("system/big.bin") ||
+        fs_write_file("system/big.bin", payload, size) != (int)size) return 1;
+    if (before - synced_free_blocks() != 769u + 1u || !counters_match_bitmap()) {
+        fprintf(stderr, "FAIL big_blocks blocks used=%u\n", before - test_free_blocks());
+        return 1;
+    }
+    fs_get_stats(&stats);
+    if (stats.journal_commits == 0 || test_journal_sequence() == sequence) return 1;
+
+    fs_init();
+    memset(out, 0, size);
+    if (fs_read_file("system/big.bin", out, size) != (int)size || memcmp(out, payload, size) != 0) {
+        fprintf(stderr, "FAIL big_blocks read back\n");
+        return 1;
+    }
+
+    // A directory block holds four times as many entries before the directory grows.
+    for (int i = 0; i < 300; i++) {
+        snprintf(path, sizeof(path), "system/d%03d.bin", i);
+        if (fs_create_file(path) != 1) return 1;
+    }
+    if (!fs_mkdir("deep") || !fs_create_file("deep/leaf.txt")) return 1;
+    if (!sys_file_open("system", &dir) || dir.size != 2u * 4096u) {
+        fprintf(stderr, "FAIL big_blocks directory size=%u\n", dir.size);
+        return 1;
+    }
+    fs_sync();
+    fs_init();
+    if (!sys_file_open("system/d299.bin", &file) || !sys_file_open("deep/leaf.txt", &file) ||
+        !sys_file_open("system/version.txt", &file)) {
+        fprintf(stderr, "FAIL big_blocks lookup after remount\n");
+        return 1;
+    }
+
+    // Shrinking into the direct range frees the indirect block too.
+    if (fs_write_file("system/big.bin", payload, 5000) != 5000) return 1;
+    if (fs_read_file("system/big.bin", out, size) != 5000 || memcmp(out, payload, 5000) != 0) return 1;
+    if (fs_delete_file("system/big.bin") != 1) return 1;
+    fs_sync();
+    if (!counters_match_bitmap()) return 1;
+    test_disk_close();
+    free(payload);
+    free(out);
+    puts("PASS big_blocks");
+    return 0;
+}
+
+static int test_page_cache(const char* image) {
+    static unsigned char frames[4][4096];
+    unsigned char payload[10000];
+    unsigned char zero[4096];
+    unsigned char* page0;
+    unsigned char* page2;
+    unsigned char* other[3];
+    SystemFile file;
+    SystemFile second;
+
+    pagecache_init(frames, 4);
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 7u + (i >> 8));
+    memset(zero, 0, sizeof(zero));
+    if (!fs_create_file("system/map.bin") ||
+        fs_write_file("system/map.bin", payload, sizeof(payload)) != (int)sizeof(payload) ||
+        !sys_file_open("system/map.bin", &file)) return 1;
+
+    // Pages come back filled, the last one zero-padded; mappers share one frame.
+    page0 = fs_page_get(file.inode_num, 0);
+    page2 = fs_page_get(file.inode_num, 2);
+    if (!page0 || !page2 || memcmp(page0, payload, 4096) != 0 ||
+        memcmp(page2, payload + 8192, 10000 - 8192) != 0 || memcmp(page2 + 10000 - 8192, zero, 4096 - (10000 - 8192)) != 0 ||
+        fs_page_get(file.inode_num, 0) != page0 || fs_page_get(file.inode_num, 3) != 0) {
+        fprintf(stderr, "FAIL page_cache fill\n");
+        return 1;
+    }
+    fs_page_put(page0);
+
+    // Writes and truncation show through pages that are still mapped.
+    memset(payload + 4000, 'W', 300);
+    if (fs_pwrite_inode(file.inode_num, 4000, payload + 4000, 300, 0) != 300 || memcmp(page0, payload, 4096) != 0) {
+        fprintf(stderr, "FAIL page_cache write-through\n");
+        return 1;
+    }
+    if (!fs_truncate_inode(file.inode_num, 8200) || memcmp(page2, payload + 8192, 8) != 0 ||
+        memcmp(page2 + 8, zero, 4096 - 8) != 0) {
+        fprintf(stderr, "FAIL page_cache truncate\n");
+        return 1;
+    }
+
+    // Only unreferenced pages are evicted; a full cache of mapped pages refuses more.
+    if (!fs_create_file("system/map2.bin") ||
+        fs_write_file("system/map2.bin", payload, sizeof(payload)) != (int)sizeof(payload) ||
+        !sys_file_open("system/map2.bin", &second)) return 1;
+    for (int i = 0; i < 2; i++) other[i] = fs_page_get(second.inode_num, (unsigned int)i);
+    if (!other[0] || !other[1] || fs_page_get(second.inode_num, 2) != 0 ||
+        memcmp(page0, payload, 4096) != 0) {
+        fprintf(stderr, "FAIL page_cache eviction\n");
+        return 1;
+    }
+    fs_page_put(other[1]);
+    other[2] = fs_page_get(second.inode_num, 2);
+    if (other[2] != other[1] || memcmp(other[2], payload + 8192, 10000 - 8192) != 0) return 1;
+
+    // A deleted file keeps its mapped pages but can no longer fault in new ones.
+    if (fs_delete_file("system/map.bin") != 1 || fs_page_get(file.inode_num, 1) != 0 ||
+        memcmp(page0, payload, 4096) != 0) {
+        fprintf(stderr, "FAIL page_cache delete\n");
+        return 1;
+    }
+    fs_page_put(page0);
+    fs_page_put(page2);
+    fs_page_put(other[0]);
+    fs_page_put(other[2]);
+    test_disk_close();
+    puts("PASS page_cache");
+    return 0;
+}
+
+static int test_readdir(const char* image) {
+    enum { FILES = 200 };
+    unsigned char seen[FILES];
+    unsigned char payload[FILES];
+    FsDirEntry batch[5];
+    char path[64];
+    SystemFile dir;
+    unsigned int cursor = 0;
+    int found_jpg = 0;
+    int found_image = 0;
+    int got;
+
+    if (!open_fs(image)) return 1;
+    memset(payload, 'r', sizeof(payload));
+    for (int i = 0; i < FILES; i++) {
+        snprintf(path, sizeof(path), "image/r%03d.bin", i);
+        if (fs_create_file(path) != 1 || fs_write_file(path, payload, (unsigned int)i) != i) return 1;
+    }
+    if (!sys_file_open("image", &dir)) return 1;
+
+    // Small batches resume where the previous call stopped; records carry size and type.
+    memset(seen, 0, sizeof(seen));
+    while ((got = fs_read_dir(dir.inode_num, &cursor, batch, 5)) > 0) {
+        for (int i = 0; i < got; i++) {
+            int n;
+            if (strcmp(batch[i].name, ".") == 0 || strcmp(batch[i].name, "..") == 0 || batch[i].inode == 0) {
+                fprintf(stderr, "FAIL readdir record %s\n", batch[i].name);
+                return 1;
+            }
+            if (strcmp(batch[i].name, "tsk_girl.jpg") == 0) found_jpg = batch[i].type == 0 && batch[i].size > 0;
+            if (sscanf(batch[i].name, "r%03d.bin", &n) != 1) continue;
+            if (n < 0 || n >= FILES || seen[n]++ || batch[i].size != (unsigned int)n || batch[i].type != 0) {
+                fprintf(stderr, "FAIL readdir entry %s size %u\n", batch[i].name, batch[i].size);
+                return 1;
+            }
+            // Entries already returned must not come back after the directory changes.
+            if (n == 100) {
+                if (fs_delete_file("image/r000.bin") != 1 || fs_create_file("image/s000.bin") != 1) return 1;
+            }
+        }
+    }
+    if (got != 0 || !found_jpg || fs_read_dir(dir.inode_num, &cursor, batch, 5) != 0) {
+        fprintf(stderr, "FAIL readdir end\n");
+        return 1;
+    }
+    for (int i = 0; i < FILES; i++) {
+        if (!seen[i]) {
+            fprintf(stderr, "FAIL readdir missing r%03d.bin\n", i);
+            return 1;
+        }
+    }
+
+    cursor = 0;
+    while ((got = fs_read_dir(2, &cursor, batch, 5)) > 0) {
+        for (int i = 0; i < got; i++) {
+            if (strcmp(batch[i].name, "image") == 0) found_image = batch[i].type == 1 && batch[i].inode == dir.inode_num;
+        }
+    }
+    if (!found_image || fs_read_dir(dir.inode_num + 100000u, &cursor, batch, 5) != -1) {
+        fprintf(stderr, "FAIL readdir root\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS readdir");
+    return 0;
+}
+
+static int test_sparse_file(const char* image) {
+    const unsigned int size = 8u * 1024u * 1024u;
+    const unsigned int far = 5u * 1024u * 1024u + 100u;
+    static unsigned char zeros[64 * 1024];
+    unsigned char out[4096];
+    unsigned char expect[4096];
+    unsigned int before;
+    unsigned int reads;
+    SystemFile file;
+
+    if (!open_fs(image)) return 1;
+    before = synced_free_blocks();
+
+    // Growing by truncation and writing zero-filled blocks leave holes instead of allocating.
+    if (!fs_create_file("system/sparse.bin") || !sys_file_open("system/sparse.bin", &file) ||
+        !fs_truncate_inode(file.inode_num, size) || synced_free_blocks() != before) {
+        fprintf(stderr, "FAIL sparse_file preallocate\n");
+        return 1;
+    }
+    if (!fs_create_file("system/zeros.bin") ||
+        fs_write_file("system/zeros.bin", zeros, sizeof(zeros)) != (int)sizeof(zeros) ||
+        synced_free_blocks() != before) {
+        fprintf(stderr, "FAIL sparse_file zero write\n");
+        return 1;
+    }
+
+    // Holes read back as zeros without touching the disk.
+    reads = test_disk_read_commands();
+    memset(out, 0xff, sizeof(out));
+    if (fs_read_inode_data(file.inode_num, 3u * 1024u * 1024u + 7u, out, sizeof(out), 0, 0) != (int)sizeof(out) ||
+        !all_zero(out, sizeof(out)) || test_disk_read_commands() != reads) {
+        fprintf(stderr, "FAIL sparse_file hole read\n");
+        return 1;
+    }
+
+    // A write far past the data allocates the touched block plus its indirect blocks only.
+    if (fs_pwrite_inode(file.inode_num, far, "far", 3, 0) != 3 || before - synced_free_blocks() > 3) {
+        fprintf(stderr, "FAIL sparse_file far write used %u blocks\n", before - synced_free_blocks());
+        return 1;
+    }
+    fs_sync();
+    fs_init();
+    memset(expect, 0, sizeof(expect));
+    memcpy(expect + 100, "far", 3);
+    if (fs_read_inode_data(file.inode_num, far - 100, out, sizeof(out), 0, 0) != (int)sizeof(out) ||
+        memcmp(out, expect, sizeof(out)) != 0 || test_bitmap_free_blocks() != test_free_blocks()) {
+        fprintf(stderr, "FAIL sparse_file far read\n");
+        return 1;
+    }
+
+    if (fs_delete_file("system/sparse.bin") != 1 || fs_delete_file("system/zeros.bin") != 1 ||
+        synced_free_blocks() != before) {
+        fprintf(stderr, "FAIL sparse_file delete\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS sparse_file");
+    return 0;
+}
+
+static int test_inline_data(const char* image) {
+    const unsigned int inline_flag = 0x10000000u;
+    unsigned char payload[200];
+    unsigned char out[256];
+    unsigned char expect[256];
+    unsigned int before;
+    unsigned int reads;
+    SystemFile file;
+    int n;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)('a' + i % 26);
+
+    // mkfs stores tiny files in the inode: once the inode is cached, reads touch no disk.
+    if (!sys_file_open("system/version.txt", &file) || file.size == 0 || file.size > 60 ||
+        !(test_inode_flags(file.inode_num) & inline_flag)) {
+        fprintf(stderr, "FAIL inline_data mkfs\n");
+        return 1;
+    }
+    reads = test_disk_read_commands();
+    n = fs_read_inode_data(file.inode_num, 0, out, sizeof(out), 0, 0);
+    if (n != (int)file.size || memcmp(out, "version=", 8) != 0 || test_disk_read_commands() != reads) {
+        fprintf(stderr, "FAIL inline_data read used %u commands\n", test_disk_read_commands() - reads);
+        return 1;
+    }
+
+    // Small writes stay inline and allocate nothing; a gap past EOF reads as zeros.
+    before = synced_free_blocks();
+    if (!fs_create_file("system/tiny.txt") || !sys_file_open("system/tiny.txt", &file) ||
+        fs_pwrite_inode(file.inode_num, 0, payload, 40, 0) != 40 ||
+        fs_pwrite_inode(file.inode_num, 50, payload, 10, 0) != 10 ||
+        synced_free_blocks() != before || !(test_inode_flags(file.inode_num) & inline_flag)) {
+        fprintf(stderr, "FAIL inline_data small write\n");
+        return 1;
+    }
+    memset(expect, 0, sizeof(expect));
+    memcpy(expect, payload, 40);
+    memcpy(expect + 50, payload, 10);
+    if (fs_read_file("system/tiny.txt", out, sizeof(out)) != 60 || memcmp(out, expect, 60) != 0) return 1;
+
+    // Outgrowing the inode moves the data into a block, keeping what was there.
+    memcpy(expect + 60, payload, 100);
+    if (fs_pwrite_inode(file.inode_num, 60, payload, 100, 0) != 100 || before - synced_free_blocks() != 1 ||
+        (test_inode_flags(file.inode_num) & inline_flag)) {
+        fprintf(stderr, "FAIL inline_data grow\n");
+        return 1;
+    }
+    fs_sync();
+    fs_init();
+    if (fs_read_file("system/tiny.txt", out, sizeof(out)) != 160 || memcmp(out, expect, 160) != 0) {
+        fprintf(stderr, "FAIL inline_data grown contents\n");
+        return 1;
+    }
+
+    // Rewriting with small contents frees the block; truncation keeps the tail zeroed.
+    if (fs_write_file("system/tiny.txt", payload, 20) != 20 || synced_free_blocks() != before ||
+        !(test_inode_flags(file.inode_num) & inline_flag) ||
+        !fs_truncate_inode(file.inode_num, 5) || !fs_truncate_inode(file.inode_num, 30)) {
+        fprintf(stderr, "FAIL inline_data rewrite\n");
+        return 1;
+    }
+    fs_sync();
+    fs_init();
+    if (fs_read_file("system/tiny.txt", out, sizeof(out)) != 30 || memcmp(out, payload, 5) != 0 ||
+        !all_zero(out + 5, 25)) {
+        fprintf(stderr, "FAIL inline_data truncate\n");
+        return 1;
+    }
+    if (fs_delete_file("system/tiny.txt") != 1 || synced_free_blocks() != before ||
+        test_bitmap_free_blocks() != test_free_blocks()) return 1;
+    test_disk_close();
+    puts("PASS inline_data");
+    return 0;
+}
+
+static int test_read_errors(const char* image) {
+    unsigned char payload[3000];
+    unsigned char out[3000];
+    SystemFile file;
+
+    if (!open_fs(image)) return 1;
+    for (unsigned int i = 0; i < sizeof(payload); i++) payload[i] = (unsigned char)(i * 13u + 1u);
+    if (!fs_create_file("system/err_a.bin") ||
+        fs_write_file("system/err_a.bin", payload, sizeof(payload)) != (int)sizeof(payload) ||
+        !fs_create_file("system/err_b.bin") ||
+        fs_write_file("system/err_b.bin", payload, sizeof(payload)) != (int)sizeof(payload)) return 1;
+    fs_sync();
+    fs_init();
+
+    // With the directory and inode cached, a failed data read is reported and not cached.
+    if (fs_read_file("system/err_a.bin", out, sizeof(out)) != (int)sizeof(payload) ||
+        !sys_file_open("system/err_b.bin", &file)) return 1;
+    test_disk_fail_reads(1);
+    if (fs_read_file("system/err_b.bin", out, sizeof(out)) >= 0) {
+        fprintf(stderr, "FAIL read_errors data read succeeded\n");
+        return 1;
+    }
+    test_disk_fail_reads(0);
+    if (fs_read_file("system/err_b.bin", out, sizeof(out)) != (int)sizeof(payload) ||
+        memcmp(out, payload, sizeof(payload)) != 0 ||
+        fs_write_file("system/err_a.bin", payload, 100) != 100) {
+        fprintf(stderr, "FAIL read_errors retry after data error\n");
+        return 1;
+    }
+
+    // A failed metadata read leaves the file system read-only until it is mounted again.
+    fs_sync();
+    fs_init();
+    test_disk_fail_reads(1);
+    if (sys_file_open("system/err_a.bin", &file) || fs_create_file("system/err_c.bin")) {
+        fprintf(stderr, "FAIL read_errors metadata read succeeded\n");
+        return 1;
+    }
+    test_disk_fail_reads(0);
+    if (!sys_file_open("system/err_a.bin", &file) || file.size != 100 || fs_create_file("system/err_c.bin")) {
+        fprintf(stderr, "FAIL read_errors read-only after metadata error\n");
+        return 1;
+    }
+    fs_init();
+    if (!fs_create_file("system/err_c.bin") || !sys_file_open("system/err_c.bin", &file)) {
+        fprintf(stderr, "FAIL read_errors remount\n");
+        return 1;
+    }
+    test_disk_close();
+    puts("PASS read_errors");
+    return 0;
+}
+
 int main(int argc, char** argv) {
     if (argc != 3) {
         fprintf(stderr, "usage: %s TEST IMAGE\n", argv[0]);
@@ -148,5 +1421,26 @@ int main(int argc, char** argv) {
     if (strcmp(argv[1], "truncate") == 0) return test_truncate_zero(argv[2]);
     if (strcmp(argv[1], "alloc-fail") == 0) return test_allocation_failure(argv[2]);
     if (strcmp(argv[1], "bad-dir") == 0) return test_bad_directory(argv[2]);
+    if (strcmp(argv[1], "writeback") == 0) return test_writeback(argv[2]);
+    if (strcmp(argv[1], "bitmaps") == 0) return test_resident_bitmaps(argv[2]);
+    if (strcmp(argv[1], "icache") == 0) return test_inode_cache(argv[2]);
+    if (strcmp(argv[1], "bigdir") == 0) return test_large_directory(argv[2]);
+    if (strcmp(argv[1], "bigfile") == 0) return test_large_file(argv[2]);
+    if (strcmp(argv[1], "contig") == 0) return test_contiguous_allocation(argv[2]);
+    if (strcmp(argv[1], "coalesce") == 0) return test_coalesced_read(argv[2]);
+    if (strcmp(argv[1], "readahead") == 0) return test_readahead(argv[2]);
+    if (strcmp(argv[1], "pwrite") == 0) return test_positional_write(argv[2]);
+    if (strcmp(argv[1], "nozero") == 0) return test_no_stale_data(argv[2]);
+    if (strcmp(argv[1], "journal") == 0) return test_journal(argv[2]);
+    if (strcmp(argv[1], "groups") == 0) return test_block_groups(argv[2]);
+    if (strcmp(argv[1], "bigblock") == 0) return test_big_blocks(argv[2]);
+    if (strcmp(argv[1], "pagecache") == 0) return test_page_cache(argv[2]);
+    if (strcmp(argv[1], "readdir") == 0) return test_readdir(argv[2]);
+    if (strcmp(argv[1], "sparse") == 0) return test_sparse_file(argv[2]);
+    if (strcmp(argv[1], "inline") == 0) return test_inline_data(argv[2]);
+    if (strcmp(argv[1], "read-errors") == 0) return test_read_errors(argv[2]);
+    if (strcmp(argv[1], "async") == 0) return test_async_io(argv[2]);
+    if (strcmp(argv[1], "iosched") == 0) return test_io_merging(argv[2]);
+    if (strcmp(argv[1], "largeio") == 0) return test_large_io(argv[2]);
     return 2;
 }
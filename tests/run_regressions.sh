@@ -24,6 +24,7 @@ mkdir -p "$TMP"
 sed \
     -e 's/__asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) :: "memory");/flags = 0;/' \
     -e 's/__asm__ volatile ("push %0; popf" :: "r"(flags) : "memory", "cc");/(void)flags;/' \
+    -e 's/__asm__ volatile ("sti" ::: "memory");//' \
     "$ROOT/fs/fs.c" > "$TMP/fs_host.c"
 
 "$CC" -std=c11 -Wall -Wextra -Werror -Wno-int-to-pointer-cast \
@@ -31,8 +32,12 @@ sed \
     -fsanitize=undefined -fno-sanitize-recover=all \
     -I"$ROOT/include" \
     "$ROOT/tests/fs_regression.c" "$ROOT/tests/fs_disk_shim.c" "$TMP/fs_host.c" \
+    "$ROOT/fs/bcache.c" "$ROOT/fs/dcache.c" "$ROOT/fs/journal.c" "$ROOT/fs/pagecache.c" \
+    "$ROOT/drivers/iosched.c" \
     -o "$TMP/fs_regression"
 
+"$CC" -Wall -Werror "$ROOT/tools/mkfs.c" -o "$TMP/mkfs"
+
 run_fs() {
     name=$1
     image="$TMP/$name.img"
@@ -40,6 +45,18 @@ run_fs() {
     "$TMP/fs_regression" "$name" "$image"
 }
 
+# 4 KiB-block image built from scratch: empty boot and kernel, one system file.
+run_fs_4k() {
+    name=$1
+    image="$TMP/$name.img"
+    mkdir -p "$TMP/4k/fsroot/system"
+    : > "$TMP/empty.bin"
+    printf "version=test\n" > "$TMP/4k/fsroot/system/version.txt"
+    "$TMP/mkfs" -b 4096 -s 64 "$image" "$TMP/empty.bin" "$TMP/empty.bin" \
+        "$TMP/4k/fsroot/system/version.txt" > /dev/null
+    "$TMP/fs_regression" "$name" "$image"
+}
+
 case "${1:-all}" in
     baseline)
         "$TMP/jpeg_regression" valid "$ROOT/tests/fixtures/baseline.jpg"
@@ -47,9 +64,12 @@ case "${1:-all}" in
     valid|invalid-al|huge)
         "$TMP/jpeg_regression" "$1" "$ROOT/tsk_girl.jpg"
         ;;
-    bounded|shrink|truncate|alloc-fail|bad-dir)
+    bounded|shrink|truncate|alloc-fail|bad-dir|writeback|bitmaps|icache|bigdir|bigfile|contig|coalesce|readahead|pwrite|nozero|journal|groups|pagecache|readdir|sparse|inline|read-errors|async|iosched|largeio)
         run_fs "$1"
         ;;
+    bigblock)
+        run_fs_4k "$1"
+        ;;
     all)
         "$TMP/core_regression"
         "$TMP/jpeg_regression" valid "$ROOT/tsk_girl.jpg"
@@ -61,6 +81,27 @@ case "${1:-all}" in
         run_fs truncate
         run_fs alloc-fail
         run_fs bad-dir
+        run_fs writeback
+        run_fs bitmaps
+        run_fs icache
+        run_fs bigdir
+        run_fs bigfile
+        run_fs contig
+        run_fs coalesce
+        run_fs readahead
+        run_fs pwrite
+        run_fs nozero
+        run_fs journal
+        run_fs groups
+        run_fs pagecache
+        run_fs readdir
+        run_fs sparse
+        run_fs inline
+        run_fs read-errors
+        run_fs async
+        run_fs iosched
+        run_fs largeio
+        run_fs_4k bigblock
         ;;
     *)
         echo "unknown test: $1" >&2
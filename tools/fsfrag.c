@@ -0,0 +1,244 @@
+// fsfrag.c - 文件系统碎片报告：统计每个文件的物理连续段 (extent) 数与空闲区分布
+// 用法: fsfrag <os-image.img> [-v]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#define MAX_BLOCK_SIZE 4096
+#define FS_START_OFFSET (1024 * 1024)
+#define EXT2_MAGIC 0xEF53
+#define EXT2_ROOT_INODE 2
+#define EXT2_INLINE_DATA_FL 0x10000000
+#define MAX_DEPTH 8
+
+typedef struct {
+    uint32_t block_size;
+    uint32_t first_data_block;
+    uint32_t blocks_count;
+    uint32_t free_blocks;
+    uint32_t inodes_count;
+    uint32_t inode_size;
+    uint32_t inodes_per_group;
+    uint32_t blocks_per_group;
+    uint32_t groups;
+} FsInfo;
+
+typedef struct {
+    uint32_t* blocks;
+    unsigned int count;
+    unsigned int capacity;
+} BlockList;
+
+static FILE* image;
+static FsInfo fs;
+static int verbose = 0;
+static unsigned int files_seen = 0;
+static unsigned int files_fragmented = 0;
+static unsigned int total_extents = 0;
+static unsigned int total_blocks = 0;
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t get_u16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static int read_block(uint32_t block, unsigned char* buf) {
+    if (block >= fs.blocks_count) return 0;
+    if (fseek(image, FS_START_OFFSET + (long)block * fs.block_size, SEEK_SET) != 0) return 0;
+    return fread(buf, 1, fs.block_size, image) == fs.block_size;
+}
+
+// 组描述符 32 字节一个，从超级块所在块的下一块起连续存放；field 为描述符内的字节偏移
+static uint32_t group_field(uint32_t group, unsigned int field) {
+    unsigned char buf[MAX_BLOCK_SIZE];
+
+    if (!read_block(fs.first_data_block + 1 + group / (fs.block_size / 32), buf)) return 0;
+    return get_u32(buf + (group % (fs.block_size / 32)) * 32 + field);
+}
+
+static int read_inode(uint32_t ino, unsigned char* raw) {
+    uint32_t inode_table;
+    long offset;
+
+    if (ino == 0 || ino > fs.inodes_count) return 0;
+    inode_table = group_field((ino - 1) / fs.inodes_per_group, 8);
+    offset = FS_START_OFFSET + (long)inode_table * fs.block_size +
+             (long)((ino - 1) % fs.inodes_per_group) * fs.inode_size;
+    if (fseek(image, offset, SEEK_SET) != 0) return 0;
+    return fread(raw, 1, 128, image) == 128;
+}
+
+static void list_push(BlockList* list, uint32_t block) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->blocks = realloc(list->blocks, list->capacity * sizeof(uint32_t));
+        if (!list->blocks) {
+            fprintf(stderr, "fsfrag: out of memory\n");
+            exit(1);
+        }
+    }
+    list->blocks[list->count++] = block;
+}
+
+// 按磁盘上的布局顺序收集块：with_meta 时间接块本身排在它映射的数据块之前
+static void collect(BlockList* list, uint32_t block, int depth, int with_meta) {
+    unsigned char buf[MAX_BLOCK_SIZE];
+
+    if (block == 0) return;
+    if (depth == 0 || with_meta) list_push(list, block);
+    if (depth == 0 || !read_block(block, buf)) return;
+    for (unsigned int i = 0; i < fs.block_size / 4; i++) collect(list, get_u32(buf + i * 4), depth - 1, with_meta);
+}
+
+static void collect_inode(BlockList* list, const unsigned char* raw, int with_meta) {
+    // 内联文件的 i_block[] 存的是数据，不占块
+    if (get_u32(raw + 32) & EXT2_INLINE_DATA_FL) return;
+    for (int i = 0; i < 15; i++) {
+        collect(list, get_u32(raw + 40 + i * 4), i < 12 ? 0 : i - 11, with_meta);
+    }
+}
+
+static unsigned int count_extents(const BlockList* list) {
+    unsigned int extents = 0;
+
+    for (unsigned int i = 0; i < list->count; i++) {
+        if (i == 0 || list->blocks[i] != list->blocks[i - 1] + 1) extents++;
+    }
+    return extents;
+}
+
+static void report_file(const char* path, const unsigned char* raw) {
+    BlockList list = {0, 0, 0};
+    unsigned int extents;
+
+    collect_inode(&list, raw, 1);
+    extents = count_extents(&list);
+    files_seen++;
+    total_blocks += list.count;
+    total_extents += extents;
+    if (extents > 1) files_fragmented++;
+    if (verbose || extents > 1) {
+        printf("%-40s %6u blocks %4u extents", path, list.count, extents);
+        if (list.count > 0) printf("  first=%u", list.blocks[0]);
+        printf("\n");
+    }
+    free(list.blocks);
+}
+
+static void walk_dir(uint32_t dir_ino, const char* prefix, int depth) {
+    unsigned char raw[128];
+    BlockList list = {0, 0, 0};
+    unsigned char buf[MAX_BLOCK_SIZE];
+
+    if (depth > MAX_DEPTH || !read_inode(dir_ino, raw)) return;
+    collect_inode(&list, raw, 0);
+    for (unsigned int b = 0; b < list.count; b++) {
+        unsigned int pos = 0;
+        if (!read_block(list.blocks[b], buf)) break;
+        while (pos + 8 <= fs.block_size) {
+            uint32_t ino = get_u32(buf + pos);
+            uint16_t rec_len = get_u16(buf + pos + 4);
+            unsigned int name_len = buf[pos + 6];
+            char name[256];
+            char path[512];
+            unsigned char child[128];
+
+            if (rec_len < 8 || pos + rec_len > fs.block_size || name_len + 8u > rec_len) break;
+            memcpy(name, buf + pos + 8, name_len);
+            name[name_len] = '\0';
+            pos += rec_len;
+            if (ino == 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+            if (!read_inode(ino, child)) continue;
+
+            snprintf(path, sizeof(path), "%s/%s", prefix, name);
+            if ((get_u16(child) & 0xF000) == 0x4000) walk_dir(ino, path, depth + 1);
+            else if ((get_u16(child) & 0xF000) == 0x8000) report_file(path, child);
+        }
+    }
+    free(list.blocks);
+}
+
+// 逐块组统计空闲区；位图第 i 位对应块组内第 i 块，空闲段不跨块组
+static void report_free_space(void) {
+    unsigned char bitmap[MAX_BLOCK_SIZE];
+    unsigned int free_extents = 0;
+    unsigned int largest = 0;
+    unsigned int free_count = 0;
+
+    for (uint32_t g = 0; g < fs.groups; g++) {
+        uint32_t base = g * fs.blocks_per_group;
+        uint32_t first_data = group_field(g, 8) + (fs.inodes_per_group * fs.inode_size) / fs.block_size - base;
+        uint32_t limit = fs.blocks_count - base < fs.blocks_per_group ? fs.blocks_count - base : fs.blocks_per_group;
+        unsigned int run = 0;
+
+        if (!read_block(group_field(g, 0), bitmap)) return;
+        for (uint32_t b = first_data; b <= limit; b++) {
+            int used = b == limit || (bitmap[b / 8] & (1u << (b % 8)));
+            if (!used) {
+                run++;
+                free_count++;
+                continue;
+            }
+            if (run > 0) {
+                free_extents++;
+                if (run > largest) largest = run;
+            }
+            run = 0;
+        }
+    }
+    printf("free: %u blocks in %u extents across %u group(s), largest %u blocks (superblock says %u)\n",
+           free_count, free_extents, fs.groups, largest, fs.free_blocks);
+}
+
+int main(int argc, char** argv) {
+    unsigned char sb[1024];
+
+    if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "-v") != 0)) {
+        fprintf(stderr, "usage: %s <image> [-v]\n", argv[0]);
+        return 2;
+    }
+    verbose = argc == 3;
+    image = fopen(argv[1], "rb");
+    if (!image) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    // 超级块固定在文件系统内字节 1024 处，与块大小无关
+    if (fseek(image, FS_START_OFFSET + 1024, SEEK_SET) != 0 || fread(sb, 1, sizeof(sb), image) != sizeof(sb) ||
+        get_u16(sb + 56) != EXT2_MAGIC) {
+        fprintf(stderr, "fsfrag: %s: no ext2 superblock at 1 MiB\n", argv[1]);
+        return 1;
+    }
+    fs.first_data_block = get_u32(sb + 20);
+    fs.block_size = get_u32(sb + 24) <= 2 ? 1024u << get_u32(sb + 24) : 0;
+    if (fs.block_size == 0 || fs.block_size > MAX_BLOCK_SIZE) {
+        fprintf(stderr, "fsfrag: %s: unsupported block size\n", argv[1]);
+        return 1;
+    }
+    fs.inodes_count = get_u32(sb + 0);
+    fs.blocks_count = get_u32(sb + 4);
+    fs.free_blocks = get_u32(sb + 12);
+    fs.blocks_per_group = get_u32(sb + 32);
+    fs.inodes_per_group = get_u32(sb + 40);
+    fs.inode_size = get_u16(sb + 88);
+    if (fs.inode_size < 128) fs.inode_size = 128;
+    if (fs.blocks_per_group == 0 || fs.blocks_per_group > fs.block_size * 8 || fs.inodes_per_group == 0) {
+        fprintf(stderr, "fsfrag: %s: bad block group geometry\n", argv[1]);
+        return 1;
+    }
+    fs.groups = (fs.blocks_count + fs.blocks_per_group - 1) / fs.blocks_per_group;
+
+    walk_dir(EXT2_ROOT_INODE, "", 0);
+    printf("files: %u, fragmented: %u, blocks: %u, extents: %u",
+           files_seen, files_fragmented, total_blocks, total_extents);
+    if (files_seen > 0) printf(" (%.2f per file)", (double)total_extents / files_seen);
+    printf("\n");
+    report_free_space();
+    fclose(image);
+    return 0;
+}
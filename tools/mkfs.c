@@ -5,7 +5,6 @@
 #include <stdint.h>
 
 #define SECTOR_SIZE 512
-#define BLOCK_SIZE 1024
 #define EXT2_MAGIC 0xEF53
 
 // 定义文件系统在磁盘上的起始偏移 (1MB = 2048 扇区)
@@ -18,6 +17,30 @@
 // -----------------------------------------------------------
 // (此处插入你原来 mkfs.c 里的结构体定义)
 
+// 块大小：默认 1 KiB，-b 4096 时为 4 KiB (s_log_block_size = 2)。
+// 超级块总在文件系统内字节 1024 处：1 KiB 块时是块 1，4 KiB 块时在块 0 内，描述符表紧随其后一块
+#define DEFAULT_BLOCK_SIZE 1024
+static int block_size = DEFAULT_BLOCK_SIZE;
+
+// 块组：每组的块数等于一块位图的位数 (1 KiB 块时 8192)，组 0 之外的块组开头依次是块位图、
+// inode 位图和 inode 表。位图第 i 位对应块组内第 i 块，与内核约定一致
+#define INODES_PER_GROUP 2048
+#define MAX_GROUPS 128
+#define DEFAULT_IMAGE_MB 10
+// 末尾不足这么多块的零头不单独成组
+#define MIN_GROUP_BLOCKS 512
+
+// 元数据日志：inode 8，一个间接块后紧跟 JOURNAL_BLOCKS 个连续数据块 (格式见 include/journal.h)
+#define JOURNAL_INODE 8
+#define JOURNAL_BLOCKS 128
+#define JOURNAL_MAGIC 0x4C4E524Au
+#define EXT2_FEATURE_COMPAT_HAS_JOURNAL 0x0004
+
+// 内联数据：不超过 60 字节 (i_block[] 的大小) 的文件直接存在 inode 里，不占数据块
+#define EXT2_FEATURE_INCOMPAT_INLINE_DATA 0x8000
+#define EXT2_INLINE_DATA_FL 0x10000000
+#define INLINE_DATA_MAX 60
+
 // 文件类型定义
 #define EXT2_FT_REG_FILE 1
 #define EXT2_FT_DIR 2
@@ -112,10 +135,10 @@ typedef struct {
     char dir[64];
     char name[256];
     int size;
+    int inline_data;
     int blocks_needed;
     int indirect_blocks;
     int first_data_block;
-    int indirect_block_num;
 } FileInfo;
 
 typedef struct {
@@ -179,13 +202,81 @@ static void write_dir_entry(char* block, int* pos, uint32_t inode, uint8_t file_
 
     entry_len = 8 + de->name_len;
     if (entry_len % 4) entry_len += 4 - (entry_len % 4);
-    de->rec_len = is_last ? (BLOCK_SIZE - *pos) : entry_len;
+    de->rec_len = is_last ? (block_size - *pos) : entry_len;
     *pos += de->rec_len;
 }
 
+// n 个数据块需要的一/二/三级间接块总数
+static int indirect_blocks_for(int n) {
+    int per = block_size / 4;
+    int count = 0;
+
+    if (n <= 12) return 0;
+    n -= 12;
+    count += 1;
+    if (n <= per) return count;
+    n -= per;
+    if (n <= per * per) return count + 1 + (n + per - 1) / per;
+    count += 1 + per;
+    n -= per * per;
+    return count + 1 + (n + per * per - 1) / (per * per) + (n + per - 1) / per;
+}
+
+static void put_block(FILE* out, uint32_t block, const void* data) {
+    fseek(out, FS_START_OFFSET + (long)block * block_size, SEEK_SET);
+    fwrite(data, 1, block_size, out);
+}
+
+static uint32_t write_data_block(FILE* out, FILE* src, uint32_t* next_block, int* written) {
+    char fbuf[block_size];
+    uint32_t block = (*next_block)++;
+
+    memset(fbuf, 0, block_size);
+    fread(fbuf, 1, block_size, src); // 末块不足部分保持为 0
+    put_block(out, block, fbuf);
+    (*written)++;
+    return block;
+}
+
+// 间接块排在它映射的数据块之前，与内核顺序写出的布局一致
+static uint32_t write_indirect(FILE* out, FILE* src, int depth, int total,
+                               uint32_t* next_block, int* written) {
+    uint32_t entries[block_size / 4];
+    uint32_t self = (*next_block)++;
+
+    memset(entries, 0, sizeof(entries));
+    for (int i = 0; i < block_size / 4 && *written < total; i++) {
+        entries[i] = depth == 1
+            ? write_data_block(out, src, next_block, written)
+            : write_indirect(out, src, depth - 1, total, next_block, written);
+    }
+    put_block(out, self, entries);
+    return self;
+}
+
+// 从 *next_block 起连续写出文件的数据块与间接块，并填好 i_block
+static void write_file_blocks(FILE* out, FILE* src, int total, uint32_t* next_block, uint32_t i_block[15]) {
+    int written = 0;
+
+    for (int b = 0; b < 12 && written < total; b++) {
+        i_block[b] = write_data_block(out, src, next_block, &written);
+    }
+    for (int depth = 1; depth <= 3 && written < total; depth++) {
+        i_block[11 + depth] = write_indirect(out, src, depth, total, next_block, &written);
+    }
+}
+
 int main(int argc, char** argv) {
-    if (argc < 4) {
-        printf("Usage: ./mkfs <output.img> <boot.bin> <kernel.bin> <files...>\n");
+    int image_mb = DEFAULT_IMAGE_MB;
+
+    while (argc >= 3 && (strcmp(argv[1], "-s") == 0 || strcmp(argv[1], "-b") == 0)) {
+        if (argv[1][1] == 's') image_mb = atoi(argv[2]);
+        else block_size = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc < 4 || image_mb < 2 || (block_size != 1024 && block_size != 4096)) {
+        printf("Usage: ./mkfs [-s size_mb] [-b 1024|4096] <output.img> <boot.bin> <kernel.bin> <files...>\n");
         return 1;
     }
 
@@ -239,14 +330,10 @@ int main(int argc, char** argv) {
         }
 
         files[file_count].size = size;
-        files[file_count].blocks_needed = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
-        if (files[file_count].blocks_needed > (12 + 256)) {
-            printf("Error: File too large for single indirect blocks: %s\n", image_path);
-            return 1;
-        }
-        files[file_count].indirect_blocks = (files[file_count].blocks_needed > 12) ? 1 : 0;
+        files[file_count].inline_data = size > 0 && size <= INLINE_DATA_MAX;
+        files[file_count].blocks_needed = files[file_count].inline_data ? 0 : (size + block_size - 1) / block_size;
+        files[file_count].indirect_blocks = indirect_blocks_for(files[file_count].blocks_needed);
         files[file_count].first_data_block = 0;
-        files[file_count].indirect_block_num = 0;
         file_count++;
     }
 
@@ -293,40 +380,59 @@ int main(int argc, char** argv) {
 
     // --- 开始构建 Ext2 (相对于 FS_START_OFFSET) ---
 
-    int inodes_per_group = 128;
-    int blocks_per_group = 8192; // 8MB per group
-    int inode_table_blocks = (inodes_per_group * 128) / BLOCK_SIZE;
-    
+    int inodes_per_group = INODES_PER_GROUP; // 目录可跨多块，单目录可存放数千个文件
+    int blocks_per_group = block_size * 8; // 一块位图管一组：1 KiB 块 8MB，4 KiB 块 128MB
+    int first_data_block = block_size == 1024 ? 1 : 0; // 超级块所在块
+    int inode_table_blocks = (inodes_per_group * 128) / block_size;
+    int blocks_count = (int)(((long)image_mb * 1024 * 1024 - FS_START_OFFSET) / block_size);
+    int num_groups;
+    int gdt_blocks;
+
+    // 末尾零头太小时舍去，不为它单独建一组位图和 inode 表
+    if (blocks_count % blocks_per_group != 0 && blocks_count % blocks_per_group < MIN_GROUP_BLOCKS &&
+        blocks_count > blocks_per_group) {
+        blocks_count -= blocks_count % blocks_per_group;
+    }
+    num_groups = (blocks_count + blocks_per_group - 1) / blocks_per_group;
+    if (num_groups > MAX_GROUPS) {
+        printf("Error: Image too large (at most %d block groups).\n", MAX_GROUPS);
+        return 1;
+    }
+    gdt_blocks = (num_groups * (int)sizeof(Ext2GroupDesc) + block_size - 1) / block_size;
+
+    // 块组 0：引导块、超级块 (4 KiB 块时二者同在块 0)、描述符表、两块位图、inode 表，之后是目录与文件数据
+    int group0_block_bitmap = first_data_block + 1 + gdt_blocks;
+    int group0_inode_table = group0_block_bitmap + 2;
+
     // 计算需要的块数
     int total_data_blocks = 0;
     for(int i=0; i<file_count; i++) {
         total_data_blocks += files[i].blocks_needed + files[i].indirect_blocks;
     }
-    int used_blocks = 6 + inode_table_blocks + dir_count + total_data_blocks;
-    if (used_blocks > blocks_per_group) {
-        printf("Error: Filesystem data exceeds the single block group.\n");
+    int used_blocks = group0_inode_table + inode_table_blocks + 1 + dir_count + total_data_blocks + 1 + JOURNAL_BLOCKS;
+    if (used_blocks > blocks_per_group || used_blocks > blocks_count) {
+        printf("Error: Filesystem data exceeds the first block group.\n");
         return 1;
     }
 
-    int num_groups = 1; // 简单起见，只有1个块组
-
-    // 3.1 写入 Block 0 (Boot block of the FS, 1024 bytes empty)
+    // 3.1 写入 Block 0 (Boot block of the FS, empty)
     // 实际上 Ext2 的 Superblock 位于 1024 字节偏移处。
-    // 如果 Block Size = 1024，Block 0 是引导块，Block 1 是 Superblock。
-    char empty_block[BLOCK_SIZE];
-    memset(empty_block, 0, BLOCK_SIZE);
-    fwrite(empty_block, 1, BLOCK_SIZE, out); // Write Block 0
+    // 如果 Block Size = 1024，Block 0 是引导块，Block 1 是 Superblock；4096 时二者同在 Block 0。
+    char empty_block[block_size];
+    memset(empty_block, 0, block_size);
+    fwrite(empty_block, 1, block_size, out); // Write Block 0
 
-    // 3.2 写入 Superblock (Block 1)
+    // 3.2 写入 Superblock (字节 1024)
     Ext2SuperBlock sb;
     memset(&sb, 0, sizeof(sb));
     sb.s_inodes_count = num_groups * inodes_per_group;
-    sb.s_blocks_count = blocks_per_group;
-    sb.s_free_blocks_count = sb.s_blocks_count - used_blocks;
+    sb.s_blocks_count = blocks_count;
+    // 其余块组各自的位图与 inode 表也算已占用
+    sb.s_free_blocks_count = sb.s_blocks_count - used_blocks - (num_groups - 1) * (2 + inode_table_blocks);
     sb.s_free_inodes_count = sb.s_inodes_count - 10 - file_count - dir_count;
-    sb.s_first_data_block = 1; // 1KB Block size -> SB is on block 1
-    sb.s_log_block_size = 0;   // 1024 bytes
-    sb.s_log_frag_size = 0;    // 1024 bytes
+    sb.s_first_data_block = first_data_block; // 1KB Block size -> SB is on block 1
+    sb.s_log_block_size = block_size == 1024 ? 0 : 2;
+    sb.s_log_frag_size = sb.s_log_block_size;
     sb.s_blocks_per_group = blocks_per_group;
     sb.s_frags_per_group = blocks_per_group;
     sb.s_inodes_per_group = inodes_per_group;
@@ -335,47 +441,66 @@ int main(int argc, char** argv) {
     sb.s_state = 1;
     sb.s_first_ino = 11;
     sb.s_inode_size = 128;
-    sb.s_feature_incompat = 0x2; // Directory entries use the file_type field.
+    sb.s_feature_incompat = 0x2 | EXT2_FEATURE_INCOMPAT_INLINE_DATA; // 0x2: 目录项带 file_type
+    sb.s_feature_compat = EXT2_FEATURE_COMPAT_HAS_JOURNAL;
+    sb.s_journal_inum = JOURNAL_INODE;
 
+    fseek(out, FS_START_OFFSET + 1024, SEEK_SET);
     fwrite(&sb, 1, sizeof(sb), out);
     // 填充 Superblock 到 1024 字节
-    char sb_pad[BLOCK_SIZE - sizeof(sb)];
+    char sb_pad[1024 - sizeof(sb)];
     memset(sb_pad, 0, sizeof(sb_pad));
     fwrite(sb_pad, 1, sizeof(sb_pad), out);
 
-    // 3.3 写入 Group Descriptors (Block 2)
-    Ext2GroupDesc gd;
-    memset(&gd, 0, sizeof(gd));
-    gd.bg_block_bitmap = 3;
-    gd.bg_inode_bitmap = 4;
-    gd.bg_inode_table = 5;
-    gd.bg_free_blocks_count = sb.s_free_blocks_count;
-    gd.bg_free_inodes_count = sb.s_free_inodes_count;
-    gd.bg_used_dirs_count = 1 + dir_count; // Root + top-level dirs
-
-    fwrite(&gd, 1, sizeof(gd), out);
-    // 填充 GD 到 Block 结束
-    char gd_pad[BLOCK_SIZE - sizeof(gd)];
-    memset(gd_pad, 0, sizeof(gd_pad));
-    fwrite(gd_pad, 1, sizeof(gd_pad), out);
-
-    // 3.4 写入 Block Bitmap (Block 3)
-    // 简单起见，我们假设前 100 个块都被占用了 (Metadata + Files)
-    char block_bitmap[BLOCK_SIZE];
-    memset(block_bitmap, 0, BLOCK_SIZE);
-    // 标记前 N 个位
-    int reserved_blocks = used_blocks - sb.s_first_data_block;
-    for(int i=0; i<reserved_blocks; i++) {
-         block_bitmap[i/8] |= (1 << (i%8));
+    // 3.3 写入 Group Descriptor Table (超级块所在块的下一块起)
+    Ext2GroupDesc* gdt = calloc(gdt_blocks, block_size);
+    for (int g = 0; g < num_groups; g++) {
+        int base = g * blocks_per_group;
+        int end = base + blocks_per_group < blocks_count ? base + blocks_per_group : blocks_count;
+        int meta = 2 + inode_table_blocks;
+
+        gdt[g].bg_block_bitmap = g == 0 ? group0_block_bitmap : base;
+        gdt[g].bg_inode_bitmap = gdt[g].bg_block_bitmap + 1;
+        gdt[g].bg_inode_table = gdt[g].bg_block_bitmap + 2;
+        gdt[g].bg_free_blocks_count = g == 0 ? end - used_blocks : end - base - meta;
+        gdt[g].bg_free_inodes_count = inodes_per_group;
     }
-    for (int i = sb.s_blocks_count - sb.s_first_data_block; i < BLOCK_SIZE * 8; i++) {
-         block_bitmap[i / 8] |= (1 << (i % 8));
+    gdt[0].bg_free_inodes_count = inodes_per_group - 10 - file_count - dir_count;
+    gdt[0].bg_used_dirs_count = 1 + dir_count; // Root + top-level dirs
+    fseek(out, FS_START_OFFSET + (long)(first_data_block + 1) * block_size, SEEK_SET);
+    fwrite(gdt, 1, gdt_blocks * block_size, out);
+
+    // 3.4 写入各块组的 Block Bitmap
+    char block_bitmap[block_size];
+    for (int g = 0; g < num_groups; g++) {
+        int base = g * blocks_per_group;
+        int used = g == 0 ? used_blocks : 2 + inode_table_blocks;
+        int valid = blocks_count - base < blocks_per_group ? blocks_count - base : blocks_per_group;
+
+        memset(block_bitmap, 0, block_size);
+        // 内核位图约定 bit i 对应块组内第 i 块：开头 used 块已占用，块组之外的位也置 1
+        for (int i = 0; i < used; i++) {
+            block_bitmap[i / 8] |= (1 << (i % 8));
+        }
+        for (int i = valid; i < block_size * 8; i++) {
+            block_bitmap[i / 8] |= (1 << (i % 8));
+        }
+        put_block(out, gdt[g].bg_block_bitmap, block_bitmap);
     }
-    fwrite(block_bitmap, 1, BLOCK_SIZE, out);
 
-    // 3.5 写入 Inode Bitmap (Block 4)
-    char inode_bitmap[BLOCK_SIZE];
-    memset(inode_bitmap, 0, BLOCK_SIZE);
+    // 3.5 写入各块组的 Inode Bitmap
+    char inode_bitmap[block_size];
+    memset(inode_bitmap, 0, block_size);
+    for (int i = inodes_per_group; i < block_size * 8; i++) {
+        inode_bitmap[i / 8] |= (1 << (i % 8));
+    }
+    for (int g = 1; g < num_groups; g++) {
+        char zero_table[block_size];
+
+        put_block(out, gdt[g].bg_inode_bitmap, inode_bitmap);
+        memset(zero_table, 0, block_size);
+        for (int b = 0; b < inode_table_blocks; b++) put_block(out, gdt[g].bg_inode_table + b, zero_table);
+    }
     // 1-10 resv, 11+ user files.
     for (int i = 0; i < 10; i++) {
         inode_bitmap[i / 8] |= (1 << (i % 8));
@@ -389,12 +514,9 @@ int main(int argc, char** argv) {
         int idx = 10 + dir_count + i;
         inode_bitmap[idx/8] |= (1 << (idx%8));
     }
-    for (int i = inodes_per_group; i < BLOCK_SIZE * 8; i++) {
-        inode_bitmap[i / 8] |= (1 << (i % 8));
-    }
-    fwrite(inode_bitmap, 1, BLOCK_SIZE, out);
+    put_block(out, gdt[0].bg_inode_bitmap, inode_bitmap);
 
-    // 3.6 写入 Inode Table (Block 5 ... )
+    // 3.6 写入块组 0 的 Inode Table
     int inode_table_len = inodes_per_group * 128; // bytes
     char* inode_table = malloc(inode_table_len);
     memset(inode_table, 0, inode_table_len);
@@ -402,10 +524,10 @@ int main(int argc, char** argv) {
     // --- Root Inode (Inode 2, index 1) ---
     Ext2Inode* root = (Ext2Inode*)(inode_table + 128); // Index 1
     root->i_mode = 0x41ED; // Dir
-    root->i_size = BLOCK_SIZE; // 1 block for dir entries
+    root->i_size = block_size; // 1 block for dir entries
     root->i_links_count = 2 + dir_count;
-    int root_data_block = 5 + inode_table_blocks; // 紧接着 inode table
-    root->i_blocks = 2; // 512b sectors
+    int root_data_block = group0_inode_table + inode_table_blocks; // 紧接着 inode table
+    root->i_blocks = block_size / 512; // 512b sectors
     root->i_block[0] = root_data_block;
 
     int file_inode_base = 11 + dir_count;
@@ -416,44 +538,72 @@ int main(int argc, char** argv) {
         dirs[d].inode_num = 11 + d;
         dirs[d].data_block = root_data_block + 1 + d;
         subdir->i_mode = 0x41ED; // Dir
-        subdir->i_size = BLOCK_SIZE;
+        subdir->i_size = block_size;
         subdir->i_links_count = 2;
-        subdir->i_blocks = 2;
+        subdir->i_blocks = block_size / 512;
         subdir->i_block[0] = dirs[d].data_block;
     }
 
     // --- File Inodes (Inode 11+, index 10+) ---
-    int current_data_block = file_data_start_block;
+    // 文件数据按块号直接定位写出，写完再回到 inode 表位置继续顺序写元数据
+    uint32_t current_data_block = file_data_start_block;
 
     for (int i=0; i<file_count; i++) {
         Ext2Inode* file_node = (Ext2Inode*)(inode_table + (file_inode_base - 1 + i) * 128);
+        FILE* f = fopen(argv[i + 4], "rb");
+        if (!f) { perror(argv[i + 4]); return 1; }
         file_node->i_mode = 0x81C0; // File
         file_node->i_size = files[i].size;
         file_node->i_links_count = 1;
-        int blocks_needed = files[i].blocks_needed;
-        file_node->i_blocks = (blocks_needed + files[i].indirect_blocks) * 2; // 512b sectors count
+        file_node->i_blocks = (files[i].blocks_needed + files[i].indirect_blocks) * (block_size / 512); // 512b sectors count
         files[i].first_data_block = current_data_block;
-        files[i].indirect_block_num = 0;
-
-        for(int b=0; b<blocks_needed && b<12; b++) {
-            file_node->i_block[b] = current_data_block + b;
+        if (files[i].inline_data) {
+            file_node->i_flags = EXT2_INLINE_DATA_FL;
+            fread(file_node->i_block, 1, files[i].size, f);
+        } else {
+            write_file_blocks(out, f, files[i].blocks_needed, &current_data_block, file_node->i_block);
         }
+        fclose(f);
+    }
 
-        if (blocks_needed > 12) {
-            int indirect_block = current_data_block + 12;
-            files[i].indirect_block_num = indirect_block;
-            file_node->i_block[12] = indirect_block;
+    // 日志 inode 放在文件数据之后：间接块在前，日志块本身物理连续
+    {
+        Ext2Inode* journal = (Ext2Inode*)(inode_table + (JOURNAL_INODE - 1) * 128);
+        uint32_t indirect[block_size / 4];
+        uint32_t jsb[block_size / 4];
+        uint32_t journal_start = current_data_block + 1;
+
+        memset(indirect, 0, sizeof(indirect));
+        memset(jsb, 0, sizeof(jsb));
+        journal->i_mode = 0x8180; // File, 0600
+        journal->i_size = JOURNAL_BLOCKS * block_size;
+        journal->i_links_count = 1;
+        journal->i_blocks = (1 + JOURNAL_BLOCKS) * (block_size / 512);
+        for (int b = 0; b < JOURNAL_BLOCKS; b++) {
+            if (b < 12) journal->i_block[b] = journal_start + b;
+            else indirect[b - 12] = journal_start + b;
         }
-
-        current_data_block += blocks_needed + files[i].indirect_blocks;
+        journal->i_block[12] = current_data_block;
+        put_block(out, current_data_block, indirect);
+
+        jsb[0] = JOURNAL_MAGIC;
+        jsb[1] = block_size;
+        jsb[2] = JOURNAL_BLOCKS;
+        jsb[3] = 1; // 下一个事务的序号
+        put_block(out, journal_start, jsb);
+        memset(jsb, 0, sizeof(jsb));
+        for (int b = 1; b < JOURNAL_BLOCKS; b++) put_block(out, journal_start + b, jsb);
+        current_data_block = journal_start + JOURNAL_BLOCKS;
     }
 
+    fseek(out, FS_START_OFFSET + (long)group0_inode_table * block_size, SEEK_SET);
     fwrite(inode_table, 1, inode_table_len, out);
     free(inode_table);
+    free(gdt);
 
     // 3.7 写入 Root Directory Data Block
-    char root_dir[BLOCK_SIZE];
-    memset(root_dir, 0, BLOCK_SIZE);
+    char root_dir[block_size];
+    memset(root_dir, 0, block_size);
     int pos = 0;
     int root_visible_files = 0;
     int root_entries_total = 0;
@@ -483,13 +633,13 @@ int main(int argc, char** argv) {
                         entry_index == root_entries_total);
     }
 
-    fwrite(root_dir, 1, BLOCK_SIZE, out);
+    fwrite(root_dir, 1, block_size, out);
 
     for (int d = 0; d < dir_count; d++) {
-        char subdir_block[BLOCK_SIZE];
+        char subdir_block[block_size];
         int subpos = 0;
 
-        memset(subdir_block, 0, BLOCK_SIZE);
+        memset(subdir_block, 0, block_size);
         write_dir_entry(subdir_block, &subpos, dirs[d].inode_num, EXT2_FT_DIR, ".", 0);
         write_dir_entry(subdir_block, &subpos, 2, EXT2_FT_DIR, "..", dirs[d].file_count == 0);
 
@@ -503,52 +653,14 @@ int main(int argc, char** argv) {
             }
         }
 
-        fwrite(subdir_block, 1, BLOCK_SIZE, out);
-    }
-
-    // 3.8 写入文件数据
-    for (int i=0; i<file_count; i++) {
-        FILE* f = fopen(argv[i + 4], "rb");
-        char fbuf[BLOCK_SIZE];
-        int remain = files[i].size;
-        int block_index = 0;
-
-        while(remain > 0 && block_index < files[i].blocks_needed && block_index < 12) {
-            memset(fbuf, 0, BLOCK_SIZE);
-            int n = (remain > BLOCK_SIZE) ? BLOCK_SIZE : remain;
-            fread(fbuf, 1, n, f);
-            fwrite(fbuf, 1, BLOCK_SIZE, out); // Always write full block padding
-            remain -= n;
-            block_index++;
-        }
-
-        if (files[i].indirect_blocks) {
-            unsigned int indirect_entries[BLOCK_SIZE / 4];
-            memset(indirect_entries, 0, sizeof(indirect_entries));
-            for (int j = 12; j < files[i].blocks_needed; j++) {
-                indirect_entries[j - 12] = files[i].indirect_block_num + (j - 12) + 1;
-            }
-            fwrite(indirect_entries, 1, BLOCK_SIZE, out);
-        }
-
-        while(remain > 0 && block_index < files[i].blocks_needed) {
-            memset(fbuf, 0, BLOCK_SIZE);
-            {
-                int n = (remain > BLOCK_SIZE) ? BLOCK_SIZE : remain;
-                fread(fbuf, 1, n, f);
-                fwrite(fbuf, 1, BLOCK_SIZE, out);
-                remain -= n;
-            }
-            block_index++;
-        }
-        fclose(f);
+        fwrite(subdir_block, 1, block_size, out);
     }
 
-    // Pad total image size to 10MB
-    fseek(out, 10*1024*1024 - 1, SEEK_SET);
+    // Pad total image size
+    fseek(out, (long)image_mb * 1024 * 1024 - 1, SEEK_SET);
     fputc(0, out);
     
     fclose(out);
-    printf("Image created. FS starts at 1MB.\n");
+    printf("Image created. FS starts at 1MB, %d MB, %d block group(s).\n", image_mb, num_groups);
     return 0;
 }
@@ -115,6 +115,14 @@ int get_video_stats(UserVideoStats* out) {
     return _syscall3(SYS_GET_VIDEO_STATS, (int)out, 0, 0);
 }
 
+int get_fs_stats(UserFsStats* out) {
+    return _syscall3(SYS_GET_FS_STATS, (int)out, 0, 0);
+}
+
+int disk_bench(UserDiskBench* out) {
+    return _syscall3(SYS_DISK_BENCH, (int)out, 0, 0);
+}
+
 int get_mouse_click(int* x, int* y) {
     int ret, mx, my;
     __asm__ volatile (
@@ -282,3 +290,19 @@ int tlx_unlink(const char* path) {
 int tlx_mkdir(const char* path) {
     return _tlx_call(TLX_OP_MKDIR, (int)path, 0, 0, 0);
 }
+
+int tlx_mmap(int handle, unsigned int offset, unsigned int length, void** address) {
+    return _tlx_call(TLX_OP_MMAP, handle, (int)offset, (int)length, (int)address);
+}
+
+int tlx_munmap(void* address) {
+    return _tlx_call(TLX_OP_MUNMAP, (int)address, 0, 0, 0);
+}
+
+int tlx_opendir(const char* path) {
+    return tlx_open(path, TLX_OPEN_DIR);
+}
+
+int tlx_readdir(int handle, TlxDirEntry* entries, unsigned int max) {
+    return _tlx_call(TLX_OP_READDIR, handle, (int)entries, (int)max, 0);
+}